@@ -0,0 +1,15 @@
+#include "Camera.h"
+
+CameraMatrices ComputeCameraMatrices(FXMVECTOR eye, FXMVECTOR at, FXMVECTOR up, float aspectRatio) {
+	CameraMatrices matrices;
+	matrices.view = XMMatrixLookAtRH(eye, at, up);
+
+	float fovAngleY = 75.0f * XM_PI / 180.0f;
+	matrices.projection = XMMatrixPerspectiveFovRH(fovAngleY, aspectRatio, 0.1f, 1000.f);
+
+	XMVECTOR det;
+	matrices.viewI = XMMatrixInverse(&det, matrices.view);
+	matrices.projectionI = XMMatrixInverse(&det, matrices.projection);
+
+	return matrices;
+}
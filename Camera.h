@@ -0,0 +1,14 @@
+#pragma once
+#include <DirectXMath.h>
+
+using namespace DirectX;
+
+// Same layout as the CameraParams cbuffer in Shaders/RayGen.hlsl.
+struct CameraMatrices {
+	XMMATRIX view;
+	XMMATRIX projection;
+	XMMATRIX viewI;
+	XMMATRIX projectionI;
+};
+
+CameraMatrices ComputeCameraMatrices(FXMVECTOR eye, FXMVECTOR at, FXMVECTOR up, float aspectRatio);
@@ -0,0 +1,24 @@
+#include "CpuBackend.h"
+
+CpuBackend::CpuBackend(uint32_t width, uint32_t height, uint32_t threadCount) :
+	m_raytracer(width, height, threadCount) { }
+
+void CpuBackend::UploadScene(const Scene& scene) {
+	m_raytracer.SetScene(scene);
+}
+
+void CpuBackend::BuildAccelerationStructures( ) {
+	m_raytracer.BuildAccelerationStructure( );
+}
+
+void CpuBackend::UpdateCamera(const CameraMatrices& camera) {
+	m_raytracer.SetCamera(camera);
+}
+
+void CpuBackend::UpdateFrameCount(uint32_t framesCount) {
+	m_framesCount = framesCount;
+}
+
+void CpuBackend::Trace( ) {
+	m_raytracer.Render(m_framesCount);
+}
@@ -0,0 +1,22 @@
+#pragma once
+#include "RenderBackend.h"
+#include "CpuRt/CpuRaytracer.h"
+
+class CpuBackend : public RenderBackend {
+public:
+	CpuBackend(uint32_t width, uint32_t height, uint32_t threadCount = 0);
+
+	void UploadScene(const Scene& scene) override;
+	void BuildAccelerationStructures( ) override;
+
+	void UpdateCamera(const CameraMatrices& camera) override;
+	void UpdateFrameCount(uint32_t framesCount) override;
+
+	void Trace( ) override;
+
+	const CpuRaytracer& GetRaytracer( ) const { return m_raytracer; }
+
+private:
+	CpuRaytracer m_raytracer;
+	uint32_t m_framesCount = 1;
+};
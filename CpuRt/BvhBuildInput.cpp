@@ -0,0 +1,168 @@
+#include "BvhBuildInput.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cfloat>
+#include <cstring>
+#include <mutex>
+
+namespace {
+	// Spreads the low 21 bits of v so that two zero bits follow each of them.
+	uint64_t ExpandBits(uint64_t v) {
+		v &= 0x1FFFFF;
+		v = (v | v << 32) & 0x001F00000000FFFFull;
+		v = (v | v << 16) & 0x001F0000FF0000FFull;
+		v = (v | v << 8) & 0x100F00F00F00F00Full;
+		v = (v | v << 4) & 0x10C30C30C30C30C3ull;
+		v = (v | v << 2) & 0x1249249249249249ull;
+		return v;
+	}
+
+	const float MortonCells = 2097152.0f; // 2^21
+}
+
+Aabb Aabb::Empty( ) {
+	return {{FLT_MAX, FLT_MAX, FLT_MAX}, {-FLT_MAX, -FLT_MAX, -FLT_MAX}};
+}
+
+void Aabb::Grow(FXMVECTOR point) {
+	XMStoreFloat3(&min, XMVectorMin(XMLoadFloat3(&min), point));
+	XMStoreFloat3(&max, XMVectorMax(XMLoadFloat3(&max), point));
+}
+
+void Aabb::Grow(const Aabb& other) {
+	XMStoreFloat3(&min, XMVectorMin(XMLoadFloat3(&min), XMLoadFloat3(&other.min)));
+	XMStoreFloat3(&max, XMVectorMax(XMLoadFloat3(&max), XMLoadFloat3(&other.max)));
+}
+
+float Aabb::SurfaceArea( ) const {
+	if (IsEmpty( )) {
+		return 0.0f;
+	}
+	float x = max.x - min.x, y = max.y - min.y, z = max.z - min.z;
+	return 2.0f * (x * y + y * z + z * x);
+}
+
+MortonEncoder::MortonEncoder(const Aabb& frame) {
+	m_origin = XMLoadFloat3(&frame.min);
+	XMVECTOR extent = XMVectorMax(XMLoadFloat3(&frame.max) - m_origin, XMVectorReplicate(1e-20f));
+	m_scale = XMVectorReplicate(MortonCells) / extent;
+}
+
+uint64_t MortonEncoder::Encode(FXMVECTOR point) const {
+	XMFLOAT3 p;
+	XMStoreFloat3(&p, (point - m_origin) * m_scale);
+	auto quantize = [](float value) { return static_cast<uint32_t>(std::clamp(value, 0.0f, MortonCells - 1)); };
+	return ExpandBits(quantize(p.x)) << 2 | ExpandBits(quantize(p.y)) << 1 | ExpandBits(quantize(p.z));
+}
+
+void BvhBuildInput::Reset(size_t primitiveCount, const Aabb& frame, bool keepPolygons) {
+	primitiveBounds.resize(primitiveCount);
+	centroids.resize(primitiveCount);
+	mortonCodes.resize(primitiveCount);
+	polygonCorners.resize(keepPolygons ? 4 * primitiveCount : 0);
+	polygonSizes.assign(keepPolygons ? primitiveCount : 0, 0);
+	bounds = Aabb::Empty( );
+	centroidBounds = Aabb::Empty( );
+	mortonFrame = frame;
+}
+
+void BvhBuildInput::Truncate(size_t primitiveCount) {
+	primitiveBounds.resize(primitiveCount);
+	centroids.resize(primitiveCount);
+	mortonCodes.resize(primitiveCount);
+	if (HasPolygons( )) {
+		polygonCorners.resize(4 * primitiveCount);
+		polygonSizes.resize(primitiveCount);
+	}
+}
+
+BvhInputWriter::BvhInputWriter(BvhBuildInput& input, const MortonEncoder& encoder, size_t first) :
+	m_input(input),
+	m_encoder(encoder),
+	m_next(first),
+	m_boundsMin(XMVectorReplicate(FLT_MAX)),
+	m_boundsMax(XMVectorReplicate(-FLT_MAX)),
+	m_centroidMin(m_boundsMin),
+	m_centroidMax(m_boundsMax) {
+}
+
+void BvhInputWriter::AddTriangle(FXMVECTOR v0, FXMVECTOR v1, FXMVECTOR v2) {
+	XMVECTOR boundsMin = XMVectorMin(v0, XMVectorMin(v1, v2));
+	XMVECTOR boundsMax = XMVectorMax(v0, XMVectorMax(v1, v2));
+	XMVECTOR centroid = (v0 + v1 + v2) * (1.0f / 3.0f);
+	if (m_input.HasPolygons( )) {
+		XMFLOAT3* corners = &m_input.polygonCorners[4 * m_next];
+		XMStoreFloat3(&corners[0], v0);
+		XMStoreFloat3(&corners[1], v1);
+		XMStoreFloat3(&corners[2], v2);
+		m_input.polygonSizes[m_next] = 3;
+	}
+	Add(boundsMin, boundsMax, centroid);
+}
+
+void BvhInputWriter::AddQuad(FXMVECTOR v0, FXMVECTOR v1, FXMVECTOR v2, GXMVECTOR v3) {
+	XMVECTOR boundsMin = XMVectorMin(XMVectorMin(v0, v1), XMVectorMin(v2, v3));
+	XMVECTOR boundsMax = XMVectorMax(XMVectorMax(v0, v1), XMVectorMax(v2, v3));
+	XMVECTOR centroid = (v0 + v1 + v2 + v3) * 0.25f;
+	if (m_input.HasPolygons( )) {
+		XMFLOAT3* corners = &m_input.polygonCorners[4 * m_next];
+		XMStoreFloat3(&corners[0], v0);
+		XMStoreFloat3(&corners[1], v1);
+		XMStoreFloat3(&corners[2], v3);
+		XMStoreFloat3(&corners[3], v2);
+		m_input.polygonSizes[m_next] = 4;
+	}
+	Add(boundsMin, boundsMax, centroid);
+}
+
+void BvhInputWriter::AddBounds(const Aabb& bounds, FXMVECTOR centroid) {
+	Add(XMLoadFloat3(&bounds.min), XMLoadFloat3(&bounds.max), centroid);
+}
+
+void BvhInputWriter::Add(FXMVECTOR boundsMin, FXMVECTOR boundsMax, FXMVECTOR centroid) {
+	XMStoreFloat3(&m_input.primitiveBounds[m_next].min, boundsMin);
+	XMStoreFloat3(&m_input.primitiveBounds[m_next].max, boundsMax);
+	XMStoreFloat3(&m_input.centroids[m_next], centroid);
+	m_input.mortonCodes[m_next] = m_encoder.Encode(centroid);
+	m_next++;
+
+	m_boundsMin = XMVectorMin(m_boundsMin, boundsMin);
+	m_boundsMax = XMVectorMax(m_boundsMax, boundsMax);
+	m_centroidMin = XMVectorMin(m_centroidMin, centroid);
+	m_centroidMax = XMVectorMax(m_centroidMax, centroid);
+}
+
+void BvhInputWriter::Merge( ) const {
+	m_input.bounds.Grow(m_boundsMin);
+	m_input.bounds.Grow(m_boundsMax);
+	m_input.centroidBounds.Grow(m_centroidMin);
+	m_input.centroidBounds.Grow(m_centroidMax);
+}
+
+void BuildBvhInput(const void* vertices, uint32_t vertexStride, const uint32_t* indices, size_t triangleCount,
+				   const Aabb& mortonFrame, BvhBuildInput& input, ThreadPool* threadPool) {
+	input.Reset(triangleCount, mortonFrame);
+	MortonEncoder encoder(mortonFrame);
+	std::mutex mergeMutex;
+
+	auto position = [&](uint32_t index) {
+		XMFLOAT3 p;
+		memcpy(&p, static_cast<const uint8_t*>(vertices) + static_cast<size_t>(index) * vertexStride, sizeof(p));
+		return XMLoadFloat3(&p);
+	};
+	auto write = [&](uint32_t begin, uint32_t end) {
+		BvhInputWriter writer(input, encoder, begin);
+		for (uint32_t triangle = begin; triangle < end; triangle++) {
+			const uint32_t* corners = indices + 3 * static_cast<size_t>(triangle);
+			writer.AddTriangle(position(corners[0]), position(corners[1]), position(corners[2]));
+		}
+		std::lock_guard<std::mutex> lock(mergeMutex);
+		writer.Merge( );
+	};
+
+	if (threadPool) {
+		threadPool->ParallelFor(static_cast<uint32_t>(triangleCount), write, 16384);
+	} else {
+		write(0, static_cast<uint32_t>(triangleCount));
+	}
+}
@@ -0,0 +1,89 @@
+#pragma once
+#include <DirectXMath.h>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+using namespace DirectX;
+
+class ThreadPool;
+
+// Axis-aligned box; Empty( ) has min > max, so growing it by anything gives that thing's box.
+struct Aabb {
+	XMFLOAT3 min;
+	XMFLOAT3 max;
+
+	static Aabb Empty( );
+	void Grow(FXMVECTOR point);
+	void Grow(const Aabb& other);
+	bool IsEmpty( ) const { return min.x > max.x; }
+	float SurfaceArea( ) const;
+};
+
+// 63-bit Morton codes of points in a box fixed up front: 21 bits per axis, interleaved with x highest.
+// code >> 33 is the 30-bit code of the same point.
+class MortonEncoder {
+public:
+	explicit MortonEncoder(const Aabb& frame);
+	uint64_t Encode(FXMVECTOR point) const;
+
+private:
+	XMVECTOR m_origin;
+	XMVECTOR m_scale;
+};
+
+// Everything a BVH build reads per primitive, in primitive order. Written while the primitives are generated,
+// the build needs no further pass over the geometry: node bounds come from primitiveBounds, splits from
+// centroids and linear builds from mortonCodes, quantized in mortonFrame.
+struct BvhBuildInput {
+	std::vector<Aabb> primitiveBounds;
+	std::vector<XMFLOAT3> centroids;
+	std::vector<uint64_t> mortonCodes;
+	Aabb bounds;         // Of all primitives.
+	Aabb centroidBounds;
+	Aabb mortonFrame;    // Has to contain every centroid; codes outside are clamped.
+	// Only kept for spatial split builds, which clip primitives: the corners of primitive i are polygonCorners[4 * i]
+	// to [4 * i + polygonSizes[i]], in order around it; the two triangles of a quad meet on its corners 1 and 3.
+	// Primitives of size 0 are clipped as boxes.
+	std::vector<XMFLOAT3> polygonCorners;
+	std::vector<uint8_t> polygonSizes;
+
+	size_t GetPrimitiveCount( ) const { return primitiveBounds.size( ); }
+	bool HasPolygons( ) const { return !polygonSizes.empty( ); }
+	// Sizes the arrays and clears the bounds, so that writers can fill disjoint ranges in parallel.
+	void Reset(size_t primitiveCount, const Aabb& frame, bool keepPolygons = false);
+	// Drops the primitives past primitiveCount, for producers that reset to an upper bound.
+	void Truncate(size_t primitiveCount);
+};
+
+// Fills primitives [first, ...) of a BvhBuildInput. Every generator task has its own writer; Merge adds its
+// bounds to the input once the task is done, which must not happen concurrently.
+class BvhInputWriter {
+public:
+	BvhInputWriter(BvhBuildInput& input, const MortonEncoder& encoder, size_t first);
+
+	void AddTriangle(FXMVECTOR v0, FXMVECTOR v1, FXMVECTOR v2);
+	// The triangle pair (v0, v1, v2), (v2, v1, v3) as one primitive, such as a cell of a plane.
+	void AddQuad(FXMVECTOR v0, FXMVECTOR v1, FXMVECTOR v2, GXMVECTOR v3);
+	// Any other primitive, e.g. an analytic shape.
+	void AddBounds(const Aabb& bounds, FXMVECTOR centroid);
+
+	size_t GetNext( ) const { return m_next; }
+	void Merge( ) const;
+
+private:
+	void Add(FXMVECTOR boundsMin, FXMVECTOR boundsMax, FXMVECTOR centroid);
+
+	BvhBuildInput& m_input;
+	const MortonEncoder& m_encoder;
+	size_t m_next;
+	XMVECTOR m_boundsMin;
+	XMVECTOR m_boundsMax;
+	XMVECTOR m_centroidMin;
+	XMVECTOR m_centroidMax;
+};
+
+// The unfused path: one pass over an indexed triangle list that is already in memory. Every vertex is
+// vertexStride bytes and starts with its float3 position, like Vertex and CompactVertex.
+void BuildBvhInput(const void* vertices, uint32_t vertexStride, const uint32_t* indices, size_t triangleCount,
+				   const Aabb& mortonFrame, BvhBuildInput& input, ThreadPool* threadPool = nullptr);
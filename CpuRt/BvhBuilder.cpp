@@ -0,0 +1,1262 @@
+#include "BvhBuilder.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <chrono>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace {
+	// Spatial splits are only looked for below object splits whose children overlap by more than this part of the
+	// root's surface area, the alpha of Stich et al. Their 1e-5 searches nearly every node of closed meshes, where
+	// the children of object splits always touch, for trees no better on the default scene and the sponge.
+	const float SpatialSplitOverlap = 1e-3f;
+	// Nodes with at least this many primitives are binned on the pool.
+	const uint32_t ParallelBinningMinimum = 65536;
+	const uint32_t BinningGrain = 16384;
+	const uint32_t ReferenceGrain = 65536;
+	const uint32_t MaxBinCount = 256;
+	// Subtrees are handed to the pool whole once they are this small, or smaller than 1/16 of a thread's share.
+	const uint32_t SubtreeMaximum = 65536;
+	const uint32_t SubtreeTasksPerThread = 16;
+	const uint32_t RadixBits = 8;
+	const uint32_t RadixDigits = 1 << RadixBits;
+	const uint32_t RadixChunkMinimum = 16384;
+	const uint32_t HierarchyGrain = 4096;
+	// Child of a linear hierarchy that is a leaf, i.e. one sorted primitive.
+	const uint32_t LinearLeaf = 0x80000000u;
+
+	struct Bin {
+		XMVECTOR boundsMin;
+		XMVECTOR boundsMax;
+		uint32_t count;
+
+		void Clear( ) {
+			boundsMin = XMVectorReplicate(FLT_MAX);
+			boundsMax = XMVectorReplicate(-FLT_MAX);
+			count = 0;
+		}
+		void Grow(const Bin& other) {
+			boundsMin = XMVectorMin(boundsMin, other.boundsMin);
+			boundsMax = XMVectorMax(boundsMax, other.boundsMax);
+			count += other.count;
+		}
+	};
+
+	float HalfArea(FXMVECTOR boundsMin, FXMVECTOR boundsMax) {
+		XMFLOAT3 e;
+		XMStoreFloat3(&e, XMVectorMax(boundsMax - boundsMin, XMVectorZero( )));
+		return e.x * e.y + e.y * e.z + e.z * e.x;
+	}
+
+	// Per-thread memory of the split search, kept across nodes.
+	struct SplitScratch {
+		std::vector<Bin> bins;               // 3 * binCount, axis by axis.
+		std::vector<uint32_t> occupiedBins;
+		std::vector<float> rightCosts;       // Of the split in front of each occupied bin.
+		// Spatial splits only: 3 * binCount bins over the node bounds, with the references starting and ending in each.
+		std::vector<Bin> spatialBins;
+		std::vector<uint32_t> entries;
+		std::vector<uint32_t> exits;
+	};
+
+	// What the build moves around instead of primitive numbers, so that every pass over a node reads memory in order.
+	struct PrimitiveReference {
+		Aabb bounds;
+		XMFLOAT3 centroid;
+		uint32_t primitive;
+	};
+
+	// References [first, first + count) with their bounds and the bounds of their centroids.
+	struct NodeRange {
+		uint32_t first;
+		uint32_t count;
+		XMVECTOR boundsMin;
+		XMVECTOR boundsMax;
+		XMVECTOR centroidMin;
+		XMVECTOR centroidMax;
+	};
+
+	// Centroid bins of a node: the bin of a centroid is (centroid - min) * scale, on axes where scale is not 0.
+	struct CentroidBins {
+		XMFLOAT3 min;
+		float scale[3];
+	};
+
+	// Best plane between the centroid bins of a node; axis is -1 if there is none.
+	struct ObjectSplit {
+		float cost;   // In half areas.
+		int axis;
+		uint32_t bin; // First bin on the right.
+		Bin left;
+		Bin right;
+	};
+
+	class BinnedSahBuilder {
+	public:
+		BinnedSahBuilder(const BvhBuildInput& input, const BvhBuildSettings& settings, std::vector<PrimitiveReference>& references) :
+			m_input(input),
+			m_references(references),
+			m_binCount(std::clamp(settings.binCount, 2u, MaxBinCount)),
+			m_maxLeafPrimitives(std::max(1u, settings.maxLeafPrimitives)),
+			m_traversalCost(settings.traversalCost) {
+		}
+
+		NodeRange GetRoot( ) const {
+			return {0, static_cast<uint32_t>(m_references.size( )),
+					XMLoadFloat3(&m_input.bounds.min), XMLoadFloat3(&m_input.bounds.max),
+					XMLoadFloat3(&m_input.centroidBounds.min), XMLoadFloat3(&m_input.centroidBounds.max)};
+		}
+
+		// Partitions the range of a node at its cheapest binned split, or returns false if it is cheaper as a leaf.
+		// With a pool, large nodes are binned in parallel.
+		bool Split(const NodeRange& node, NodeRange& left, NodeRange& right, SplitScratch& scratch, ThreadPool* threadPool) const {
+			if (node.count <= 1) {
+				return false;
+			}
+
+			CentroidBins centroidBins;
+			if (!SetUpCentroidBins(node, centroidBins)) {
+				// Every centroid is in the same place, so no plane separates them; only the leaf size forces a split.
+				return node.count > m_maxLeafPrimitives && SplitInTheMiddle(node, left, right);
+			}
+			if (node.count <= m_binCount) {
+				return SplitSmall(node, centroidBins.scale, left, right);
+			}
+
+			ObjectSplit split = FindObjectSplit(node, centroidBins, scratch, threadPool);
+			if (split.axis < 0) {
+				return node.count > m_maxLeafPrimitives && SplitInTheMiddle(node, left, right);
+			}
+			if (IsCheaperAsLeaf(node, split.cost)) {
+				return false;
+			}
+			ApplyObjectSplit(node, centroidBins, split, left, right);
+			return true;
+		}
+
+		// Bins over the centroid bounds of a node; false if the centroids all coincide.
+		bool SetUpCentroidBins(const NodeRange& node, CentroidBins& centroidBins) const {
+			XMFLOAT3 extent;
+			XMStoreFloat3(&centroidBins.min, node.centroidMin);
+			XMStoreFloat3(&extent, node.centroidMax - node.centroidMin);
+			for (int axis = 0; axis < 3; axis++) {
+				float axisExtent = (&extent.x)[axis];
+				centroidBins.scale[axis] = axisExtent > 0 ? m_binCount / axisExtent : 0.0f;
+			}
+			return centroidBins.scale[0] != 0 || centroidBins.scale[1] != 0 || centroidBins.scale[2] != 0;
+		}
+
+		// Bins the centroids and finds the cheapest plane between two bins.
+		ObjectSplit FindObjectSplit(const NodeRange& node, const CentroidBins& centroidBins, SplitScratch& scratch, ThreadPool* threadPool) const {
+			BinPrimitives(node, &centroidBins.min.x, centroidBins.scale, scratch.bins, threadPool);
+
+			// Planes between two empty bins cost as much as the plane in front of the next occupied one, so only
+			// those are swept: from the right for the right-hand costs, then from the left. Costs are in half areas.
+			ObjectSplit best = {FLT_MAX, -1, 0, { }, { }};
+			for (int axis = 0; axis < 3; axis++) {
+				if (centroidBins.scale[axis] == 0) {
+					continue;
+				}
+				const Bin* axisBins = &scratch.bins[axis * m_binCount];
+				std::vector<uint32_t>& occupied = scratch.occupiedBins;
+				occupied.clear( );
+				for (uint32_t bin = 0; bin < m_binCount; bin++) {
+					if (axisBins[bin].count > 0) {
+						occupied.push_back(bin);
+					}
+				}
+				scratch.rightCosts.resize(occupied.size( ));
+
+				Bin side;
+				side.Clear( );
+				for (size_t i = occupied.size( ) - 1; i > 0; i--) {
+					side.Grow(axisBins[occupied[i]]);
+					scratch.rightCosts[i] = HalfArea(side.boundsMin, side.boundsMax) * side.count;
+				}
+				side.Clear( );
+				for (size_t i = 1; i < occupied.size( ); i++) {
+					side.Grow(axisBins[occupied[i - 1]]);
+					float cost = HalfArea(side.boundsMin, side.boundsMax) * side.count + scratch.rightCosts[i];
+					if (cost < best.cost) {
+						best.cost = cost;
+						best.axis = axis;
+						best.bin = occupied[i];
+					}
+				}
+			}
+			if (best.axis < 0) {
+				return best;
+			}
+
+			const Bin* axisBins = &scratch.bins[best.axis * m_binCount];
+			best.left.Clear( );
+			best.right.Clear( );
+			for (uint32_t bin = 0; bin < m_binCount; bin++) {
+				(bin < best.bin ? best.left : best.right).Grow(axisBins[bin]);
+			}
+			return best;
+		}
+
+		void ApplyObjectSplit(const NodeRange& node, const CentroidBins& centroidBins, const ObjectSplit& split, NodeRange& left, NodeRange& right) const {
+			// Partition fills in the centroid bounds.
+			left = {node.first, split.left.count, split.left.boundsMin, split.left.boundsMax, XMVectorZero( ), XMVectorZero( )};
+			right = {node.first + split.left.count, split.right.count, split.right.boundsMin, split.right.boundsMax, XMVectorZero( ), XMVectorZero( )};
+			Partition(node, split.axis, (&centroidBins.min.x)[split.axis], centroidBins.scale[split.axis], split.bin, left, right);
+		}
+
+		// Whether a node is better off as a leaf than split at the given cost, in half areas.
+		bool IsCheaperAsLeaf(const NodeRange& node, float splitHalfAreas) const {
+			float nodeArea = HalfArea(node.boundsMin, node.boundsMax);
+			float splitCost = m_traversalCost + (nodeArea > 0 ? splitHalfAreas / nodeArea : 0.0f);
+			return node.count <= m_maxLeafPrimitives && node.count <= splitCost;
+		}
+
+		// Halves a range whose centroids cannot be told apart by position.
+		bool SplitInTheMiddle(const NodeRange& node, NodeRange& left, NodeRange& right) const {
+			uint32_t leftCount = node.count / 2;
+			left = RangeBounds(node.first, leftCount);
+			right = RangeBounds(node.first + leftCount, node.count - leftCount);
+			return true;
+		}
+
+		NodeRange RangeBounds(uint32_t first, uint32_t count) const {
+			NodeRange range = {first, count, XMVectorReplicate(FLT_MAX), XMVectorReplicate(-FLT_MAX), XMVectorReplicate(FLT_MAX), XMVectorReplicate(-FLT_MAX)};
+			for (uint32_t i = first; i < first + count; i++) {
+				const PrimitiveReference& reference = m_references[i];
+				XMVECTOR centroid = XMLoadFloat3(&reference.centroid);
+				range.boundsMin = XMVectorMin(range.boundsMin, XMLoadFloat3(&reference.bounds.min));
+				range.boundsMax = XMVectorMax(range.boundsMax, XMLoadFloat3(&reference.bounds.max));
+				range.centroidMin = XMVectorMin(range.centroidMin, centroid);
+				range.centroidMax = XMVectorMax(range.centroidMax, centroid);
+			}
+			return range;
+		}
+
+		// Builds the subtree of node on the calling thread. nodes[nodeIndex] is its root; its descendants are appended.
+		void BuildSubtree(const NodeRange& root, std::vector<BvhNode>& nodes, uint32_t nodeIndex, SplitScratch& scratch) const {
+			std::vector<std::pair<uint32_t, NodeRange>> stack = {{nodeIndex, root}};
+			while (!stack.empty( )) {
+				auto [index, node] = stack.back( );
+				stack.pop_back( );
+
+				NodeRange left, right;
+				if (!Split(node, left, right, scratch, nullptr)) {
+					nodes[index] = MakeLeaf(node);
+					continue;
+				}
+				uint32_t leftIndex = static_cast<uint32_t>(nodes.size( ));
+				nodes[index] = MakeInner(node, leftIndex);
+				nodes.emplace_back( );
+				nodes.emplace_back( );
+				stack.push_back({leftIndex + 1, right});
+				stack.push_back({leftIndex, left});
+			}
+		}
+
+		static BvhNode MakeLeaf(const NodeRange& node) {
+			BvhNode leaf = {{ }, node.first, { }, node.count};
+			XMStoreFloat3(&leaf.boundsMin, node.boundsMin);
+			XMStoreFloat3(&leaf.boundsMax, node.boundsMax);
+			return leaf;
+		}
+
+		static BvhNode MakeInner(const NodeRange& node, uint32_t leftIndex) {
+			BvhNode inner = {{ }, leftIndex, { }, 0};
+			XMStoreFloat3(&inner.boundsMin, node.boundsMin);
+			XMStoreFloat3(&inner.boundsMax, node.boundsMax);
+			return inner;
+		}
+
+	private:
+		uint32_t BinIndex(float centroid, float axisMin, float axisScale) const {
+			return std::min(m_binCount - 1, static_cast<uint32_t>((centroid - axisMin) * axisScale));
+		}
+
+		void BinPrimitives(const NodeRange& node, const float* centroidMin, const float* binScale, std::vector<Bin>& bins, ThreadPool* threadPool) const {
+			auto binRange = [&](uint32_t begin, uint32_t end, Bin* rangeBins) {
+				for (uint32_t bin = 0; bin < 3 * m_binCount; bin++) {
+					rangeBins[bin].Clear( );
+				}
+				for (uint32_t i = begin; i < end; i++) {
+					const PrimitiveReference& reference = m_references[i];
+					const XMFLOAT3& centroid = reference.centroid;
+					XMVECTOR boundsMin = XMLoadFloat3(&reference.bounds.min);
+					XMVECTOR boundsMax = XMLoadFloat3(&reference.bounds.max);
+					for (int axis = 0; axis < 3; axis++) {
+						if (binScale[axis] == 0) {
+							continue;
+						}
+						Bin& bin = rangeBins[axis * m_binCount + BinIndex((&centroid.x)[axis], centroidMin[axis], binScale[axis])];
+						bin.boundsMin = XMVectorMin(bin.boundsMin, boundsMin);
+						bin.boundsMax = XMVectorMax(bin.boundsMax, boundsMax);
+						bin.count++;
+					}
+				}
+			};
+
+			bins.resize(3 * m_binCount);
+			if (!threadPool || threadPool->GetThreadCount( ) == 1 || node.count < ParallelBinningMinimum) {
+				binRange(node.first, node.first + node.count, bins.data( ));
+				return;
+			}
+
+			// Every chunk has its own bins, summed up once all of them are done.
+			uint32_t chunkCount = (node.count + BinningGrain - 1) / BinningGrain;
+			std::vector<Bin> chunkBins(static_cast<size_t>(chunkCount) * 3 * m_binCount);
+			threadPool->ParallelFor(node.count, [&](uint32_t begin, uint32_t end) {
+				binRange(node.first + begin, node.first + end, &chunkBins[static_cast<size_t>(begin / BinningGrain) * 3 * m_binCount]);
+			}, BinningGrain);
+			for (uint32_t bin = 0; bin < 3 * m_binCount; bin++) {
+				bins[bin] = chunkBins[bin];
+			}
+			for (uint32_t chunk = 1; chunk < chunkCount; chunk++) {
+				for (uint32_t bin = 0; bin < 3 * m_binCount; bin++) {
+					bins[bin].Grow(chunkBins[static_cast<size_t>(chunk) * 3 * m_binCount + bin]);
+				}
+			}
+		}
+
+		// Moves the primitives of the bins in front of split to the front of the range, gathering the centroid
+		// bounds of both sides on the way; each primitive is looked at once.
+		void Partition(const NodeRange& node, int axis, float axisMin, float axisScale, uint32_t split, NodeRange& left, NodeRange& right) const {
+			left.centroidMin = right.centroidMin = XMVectorReplicate(FLT_MAX);
+			left.centroidMax = right.centroidMax = XMVectorReplicate(-FLT_MAX);
+			PrimitiveReference* begin = m_references.data( ) + node.first;
+			PrimitiveReference* end = begin + node.count;
+			while (begin < end) {
+				const XMFLOAT3& centroid = begin->centroid;
+				XMVECTOR centroidVector = XMLoadFloat3(&centroid);
+				if (BinIndex((&centroid.x)[axis], axisMin, axisScale) < split) {
+					left.centroidMin = XMVectorMin(left.centroidMin, centroidVector);
+					left.centroidMax = XMVectorMax(left.centroidMax, centroidVector);
+					begin++;
+				} else {
+					right.centroidMin = XMVectorMin(right.centroidMin, centroidVector);
+					right.centroidMax = XMVectorMax(right.centroidMax, centroidVector);
+					std::swap(*begin, *--end);
+				}
+			}
+		}
+
+		// Nodes with no more primitives than bins try the plane behind every centroid instead, which is exact and
+		// cheaper than clearing and sweeping all the bins.
+		bool SplitSmall(const NodeRange& node, const float* binScale, NodeRange& left, NodeRange& right) const {
+			PrimitiveReference* begin = m_references.data( ) + node.first;
+			PrimitiveReference* end = begin + node.count;
+			auto sortOnAxis = [&](int axis) {
+				std::sort(begin, end, [axis](const PrimitiveReference& a, const PrimitiveReference& b) {
+					return (&a.centroid.x)[axis] < (&b.centroid.x)[axis];
+				});
+			};
+
+			float rightCosts[MaxBinCount];
+			float bestCost = FLT_MAX;
+			int bestAxis = -1;
+			int sortedAxis = -1;
+			uint32_t bestSplit = 0;
+			for (int axis = 0; axis < 3; axis++) {
+				if (binScale[axis] == 0) {
+					continue;
+				}
+				sortOnAxis(axis);
+				sortedAxis = axis;
+				XMVECTOR sideMin = XMVectorReplicate(FLT_MAX);
+				XMVECTOR sideMax = XMVectorReplicate(-FLT_MAX);
+				for (uint32_t i = node.count - 1; i > 0; i--) {
+					sideMin = XMVectorMin(sideMin, XMLoadFloat3(&begin[i].bounds.min));
+					sideMax = XMVectorMax(sideMax, XMLoadFloat3(&begin[i].bounds.max));
+					rightCosts[i] = HalfArea(sideMin, sideMax) * (node.count - i);
+				}
+				sideMin = XMVectorReplicate(FLT_MAX);
+				sideMax = XMVectorReplicate(-FLT_MAX);
+				for (uint32_t i = 1; i < node.count; i++) {
+					sideMin = XMVectorMin(sideMin, XMLoadFloat3(&begin[i - 1].bounds.min));
+					sideMax = XMVectorMax(sideMax, XMLoadFloat3(&begin[i - 1].bounds.max));
+					float cost = HalfArea(sideMin, sideMax) * i + rightCosts[i];
+					if (cost < bestCost) {
+						bestCost = cost;
+						bestAxis = axis;
+						bestSplit = i;
+					}
+				}
+			}
+
+			if (IsCheaperAsLeaf(node, bestCost)) {
+				return false;
+			}
+
+			if (bestAxis != sortedAxis) {
+				sortOnAxis(bestAxis);
+			}
+			left = RangeBounds(node.first, bestSplit);
+			right = RangeBounds(node.first + bestSplit, node.count - bestSplit);
+			return true;
+		}
+
+		const BvhBuildInput& m_input;
+		std::vector<PrimitiveReference>& m_references;
+		uint32_t m_binCount;
+		uint32_t m_maxLeafPrimitives;
+		float m_traversalCost;
+	};
+
+	uint32_t CountLeadingZeros(uint64_t value) {
+#ifdef _MSC_VER
+		unsigned long bit;
+		return _BitScanReverse64(&bit, value) ? 63 - bit : 64;
+#else
+		return value ? __builtin_clzll(value) : 64;
+#endif
+	}
+
+	void ParallelFor(ThreadPool* threadPool, uint32_t count, uint32_t grainSize, const ThreadPool::RangeTask& task) {
+		if (threadPool) {
+			threadPool->ParallelFor(count, task, grainSize);
+		} else if (count > 0) {
+			task(0, count);
+		}
+	}
+
+	// Best plane at a spatial bin boundary of a node; axis is -1 if there is none.
+	struct SpatialSplit {
+		float cost;   // In half areas.
+		int axis;
+		uint32_t bin; // First bin on the right; the plane is at its lower end.
+		float position;
+		float origin; // The bin of a position on axis is (position - origin) * scale.
+		float scale;
+		Bin left;     // Bounds of the clipped references on each side, counted with the references they hold.
+		Bin right;
+	};
+
+	// A node of a spatial split build, which owns its references: its children copy them, or clip them in two.
+	struct SpatialNode {
+		std::vector<PrimitiveReference> references;
+		NodeRange range; // Over all of references.
+		int64_t duplicateBudget = 0; // References the subtree may still add by clipping.
+	};
+
+	// Looks for the best spatial split of every node next to the best object split of BinnedSahBuilder and takes
+	// the cheaper one. References that cross the plane of a spatial split are clipped to either side, unless
+	// moving them whole is cheaper. Every node hands what is left of its budget of duplicates down to its children,
+	// in proportion to the references they hold, so the tree is the same whatever order the subtrees are built in.
+	class SpatialSplitBuilder {
+	public:
+		SpatialSplitBuilder(const BvhBuildInput& input, const BvhBuildSettings& settings) :
+			m_input(input),
+			m_settings(settings),
+			m_binCount(std::clamp(settings.binCount, 2u, MaxBinCount)),
+			m_maxLeafPrimitives(std::max(1u, settings.maxLeafPrimitives)),
+			m_minimumOverlap(SpatialSplitOverlap * HalfArea(XMLoadFloat3(&input.bounds.min), XMLoadFloat3(&input.bounds.max))) {
+		}
+
+		// Splits node into left and right, handing its references over, or returns false if it is cheaper as a leaf.
+		bool Split(SpatialNode& node, SpatialNode& left, SpatialNode& right, SplitScratch& scratch, ThreadPool* threadPool) {
+			const NodeRange& range = node.range;
+			if (range.count <= 1) {
+				return false;
+			}
+
+			BinnedSahBuilder objects(m_input, m_settings, node.references);
+			CentroidBins centroidBins;
+			ObjectSplit objectSplit = {FLT_MAX, -1, 0, { }, { }};
+			if (objects.SetUpCentroidBins(range, centroidBins)) {
+				objectSplit = objects.FindObjectSplit(range, centroidBins, scratch, threadPool);
+			}
+			SpatialSplit spatialSplit = {FLT_MAX, -1, 0, 0.0f, 0.0f, 0.0f, { }, { }};
+			if (node.duplicateBudget > 0
+				&& (objectSplit.axis < 0 || OverlapArea(objectSplit.left, objectSplit.right) > m_minimumOverlap)) {
+				spatialSplit = FindSpatialSplit(node, scratch, threadPool);
+			}
+
+			float cost = std::min(objectSplit.cost, spatialSplit.cost);
+			if (cost < FLT_MAX && objects.IsCheaperAsLeaf(range, cost)) {
+				return false;
+			}
+			if (spatialSplit.cost < objectSplit.cost) {
+				ApplySpatialSplit(node, spatialSplit, left, right);
+				return true;
+			}
+
+			NodeRange leftRange, rightRange;
+			if (objectSplit.axis >= 0) {
+				objects.ApplyObjectSplit(range, centroidBins, objectSplit, leftRange, rightRange);
+			} else if (range.count <= m_maxLeafPrimitives) {
+				return false;
+			} else {
+				objects.SplitInTheMiddle(range, leftRange, rightRange);
+			}
+			left.references.assign(node.references.begin( ), node.references.begin( ) + leftRange.count);
+			right.references.assign(node.references.begin( ) + leftRange.count, node.references.end( ));
+			left.range = leftRange;
+			right.range = rightRange;
+			left.range.first = right.range.first = 0;
+			ShareBudget(node.duplicateBudget, left, right);
+			std::vector<PrimitiveReference>( ).swap(node.references);
+			return true;
+		}
+
+		// Builds the subtree of root on the calling thread. nodes[nodeIndex] is its root; its descendants are
+		// appended to nodes and the references of its leaves to order.
+		void BuildSubtree(SpatialNode&& root, std::vector<BvhNode>& nodes, uint32_t nodeIndex, std::vector<uint32_t>& order, SplitScratch& scratch) {
+			std::vector<std::pair<uint32_t, SpatialNode>> stack;
+			stack.emplace_back(nodeIndex, std::move(root));
+			while (!stack.empty( )) {
+				uint32_t index = stack.back( ).first;
+				SpatialNode node = std::move(stack.back( ).second);
+				stack.pop_back( );
+
+				SpatialNode left, right;
+				if (!Split(node, left, right, scratch, nullptr)) {
+					nodes[index] = MakeLeaf(node, order);
+					continue;
+				}
+				uint32_t leftIndex = static_cast<uint32_t>(nodes.size( ));
+				nodes[index] = BinnedSahBuilder::MakeInner(node.range, leftIndex);
+				nodes.emplace_back( );
+				nodes.emplace_back( );
+				stack.emplace_back(leftIndex + 1, std::move(right));
+				stack.emplace_back(leftIndex, std::move(left));
+			}
+		}
+
+		static BvhNode MakeLeaf(const SpatialNode& node, std::vector<uint32_t>& order) {
+			NodeRange range = node.range;
+			range.first = static_cast<uint32_t>(order.size( ));
+			for (const PrimitiveReference& reference : node.references) {
+				order.push_back(reference.primitive);
+			}
+			return BinnedSahBuilder::MakeLeaf(range);
+		}
+
+	private:
+		static void ShareBudget(int64_t budget, SpatialNode& left, SpatialNode& right) {
+			double share = static_cast<double>(left.references.size( )) / (left.references.size( ) + right.references.size( ));
+			left.duplicateBudget = static_cast<int64_t>(budget * share);
+			right.duplicateBudget = budget - left.duplicateBudget;
+		}
+
+		static float OverlapArea(const Bin& a, const Bin& b) {
+			XMFLOAT3 overlapMin, overlapMax;
+			XMStoreFloat3(&overlapMin, XMVectorMax(a.boundsMin, b.boundsMin));
+			XMStoreFloat3(&overlapMax, XMVectorMin(a.boundsMax, b.boundsMax));
+			if (overlapMin.x > overlapMax.x || overlapMin.y > overlapMax.y || overlapMin.z > overlapMax.z) {
+				return 0.0f;
+			}
+			return HalfArea(XMLoadFloat3(&overlapMin), XMLoadFloat3(&overlapMax));
+		}
+
+		// Clipping a primitive that only touches a plane can leave nothing on one side, up to rounding.
+		static bool IsInverted(const Aabb& bounds) {
+			return bounds.min.x > bounds.max.x || bounds.min.y > bounds.max.y || bounds.min.z > bounds.max.z;
+		}
+
+		uint32_t SpatialBin(float position, float origin, float scale) const {
+			return std::min(m_binCount - 1, static_cast<uint32_t>(std::max(0.0f, (position - origin) * scale)));
+		}
+
+		// Bounds of the part of a reference between lower and upper on axis. Polygons are clipped, the rest of
+		// the primitives as boxes; either way the result stays within the bounds of the reference.
+		Aabb Clip(const PrimitiveReference& reference, int axis, float lower, float upper) const {
+			Aabb clipped = reference.bounds;
+			uint8_t size = m_input.HasPolygons( ) ? m_input.polygonSizes[reference.primitive] : 0;
+			if (size > 0) {
+				// The clipped polygon has the corners between the planes and the points where edges cross them.
+				float polygonMin[3] = {FLT_MAX, FLT_MAX, FLT_MAX};
+				float polygonMax[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+				auto grow = [&](const float* point) {
+					for (int i = 0; i < 3; i++) {
+						polygonMin[i] = std::min(polygonMin[i], point[i]);
+						polygonMax[i] = std::max(polygonMax[i], point[i]);
+					}
+				};
+				auto growCrossings = [&](const float* a, const float* b) {
+					for (float plane : {lower, upper}) {
+						if ((a[axis] < plane) != (b[axis] < plane)) {
+							float t = (plane - a[axis]) / (b[axis] - a[axis]);
+							float crossing[3] = {a[0] + (b[0] - a[0]) * t, a[1] + (b[1] - a[1]) * t, a[2] + (b[2] - a[2]) * t};
+							crossing[axis] = plane;
+							grow(crossing);
+						}
+					}
+				};
+				const XMFLOAT3* corners = &m_input.polygonCorners[4 * static_cast<size_t>(reference.primitive)];
+				for (uint8_t corner = 0; corner < size; corner++) {
+					const float* a = &corners[corner].x;
+					if (a[axis] >= lower && a[axis] <= upper) {
+						grow(a);
+					}
+					growCrossings(a, &corners[corner + 1 < size ? corner + 1 : 0].x);
+				}
+				// The triangles of a quad need not be coplanar, so the planes may also cut the diagonal off the outline.
+				if (size == 4) {
+					growCrossings(&corners[1].x, &corners[3].x);
+				}
+				for (int i = 0; i < 3; i++) {
+					(&clipped.min.x)[i] = std::max((&clipped.min.x)[i], polygonMin[i]);
+					(&clipped.max.x)[i] = std::min((&clipped.max.x)[i], polygonMax[i]);
+				}
+			}
+			(&clipped.min.x)[axis] = std::max((&clipped.min.x)[axis], lower);
+			(&clipped.max.x)[axis] = std::min((&clipped.max.x)[axis], upper);
+			return clipped;
+		}
+
+		// Bins the references over the node bounds on every axis, clipping them to each bin they cross, and
+		// sweeps the bin boundaries. Large nodes are binned in parallel, like the centroids.
+		SpatialSplit FindSpatialSplit(const SpatialNode& node, SplitScratch& scratch, ThreadPool* threadPool) const {
+			const NodeRange& range = node.range;
+			XMFLOAT3 origin, extent;
+			XMStoreFloat3(&origin, range.boundsMin);
+			XMStoreFloat3(&extent, range.boundsMax - range.boundsMin);
+			float scale[3];
+			for (int axis = 0; axis < 3; axis++) {
+				float axisExtent = (&extent.x)[axis];
+				scale[axis] = axisExtent > 0 ? m_binCount / axisExtent : 0.0f;
+			}
+
+			auto binRange = [&](uint32_t begin, uint32_t end, Bin* bins, uint32_t* entries, uint32_t* exits) {
+				for (uint32_t bin = 0; bin < 3 * m_binCount; bin++) {
+					bins[bin].Clear( );
+					entries[bin] = exits[bin] = 0;
+				}
+				for (uint32_t i = begin; i < end; i++) {
+					const PrimitiveReference& reference = node.references[i];
+					for (int axis = 0; axis < 3; axis++) {
+						if (scale[axis] == 0) {
+							continue;
+						}
+						float axisOrigin = (&origin.x)[axis];
+						uint32_t first = SpatialBin((&reference.bounds.min.x)[axis], axisOrigin, scale[axis]);
+						uint32_t last = SpatialBin((&reference.bounds.max.x)[axis], axisOrigin, scale[axis]);
+						Bin* axisBins = &bins[axis * m_binCount];
+						entries[axis * m_binCount + first]++;
+						exits[axis * m_binCount + last]++;
+						for (uint32_t bin = first; bin <= last; bin++) {
+							Aabb part = first == last ? reference.bounds
+								: Clip(reference, axis, bin == first ? -FLT_MAX : axisOrigin + bin / scale[axis],
+									   bin == last ? FLT_MAX : axisOrigin + (bin + 1) / scale[axis]);
+							axisBins[bin].boundsMin = XMVectorMin(axisBins[bin].boundsMin, XMLoadFloat3(&part.min));
+							axisBins[bin].boundsMax = XMVectorMax(axisBins[bin].boundsMax, XMLoadFloat3(&part.max));
+						}
+					}
+				}
+			};
+
+			scratch.spatialBins.resize(3 * m_binCount);
+			scratch.entries.resize(3 * m_binCount);
+			scratch.exits.resize(3 * m_binCount);
+			if (!threadPool || threadPool->GetThreadCount( ) == 1 || range.count < ParallelBinningMinimum) {
+				binRange(0, range.count, scratch.spatialBins.data( ), scratch.entries.data( ), scratch.exits.data( ));
+			} else {
+				uint32_t chunkCount = (range.count + BinningGrain - 1) / BinningGrain;
+				size_t chunkSize = 3 * static_cast<size_t>(m_binCount);
+				std::vector<Bin> chunkBins(chunkCount * chunkSize);
+				std::vector<uint32_t> chunkEntries(chunkCount * chunkSize);
+				std::vector<uint32_t> chunkExits(chunkCount * chunkSize);
+				threadPool->ParallelFor(range.count, [&](uint32_t begin, uint32_t end) {
+					size_t chunk = begin / BinningGrain * chunkSize;
+					binRange(begin, end, &chunkBins[chunk], &chunkEntries[chunk], &chunkExits[chunk]);
+				}, BinningGrain);
+				for (uint32_t bin = 0; bin < 3 * m_binCount; bin++) {
+					scratch.spatialBins[bin].Clear( );
+					scratch.entries[bin] = scratch.exits[bin] = 0;
+					for (size_t chunk = 0; chunk < chunkCount; chunk++) {
+						scratch.spatialBins[bin].Grow(chunkBins[chunk * chunkSize + bin]);
+						scratch.entries[bin] += chunkEntries[chunk * chunkSize + bin];
+						scratch.exits[bin] += chunkExits[chunk * chunkSize + bin];
+					}
+				}
+			}
+
+			// The references on the left of a plane are those that enter before it, on the right those that exit
+			// after it; the ones crossing it are on both sides. Splits that duplicate beyond the budget are skipped.
+			int64_t budget = node.duplicateBudget;
+			SpatialSplit best = {FLT_MAX, -1, 0, 0.0f, 0.0f, 0.0f, { }, { }};
+			for (int axis = 0; axis < 3; axis++) {
+				if (scale[axis] == 0) {
+					continue;
+				}
+				const Bin* axisBins = &scratch.spatialBins[axis * m_binCount];
+				float rightCosts[MaxBinCount];
+				uint32_t rightCounts[MaxBinCount];
+				Bin side;
+				side.Clear( );
+				for (uint32_t bin = m_binCount - 1; bin > 0; bin--) {
+					side.Grow(axisBins[bin]);
+					side.count += scratch.exits[axis * m_binCount + bin];
+					rightCosts[bin] = HalfArea(side.boundsMin, side.boundsMax) * side.count;
+					rightCounts[bin] = side.count;
+				}
+				side.Clear( );
+				for (uint32_t bin = 1; bin < m_binCount; bin++) {
+					side.Grow(axisBins[bin - 1]);
+					side.count += scratch.entries[axis * m_binCount + bin - 1];
+					if (side.count == 0 || rightCounts[bin] == 0 || side.count + rightCounts[bin] - range.count > budget) {
+						continue;
+					}
+					float cost = HalfArea(side.boundsMin, side.boundsMax) * side.count + rightCosts[bin];
+					if (cost < best.cost) {
+						best = {cost, axis, bin, (&origin.x)[axis] + bin / scale[axis], (&origin.x)[axis], scale[axis], { }, { }};
+					}
+				}
+			}
+			if (best.axis < 0) {
+				return best;
+			}
+
+			const Bin* axisBins = &scratch.spatialBins[best.axis * m_binCount];
+			best.left.Clear( );
+			best.right.Clear( );
+			for (uint32_t bin = 0; bin < m_binCount; bin++) {
+				Bin& side = bin < best.bin ? best.left : best.right;
+				side.Grow(axisBins[bin]);
+				side.count += bin < best.bin ? scratch.entries[best.axis * m_binCount + bin] : scratch.exits[best.axis * m_binCount + bin];
+			}
+			return best;
+		}
+
+		// Sends every reference to the side of the plane it is on. Those crossing it are clipped in two, unless
+		// moving them whole to one side costs less, which is the "unsplitting" of Stich et al.
+		void ApplySpatialSplit(SpatialNode& node, const SpatialSplit& split, SpatialNode& left, SpatialNode& right) {
+			float leftArea = HalfArea(split.left.boundsMin, split.left.boundsMax);
+			float rightArea = HalfArea(split.right.boundsMin, split.right.boundsMax);
+			float splitCost = leftArea * split.left.count + rightArea * split.right.count;
+			int64_t duplicates = 0;
+			left.references.reserve(split.left.count);
+			right.references.reserve(split.right.count);
+			for (const PrimitiveReference& reference : node.references) {
+				uint32_t first = SpatialBin((&reference.bounds.min.x)[split.axis], split.origin, split.scale);
+				uint32_t last = SpatialBin((&reference.bounds.max.x)[split.axis], split.origin, split.scale);
+				if (last < split.bin) {
+					left.references.push_back(reference);
+					continue;
+				}
+				if (first >= split.bin) {
+					right.references.push_back(reference);
+					continue;
+				}
+
+				XMVECTOR boundsMin = XMLoadFloat3(&reference.bounds.min);
+				XMVECTOR boundsMax = XMLoadFloat3(&reference.bounds.max);
+				float leftOnlyCost = HalfArea(XMVectorMin(split.left.boundsMin, boundsMin), XMVectorMax(split.left.boundsMax, boundsMax)) * split.left.count
+					+ rightArea * (split.right.count - 1);
+				float rightOnlyCost = leftArea * (split.left.count - 1)
+					+ HalfArea(XMVectorMin(split.right.boundsMin, boundsMin), XMVectorMax(split.right.boundsMax, boundsMax)) * split.right.count;
+				if (leftOnlyCost < splitCost && leftOnlyCost <= rightOnlyCost) {
+					left.references.push_back(reference);
+					continue;
+				}
+				if (rightOnlyCost < splitCost) {
+					right.references.push_back(reference);
+					continue;
+				}
+
+				PrimitiveReference leftPart = Clipped(reference, split.axis, -FLT_MAX, split.position);
+				PrimitiveReference rightPart = Clipped(reference, split.axis, split.position, FLT_MAX);
+				if (IsInverted(leftPart.bounds) || IsInverted(rightPart.bounds)) {
+					(IsInverted(leftPart.bounds) ? right : left).references.push_back(reference);
+					continue;
+				}
+				left.references.push_back(leftPart);
+				right.references.push_back(rightPart);
+				duplicates++;
+			}
+			int64_t budget = node.duplicateBudget - duplicates;
+			std::vector<PrimitiveReference>( ).swap(node.references);
+
+			// A reference moved whole can leave the other side empty; a plain split in the middle then goes on.
+			for (SpatialNode* child : {&left, &right}) {
+				BinnedSahBuilder childReferences(m_input, m_settings, child->references);
+				child->range = childReferences.RangeBounds(0, static_cast<uint32_t>(child->references.size( )));
+			}
+			if (left.references.empty( ) || right.references.empty( )) {
+				SpatialNode& whole = left.references.empty( ) ? right : left;
+				node.references = std::move(whole.references);
+				node.range = whole.range;
+				BinnedSahBuilder objects(m_input, m_settings, node.references);
+				NodeRange leftRange, rightRange;
+				objects.SplitInTheMiddle(node.range, leftRange, rightRange);
+				left.references.assign(node.references.begin( ), node.references.begin( ) + leftRange.count);
+				right.references.assign(node.references.begin( ) + leftRange.count, node.references.end( ));
+				left.range = leftRange;
+				right.range = rightRange;
+				right.range.first = 0;
+			}
+			ShareBudget(budget, left, right);
+		}
+
+		// A reference to the part of a primitive between lower and upper on axis, centred in its clipped bounds.
+		PrimitiveReference Clipped(const PrimitiveReference& reference, int axis, float lower, float upper) const {
+			PrimitiveReference part = reference;
+			part.bounds = Clip(reference, axis, lower, upper);
+			XMStoreFloat3(&part.centroid, (XMLoadFloat3(&part.bounds.min) + XMLoadFloat3(&part.bounds.max)) * 0.5f);
+			return part;
+		}
+
+		const BvhBuildInput& m_input;
+		const BvhBuildSettings& m_settings;
+		uint32_t m_binCount;
+		uint32_t m_maxLeafPrimitives;
+		float m_minimumOverlap;
+	};
+
+	// Stable LSD radix sort on the low keyBits bits of keys, moving values along. Every chunk of the input counts
+	// its digits, then scatters them to its own slots; passes in which all keys share a digit are skipped.
+	void RadixSort(std::vector<uint64_t>& keys, std::vector<uint32_t>& values, uint32_t keyBits, ThreadPool* threadPool) {
+		uint32_t count = static_cast<uint32_t>(keys.size( ));
+		uint32_t chunkCount = threadPool ? std::clamp(count / RadixChunkMinimum, 1u, 4 * threadPool->GetThreadCount( )) : 1;
+		uint32_t chunkSize = (count + chunkCount - 1) / chunkCount;
+		std::vector<uint64_t> sortedKeys(count);
+		std::vector<uint32_t> sortedValues(count);
+		std::vector<uint32_t> offsets(static_cast<size_t>(chunkCount) * RadixDigits);
+
+		for (uint32_t shift = 0; shift < keyBits; shift += RadixBits) {
+			std::fill(offsets.begin( ), offsets.end( ), 0);
+			ParallelFor(threadPool, chunkCount, 1, [&](uint32_t begin, uint32_t end) {
+				for (uint32_t chunk = begin; chunk < end; chunk++) {
+					uint32_t* histogram = &offsets[static_cast<size_t>(chunk) * RadixDigits];
+					for (uint32_t i = chunk * chunkSize; i < std::min(count, (chunk + 1) * chunkSize); i++) {
+						histogram[(keys[i] >> shift) & (RadixDigits - 1)]++;
+					}
+				}
+			});
+
+			uint32_t sum = 0;
+			bool oneDigit = false;
+			for (uint32_t digit = 0; digit < RadixDigits; digit++) {
+				uint32_t digitStart = sum;
+				for (uint32_t chunk = 0; chunk < chunkCount; chunk++) {
+					uint32_t& offset = offsets[static_cast<size_t>(chunk) * RadixDigits + digit];
+					uint32_t digitCount = offset;
+					offset = sum;
+					sum += digitCount;
+				}
+				oneDigit |= sum - digitStart == count;
+			}
+			if (oneDigit) {
+				continue;
+			}
+
+			ParallelFor(threadPool, chunkCount, 1, [&](uint32_t begin, uint32_t end) {
+				for (uint32_t chunk = begin; chunk < end; chunk++) {
+					uint32_t* offset = &offsets[static_cast<size_t>(chunk) * RadixDigits];
+					for (uint32_t i = chunk * chunkSize; i < std::min(count, (chunk + 1) * chunkSize); i++) {
+						uint32_t slot = offset[(keys[i] >> shift) & (RadixDigits - 1)]++;
+						sortedKeys[slot] = keys[i];
+						sortedValues[slot] = values[i];
+					}
+				}
+			});
+			keys.swap(sortedKeys);
+			values.swap(sortedValues);
+		}
+	}
+
+	// Inner node of Karras 2012, "Maximizing Parallelism in the Construction of BVHs, Octrees, and k-d Trees":
+	// node 0 is the root, and inner node i covers the sorted primitives first to last.
+	struct LinearNode {
+		uint32_t first;
+		uint32_t last;
+		uint32_t left;  // Inner node, or sorted primitive | LinearLeaf.
+		uint32_t right;
+		uint32_t parent;
+		uint32_t descendants; // Below it once laid out as BvhNodes, 0 if it becomes a leaf.
+		Aabb bounds;
+	};
+}
+
+Bvh BvhBuilder::Build(const BvhBuildInput& input, const BvhBuildSettings& settings, ThreadPool* threadPool, BvhBuildStats* stats) {
+	auto start = std::chrono::steady_clock::now( );
+	Bvh bvh;
+	switch (settings.mode) {
+	case BvhBuildMode::Linear:
+		bvh = BuildLinear(input, settings, threadPool);
+		break;
+	case BvhBuildMode::SpatialSplits:
+		bvh = BuildSpatialSplits(input, settings, threadPool);
+		break;
+	default:
+		bvh = BuildBinnedSah(input, settings, threadPool);
+		break;
+	}
+	if (stats) {
+		stats->buildMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now( ) - start).count( );
+		Measure(bvh, settings, *stats);
+	}
+	return bvh;
+}
+
+Bvh BvhBuilder::BuildBinnedSah(const BvhBuildInput& input, const BvhBuildSettings& settings, ThreadPool* threadPool) {
+	Bvh bvh;
+	uint32_t primitiveCount = static_cast<uint32_t>(input.GetPrimitiveCount( ));
+	if (primitiveCount > 0) {
+		std::vector<PrimitiveReference> references(primitiveCount);
+		auto reference = [&](uint32_t begin, uint32_t end) {
+			for (uint32_t i = begin; i < end; i++) {
+				references[i] = {input.primitiveBounds[i], input.centroids[i], i};
+			}
+		};
+		if (threadPool) {
+			threadPool->ParallelFor(primitiveCount, reference, ReferenceGrain);
+		} else {
+			reference(0, primitiveCount);
+		}
+		bvh.nodes.reserve(2 * static_cast<size_t>(primitiveCount) - 1);
+		bvh.nodes.emplace_back( );
+
+		BinnedSahBuilder builder(input, settings, references);
+		SplitScratch scratch;
+		if (!threadPool || threadPool->GetThreadCount( ) == 1) {
+			builder.BuildSubtree(builder.GetRoot( ), bvh.nodes, 0, scratch);
+		} else {
+			// The top of the tree is split here, binning on the pool, until the nodes are small enough to be
+			// built on one thread each. Those subtrees go to the pool and are appended in order afterwards.
+			uint32_t subtreeMaximum = std::min(SubtreeMaximum, std::max(1u, primitiveCount / (threadPool->GetThreadCount( ) * SubtreeTasksPerThread)));
+			std::vector<std::pair<uint32_t, NodeRange>> subtrees;
+			std::vector<std::pair<uint32_t, NodeRange>> stack = {{0, builder.GetRoot( )}};
+			while (!stack.empty( )) {
+				auto [index, node] = stack.back( );
+				stack.pop_back( );
+				if (node.count <= subtreeMaximum) {
+					subtrees.push_back({index, node});
+					continue;
+				}
+
+				NodeRange left, right;
+				if (!builder.Split(node, left, right, scratch, threadPool)) {
+					bvh.nodes[index] = BinnedSahBuilder::MakeLeaf(node);
+					continue;
+				}
+				uint32_t leftIndex = static_cast<uint32_t>(bvh.nodes.size( ));
+				bvh.nodes[index] = BinnedSahBuilder::MakeInner(node, leftIndex);
+				bvh.nodes.emplace_back( );
+				bvh.nodes.emplace_back( );
+				stack.push_back({leftIndex + 1, right});
+				stack.push_back({leftIndex, left});
+			}
+
+			// Every subtree works on its own range of references and its own nodes, rooted at index 0.
+			std::vector<std::vector<BvhNode>> subtreeNodes(subtrees.size( ));
+			threadPool->ParallelFor(static_cast<uint32_t>(subtrees.size( )), [&](uint32_t begin, uint32_t end) {
+				SplitScratch subtreeScratch;
+				for (uint32_t subtree = begin; subtree < end; subtree++) {
+					subtreeNodes[subtree].emplace_back( );
+					builder.BuildSubtree(subtrees[subtree].second, subtreeNodes[subtree], 0, subtreeScratch);
+				}
+			});
+
+			for (size_t subtree = 0; subtree < subtrees.size( ); subtree++) {
+				// Local node i > 0 lands at offset + i; the root replaces the placeholder left in the top of the tree.
+				const std::vector<BvhNode>& local = subtreeNodes[subtree];
+				uint32_t offset = static_cast<uint32_t>(bvh.nodes.size( )) - 1;
+				for (size_t i = 0; i < local.size( ); i++) {
+					BvhNode node = local[i];
+					if (node.count == 0) {
+						node.leftFirst += offset;
+					}
+					if (i == 0) {
+						bvh.nodes[subtrees[subtree].first] = node;
+					} else {
+						bvh.nodes.push_back(node);
+					}
+				}
+			}
+		}
+
+		bvh.primitiveOrder.resize(primitiveCount);
+		for (uint32_t i = 0; i < primitiveCount; i++) {
+			bvh.primitiveOrder[i] = references[i].primitive;
+		}
+	}
+	return bvh;
+}
+
+Bvh BvhBuilder::BuildLinear(const BvhBuildInput& input, const BvhBuildSettings& settings, ThreadPool* threadPool) {
+	Bvh bvh;
+	uint32_t primitiveCount = static_cast<uint32_t>(input.GetPrimitiveCount( ));
+	if (primitiveCount == 0) {
+		return bvh;
+	}
+
+	// The 30-bit code is the top of the 63-bit one.
+	uint32_t codeBits = settings.mortonCodeBits <= 30 ? 30 : 63;
+	std::vector<uint64_t> codes(primitiveCount);
+	bvh.primitiveOrder.resize(primitiveCount);
+	ParallelFor(threadPool, primitiveCount, ReferenceGrain, [&](uint32_t begin, uint32_t end) {
+		for (uint32_t i = begin; i < end; i++) {
+			codes[i] = input.mortonCodes[i] >> (63 - codeBits);
+			bvh.primitiveOrder[i] = i;
+		}
+	});
+	RadixSort(codes, bvh.primitiveOrder, codeBits, threadPool);
+
+	auto leafBounds = [&](uint32_t leaf) -> const Aabb& { return input.primitiveBounds[bvh.primitiveOrder[leaf]]; };
+	if (primitiveCount == 1) {
+		bvh.nodes.push_back({leafBounds(0).min, 0, leafBounds(0).max, 1});
+		return bvh;
+	}
+
+	// Common prefix length of the codes of sorted primitives i and j; equal codes compare their positions instead.
+	auto delta = [&](int64_t i, int64_t j) -> int {
+		if (j < 0 || j >= primitiveCount) {
+			return -1;
+		}
+		uint64_t difference = codes[i] ^ codes[j];
+		return difference ? CountLeadingZeros(difference) : 64 + CountLeadingZeros(static_cast<uint64_t>(i ^ j));
+	};
+
+	// Every inner node finds its range and split on its own.
+	std::vector<LinearNode> inner(primitiveCount - 1);
+	std::vector<uint32_t> leafParents(primitiveCount);
+	ParallelFor(threadPool, primitiveCount - 1, HierarchyGrain, [&](uint32_t begin, uint32_t end) {
+		for (int64_t i = begin; i < end; i++) {
+			int64_t direction = delta(i, i + 1) > delta(i, i - 1) ? 1 : -1;
+			int minimumPrefix = delta(i, i - direction);
+			int64_t maxLength = 2;
+			while (delta(i, i + maxLength * direction) > minimumPrefix) {
+				maxLength *= 2;
+			}
+			int64_t length = 0;
+			for (int64_t step = maxLength / 2; step > 0; step /= 2) {
+				if (delta(i, i + (length + step) * direction) > minimumPrefix) {
+					length += step;
+				}
+			}
+			int64_t j = i + length * direction;
+
+			int nodePrefix = delta(i, j);
+			int64_t split = 0;
+			int64_t step = length;
+			do {
+				step = (step + 1) / 2;
+				if (delta(i, i + (split + step) * direction) > nodePrefix) {
+					split += step;
+				}
+			} while (step > 1);
+			uint32_t gamma = static_cast<uint32_t>(i + split * direction + std::min<int64_t>(direction, 0));
+
+			LinearNode& node = inner[i];
+			node.first = static_cast<uint32_t>(std::min(i, j));
+			node.last = static_cast<uint32_t>(std::max(i, j));
+			node.left = node.first == gamma ? gamma | LinearLeaf : gamma;
+			node.right = node.last == gamma + 1 ? (gamma + 1) | LinearLeaf : gamma + 1;
+			(node.left & LinearLeaf ? leafParents[gamma] : inner[gamma].parent) = static_cast<uint32_t>(i);
+			(node.right & LinearLeaf ? leafParents[gamma + 1] : inner[gamma + 1].parent) = static_cast<uint32_t>(i);
+		}
+	});
+
+	// Bounds and laid out sizes, bottom-up: of the two children of a node, the one that finishes second goes on.
+	std::vector<std::atomic<uint32_t>> arrivals(primitiveCount - 1);
+	auto descendants = [&](uint32_t child) { return child & LinearLeaf ? 0 : inner[child].descendants; };
+	auto childBounds = [&](uint32_t child) -> const Aabb& { return child & LinearLeaf ? leafBounds(child & ~LinearLeaf) : inner[child].bounds; };
+	ParallelFor(threadPool, primitiveCount, HierarchyGrain, [&](uint32_t begin, uint32_t end) {
+		for (uint32_t leaf = begin; leaf < end; leaf++) {
+			uint32_t index = leafParents[leaf];
+			while (arrivals[index].fetch_add(1, std::memory_order_acq_rel) == 1) {
+				LinearNode& node = inner[index];
+				node.bounds = childBounds(node.left);
+				node.bounds.Grow(childBounds(node.right));
+				node.descendants = node.last - node.first < settings.maxLeafPrimitives ? 0 : 2 + descendants(node.left) + descendants(node.right);
+				if (index == 0) {
+					break;
+				}
+				index = node.parent;
+			}
+		}
+	});
+
+	// Top-down layout: the children of a node go to the pair at pairBase, the subtree of the left one right after
+	// them and that of the right one after it. Nodes of large ranges are placed here, smaller subtrees on the pool.
+	struct Placement {
+		uint32_t node; // Inner node, or sorted primitive | LinearLeaf.
+		uint32_t slot;
+		uint32_t pairBase;
+	};
+	bvh.nodes.resize(1 + static_cast<size_t>(inner[0].descendants));
+	auto place = [&](const Placement& placement, std::vector<Placement>& stack) {
+		if (placement.node & LinearLeaf) {
+			const Aabb& bounds = leafBounds(placement.node & ~LinearLeaf);
+			bvh.nodes[placement.slot] = {bounds.min, placement.node & ~LinearLeaf, bounds.max, 1};
+			return;
+		}
+		const LinearNode& node = inner[placement.node];
+		if (node.descendants == 0) {
+			bvh.nodes[placement.slot] = {node.bounds.min, node.first, node.bounds.max, node.last - node.first + 1};
+			return;
+		}
+		bvh.nodes[placement.slot] = {node.bounds.min, placement.pairBase, node.bounds.max, 0};
+		stack.push_back({node.right, placement.pairBase + 1, placement.pairBase + 2 + descendants(node.left)});
+		stack.push_back({node.left, placement.pairBase, placement.pairBase + 2});
+	};
+
+	uint32_t subtreeMaximum = threadPool ? std::max(1u, primitiveCount / (threadPool->GetThreadCount( ) * SubtreeTasksPerThread)) : primitiveCount;
+	std::vector<Placement> subtrees;
+	std::vector<Placement> stack = {{0, 0, 1}};
+	while (!stack.empty( )) {
+		Placement placement = stack.back( );
+		stack.pop_back( );
+		bool small = placement.node & LinearLeaf || inner[placement.node].last - inner[placement.node].first < subtreeMaximum;
+		if (small && threadPool) {
+			subtrees.push_back(placement);
+		} else {
+			place(placement, stack);
+		}
+	}
+	ParallelFor(threadPool, static_cast<uint32_t>(subtrees.size( )), 1, [&](uint32_t begin, uint32_t end) {
+		std::vector<Placement> subtreeStack;
+		for (uint32_t subtree = begin; subtree < end; subtree++) {
+			subtreeStack.push_back(subtrees[subtree]);
+			while (!subtreeStack.empty( )) {
+				Placement placement = subtreeStack.back( );
+				subtreeStack.pop_back( );
+				place(placement, subtreeStack);
+			}
+		}
+	});
+	return bvh;
+}
+
+Bvh BvhBuilder::BuildSpatialSplits(const BvhBuildInput& input, const BvhBuildSettings& settings, ThreadPool* threadPool) {
+	Bvh bvh;
+	uint32_t primitiveCount = static_cast<uint32_t>(input.GetPrimitiveCount( ));
+	if (primitiveCount == 0) {
+		return bvh;
+	}
+
+	SpatialNode root;
+	root.references.resize(primitiveCount);
+	ParallelFor(threadPool, primitiveCount, ReferenceGrain, [&](uint32_t begin, uint32_t end) {
+		for (uint32_t i = begin; i < end; i++) {
+			root.references[i] = {input.primitiveBounds[i], input.centroids[i], i};
+		}
+	});
+	root.range = {0, primitiveCount, XMLoadFloat3(&input.bounds.min), XMLoadFloat3(&input.bounds.max),
+				  XMLoadFloat3(&input.centroidBounds.min), XMLoadFloat3(&input.centroidBounds.max)};
+	root.duplicateBudget = static_cast<int64_t>(std::max(0.0f, settings.spatialSplitBudget) * primitiveCount);
+	SpatialSplitBuilder builder(input, settings);
+	bvh.nodes.emplace_back( );
+	bvh.primitiveOrder.reserve(primitiveCount);
+
+	SplitScratch scratch;
+	if (!threadPool || threadPool->GetThreadCount( ) == 1) {
+		builder.BuildSubtree(std::move(root), bvh.nodes, 0, bvh.primitiveOrder, scratch);
+		return bvh;
+	}
+
+	// As in BuildBinnedSah, except that the subtrees also list the references of their leaves on their own,
+	// which are appended to primitiveOrder in the same order as their nodes.
+	uint32_t subtreeMaximum = std::min(SubtreeMaximum, std::max(1u, primitiveCount / (threadPool->GetThreadCount( ) * SubtreeTasksPerThread)));
+	std::vector<std::pair<uint32_t, SpatialNode>> subtrees;
+	std::vector<std::pair<uint32_t, SpatialNode>> stack;
+	stack.emplace_back(0, std::move(root));
+	while (!stack.empty( )) {
+		uint32_t index = stack.back( ).first;
+		SpatialNode node = std::move(stack.back( ).second);
+		stack.pop_back( );
+		if (node.range.count <= subtreeMaximum) {
+			subtrees.emplace_back(index, std::move(node));
+			continue;
+		}
+
+		SpatialNode left, right;
+		if (!builder.Split(node, left, right, scratch, threadPool)) {
+			bvh.nodes[index] = SpatialSplitBuilder::MakeLeaf(node, bvh.primitiveOrder);
+			continue;
+		}
+		uint32_t leftIndex = static_cast<uint32_t>(bvh.nodes.size( ));
+		bvh.nodes[index] = BinnedSahBuilder::MakeInner(node.range, leftIndex);
+		bvh.nodes.emplace_back( );
+		bvh.nodes.emplace_back( );
+		stack.emplace_back(leftIndex + 1, std::move(right));
+		stack.emplace_back(leftIndex, std::move(left));
+	}
+
+	std::vector<std::vector<BvhNode>> subtreeNodes(subtrees.size( ));
+	std::vector<std::vector<uint32_t>> subtreeOrders(subtrees.size( ));
+	threadPool->ParallelFor(static_cast<uint32_t>(subtrees.size( )), [&](uint32_t begin, uint32_t end) {
+		SplitScratch subtreeScratch;
+		for (uint32_t subtree = begin; subtree < end; subtree++) {
+			subtreeNodes[subtree].emplace_back( );
+			builder.BuildSubtree(std::move(subtrees[subtree].second), subtreeNodes[subtree], 0, subtreeOrders[subtree], subtreeScratch);
+		}
+	});
+
+	for (size_t subtree = 0; subtree < subtrees.size( ); subtree++) {
+		const std::vector<BvhNode>& local = subtreeNodes[subtree];
+		uint32_t nodeOffset = static_cast<uint32_t>(bvh.nodes.size( )) - 1;
+		uint32_t orderOffset = static_cast<uint32_t>(bvh.primitiveOrder.size( ));
+		for (size_t i = 0; i < local.size( ); i++) {
+			BvhNode node = local[i];
+			node.leftFirst += node.count == 0 ? nodeOffset : orderOffset;
+			if (i == 0) {
+				bvh.nodes[subtrees[subtree].first] = node;
+			} else {
+				bvh.nodes.push_back(node);
+			}
+		}
+		bvh.primitiveOrder.insert(bvh.primitiveOrder.end( ), subtreeOrders[subtree].begin( ), subtreeOrders[subtree].end( ));
+	}
+	return bvh;
+}
+
+void BvhBuilder::Refit(Bvh& bvh, const BvhBuildInput& input) {
+	// Children always come after their parent, so walking backwards visits them first.
+	for (size_t i = bvh.nodes.size( ); i-- > 0;) {
+		BvhNode& node = bvh.nodes[i];
+		XMVECTOR boundsMin, boundsMax;
+		if (node.count == 0) {
+			const BvhNode& left = bvh.nodes[node.leftFirst];
+			const BvhNode& right = bvh.nodes[node.leftFirst + 1];
+			boundsMin = XMVectorMin(XMLoadFloat3(&left.boundsMin), XMLoadFloat3(&right.boundsMin));
+			boundsMax = XMVectorMax(XMLoadFloat3(&left.boundsMax), XMLoadFloat3(&right.boundsMax));
+		} else {
+			boundsMin = XMVectorReplicate(FLT_MAX);
+			boundsMax = XMVectorReplicate(-FLT_MAX);
+			for (uint32_t j = node.leftFirst; j < node.leftFirst + node.count; j++) {
+				const Aabb& bounds = input.primitiveBounds[bvh.primitiveOrder[j]];
+				boundsMin = XMVectorMin(boundsMin, XMLoadFloat3(&bounds.min));
+				boundsMax = XMVectorMax(boundsMax, XMLoadFloat3(&bounds.max));
+			}
+		}
+		XMStoreFloat3(&node.boundsMin, boundsMin);
+		XMStoreFloat3(&node.boundsMax, boundsMax);
+	}
+}
+
+void BvhBuilder::Measure(const Bvh& bvh, const BvhBuildSettings& settings, BvhBuildStats& stats) {
+	stats.nodeCount = bvh.nodes.size( );
+	stats.leafCount = 0;
+	stats.depth = 0;
+	stats.sahCost = 0.0f;
+	stats.nodeVisits = 0.0f;
+	stats.primitiveTests = 0.0f;
+	stats.referenceCount = bvh.primitiveOrder.size( );
+	if (bvh.nodes.empty( )) {
+		return;
+	}
+
+	auto area = [](const BvhNode& node) { return HalfArea(XMLoadFloat3(&node.boundsMin), XMLoadFloat3(&node.boundsMax)); };
+	float rootArea = area(bvh.nodes[0]);
+	double visits = 0.0;
+	double tests = 0.0;
+	std::vector<uint32_t> depths(bvh.nodes.size( ), 1);
+	for (size_t i = 0; i < bvh.nodes.size( ); i++) {
+		const BvhNode& node = bvh.nodes[i];
+		float probability = rootArea > 0 ? area(node) / rootArea : 1.0f;
+		visits += probability;
+		stats.depth = std::max(stats.depth, depths[i]);
+		if (node.count == 0) {
+			depths[node.leftFirst] = depths[node.leftFirst + 1] = depths[i] + 1;
+		} else {
+			tests += node.count * probability;
+			stats.leafCount++;
+		}
+	}
+	stats.nodeVisits = static_cast<float>(visits);
+	stats.primitiveTests = static_cast<float>(tests);
+	stats.sahCost = static_cast<float>(settings.traversalCost * visits + tests);
+}
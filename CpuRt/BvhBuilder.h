@@ -0,0 +1,71 @@
+#pragma once
+#include "BvhBuildInput.h"
+#include <vector>
+
+// Binary BVH node. The children of an inner node are leftFirst and leftFirst + 1, and come after it.
+struct BvhNode {
+	XMFLOAT3 boundsMin;
+	uint32_t leftFirst; // First entry of Bvh::primitiveOrder for leaves, left child otherwise.
+	XMFLOAT3 boundsMax;
+	uint32_t count;     // 0 for inner nodes.
+};
+
+enum class BvhBuildMode {
+	BinnedSah, // Top-down binned SAH: the best trees, for geometry built once.
+	Linear,    // Morton order and a Karras hierarchy: much faster builds of worse trees, for geometry rebuilt often.
+	// Binned SAH that may also split space, clipping the primitives on the plane and referencing them from both
+	// sides: fewer overlapping boxes where large primitives cross many small ones, at the cost of slower builds
+	// and duplicate references.
+	SpatialSplits,
+};
+
+struct BvhBuildSettings {
+	uint32_t maxLeafPrimitives = 4; // Hard limit; SAH builds make smaller leaves whenever they are cheaper.
+	uint32_t binCount = 16;         // Candidate split planes per axis are binCount - 1.
+	float traversalCost = 1.0f;     // Cost of visiting a node, relative to testing one primitive.
+	BvhBuildMode mode = BvhBuildMode::BinnedSah;
+	uint32_t mortonCodeBits = 63;   // Linear builds sort on the top 30 or all 63 bits of BvhBuildInput::mortonCodes.
+	float spatialSplitBudget = 0.5f; // Spatial split builds duplicate at most this many references per primitive.
+};
+
+struct BvhBuildStats {
+	double buildMilliseconds = 0.0;
+	float sahCost = 0.0f; // Expected node visits and primitive tests of a random ray that hits the root.
+	float nodeVisits = 0.0f;     // The two terms of sahCost on their own.
+	float primitiveTests = 0.0f;
+	size_t referenceCount = 0;   // Entries of Bvh::primitiveOrder, more than the primitives after spatial splits.
+	size_t nodeCount = 0;
+	size_t leafCount = 0;
+	uint32_t depth = 0;
+};
+
+// Leaves cover primitiveOrder[leftFirst, leftFirst + count), which holds indices into the build input. Spatial
+// split builds list a primitive once for every leaf it overlaps.
+struct Bvh {
+	std::vector<BvhNode> nodes;
+	std::vector<uint32_t> primitiveOrder;
+};
+
+class ThreadPool;
+
+class BvhBuilder {
+public:
+	// Builds in the mode of settings, in parallel on threadPool if there is one.
+	static Bvh Build(const BvhBuildInput& input, const BvhBuildSettings& settings, ThreadPool* threadPool = nullptr, BvhBuildStats* stats = nullptr);
+	// Recomputes the node bounds bottom-up from input, keeping the topology; input must have the same primitives.
+	// Leaves of spatial splits grow back to the whole primitives they clipped.
+	static void Refit(Bvh& bvh, const BvhBuildInput& input);
+	// The SAH cost, leaf count and depth of stats.
+	static void Measure(const Bvh& bvh, const BvhBuildSettings& settings, BvhBuildStats& stats);
+
+private:
+	// Top-down binned SAH. Large nodes are binned in parallel; once there are enough of them, whole subtrees
+	// are built in parallel.
+	static Bvh BuildBinnedSah(const BvhBuildInput& input, const BvhBuildSettings& settings, ThreadPool* threadPool);
+	// Radix sorts the Morton codes, emits the hierarchy of Karras 2012 for all inner nodes at once, then fits the
+	// bounds bottom-up and lays the nodes out top-down, collapsing subtrees of up to maxLeafPrimitives into leaves.
+	static Bvh BuildLinear(const BvhBuildInput& input, const BvhBuildSettings& settings, ThreadPool* threadPool);
+	// Stich et al. 2009, "Spatial Splits in Bounding Volume Hierarchies". Every node owns its references, so the
+	// top of the tree is split here and the subtrees below are built on the pool like those of BuildBinnedSah.
+	static Bvh BuildSpatialSplits(const BvhBuildInput& input, const BvhBuildSettings& settings, ThreadPool* threadPool);
+};
@@ -0,0 +1,172 @@
+#include "CpuBlasGenerator.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+
+namespace {
+	const uint32_t InputGrain = 16384;
+
+	uint32_t GetIndex(const void* indices, bool shortIndices, size_t i) {
+		return shortIndices ? static_cast<const uint16_t*>(indices)[i] : static_cast<const uint32_t*>(indices)[i];
+	}
+}
+
+void CpuBlasGenerator::AddVertexBuffer(const void* vertices, uint32_t vertexCount, uint32_t vertexStride,
+									   const XMMATRIX* transform, bool isOpaque) {
+	AddTriangles(vertices, vertexCount, vertexStride, nullptr, false, vertexCount / 3, transform, isOpaque);
+}
+
+void CpuBlasGenerator::AddVertexBuffer(const void* vertices, uint32_t vertexCount, uint32_t vertexStride,
+									   const uint32_t* indices, uint32_t indexCount, const XMMATRIX* transform, bool isOpaque) {
+	AddTriangles(vertices, vertexCount, vertexStride, indices, false, indexCount / 3, transform, isOpaque);
+}
+
+void CpuBlasGenerator::AddVertexBuffer(const void* vertices, uint32_t vertexCount, uint32_t vertexStride,
+									   const uint16_t* indices, uint32_t indexCount, const XMMATRIX* transform, bool isOpaque) {
+	AddTriangles(vertices, vertexCount, vertexStride, indices, true, indexCount / 3, transform, isOpaque);
+}
+
+void CpuBlasGenerator::AddAabbBuffer(const Aabb* aabbs, uint32_t aabbCount, bool isOpaque) {
+	Geometry geometry = { };
+	geometry.primitiveCount = aabbCount;
+	geometry.transform = XMMatrixIdentity( );
+	geometry.aabbs = aabbs;
+	geometry.isOpaque = isOpaque;
+	m_geometries.push_back(geometry);
+}
+
+void CpuBlasGenerator::AddTriangles(const void* vertices, uint32_t vertexCount, uint32_t vertexStride, const void* indices, bool shortIndices,
+									uint32_t triangleCount, const XMMATRIX* transform, bool isOpaque) {
+	Geometry geometry = { };
+	geometry.vertices = static_cast<const uint8_t*>(vertices);
+	geometry.vertexCount = vertexCount;
+	geometry.vertexStride = vertexStride;
+	geometry.indices = indices;
+	geometry.shortIndices = shortIndices;
+	geometry.primitiveCount = triangleCount;
+	geometry.hasTransform = transform != nullptr;
+	geometry.transform = transform ? *transform : XMMatrixIdentity( );
+	geometry.isOpaque = isOpaque;
+	m_geometries.push_back(geometry);
+}
+
+void CpuBlasGenerator::ComputeASBufferSizes(bool allowUpdate, uint64_t* scratchSizeInBytes, uint64_t* resultSizeInBytes) {
+	uint64_t primitiveCount = 0;
+	for (const auto& geometry : m_geometries) {
+		primitiveCount += geometry.primitiveCount;
+	}
+
+	// A binary tree over n references has at most 2n - 1 nodes; refits need nothing beyond the tree itself. Spatial
+	// splits keep the polygons in the scratch and add up to spatialSplitBudget references per primitive.
+	uint64_t polygonSize = 0;
+	uint64_t referenceCount = primitiveCount;
+	if (m_settings.mode == BvhBuildMode::SpatialSplits) {
+		polygonSize = 4 * sizeof(XMFLOAT3) + sizeof(uint8_t);
+		referenceCount += static_cast<uint64_t>(std::max(0.0f, m_settings.spatialSplitBudget) * primitiveCount);
+	}
+	m_allowUpdate = allowUpdate;
+	m_scratchSizeInBytes = std::max<uint64_t>(1, primitiveCount * (sizeof(Aabb) + sizeof(XMFLOAT3) + sizeof(uint64_t) + polygonSize));
+	m_resultSizeInBytes = std::max<uint64_t>(1, (2 * referenceCount) * sizeof(BvhNode) + referenceCount * sizeof(uint32_t)
+												+ m_geometries.size( ) * sizeof(CpuBlasGeometry));
+	*scratchSizeInBytes = m_scratchSizeInBytes;
+	*resultSizeInBytes = m_resultSizeInBytes;
+}
+
+void CpuBlasGenerator::Generate(BvhBuildInput& scratch, CpuBlas& result, ThreadPool* threadPool, bool updateOnly, const CpuBlas* previousResult) {
+	if (updateOnly && !m_allowUpdate) {
+		throw std::logic_error("Cannot update a bottom-level AS not originally built for updates");
+	}
+	if (updateOnly && previousResult == nullptr) {
+		throw std::logic_error("Bottom-level hierarchy update requires the previous hierarchy");
+	}
+	if (m_resultSizeInBytes == 0 || m_scratchSizeInBytes == 0) {
+		throw std::logic_error("Invalid scratch and result buffer sizes - ComputeASBufferSizes needs to be called before Build");
+	}
+
+	auto start = std::chrono::steady_clock::now( );
+	FillInput(scratch, threadPool);
+
+	if (updateOnly) {
+		if (previousResult != &result) {
+			result = *previousResult;
+		}
+		BvhBuilder::Refit(result.bvh, scratch);
+		result.stats.buildMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now( ) - start).count( );
+		BvhBuilder::Measure(result.bvh, m_settings, result.stats);
+		return;
+	}
+
+	result.bvh = BvhBuilder::Build(scratch, m_settings, threadPool, &result.stats);
+	result.stats.buildMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now( ) - start).count( );
+	result.allowUpdate = m_allowUpdate;
+	result.geometries.clear( );
+	uint32_t firstPrimitive = 0;
+	for (const auto& geometry : m_geometries) {
+		result.geometries.push_back({firstPrimitive, geometry.primitiveCount, geometry.aabbs != nullptr, geometry.isOpaque});
+		firstPrimitive += geometry.primitiveCount;
+	}
+}
+
+void CpuBlasGenerator::FillInput(BvhBuildInput& input, ThreadPool* threadPool) const {
+	auto parallelFor = [&](uint32_t count, const ThreadPool::RangeTask& task) {
+		if (threadPool) {
+			threadPool->ParallelFor(count, task, InputGrain);
+		} else if (count > 0) {
+			task(0, count);
+		}
+	};
+	auto position = [](const Geometry& geometry, uint32_t vertex) {
+		XMFLOAT3 p;
+		memcpy(&p, geometry.vertices + static_cast<size_t>(vertex) * geometry.vertexStride, sizeof(p));
+		return geometry.hasTransform ? XMVector3Transform(XMLoadFloat3(&p), geometry.transform) : XMLoadFloat3(&p);
+	};
+
+	// The Morton frame takes one pass over the vertices; the SAH builds do not need it, the linear one does.
+	std::mutex mergeMutex;
+	Aabb frame = Aabb::Empty( );
+	size_t primitiveCount = 0;
+	for (const auto& geometry : m_geometries) {
+		primitiveCount += geometry.primitiveCount;
+		uint32_t count = geometry.aabbs ? geometry.primitiveCount : geometry.vertexCount;
+		parallelFor(count, [&](uint32_t begin, uint32_t end) {
+			Aabb bounds = Aabb::Empty( );
+			for (uint32_t i = begin; i < end; i++) {
+				if (geometry.aabbs) {
+					bounds.Grow(geometry.aabbs[i]);
+				} else {
+					bounds.Grow(position(geometry, i));
+				}
+			}
+			std::lock_guard<std::mutex> lock(mergeMutex);
+			frame.Grow(bounds);
+		});
+	}
+
+	input.Reset(primitiveCount, frame, m_settings.mode == BvhBuildMode::SpatialSplits);
+	MortonEncoder encoder(frame);
+	size_t firstPrimitive = 0;
+	for (const auto& geometry : m_geometries) {
+		parallelFor(geometry.primitiveCount, [&](uint32_t begin, uint32_t end) {
+			BvhInputWriter writer(input, encoder, firstPrimitive + begin);
+			for (uint32_t primitive = begin; primitive < end; primitive++) {
+				if (geometry.aabbs) {
+					const Aabb& box = geometry.aabbs[primitive];
+					writer.AddBounds(box, (XMLoadFloat3(&box.min) + XMLoadFloat3(&box.max)) * 0.5f);
+					continue;
+				}
+				uint32_t corners[3];
+				for (uint32_t corner = 0; corner < 3; corner++) {
+					size_t i = 3 * static_cast<size_t>(primitive) + corner;
+					corners[corner] = geometry.indices ? GetIndex(geometry.indices, geometry.shortIndices, i) : static_cast<uint32_t>(i);
+				}
+				writer.AddTriangle(position(geometry, corners[0]), position(geometry, corners[1]), position(geometry, corners[2]));
+			}
+			std::lock_guard<std::mutex> lock(mergeMutex);
+			writer.Merge( );
+		});
+		firstPrimitive += geometry.primitiveCount;
+	}
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include "BvhBuilder.h"
+
+// One AddVertexBuffer or AddAabbBuffer call; GeometryIndex( ) is its position, PrimitiveIndex( ) counts from firstPrimitive.
+struct CpuBlasGeometry {
+	uint32_t firstPrimitive;
+	uint32_t primitiveCount;
+	bool procedural;
+	bool isOpaque;
+};
+
+// Bottom-level structure built on the CPU. The leaves of bvh refer to primitives counted across all geometries.
+struct CpuBlas {
+	Bvh bvh;
+	std::vector<CpuBlasGeometry> geometries;
+	BvhBuildStats stats;
+	bool allowUpdate = false;
+};
+
+// CPU counterpart of nv_helpers_dx12::BottomLevelASGenerator, over vertex and index arrays in memory. The
+// arrays are read again by every Generate, so they have to stay alive and in place until the last one.
+class CpuBlasGenerator {
+public:
+	// Non-indexed triangles. Every vertex is vertexStride bytes and starts with its float3 position; transform,
+	// if any, is applied to the positions.
+	void AddVertexBuffer(const void* vertices, uint32_t vertexCount, uint32_t vertexStride,
+						 const XMMATRIX* transform = nullptr, bool isOpaque = true);
+	void AddVertexBuffer(const void* vertices, uint32_t vertexCount, uint32_t vertexStride,
+						 const uint32_t* indices, uint32_t indexCount, const XMMATRIX* transform = nullptr, bool isOpaque = true);
+	void AddVertexBuffer(const void* vertices, uint32_t vertexCount, uint32_t vertexStride,
+						 const uint16_t* indices, uint32_t indexCount, const XMMATRIX* transform = nullptr, bool isOpaque = true);
+	// One procedural primitive per box, resolved by the intersection test of its hit group.
+	void AddAabbBuffer(const Aabb* aabbs, uint32_t aabbCount, bool isOpaque = true);
+
+	// Build mode, leaf size and SAH parameters of the next Generate; BvhBuildMode::Linear for geometry rebuilt often.
+	// Set before ComputeASBufferSizes, whose sizes depend on the mode.
+	void SetBuildSettings(const BvhBuildSettings& settings) { m_settings = settings; }
+
+	// Upper bounds of the memory a build takes: the BvhBuildInput it is handed as scratch and the CpuBlas.
+	void ComputeASBufferSizes(bool allowUpdate, uint64_t* scratchSizeInBytes, uint64_t* resultSizeInBytes);
+
+	// Builds the structure into result, or only refits the bounds of previousResult, which may be result itself,
+	// to the current vertex positions. build time and SAH cost end up in result.stats.
+	void Generate(BvhBuildInput& scratch, CpuBlas& result, ThreadPool* threadPool = nullptr,
+				  bool updateOnly = false, const CpuBlas* previousResult = nullptr);
+
+private:
+	struct Geometry {
+		const uint8_t* vertices;
+		uint32_t vertexCount;
+		uint32_t vertexStride;
+		const void* indices; // Null for non-indexed triangles and for boxes.
+		bool shortIndices;
+		uint32_t primitiveCount;
+		bool hasTransform;
+		XMMATRIX transform;
+		const Aabb* aabbs;   // Only for procedural geometry.
+		bool isOpaque;
+	};
+
+	void AddTriangles(const void* vertices, uint32_t vertexCount, uint32_t vertexStride, const void* indices, bool shortIndices,
+					  uint32_t triangleCount, const XMMATRIX* transform, bool isOpaque);
+	void FillInput(BvhBuildInput& input, ThreadPool* threadPool) const;
+
+	std::vector<Geometry> m_geometries;
+	BvhBuildSettings m_settings;
+	uint64_t m_scratchSizeInBytes = 0;
+	uint64_t m_resultSizeInBytes = 0;
+	bool m_allowUpdate = false;
+};
@@ -0,0 +1,951 @@
+#include "CpuRaytracer.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace {
+	const float PI = 3.1415926535f;
+	const float RayTMax = 100000.0f;
+	// Hit.hlsl samples the whole sphere around the normal, so a diffuse bounce is treated as a cone of about one radian.
+	const float DiffuseConeSpread = 1.0f;
+	// Entries the traversal stacks hold before they spill to the heap: every binary node pushes at most one
+	// child more than it pops, and every wide node Width - 1.
+	const uint32_t BinaryStackSize = 64;
+	const uint32_t WideStackSize = 256;
+
+	// Rays traced by the thread, read around each share of a Render.
+	thread_local uint64_t t_rayCount = 0;
+
+	float Frac(float value) {
+		return value - std::floor(value);
+	}
+
+	// Random( ) from Hit.hlsl.
+	float Random(XMFLOAT2 co) {
+		return Frac(std::sin(co.x * 4.9898f + co.y * 267.2433f) * 47321.5453f);
+	}
+
+	// Random( ) from RayGen.hlsl, which uses different constants and is centered on zero.
+	float RandomRayGen(XMFLOAT2 co) {
+		return 0.5f - Frac(std::sin(co.x * 12.9898f + co.y * 78.233f) * 43758.5453f);
+	}
+
+	XMFLOAT2 Add(XMFLOAT2 a, float b) {
+		return {a.x + b, a.y + b};
+	}
+
+	XMFLOAT2 Swizzle(XMFLOAT2 a) {
+		return {a.y, a.x};
+	}
+
+	XMVECTOR RandomPointOnSphere(XMFLOAT2 seed) {
+		float r1 = Random(Add(seed, 1.24554f));
+		float r2 = Random(Add(Swizzle(seed), 2.25544f));
+
+		float theta = 2 * PI * r1;
+		float phi = std::acos((2 * r2) - 1);
+		// Hit.hlsl computes the radius as pow(r3, 1 / 3), an integer division, so it is always 1.
+		float r = 1.0f;
+
+		return XMVectorSet(r * std::sin(phi) * std::cos(theta), r * std::sin(phi) * std::sin(theta), r * std::cos(phi), 0);
+	}
+
+	float Dot3(FXMVECTOR a, FXMVECTOR b) {
+		return XMVectorGetX(XMVector3Dot(a, b));
+	}
+
+	// Upper bound of how much the matrix stretches distances.
+	float MaxScale(FXMMATRIX m) {
+		return std::sqrt(std::max(std::max(Dot3(m.r[0], m.r[0]), Dot3(m.r[1], m.r[1])), Dot3(m.r[2], m.r[2])));
+	}
+
+	// Edge function of Woop et al. 2013 for the edge from a to b of a triangle in the frame of a ShearedRay: its
+	// sign is the side of the edge the ray passes on. The products of floats are exact in double, so the two
+	// triangles on an edge get exactly opposite values and no ray slips between them.
+	double EdgeFunction(const XMFLOAT3& a, const XMFLOAT3& b) {
+		return static_cast<double>(b.x) * a.y - static_cast<double>(b.y) * a.x;
+	}
+
+	// Stack of a traversal loop, in a local array as long as the tree is no deeper than it allows. None of the
+	// builders bounds the depth, so a degenerate tree, such as one over many coincident primitives, moves it to
+	// the heap instead of overflowing it. Push only stores, after Reserve has made room for the entries.
+	template <typename T, uint32_t Size>
+	class TraversalStack {
+	public:
+		TraversalStack( ) = default;
+		TraversalStack(const TraversalStack&) = delete;
+		TraversalStack& operator=(const TraversalStack&) = delete;
+
+		bool IsEmpty( ) const { return m_size == 0; }
+		uint32_t GetSize( ) const { return m_size; }
+		T& operator[](uint32_t i) { return m_data[i]; }
+
+		void Reserve(uint32_t count) {
+			if (m_size + count > m_capacity) {
+				Grow(count);
+			}
+		}
+		void Push(const T& value) { m_data[m_size++] = value; }
+		T Pop( ) { return m_data[--m_size]; }
+
+	private:
+		void Grow(uint32_t count) {
+			std::vector<T> heap(std::max(2 * m_capacity, m_size + count));
+			std::copy(m_data, m_data + m_size, heap.begin( ));
+			m_heap.swap(heap);
+			m_data = m_heap.data( );
+			m_capacity = static_cast<uint32_t>(m_heap.size( ));
+		}
+
+		T m_local[Size];
+		std::vector<T> m_heap;
+		T* m_data = m_local;
+		uint32_t m_capacity = Size;
+		uint32_t m_size = 0;
+	};
+
+	// The binary BVH loop of both levels. intersectLeaf(first, count) tests what a leaf covers, which may lower
+	// tMax, and returns whether it hit anything. Both children of an inner node are tested at once and the nearer
+	// one is visited first, so the closest hit comes early and prunes the rest.
+	template <typename IntersectLeaf>
+	bool TraverseBvh(const std::vector<BvhNode>& nodes, FXMVECTOR rayOrigin, FXMVECTOR rayDirection, const float& tMax, IntersectLeaf intersectLeaf) {
+		XMFLOAT3 origin, direction;
+		XMStoreFloat3(&origin, rayOrigin);
+		XMStoreFloat3(&direction, rayDirection);
+		XMFLOAT3 invDirection = {1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z};
+
+		bool negative[3] = {std::signbit(invDirection.x), std::signbit(invDirection.y), std::signbit(invDirection.z)};
+
+		// Distance at which the ray enters the box of node, or FLT_MAX if it misses it before tMax. The sign of the
+		// direction picks the near and far plane of each axis; one that is NaN, with the ray in its plane, is
+		// skipped by std::max and std::min, like in WideBvh::IntersectChildren.
+		auto enterBox = [&](const BvhNode& node) {
+			float tNear = -std::numeric_limits<float>::infinity( ), tFar = std::numeric_limits<float>::infinity( );
+			for (int axis = 0; axis < 3; axis++) {
+				float nearPlane = negative[axis] ? (&node.boundsMax.x)[axis] : (&node.boundsMin.x)[axis];
+				float farPlane = negative[axis] ? (&node.boundsMin.x)[axis] : (&node.boundsMax.x)[axis];
+				tNear = std::max(tNear, (nearPlane - (&origin.x)[axis]) * (&invDirection.x)[axis]);
+				tFar = std::min(tFar, (farPlane - (&origin.x)[axis]) * (&invDirection.x)[axis]);
+			}
+			tFar *= RobustExitScale;
+			return tNear <= tFar && tFar >= 0 && tNear < tMax ? tNear : FLT_MAX;
+		};
+
+		// Nodes wait on the stack with their entry distance, so those behind a hit found meanwhile are skipped.
+		struct Entry {
+			uint32_t node;
+			float tNear;
+		};
+		float rootNear = enterBox(nodes[0]);
+		if (rootNear == FLT_MAX) {
+			return false;
+		}
+
+		bool found = false;
+		TraversalStack<Entry, BinaryStackSize> stack;
+		stack.Reserve(1);
+		stack.Push({0, rootNear});
+
+		while (!stack.IsEmpty( )) {
+			Entry entry = stack.Pop( );
+			if (entry.tNear >= tMax) {
+				continue;
+			}
+			const BvhNode& node = nodes[entry.node];
+			if (node.count > 0) {
+				found |= intersectLeaf(node.leftFirst, node.count);
+				continue;
+			}
+
+			Entry near = {node.leftFirst, enterBox(nodes[node.leftFirst])};
+			Entry far = {node.leftFirst + 1, enterBox(nodes[node.leftFirst + 1])};
+			if (far.tNear < near.tNear) {
+				std::swap(near, far);
+			}
+			stack.Reserve(2);
+			if (far.tNear != FLT_MAX) {
+				stack.Push(far);
+			}
+			if (near.tNear != FLT_MAX) {
+				stack.Push(near);
+			}
+		}
+
+		return found;
+	}
+}
+
+CpuRaytracer::CpuRaytracer(uint32_t width, uint32_t height, uint32_t threadCount) :
+	m_width(width),
+	m_height(height),
+	m_threadPool(threadCount),
+	m_output(width * height, {0, 0, 0, 1}),
+	m_image(width * height, {0, 0, 0, 1}),
+	m_gradX(width * height, {0, 0, 0, 1}),
+	m_gradY(width * height, {0, 0, 0, 1}) {
+	m_camera = {XMMatrixIdentity( ), XMMatrixIdentity( ), XMMatrixIdentity( ), XMMatrixIdentity( )};
+}
+
+void CpuRaytracer::SetScene(const Scene& scene) {
+	m_meshes.clear( );
+	m_objects.clear( );
+	m_hitGroups.clear( );
+	m_levels.clear( ); // They point into the bottom levels of the meshes.
+	m_light = scene.light;
+
+	// Like CreateAccelerationStructures, every mesh is copied once, in object space, whatever the number of
+	// objects using it; the objects only keep their transforms, which the instances of the top level take.
+	size_t gridsBegin = scene.meshes.size( ) + scene.meshFiles.size( );
+	size_t shapesBegin = gridsBegin + scene.grids.size( );
+	std::vector<uint32_t> meshIndices(shapesBegin + scene.shapes.size( ), ~0u);
+
+	auto addMesh = [&](uint32_t sceneMesh) {
+		Mesh mesh;
+		mesh.shape = false;
+		mesh.shapeType = ShapeType::Sphere;
+
+		auto addLevel = [&](const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, float error) {
+			MeshGeometry geometry;
+			geometry.indices = indices;
+			geometry.vertices.resize(vertices.size( ));
+			geometry.bounds = Aabb::Empty( );
+			geometry.error = error;
+
+			for (size_t i = 0; i < vertices.size( ); i++) {
+				XMStoreFloat3(&geometry.vertices[i].Position, vertices[i].Position);
+				geometry.vertices[i].Normal = EncodeOctahedralNormal(vertices[i].Normal);
+				geometry.bounds.Grow(vertices[i].Position);
+			}
+			mesh.lods.push_back(std::move(geometry));
+		};
+
+		if (sceneMesh >= shapesBegin) {
+			// No triangles; BuildBottomLevel makes the unit shape its single primitive.
+			mesh.shape = true;
+			mesh.shapeType = scene.shapes[sceneMesh - shapesBegin].type;
+			MeshGeometry geometry;
+			geometry.bounds = {{-1, -1, -1}, {1, 1, 1}};
+			geometry.error = 0.0f;
+			mesh.lods.push_back(std::move(geometry));
+		} else if (sceneMesh >= gridsBegin) {
+			const GridObject& grid = scene.grids[sceneMesh - gridsBegin];
+			addLevel(grid.Vertices, { }, 0.0f);
+			mesh.lods.back( ).patches = grid.Patches;
+		} else if (sceneMesh >= scene.meshes.size( )) {
+			// Mapped meshes are already compact, so they are copied as they are.
+			const MeshFile& file = *scene.meshFiles[sceneMesh - scene.meshes.size( )];
+			const CompactVertex* vertices = file.GetVertices( );
+			MeshGeometry geometry;
+			geometry.vertices.assign(vertices, vertices + file.GetVertexCount( ));
+			geometry.indices.resize(file.GetIndexCount( ));
+			geometry.bounds = Aabb::Empty( );
+			geometry.error = 0.0f;
+
+			for (const auto& vertex : geometry.vertices) {
+				geometry.bounds.Grow(XMLoadFloat3(&vertex.Position));
+			}
+			if (file.GetIndexSize( ) == sizeof(uint32_t)) {
+				memcpy(geometry.indices.data( ), file.GetIndexData( ), geometry.indices.size( ) * sizeof(uint32_t));
+			} else {
+				const uint16_t* indices = static_cast<const uint16_t*>(file.GetIndexData( ));
+				std::copy(indices, indices + geometry.indices.size( ), geometry.indices.begin( ));
+			}
+			// Opening the file only checks its blocks, so the copy is range checked before the BVH input reads it.
+			if (!geometry.indices.empty( ) && *std::max_element(geometry.indices.begin( ), geometry.indices.end( )) >= geometry.vertices.size( )) {
+				throw std::runtime_error("Mesh file index out of range");
+			}
+			mesh.lods.push_back(std::move(geometry));
+		} else {
+			addLevel(scene.meshes[sceneMesh].Vertices, scene.meshes[sceneMesh].Indices, 0.0f);
+		}
+		if (sceneMesh < scene.lods.size( )) {
+			for (const auto& lod : scene.lods[sceneMesh]) {
+				addLevel(lod.mesh.Vertices, lod.mesh.Indices, lod.error);
+			}
+		}
+		m_meshes.push_back(std::move(mesh));
+	};
+
+	for (const auto& sceneObject : scene.objects) {
+		if (meshIndices[sceneObject.mesh] == ~0u) {
+			meshIndices[sceneObject.mesh] = static_cast<uint32_t>(m_meshes.size( ));
+			addMesh(sceneObject.mesh);
+		}
+
+		Object object;
+		object.mesh = meshIndices[sceneObject.mesh];
+		object.objectToWorld = sceneObject.modelMatrix;
+		if (sceneObject.mesh >= shapesBegin) {
+			object.objectToWorld = scene.shapes[sceneObject.mesh - shapesBegin].GetUnitTransform( ) * sceneObject.modelMatrix;
+		}
+		object.normalToWorld = XMMatrixTranspose(XMMatrixInverse(nullptr, object.objectToWorld));
+		m_objects.push_back(object);
+		m_hitGroups.push_back({object.mesh, sceneObject.material});
+	}
+}
+
+uint32_t CpuRaytracer::MeshGeometry::GetTriangleCount( ) const {
+	if (patches.empty( )) {
+		return static_cast<uint32_t>(indices.size( ) / 3);
+	}
+	return patches.back( ).FirstTriangle + 2 * patches.back( ).Parts.x * patches.back( ).Parts.y;
+}
+
+uint32_t CpuRaytracer::MeshGeometry::GetIndex(uint32_t triangle, uint32_t corner) const {
+	if (patches.empty( )) {
+		return indices[triangle * 3 + corner];
+	}
+	auto patch = std::upper_bound(patches.begin( ), patches.end( ), triangle, [](uint32_t t, const GridPatch& p) { return t < p.FirstTriangle; }) - 1;
+	return patch->GetIndex(triangle - patch->FirstTriangle, corner);
+}
+
+void CpuRaytracer::SetCamera(const CameraMatrices& camera) {
+	m_camera = camera;
+
+	// projection[1][1] is 1 / tan(fovY / 2), so this is the angle one pixel covers vertically.
+	m_pixelSpread = 2.0f / (XMVectorGetY(camera.projection.r[1]) * m_height);
+}
+
+void CpuRaytracer::BuildAccelerationStructure( ) {
+	size_t levelCount = 1;
+	for (auto& mesh : m_meshes) {
+		levelCount = std::max(levelCount, mesh.lods.size( ));
+		mesh.bottomLevels.assign(mesh.lods.size( ), { });
+		for (uint32_t lod = 0; lod < mesh.lods.size( ); lod++) {
+			BuildBottomLevel(mesh, lod, mesh.bottomLevels[lod]);
+		}
+	}
+
+	m_levels.assign(levelCount, { });
+	for (uint32_t lod = 0; lod < levelCount; lod++) {
+		BuildLevel(lod, m_levels[lod]);
+	}
+}
+
+void CpuRaytracer::BuildBottomLevel(const Mesh& object, uint32_t lod, BottomLevel& bottomLevel) {
+	const MeshGeometry& mesh = object.lods[lod];
+
+	// Every triangle is at most one primitive, so the input is sized for that and cut down at the end.
+	size_t maxPrimitives = object.shape ? 1 : mesh.GetTriangleCount( );
+	BvhBuildInput input;
+	input.Reset(maxPrimitives, mesh.bounds, m_bvhSettings.mode == BvhBuildMode::SpatialSplits);
+	MortonEncoder encoder(mesh.bounds);
+	BvhInputWriter writer(input, encoder, 0);
+	std::vector<Primitive>& primitives = bottomLevel.primitives;
+	primitives.reserve(maxPrimitives);
+
+	if (object.shape) {
+		// One AABB per shape, so PrimitiveIndex is 0 as in the DXR procedural geometry.
+		Primitive primitive = { };
+		primitive.primitive = static_cast<uint32_t>(object.shapeType);
+		primitive.quadPrimitive = ShapePrimitive;
+		primitives.push_back(primitive);
+		writer.AddBounds(mesh.bounds, XMVectorZero( ));
+	}
+
+	uint32_t triangleCount = object.shape ? 0 : mesh.GetTriangleCount( );
+	auto position = [&](uint32_t triangle, uint32_t corner) {
+		return XMLoadFloat3(&mesh.vertices[mesh.GetIndex(triangle, corner)].Position);
+	};
+
+	// CreatePlane, CreateBox and the sponge emit every cell as (a, b, c), (c, b, d) with d = b + c - a.
+	// The optimizer moves triangles but never rotates them, so the second half is found by its first edge.
+	std::vector<uint32_t> partner(triangleCount, NoQuad);
+	std::vector<bool> covered(triangleCount, false); // Second triangle of a quad, or part of a grid.
+	if (m_quadPrimitives) {
+		// A planar patch is a single primitive; the cell is only looked up from the hit, as in height field tracing.
+		for (const auto& patch : mesh.patches) {
+			auto vertex = [&](uint32_t col, uint32_t row) {
+				return XMLoadFloat3(&mesh.vertices[patch.FirstVertex + col * (patch.Parts.y + 1) + row].Position);
+			};
+			XMVECTOR v0 = vertex(0, 0);
+			XMVECTOR v1 = vertex(patch.Parts.x, 0);
+			XMVECTOR v2 = vertex(0, patch.Parts.y);
+			XMVECTOR v3 = vertex(patch.Parts.x, patch.Parts.y);
+			XMVECTOR e1 = v1 - v0;
+			XMVECTOR e2 = v2 - v0;
+			float scale = std::max(Dot3(e1, e1), Dot3(e2, e2));
+			bool planar = true;
+			for (uint32_t col = 0; col <= patch.Parts.x && planar; col++) {
+				for (uint32_t row = 0; row <= patch.Parts.y && planar; row++) {
+					XMVECTOR offset = vertex(col, row) - (v0 + e1 * (static_cast<float>(col) / patch.Parts.x) + e2 * (static_cast<float>(row) / patch.Parts.y));
+					planar = Dot3(offset, offset) <= 1e-10f * scale;
+				}
+			}
+			if (!planar) {
+				continue;
+			}
+
+			Primitive primitive;
+			XMStoreFloat3(&primitive.v0, v0);
+			XMStoreFloat3(&primitive.v1, v1);
+			XMStoreFloat3(&primitive.v2, v2);
+			XMStoreFloat3(&primitive.v3, v3);
+			primitive.primitive = patch.FirstTriangle;
+			primitive.quadPrimitive = patch.FirstTriangle + 1;
+			primitive.cells = patch.Parts;
+			primitives.push_back(primitive);
+			writer.AddQuad(v0, v1, v2, v3);
+			std::fill(covered.begin( ) + patch.FirstTriangle, covered.begin( ) + patch.FirstTriangle + 2 * patch.Parts.x * patch.Parts.y, true);
+		}
+
+		auto edgeKey = [](uint32_t a, uint32_t b) { return static_cast<uint64_t>(a) << 32 | b; };
+		std::unordered_map<uint64_t, uint32_t> firstEdges;
+		firstEdges.reserve(triangleCount);
+		for (uint32_t triangle = 0; triangle < triangleCount; triangle++) {
+			if (!covered[triangle]) {
+				firstEdges.emplace(edgeKey(mesh.GetIndex(triangle, 0), mesh.GetIndex(triangle, 1)), triangle);
+			}
+		}
+
+		for (uint32_t triangle = 0; triangle < triangleCount; triangle++) {
+			auto found = firstEdges.find(edgeKey(mesh.GetIndex(triangle, 2), mesh.GetIndex(triangle, 1)));
+			if (partner[triangle] != NoQuad || covered[triangle] || found == firstEdges.end( ) || found->second == triangle
+				|| partner[found->second] != NoQuad || covered[found->second]) {
+				continue;
+			}
+			XMVECTOR v0 = position(triangle, 0);
+			XMVECTOR e1 = position(triangle, 1) - v0;
+			XMVECTOR e2 = position(triangle, 2) - v0;
+			// Only parallelograms, up to rounding, so a quad keeps the bounds and cells of the planar ones.
+			XMVECTOR offset = position(found->second, 2) - (v0 + e1 + e2);
+			float scale = std::max(Dot3(e1, e1), Dot3(e2, e2));
+			if (Dot3(offset, offset) <= 1e-10f * scale) {
+				partner[triangle] = found->second;
+				covered[found->second] = true;
+			}
+		}
+	}
+
+	for (uint32_t triangle = 0; triangle < triangleCount; triangle++) {
+		if (covered[triangle]) {
+			continue;
+		}
+		XMVECTOR v0 = position(triangle, 0);
+		XMVECTOR v1 = position(triangle, 1);
+		XMVECTOR v2 = position(triangle, 2);
+
+		Primitive primitive = { };
+		XMStoreFloat3(&primitive.v0, v0);
+		XMStoreFloat3(&primitive.v1, v1);
+		XMStoreFloat3(&primitive.v2, v2);
+		primitive.primitive = triangle;
+		primitive.quadPrimitive = partner[triangle];
+		primitive.cells = {1, 1};
+		if (primitive.quadPrimitive == NoQuad) {
+			primitives.push_back(primitive);
+			writer.AddTriangle(v0, v1, v2);
+		} else {
+			XMVECTOR v3 = position(primitive.quadPrimitive, 2);
+			XMStoreFloat3(&primitive.v3, v3);
+			primitives.push_back(primitive);
+			writer.AddQuad(v0, v1, v2, v3);
+		}
+	}
+	writer.Merge( );
+	input.Truncate(writer.GetNext( ));
+
+	if (primitives.empty( )) {
+		return;
+	}
+
+	// The build only moves primitive numbers around; the primitives follow once, in leaf order, so the leaves
+	// need no primitiveOrder to refer to them.
+	Bvh& bvh = bottomLevel.blas.bvh;
+	bvh = BvhBuilder::Build(input, m_bvhSettings, &m_threadPool, &bottomLevel.blas.stats);
+	std::vector<Primitive> sortedPrimitives(bvh.primitiveOrder.size( ));
+	for (size_t i = 0; i < bvh.primitiveOrder.size( ); i++) {
+		sortedPrimitives[i] = primitives[bvh.primitiveOrder[i]];
+	}
+	primitives = std::move(sortedPrimitives);
+	bvh.primitiveOrder.clear( );
+	bottomLevel.blas.geometries = {{0, static_cast<uint32_t>(input.GetPrimitiveCount( )), object.shape, true}};
+	if (m_bvhWidth == 4) {
+		bottomLevel.nodes4 = CollapseBvh<4>(bvh.nodes);
+	} else if (m_bvhWidth == 8) {
+		bottomLevel.nodes8 = CollapseBvh<8>(bvh.nodes);
+	}
+}
+
+void CpuRaytracer::BuildLevel(uint32_t lod, AccelerationStructure& level) {
+	level.error = 0.0f;
+
+	// The CPU integrator runs the same closest hit for both ray types, so every object has a single hit group.
+	CpuTlasGenerator generator;
+	for (uint32_t i = 0; i < m_objects.size( ); i++) {
+		const Object& object = m_objects[i];
+		const Mesh& mesh = m_meshes[object.mesh];
+		size_t meshLod = std::min<size_t>(lod, mesh.lods.size( ) - 1);
+		generator.AddInstance(&mesh.bottomLevels[meshLod].blas, object.objectToWorld, i, i);
+		level.bottomLevels.push_back(&mesh.bottomLevels[meshLod]);
+		level.error = std::max(level.error, mesh.lods[meshLod].error * MaxScale(object.objectToWorld));
+	}
+
+	uint64_t scratchSizeInBytes, resultSizeInBytes, descriptorsSizeInBytes;
+	generator.ComputeASBufferSizes(false, &scratchSizeInBytes, &resultSizeInBytes, &descriptorsSizeInBytes);
+	BvhBuildInput scratch;
+	generator.Generate(scratch, level.tlas, &m_threadPool);
+
+	// Bottom levels shared by several levels of detail count in each of them.
+	level.stats = level.tlas.stats;
+	std::vector<const BottomLevel*> bottomLevels = level.bottomLevels;
+	std::sort(bottomLevels.begin( ), bottomLevels.end( ));
+	bottomLevels.erase(std::unique(bottomLevels.begin( ), bottomLevels.end( )), bottomLevels.end( ));
+	for (const BottomLevel* bottomLevel : bottomLevels) {
+		level.stats.buildMilliseconds += bottomLevel->blas.stats.buildMilliseconds;
+	}
+}
+
+size_t CpuRaytracer::GetPrimitiveCount(uint32_t lod) const {
+	size_t count = 0;
+	for (const auto& mesh : m_meshes) {
+		count += mesh.bottomLevels[std::min<size_t>(lod, mesh.bottomLevels.size( ) - 1)].primitives.size( );
+	}
+	return count;
+}
+
+uint32_t CpuRaytracer::SelectLod(const RayCone& cone) const {
+	if (!m_lodSelection.enabled) {
+		return 0;
+	}
+
+	float budget = cone.width * m_lodSelection.footprintScale;
+	uint32_t lod = 0;
+	while (lod + 1 < m_levels.size( ) && m_levels[lod + 1].error <= budget) {
+		lod++;
+	}
+	return lod;
+}
+
+bool CpuRaytracer::Intersect(const Ray& ray, uint32_t lod, Hit& hit) const {
+	if (m_levels.empty( ) || m_levels[lod].tlas.bvh.nodes.empty( )) {
+		return false;
+	}
+	t_rayCount++;
+	hit.t = RayTMax;
+
+	// Each instance gets the ray in object space, where t is the same, as ObjectRayOrigin and ObjectRayDirection.
+	const AccelerationStructure& level = m_levels[lod];
+	return TraverseBvh(level.tlas.bvh.nodes, ray.origin, ray.direction, hit.t, [&](uint32_t first, uint32_t count) {
+		bool found = false;
+		for (uint32_t i = first; i < first + count; i++) {
+			uint32_t index = level.tlas.bvh.primitiveOrder[i];
+			const CpuInstance& instance = level.tlas.instances[index];
+			Ray objectRay = {XMVector3TransformCoord(ray.origin, instance.worldToObject), XMVector3TransformNormal(ray.direction, instance.worldToObject)};
+			if (IntersectBottomLevel(*level.bottomLevels[index], objectRay, hit)) {
+				hit.instanceID = instance.instanceID;
+				hit.hitGroupIndex = instance.hitGroupIndex;
+				hit.lod = lod;
+				found = true;
+			}
+		}
+		return found;
+	});
+}
+
+bool CpuRaytracer::IntersectBottomLevel(const BottomLevel& bottomLevel, const Ray& ray, Hit& hit) const {
+	if (bottomLevel.blas.bvh.nodes.empty( )) {
+		return false;
+	}
+
+	// The largest component of the direction becomes z; swapping x and y when it is negative keeps the winding.
+	XMFLOAT3 origin, direction;
+	XMStoreFloat3(&origin, ray.origin);
+	XMStoreFloat3(&direction, ray.direction);
+	const float* d = &direction.x;
+	uint32_t kz = std::fabs(d[0]) > std::fabs(d[1]) ? (std::fabs(d[0]) > std::fabs(d[2]) ? 0 : 2) : (std::fabs(d[1]) > std::fabs(d[2]) ? 1 : 2);
+	uint32_t kx = (kz + 1) % 3;
+	uint32_t ky = (kx + 1) % 3;
+	if (d[kz] < 0) {
+		std::swap(kx, ky);
+	}
+	ShearedRay shearedRay = {origin, kx, ky, kz, {d[kx] / d[kz], d[ky] / d[kz], 1.0f / d[kz]}};
+
+	if (m_bvhWidth == 4) {
+		return IntersectWide(bottomLevel.nodes4, bottomLevel, ray, shearedRay, hit);
+	}
+	if (m_bvhWidth == 8) {
+		return IntersectWide(bottomLevel.nodes8, bottomLevel, ray, shearedRay, hit);
+	}
+	return TraverseBvh(bottomLevel.blas.bvh.nodes, ray.origin, ray.direction, hit.t, [&](uint32_t first, uint32_t count) {
+		return IntersectPrimitives(bottomLevel, ray, shearedRay, first, count, hit);
+	});
+}
+
+template <uint32_t Width>
+bool CpuRaytracer::IntersectWide(const std::vector<WideBvhNode<Width>>& nodes, const BottomLevel& bottomLevel, const Ray& ray,
+								 const ShearedRay& shearedRay, Hit& hit) const {
+	XMFLOAT3 origin, direction;
+	XMStoreFloat3(&origin, ray.origin);
+	XMStoreFloat3(&direction, ray.direction);
+	WideRay wideRay = {{origin.x, origin.y, origin.z}, {1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z}};
+
+	// A child with the distance at which the ray enters it, which may be past the closest hit by the time it comes up.
+	struct Entry {
+		uint32_t child;
+		uint32_t count;
+		float tNear;
+	};
+	TraversalStack<Entry, WideStackSize> stack;
+	stack.Reserve(1);
+	stack.Push({0, 0, -FLT_MAX});
+
+	bool found = false;
+	while (!stack.IsEmpty( )) {
+		Entry entry = stack.Pop( );
+		if (entry.tNear >= hit.t) {
+			continue;
+		}
+		if (entry.count > 0) {
+			found |= IntersectPrimitives(bottomLevel, ray, shearedRay, entry.child, entry.count, hit);
+			continue;
+		}
+
+		// The children entered go on the stack farthest first, so the nearest one comes off next.
+		const WideBvhNode<Width>& node = nodes[entry.child];
+		float tNear[Width];
+		uint32_t entered = WideBvh::IntersectChildren(node, wideRay, hit.t, tNear);
+		stack.Reserve(Width);
+		uint32_t first = stack.GetSize( );
+		for (uint32_t i = 0; i < Width; i++) {
+			if (!(entered & 1u << i)) {
+				continue;
+			}
+			Entry child = {node.child[i], node.count[i], tNear[i]};
+			uint32_t slot = stack.GetSize( );
+			stack.Push(child);
+			for (; slot > first && stack[slot - 1].tNear < child.tNear; slot--) {
+				stack[slot] = stack[slot - 1];
+			}
+			stack[slot] = child;
+		}
+	}
+	return found;
+}
+
+bool CpuRaytracer::IntersectPrimitives(const BottomLevel& bottomLevel, const Ray& ray, const ShearedRay& shearedRay, uint32_t first, uint32_t count,
+									   Hit& hit) const {
+	// Woop et al. 2013, "Watertight Ray/Triangle Intersection": in the frame of shearedRay the ray runs along z
+	// through the origin, which is inside a triangle if it is on the same side of all three edges. DXR does not
+	// cull back faces with RAY_FLAG_NONE, neither do we. A quad is its two triangles, which share the diagonal
+	// b, c; the corners are the vertices of the mesh, so the quads and triangles on an edge share it exactly.
+	auto shear = [&](const XMFLOAT3& vertex) {
+		float a[3] = {vertex.x - shearedRay.origin.x, vertex.y - shearedRay.origin.y, vertex.z - shearedRay.origin.z};
+		return XMFLOAT3{a[shearedRay.kx] - shearedRay.shear.x * a[shearedRay.kz], a[shearedRay.ky] - shearedRay.shear.y * a[shearedRay.kz],
+						shearedRay.shear.z * a[shearedRay.kz]};
+	};
+	// Triangle a, b, c with the edge functions u, v, w of the edges opposite its corners: the distance and the
+	// barycentrics of b and c if it is hit in front of hit.t.
+	auto intersectTriangle = [&](const XMFLOAT3& a, const XMFLOAT3& b, const XMFLOAT3& c, double u, double v, double w, float& t, XMFLOAT2& bary) {
+		if ((u < 0 || v < 0 || w < 0) && (u > 0 || v > 0 || w > 0)) {
+			return false;
+		}
+		double det = u + v + w;
+		if (det == 0) {
+			return false;
+		}
+		t = static_cast<float>((u * a.z + v * b.z + w * c.z) / det);
+		bary = {static_cast<float>(v / det), static_cast<float>(w / det)};
+		return t > 0 && t < hit.t;
+	};
+
+	bool found = false;
+	for (uint32_t i = first; i < first + count; i++) {
+		const Primitive& primitive = bottomLevel.primitives[i];
+		if (primitive.quadPrimitive == ShapePrimitive) {
+			float t;
+			XMVECTOR normal;
+			if (IntersectShape(static_cast<ShapeType>(primitive.primitive), ray, t, normal) && t < hit.t) {
+				hit.t = t;
+				hit.bary = {0, 0};
+				hit.primitive = 0;
+				XMStoreFloat3(&hit.normal, normal);
+				found = true;
+			}
+			continue;
+		}
+
+		XMFLOAT3 a = shear(primitive.v0);
+		XMFLOAT3 b = shear(primitive.v1);
+		XMFLOAT3 c = shear(primitive.v2);
+		double diagonal = EdgeFunction(b, c);
+		float t;
+		XMFLOAT2 bary;
+		bool second = false;
+		if (!intersectTriangle(a, b, c, diagonal, EdgeFunction(c, a), EdgeFunction(a, b), t, bary)) {
+			if (primitive.quadPrimitive == NoQuad) {
+				continue;
+			}
+			XMFLOAT3 d = shear(primitive.v3);
+			if (!intersectTriangle(d, c, b, -diagonal, EdgeFunction(b, d), EdgeFunction(d, c), t, bary)) {
+				continue;
+			}
+			second = true;
+		}
+
+		hit.t = t;
+		found = true;
+		if (primitive.cells.x == 1 && primitive.cells.y == 1) {
+			// bary holds the weights of c and b in the (d, c, b) triangle, which DXR indexes as (c, b, d).
+			hit.bary = second ? XMFLOAT2{bary.y, 1 - bary.x - bary.y} : bary;
+			hit.primitive = second ? primitive.quadPrimitive : primitive.primitive;
+			continue;
+		}
+
+		// A grid scales its (u, v), along v1 - v0 and v2 - v0, to its cells; the triangles of cell (col, row) are
+		// 2 * (col * cells.y + row) on.
+		float u = (second ? 1 - bary.x : bary.x) * primitive.cells.x;
+		float v = (second ? 1 - bary.y : bary.y) * primitive.cells.y;
+		uint32_t col = std::min(static_cast<uint32_t>(std::max(u, 0.0f)), primitive.cells.x - 1);
+		uint32_t row = std::min(static_cast<uint32_t>(std::max(v, 0.0f)), primitive.cells.y - 1);
+		u -= col;
+		v -= row;
+		uint32_t cell = 2 * (col * primitive.cells.y + row);
+		if (u + v <= 1) {
+			hit.bary = {u, v};
+			hit.primitive = primitive.primitive + cell;
+		} else {
+			// v0 + u e1 + v e2 in the (c, b, d) triangle, whose edges are e1 - e2 and e1 from c.
+			hit.bary = {1 - v, u + v - 1};
+			hit.primitive = primitive.quadPrimitive + cell;
+		}
+	}
+	return found;
+}
+
+// SphereIntersection and BoxIntersection of Shaders/Hit.hlsl, on a ray already in the space of the unit sphere or
+// the -1 to 1 cube: the nearest hit past the origin, so rays that start inside a shape hit it from within. The
+// normal stays in object space, as the vertex normals of meshes do, until the hit is shaded.
+bool CpuRaytracer::IntersectShape(ShapeType type, const Ray& ray, float& t, XMVECTOR& normal) {
+	XMVECTOR origin = ray.origin;
+	XMVECTOR direction = ray.direction;
+
+	if (type == ShapeType::Sphere) {
+		float a = Dot3(direction, direction);
+		float b = Dot3(origin, direction);
+		float c = Dot3(origin, origin) - 1;
+		float discriminant = b * b - a * c;
+		if (discriminant < 0) {
+			return false;
+		}
+		float root = std::sqrt(discriminant);
+		t = (-b - root) / a;
+		if (t <= 0) {
+			t = (-b + root) / a;
+		}
+		normal = origin + direction * t;
+	} else {
+		// The slab test of TraverseBvh. A ray parallel to the faces of an axis only has to start between them;
+		// in the plane of a face, 0 * infinity would make its distances NaN.
+		XMFLOAT3 o, d;
+		XMStoreFloat3(&o, origin);
+		XMStoreFloat3(&d, direction);
+		float tNear = -FLT_MAX, tFar = FLT_MAX;
+		for (int axis = 0; axis < 3; axis++) {
+			float axisOrigin = (&o.x)[axis];
+			float axisDirection = (&d.x)[axis];
+			if (axisDirection == 0) {
+				if (std::fabs(axisOrigin) > 1) {
+					return false;
+				}
+				continue;
+			}
+			float invDirection = 1.0f / axisDirection;
+			float t1 = (-1 - axisOrigin) * invDirection, t2 = (1 - axisOrigin) * invDirection;
+			tNear = std::max(tNear, std::min(t1, t2));
+			tFar = std::min(tFar, std::max(t1, t2));
+		}
+		if (tNear > tFar) {
+			return false;
+		}
+		t = tNear > 0 ? tNear : tFar;
+
+		// The face is the axis on which the hit point is farthest out.
+		XMFLOAT3 p = {o.x + d.x * t, o.y + d.y * t, o.z + d.z * t};
+		XMFLOAT3 a = {std::fabs(p.x), std::fabs(p.y), std::fabs(p.z)};
+		normal = a.x >= a.y && a.x >= a.z ? XMVectorSet(p.x > 0 ? 1.0f : -1.0f, 0, 0, 0)
+			: a.y >= a.z ? XMVectorSet(0, p.y > 0 ? 1.0f : -1.0f, 0, 0)
+			: XMVectorSet(0, 0, p.z > 0 ? 1.0f : -1.0f, 0);
+	}
+	if (t <= 0) {
+		return false;
+	}
+
+	return true;
+}
+
+XMVECTOR CpuRaytracer::Generate(XMFLOAT2 seed, XMFLOAT2 d) const {
+	XMVECTOR origin = XMVector4Transform(XMVectorSet(0, 0, 0, 1), m_camera.viewI);
+	XMVECTOR target = XMVector4Transform(XMVectorSet(d.x, -d.y, 1, 1), m_camera.projectionI);
+	XMVECTOR direction = XMVector4Transform(XMVectorSetW(target, 0), m_camera.viewI);
+
+	Ray ray = {origin, direction};
+	Hit hit;
+	if (!Intersect(ray, 0, hit)) {
+		return XMVectorSet(0, 0, 0, 1);
+	}
+	return ObjectClosestHit(ray, hit, 1, seed, {0.0f, m_pixelSpread});
+}
+
+XMVECTOR CpuRaytracer::CastRays(FXMVECTOR origin, FXMVECTOR direction, float depth, XMFLOAT2 seed, const RayCone& cone) const {
+	XMFLOAT2 payloadSeed = {Random(Add(seed, 1.174f)), Random(Add(Swizzle(seed), 871.15f))};
+
+	Ray ray = {origin, direction};
+	Hit hit;
+	if (!Intersect(ray, SelectLod(cone), hit)) {
+		return XMVectorSet(0, 0, 0, 1);
+	}
+	return ObjectClosestHit(ray, hit, depth, payloadSeed, cone);
+}
+
+XMVECTOR CpuRaytracer::ObjectClosestHit(const Ray& ray, const Hit& hit, float depth, XMFLOAT2 seed, const RayCone& cone) const {
+	if (depth >= 10) {
+		return XMVectorSet(0, 0, 0, 1);
+	}
+
+	const HitGroup& hitGroup = m_hitGroups[hit.hitGroupIndex];
+	const Material& material = hitGroup.material;
+	const Mesh& object = m_meshes[hitGroup.mesh];
+	const MeshGeometry& mesh = object.lods[std::min<size_t>(hit.lod, object.lods.size( ) - 1)];
+
+	// Camera rays are not normalized, so t is not the distance.
+	float hitConeWidth = cone.width + cone.spread * hit.t * XMVectorGetX(XMVector3Length(ray.direction));
+
+	XMVECTOR rayDir = XMVector3Normalize(ray.direction);
+	XMVECTOR hitLocation = ray.origin + ray.direction * hit.t;
+
+	XMVECTOR normal = XMLoadFloat3(&hit.normal);
+	if (!mesh.vertices.empty( )) {
+		normal = DecodeOctahedralNormal(mesh.vertices[mesh.GetIndex(hit.primitive, 0)].Normal) * (1.0f - hit.bary.x - hit.bary.y)
+			+ DecodeOctahedralNormal(mesh.vertices[mesh.GetIndex(hit.primitive, 1)].Normal) * hit.bary.x
+			+ DecodeOctahedralNormal(mesh.vertices[mesh.GetIndex(hit.primitive, 2)].Normal) * hit.bary.y;
+	}
+
+	normal = XMVector3Normalize(XMVector3TransformNormal(normal, m_objects[hit.instanceID].normalToWorld));
+	XMVECTOR normalCorrected = Dot3(rayDir, normal) < 0 ? normal : -normal;
+
+	XMVECTOR calculatedColor = XMVectorZero( );
+
+	if (material.type == static_cast<float>(MaterialType::Diffuse)) {
+		calculatedColor = DirectLight(hitLocation, normalCorrected, {seed.x * 2.78946f, seed.y * 2.78946f}, material, hit.lod);
+
+		XMVECTOR random = RandomPointOnSphere(Add(Swizzle(seed), 2.8754f));
+
+		XMVECTOR v = normalCorrected;
+		XMVECTOR u = XMVector3Cross(v, XMVectorSet(1, 0, 0, 0));
+		if (XMVectorGetX(XMVector3Length(u)) < 0.1f) {
+			u = XMVector3Cross(v, XMVectorSet(0, 0, 1, 0));
+		}
+		u = XMVector3Normalize(u);
+		XMVECTOR w = XMVector3Cross(u, v);
+
+		// mul(random, transpose(float3x3(u, v, w)))
+		XMVECTOR dir = XMVectorSet(Dot3(random, u), Dot3(random, v), Dot3(random, w), 0);
+
+		float p = 1 / (2 * PI);
+		float cos = Dot3(dir, normalCorrected);
+
+		XMVECTOR radiance = CastRays(hitLocation + normalCorrected * 0.01f, dir, depth + 1, Add(seed, 4.4879f), {hitConeWidth, DiffuseConeSpread}) * material.color * cos * p;
+
+		calculatedColor += material.emission + radiance;
+	}
+
+	if (material.type == static_cast<float>(MaterialType::Specular)) {
+		XMVECTOR reflectDir = rayDir - (normalCorrected * Dot3(normalCorrected, rayDir) * 2.0f);
+		calculatedColor += material.emission + material.color * CastRays(hitLocation + 0.01f * normalCorrected, reflectDir, depth + 1, Add(seed, 1.7894f), {hitConeWidth, cone.spread});
+	}
+
+	if (material.type == static_cast<float>(MaterialType::Light)) {
+		calculatedColor += material.emission;
+	}
+
+	return XMVectorSetW(calculatedColor, 1);
+}
+
+XMVECTOR CpuRaytracer::DirectLight(FXMVECTOR hitLocation, FXMVECTOR normal, XMFLOAT2 seed, const Material& material, uint32_t lod) const {
+	float radius = XMVectorGetX(XMVector3Length(m_light.size));
+	XMVECTOR lightPos = m_light.position + RandomPointOnSphere(seed) * radius;
+
+	Ray ray = {hitLocation + 0.001f * normal, XMVector3Normalize(lightPos - hitLocation)};
+	if (!TraceShadowRay(ray, lod)) {
+		return XMVectorZero( );
+	}
+
+	float cosTheta = std::max(Dot3(XMVector3Normalize(lightPos - hitLocation), XMVector3Normalize(normal)), 0.0f);
+	float dist = XMVectorGetX(XMVector3Length(lightPos - hitLocation));
+	dist *= dist;
+
+	if (dist < 0.0001f) {
+		dist = 0.0001f;
+	}
+
+	return material.color * cosTheta * (m_light.light / dist);
+}
+
+// ShadowClosestHit / ShadowMiss: only a closest hit on a light counts. Shadow rays use the level of the surface
+// they start on, so a coarser level cannot shadow the point it was cast from.
+bool CpuRaytracer::TraceShadowRay(const Ray& ray, uint32_t lod) const {
+	Hit hit;
+	if (!Intersect(ray, lod, hit)) {
+		return false;
+	}
+	return m_hitGroups[hit.hitGroupIndex].material.type == static_cast<float>(MaterialType::Light);
+}
+
+void CpuRaytracer::Render(uint32_t framesCount) {
+	m_rayCount = 0;
+	m_threadPool.ParallelFor(m_height, [&](uint32_t begin, uint32_t end) {
+		uint64_t rayCount = t_rayCount;
+		for (uint32_t y = begin; y < end; y++) {
+			RenderRow(y, framesCount);
+		}
+		m_rayCount += t_rayCount - rayCount;
+	});
+}
+
+void CpuRaytracer::RenderRow(uint32_t y, uint32_t framesCount) {
+	float nextFrameCount = static_cast<float>(framesCount + 1);
+	float frames = static_cast<float>(framesCount);
+
+	auto getD = [&](uint32_t x, float offsetX, float offsetY) {
+		return XMFLOAT2 {
+			((x + offsetX + 0.5f) / m_width) * 2.f - 1.f,
+			((y + offsetY + 0.5f) / m_height) * 2.f - 1.f
+		};
+	};
+
+	for (uint32_t x = 0; x < m_width; x++) {
+		size_t pixel = static_cast<size_t>(y) * m_width + x;
+
+		// InitRandom( )
+		XMFLOAT2 launchIndex = {static_cast<float>(x), static_cast<float>(y)};
+		float randLeft = RandomRayGen(Add(launchIndex, framesCount * 1.21568f));
+		float randRight = RandomRayGen(Add(Swizzle(launchIndex), framesCount * 4.68416f));
+		XMFLOAT2 rnd = {RandomRayGen({randLeft, randRight}), RandomRayGen({randRight, randLeft})};
+
+		if (framesCount == 1) {
+			m_output[pixel] = m_image[pixel] = m_gradX[pixel] = m_gradY[pixel] = {0, 0, 0, 1};
+		}
+
+		XMVECTOR c = Generate(rnd, getD(x, 0, 0));
+		XMVECTOR prevC = XMLoadFloat4(&m_image[pixel]) * frames;
+		XMStoreFloat4(&m_image[pixel], (c + prevC) / nextFrameCount);
+
+		XMVECTOR prevGx = XMLoadFloat4(&m_gradX[pixel]) * frames;
+
+		XMVECTOR cup = Generate(rnd, getD(x, 0, -1));
+		XMVECTOR cdown = Generate(rnd, getD(x, 0, 1));
+		XMVECTOR cleft = Generate(rnd, getD(x, -1, 0));
+		XMVECTOR cright = Generate(rnd, getD(x, 1, 0));
+
+		// RayGen.hlsl blends both gradients with the previous X gradient; kept identical so the outputs match.
+		XMStoreFloat4(&m_gradX[pixel], (prevGx + XMVectorAbs(cright - cleft) / 2) / nextFrameCount);
+		XMStoreFloat4(&m_gradY[pixel], (prevGx + XMVectorAbs(cdown - cup) / 2) / nextFrameCount);
+
+		m_output[pixel] = m_image[pixel];
+	}
+}
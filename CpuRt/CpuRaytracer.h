@@ -0,0 +1,212 @@
+#pragma once
+#include "../Camera.h"
+#include "../SceneTypes.h"
+#include "CpuTlasGenerator.h"
+#include "ThreadPool.h"
+#include "WideBvh.h"
+#include <atomic>
+#include <vector>
+
+// Level of detail selection for the CPU tracer. Every ray carries a cone: camera rays start with the
+// footprint of a pixel, and diffuse bounces widen it. A ray traces the coarsest level of the scene whose
+// world-space error is at most footprintScale times the width of its cone at the ray origin.
+struct LodSelection {
+	bool enabled = true;
+	float footprintScale = 1.0f;
+};
+
+// Headless path tracer running the integrator of Shaders/RayGen.hlsl, Hit.hlsl and ShadowRay.hlsl
+// on a thread pool. It consumes the same Scene that SceneBuilder produces for the DXR path, traces it
+// through the same two levels, a CpuBlas per mesh and a CpuTlas over the objects, and accumulates the
+// image and gradient buffers in memory instead of UAV textures.
+class CpuRaytracer {
+public:
+	CpuRaytracer(uint32_t width, uint32_t height, uint32_t threadCount = 0);
+
+	// Copies every mesh the objects use once, in object space. BuildAccelerationStructure must be called before rendering.
+	void SetScene(const Scene& scene);
+	void BuildAccelerationStructure( );
+	void SetCamera(const CameraMatrices& camera);
+	void SetLodSelection(const LodSelection& selection) { m_lodSelection = selection; }
+	// Triangle pairs that form a parallelogram, like the cells of ObjectCreator::CreatePlane, are traced as
+	// one quad, and planar Scene::grids patches as one primitive. Takes effect at the next BuildAccelerationStructure.
+	void SetQuadPrimitives(bool enabled) { m_quadPrimitives = enabled; }
+	// Of the bottom levels; takes effect at the next BuildAccelerationStructure. Binned SAH by default: on the
+	// default scene and the sponge of CoreBenchmark, spatial splits take about four times as long to build and
+	// lower the SAH cost by less than 0.5%.
+	void SetBvhBuildSettings(const BvhBuildSettings& settings) { m_bvhSettings = settings; }
+	// Children per BVH node while tracing: 2 traces the built tree as it is, 4 and 8 collapse it into nodes whose
+	// children are tested at once with SSE, or AVX2 where the build enables it. 4 by default: with SSE it was the
+	// fastest in CoreBenchmark, ahead of 2 by about 10% on the default scene and 30% on the sponge, and level with
+	// or slightly ahead of 8, whose nodes are mostly half empty. Takes effect at the next BuildAccelerationStructure.
+	void SetBvhWidth(uint32_t width) { m_bvhWidth = width; }
+
+	// Levels of detail of the scene; 1 when the scene has no LOD chains.
+	uint32_t GetLodLevelCount( ) const { return static_cast<uint32_t>(m_levels.size( )); }
+	size_t GetInstanceCount(uint32_t lod = 0) const { return m_levels[lod].tlas.instances.size( ); }
+	// Stored once per mesh, however many objects use it.
+	size_t GetPrimitiveCount(uint32_t lod = 0) const;
+	size_t GetBvhNodeCount(uint32_t lod = 0) const { return m_levels[lod].stats.nodeCount; }
+	// Of both levels together, as CpuTlas::stats; the build time also covers the bottom levels.
+	const BvhBuildStats& GetBvhStats(uint32_t lod = 0) const { return m_levels[lod].stats; }
+
+	// One DispatchRays worth of work. framesCount has the meaning of the FrameParams cbuffer:
+	// 1 restarts the accumulation, higher values blend into the previous frames.
+	void Render(uint32_t framesCount);
+	// Closest hit and shadow rays of the last Render.
+	uint64_t GetRayCount( ) const { return m_rayCount; }
+
+	uint32_t GetWidth( ) const { return m_width; }
+	uint32_t GetHeight( ) const { return m_height; }
+	uint32_t GetThreadCount( ) const { return m_threadPool.GetThreadCount( ); }
+
+	const std::vector<XMFLOAT4>& GetOutput( ) const { return m_output; }
+	const std::vector<XMFLOAT4>& GetImage( ) const { return m_image; }
+	const std::vector<XMFLOAT4>& GetGradX( ) const { return m_gradX; }
+	const std::vector<XMFLOAT4>& GetGradY( ) const { return m_gradY; }
+
+private:
+	struct Ray {
+		XMVECTOR origin;
+		XMVECTOR direction;
+	};
+
+	// A ray set up for the watertight triangle test of Woop et al. 2013: the axes are permuted so that z is the
+	// largest component of the direction, and the shear (x - shear.x z, y - shear.y z, shear.z z) takes the
+	// direction to (0, 0, 1). Made once per bottom level the ray enters.
+	struct ShearedRay {
+		XMFLOAT3 origin;
+		uint32_t kx, ky, kz;
+		XMFLOAT3 shear;
+	};
+
+	// Ray cone of the path so far: its width at the ray origin and its spread angle.
+	struct RayCone {
+		float width;
+		float spread;
+	};
+
+	// What DXR hands to the closest hit shader: RayTCurrent, the Attributes struct, PrimitiveIndex, InstanceID
+	// and the hit group the instance contributes.
+	struct Hit {
+		float t;
+		XMFLOAT2 bary;
+		uint32_t instanceID;
+		uint32_t hitGroupIndex;
+		uint32_t primitive;
+		uint32_t lod;
+		XMFLOAT3 normal; // Object-space ShapeAttributes of analytic shapes, which have no vertices to interpolate.
+	};
+
+	// Object-space vertices in the compact GPU layout; normals are decoded at the hit.
+	struct MeshGeometry {
+		std::vector<CompactVertex> vertices;
+		std::vector<uint32_t> indices;
+		std::vector<GridPatch> patches; // Instead of indices for Scene::grids.
+		Aabb bounds;
+		float error; // Object-space distance to the full resolution surface.
+
+		uint32_t GetTriangleCount( ) const;
+		uint32_t GetIndex(uint32_t triangle, uint32_t corner) const;
+	};
+
+	// A triangle v0, v1, v2, or the quad that also covers v3: the triangle pair (v0, v1, v2), (v2, v1, v3) of
+	// the index buffer, or a planar GridPatch, whose corners these are, split into cells x cells such pairs.
+	// Hits report the triangle and barycentrics DXR would, so shading is the same for all three.
+	struct Primitive {
+		XMFLOAT3 v0;
+		XMFLOAT3 v1;
+		XMFLOAT3 v2;
+		XMFLOAT3 v3;    // Unused for triangles.
+		uint32_t primitive;
+		uint32_t quadPrimitive; // The (c, b, d) triangle of the first cell, NoQuad for triangles.
+		XMUINT2 cells;
+	};
+	static constexpr uint32_t NoQuad = ~0u;
+	// quadPrimitive of analytic shapes, whose primitive is their ShapeType; the other members are unused.
+	static constexpr uint32_t ShapePrimitive = ~0u - 1;
+
+	// One level of detail of a mesh: the CpuBlas its instances refer to, with the primitives its leaves cover.
+	struct BottomLevel {
+		CpuBlas blas;
+		std::vector<Primitive> primitives; // In leaf order, so leaves refer to them directly.
+		// The nodes collapsed for the BVH width, if it is 4 or 8; their leaves are those of blas.
+		std::vector<WideBvhNode<4>> nodes4;
+		std::vector<WideBvhNode<8>> nodes8;
+	};
+
+	// lods[0] is the full resolution mesh. A Scene::shapes entry has a single empty level and is traced as
+	// the unit sphere or the -1 to 1 cube, which its instances scale, as the DXR intersection shaders do.
+	struct Mesh {
+		std::vector<MeshGeometry> lods;
+		std::vector<BottomLevel> bottomLevels; // Of lods, made by BuildAccelerationStructure.
+		bool shape;
+		ShapeType shapeType;
+	};
+
+	// A SceneObject as its instances see it; objectToWorld includes the unit transform of shapes.
+	struct Object {
+		uint32_t mesh;
+		XMMATRIX objectToWorld;
+		XMMATRIX normalToWorld; // Transpose of the inverse of objectToWorld.
+	};
+
+	// The shader record of an object, as CreateShaderBindingTable fills it: the buffers of its mesh and its material.
+	struct HitGroup {
+		uint32_t mesh;
+		Material material;
+	};
+
+	// The whole scene at one level of detail: an instance per object, of its mesh at that level or at its coarsest.
+	struct AccelerationStructure {
+		CpuTlas tlas;
+		std::vector<const BottomLevel*> bottomLevels; // Of tlas.instances.
+		float error; // Largest world-space error of the instances in it.
+		BvhBuildStats stats;
+	};
+
+	// Fills the BVH input while the primitives are made, so the build never reads the vertices again.
+	void BuildBottomLevel(const Mesh& mesh, uint32_t lod, BottomLevel& bottomLevel);
+	void BuildLevel(uint32_t lod, AccelerationStructure& level);
+	static bool IntersectShape(ShapeType type, const Ray& ray, float& t, XMVECTOR& normal);
+
+	uint32_t SelectLod(const RayCone& cone) const;
+	// Through the top level to every instance entered; its bottom level is traced with the ray in object space.
+	bool Intersect(const Ray& ray, uint32_t lod, Hit& hit) const;
+	bool IntersectBottomLevel(const BottomLevel& bottomLevel, const Ray& ray, Hit& hit) const;
+	// Front to back: the children a node is entered by are visited nearest first.
+	template <uint32_t Width>
+	bool IntersectWide(const std::vector<WideBvhNode<Width>>& nodes, const BottomLevel& bottomLevel, const Ray& ray, const ShearedRay& shearedRay, Hit& hit) const;
+	bool IntersectPrimitives(const BottomLevel& bottomLevel, const Ray& ray, const ShearedRay& shearedRay, uint32_t first, uint32_t count, Hit& hit) const;
+
+	XMVECTOR Generate(XMFLOAT2 seed, XMFLOAT2 d) const;
+	XMVECTOR CastRays(FXMVECTOR origin, FXMVECTOR direction, float depth, XMFLOAT2 seed, const RayCone& cone) const;
+	XMVECTOR ObjectClosestHit(const Ray& ray, const Hit& hit, float depth, XMFLOAT2 seed, const RayCone& cone) const;
+	XMVECTOR DirectLight(FXMVECTOR hitLocation, FXMVECTOR normal, XMFLOAT2 seed, const Material& material, uint32_t lod) const;
+	bool TraceShadowRay(const Ray& ray, uint32_t lod) const;
+
+	void RenderRow(uint32_t y, uint32_t framesCount);
+
+	uint32_t m_width;
+	uint32_t m_height;
+	ThreadPool m_threadPool;
+
+	std::vector<Mesh> m_meshes;
+	std::vector<Object> m_objects;     // Indexed by InstanceID( ).
+	std::vector<HitGroup> m_hitGroups; // Indexed by the hit group of the instance.
+	Light m_light = {};
+	CameraMatrices m_camera;
+	float m_pixelSpread = 0; // Spread angle of the camera ray cones.
+	LodSelection m_lodSelection;
+	bool m_quadPrimitives = true;
+	BvhBuildSettings m_bvhSettings = {4, 16, 1.0f, BvhBuildMode::BinnedSah};
+	uint32_t m_bvhWidth = 4;
+	std::atomic<uint64_t> m_rayCount = 0;
+
+	std::vector<AccelerationStructure> m_levels;
+
+	std::vector<XMFLOAT4> m_output;
+	std::vector<XMFLOAT4> m_image;
+	std::vector<XMFLOAT4> m_gradX;
+	std::vector<XMFLOAT4> m_gradY;
+};
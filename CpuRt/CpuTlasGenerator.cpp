@@ -0,0 +1,136 @@
+#include "CpuTlasGenerator.h"
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+
+void CpuTlasGenerator::AddInstance(const CpuBlas* bottomLevelAS, const XMMATRIX& transform, uint32_t instanceID, uint32_t hitGroupIndex) {
+	CpuInstance instance;
+	instance.objectToWorld = transform;
+	instance.worldToObject = XMMatrixInverse(nullptr, transform);
+	instance.bounds = Aabb::Empty( );
+	instance.bottomLevelAS = bottomLevelAS;
+	instance.instanceID = instanceID;
+	instance.hitGroupIndex = hitGroupIndex;
+	m_instances.push_back(instance);
+}
+
+void CpuTlasGenerator::ComputeASBufferSizes(bool allowUpdate, uint64_t* scratchSizeInBytes, uint64_t* resultSizeInBytes,
+											uint64_t* descriptorsSizeInBytes) {
+	// Instances are never split, so the tree is at most 2n - 1 nodes over n references.
+	uint64_t instanceCount = m_instances.size( );
+	m_allowUpdate = allowUpdate;
+	m_scratchSizeInBytes = std::max<uint64_t>(1, instanceCount * (sizeof(Aabb) + sizeof(XMFLOAT3) + sizeof(uint64_t)));
+	m_resultSizeInBytes = std::max<uint64_t>(1, 2 * instanceCount * sizeof(BvhNode) + instanceCount * sizeof(uint32_t));
+	m_descriptorsSizeInBytes = std::max<uint64_t>(1, instanceCount * sizeof(CpuInstance));
+	*scratchSizeInBytes = m_scratchSizeInBytes;
+	*resultSizeInBytes = m_resultSizeInBytes;
+	*descriptorsSizeInBytes = m_descriptorsSizeInBytes;
+}
+
+void CpuTlasGenerator::Generate(BvhBuildInput& scratch, CpuTlas& result, ThreadPool* threadPool, bool updateOnly, const CpuTlas* previousResult) {
+	if (updateOnly && !m_allowUpdate) {
+		throw std::logic_error("Cannot update a top-level AS not originally built for updates");
+	}
+	if (updateOnly && previousResult == nullptr) {
+		throw std::logic_error("Top-level hierarchy update requires the previous hierarchy");
+	}
+	if (updateOnly && previousResult->instances.size( ) != m_instances.size( )) {
+		throw std::logic_error("Top-level hierarchy update requires the same instances");
+	}
+	if (m_resultSizeInBytes == 0 || m_scratchSizeInBytes == 0 || m_descriptorsSizeInBytes == 0) {
+		throw std::logic_error("Invalid scratch and result buffer sizes - ComputeASBufferSizes needs to be called before Build");
+	}
+
+	auto start = std::chrono::steady_clock::now( );
+	FillInput(scratch);
+
+	if (updateOnly) {
+		if (previousResult != &result) {
+			result.bvh = previousResult->bvh;
+			result.allowUpdate = previousResult->allowUpdate;
+		}
+		result.instances = m_instances;
+		BvhBuilder::Refit(result.bvh, scratch);
+		result.stats.buildMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now( ) - start).count( );
+		Measure(result);
+		return;
+	}
+
+	result.bvh = m_instances.empty( ) ? Bvh{ } : BvhBuilder::Build(scratch, m_settings, threadPool);
+	result.stats.buildMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now( ) - start).count( );
+	result.instances = m_instances;
+	result.allowUpdate = m_allowUpdate;
+	Measure(result);
+}
+
+void CpuTlasGenerator::FillInput(BvhBuildInput& input) {
+	// The box of the bottom-level root, transformed by its center and half extents: each world axis gets the
+	// absolute value of the matrix times the extents.
+	Aabb frame = Aabb::Empty( );
+	for (auto& instance : m_instances) {
+		instance.bounds = Aabb::Empty( );
+		const std::vector<BvhNode>& nodes = instance.bottomLevelAS->bvh.nodes;
+		if (nodes.empty( )) {
+			continue;
+		}
+		XMVECTOR boundsMin = XMLoadFloat3(&nodes[0].boundsMin);
+		XMVECTOR boundsMax = XMLoadFloat3(&nodes[0].boundsMax);
+		XMFLOAT3 extent;
+		XMStoreFloat3(&extent, (boundsMax - boundsMin) * 0.5f);
+		const XMMATRIX& m = instance.objectToWorld;
+		XMVECTOR center = XMVector3TransformCoord((boundsMin + boundsMax) * 0.5f, m);
+		XMVECTOR worldExtent = XMVectorAbs(m.r[0]) * extent.x + XMVectorAbs(m.r[1]) * extent.y + XMVectorAbs(m.r[2]) * extent.z;
+		instance.bounds.Grow(center - worldExtent);
+		instance.bounds.Grow(center + worldExtent);
+		frame.Grow(instance.bounds);
+	}
+
+	// An instance of an empty bottom level still takes a leaf, as a point at the corner of the frame.
+	if (frame.IsEmpty( )) {
+		frame = {{0, 0, 0}, {0, 0, 0}};
+	}
+	input.Reset(m_instances.size( ), frame);
+	MortonEncoder encoder(frame);
+	BvhInputWriter writer(input, encoder, 0);
+	for (const auto& instance : m_instances) {
+		Aabb bounds = instance.bounds.IsEmpty( ) ? Aabb{frame.min, frame.min} : instance.bounds;
+		writer.AddBounds(bounds, (XMLoadFloat3(&bounds.min) + XMLoadFloat3(&bounds.max)) * 0.5f);
+	}
+	writer.Merge( );
+}
+
+void CpuTlasGenerator::Measure(CpuTlas& result) const {
+	double buildMilliseconds = result.stats.buildMilliseconds;
+	BvhBuilder::Measure(result.bvh, m_settings, result.stats);
+	result.stats.buildMilliseconds = buildMilliseconds;
+	if (result.bvh.nodes.empty( )) {
+		return;
+	}
+
+	// Instance tests are the root visits of their bottom levels, so the top level only adds its node visits.
+	const BvhNode& root = result.bvh.nodes[0];
+	float rootArea = Aabb{root.boundsMin, root.boundsMax}.SurfaceArea( );
+	double visits = result.stats.nodeVisits;
+	double tests = 0.0;
+	uint32_t bottomDepth = 0;
+	std::vector<const CpuBlas*> distinct;
+	for (const auto& instance : result.instances) {
+		const BvhBuildStats& bottom = instance.bottomLevelAS->stats;
+		float probability = rootArea > 0 ? instance.bounds.SurfaceArea( ) / rootArea : 1.0f;
+		visits += probability * bottom.nodeVisits;
+		tests += probability * bottom.primitiveTests;
+		bottomDepth = std::max(bottomDepth, bottom.depth);
+		distinct.push_back(instance.bottomLevelAS);
+	}
+	std::sort(distinct.begin( ), distinct.end( ));
+	distinct.erase(std::unique(distinct.begin( ), distinct.end( )), distinct.end( ));
+	for (const CpuBlas* bottomLevelAS : distinct) {
+		result.stats.referenceCount += bottomLevelAS->stats.referenceCount;
+		result.stats.nodeCount += bottomLevelAS->stats.nodeCount;
+		result.stats.leafCount += bottomLevelAS->stats.leafCount;
+	}
+	result.stats.depth += bottomDepth;
+	result.stats.nodeVisits = static_cast<float>(visits);
+	result.stats.primitiveTests = static_cast<float>(tests);
+	result.stats.sahCost = static_cast<float>(m_settings.traversalCost * visits + tests);
+}
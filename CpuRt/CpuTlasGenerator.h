@@ -0,0 +1,56 @@
+#pragma once
+#include "CpuBlasGenerator.h"
+
+// D3D12_RAYTRACING_INSTANCE_DESC of a CpuTlas, with the inverse transform cached: rays are moved into object
+// space, where t stays the same, instead of moving the bottom level into world space.
+struct CpuInstance {
+	XMMATRIX objectToWorld;
+	XMMATRIX worldToObject;
+	Aabb bounds;                 // World-space box around the bottom level.
+	const CpuBlas* bottomLevelAS;
+	uint32_t instanceID;         // InstanceID( ) of the hits.
+	uint32_t hitGroupIndex;      // InstanceContributionToHitGroupIndex of the hits.
+};
+
+// Top-level structure built on the CPU. The leaves of bvh refer to instances, which stay in AddInstance order, so
+// a position in instances is the InstanceIndex( ) of its hits.
+struct CpuTlas {
+	Bvh bvh;
+	std::vector<CpuInstance> instances;
+	// Of both levels together: counts over the top level and every distinct bottom level, and the SAH terms of a
+	// ray that enters the top level, which enters each instance with the probability of hitting its world box.
+	// buildMilliseconds only covers the top level, which does not rebuild the bottom ones.
+	BvhBuildStats stats;
+	bool allowUpdate = false;
+};
+
+// CPU counterpart of nv_helpers_dx12::TopLevelASGenerator. Bottom levels are referenced, not copied, so an
+// instance costs the same whatever its geometry; they have to stay alive and in place while the result is used.
+class CpuTlasGenerator {
+public:
+	void AddInstance(const CpuBlas* bottomLevelAS, const XMMATRIX& transform, uint32_t instanceID, uint32_t hitGroupIndex);
+
+	// Build mode and SAH parameters of the next Generate. Every instance costs a transform and a bottom-level
+	// traversal, so the default leaves hold a single instance.
+	void SetBuildSettings(const BvhBuildSettings& settings) { m_settings = settings; }
+
+	// Upper bounds of the memory a build takes: the BvhBuildInput it is handed as scratch, the tree of the CpuTlas
+	// and its instance descriptors.
+	void ComputeASBufferSizes(bool allowUpdate, uint64_t* scratchSizeInBytes, uint64_t* resultSizeInBytes, uint64_t* descriptorsSizeInBytes);
+
+	// Builds the structure into result, or only refits the bounds of previousResult, which may be result itself,
+	// to the current instance transforms; the instances must be the same, in the same order.
+	void Generate(BvhBuildInput& scratch, CpuTlas& result, ThreadPool* threadPool = nullptr,
+				  bool updateOnly = false, const CpuTlas* previousResult = nullptr);
+
+private:
+	void FillInput(BvhBuildInput& input);
+	void Measure(CpuTlas& result) const;
+
+	std::vector<CpuInstance> m_instances;
+	BvhBuildSettings m_settings = {1, 16, 1.0f, BvhBuildMode::BinnedSah};
+	uint64_t m_scratchSizeInBytes = 0;
+	uint64_t m_resultSizeInBytes = 0;
+	uint64_t m_descriptorsSizeInBytes = 0;
+	bool m_allowUpdate = false;
+};
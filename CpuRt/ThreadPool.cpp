@@ -0,0 +1,85 @@
+#include "ThreadPool.h"
+#include <algorithm>
+
+ThreadPool::ThreadPool(uint32_t threadCount) {
+	if (threadCount == 0) {
+		threadCount = std::max(1u, std::thread::hardware_concurrency( ));
+	}
+
+	for (uint32_t i = 1; i < threadCount; i++) {
+		m_workers.emplace_back(&ThreadPool::WorkerLoop, this);
+	}
+}
+
+ThreadPool::~ThreadPool( ) {
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_wakeWorkers.notify_all( );
+
+	for (auto& worker : m_workers) {
+		worker.join( );
+	}
+}
+
+void ThreadPool::ParallelFor(uint32_t count, const RangeTask& task, uint32_t grainSize) {
+	if (count == 0) {
+		return;
+	}
+
+	grainSize = std::max(1u, grainSize);
+	if (m_workers.empty( ) || count <= grainSize) {
+		task(0, count);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_task = &task;
+		m_count = count;
+		m_grainSize = grainSize;
+		m_nextChunk = 0;
+		m_busyWorkers = static_cast<uint32_t>(m_workers.size( ));
+		m_generation++;
+	}
+	m_wakeWorkers.notify_all( );
+
+	RunChunks( );
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_jobDone.wait(lock, [this] { return m_busyWorkers == 0; });
+	m_task = nullptr;
+}
+
+void ThreadPool::WorkerLoop( ) {
+	uint64_t seenGeneration = 0;
+
+	while (true) {
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_wakeWorkers.wait(lock, [&] { return m_stop || m_generation != seenGeneration; });
+			if (m_stop) {
+				return;
+			}
+			seenGeneration = m_generation;
+		}
+
+		RunChunks( );
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (--m_busyWorkers == 0) {
+			m_jobDone.notify_one( );
+		}
+	}
+}
+
+void ThreadPool::RunChunks( ) {
+	uint32_t chunkCount = (m_count + m_grainSize - 1) / m_grainSize;
+
+	for (uint32_t chunk = m_nextChunk++; chunk < chunkCount; chunk = m_nextChunk++) {
+		uint32_t begin = chunk * m_grainSize;
+		uint32_t end = std::min(m_count, begin + m_grainSize);
+		(*m_task)(begin, end);
+	}
+}
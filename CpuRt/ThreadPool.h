@@ -0,0 +1,47 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads that split index ranges between themselves.
+// The calling thread takes part in the work, so a pool of one thread runs everything inline.
+// ParallelFor is not reentrant: tasks must not call back into the same pool.
+class ThreadPool {
+public:
+	using RangeTask = std::function<void(uint32_t begin, uint32_t end)>;
+
+	explicit ThreadPool(uint32_t threadCount = 0);
+	~ThreadPool( );
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	uint32_t GetThreadCount( ) const { return static_cast<uint32_t>(m_workers.size( )) + 1; }
+
+	// Calls task on consecutive [begin, end) chunks of at most grainSize indices until [0, count) is covered.
+	// Returns once every chunk has finished.
+	void ParallelFor(uint32_t count, const RangeTask& task, uint32_t grainSize = 1);
+
+private:
+	void WorkerLoop( );
+	void RunChunks( );
+
+	std::vector<std::thread> m_workers;
+
+	std::mutex m_mutex;
+	std::condition_variable m_wakeWorkers;
+	std::condition_variable m_jobDone;
+
+	const RangeTask* m_task = nullptr;
+	uint32_t m_count = 0;
+	uint32_t m_grainSize = 1;
+	uint64_t m_generation = 0;
+	uint32_t m_busyWorkers = 0;
+	bool m_stop = false;
+
+	std::atomic<uint32_t> m_nextChunk {0};
+};
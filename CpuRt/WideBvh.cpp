@@ -0,0 +1,78 @@
+#include "WideBvh.h"
+#include <limits>
+
+template <uint32_t Width>
+std::vector<WideBvhNode<Width>> CollapseBvh(const std::vector<BvhNode>& nodes) {
+	std::vector<WideBvhNode<Width>> wideNodes;
+	if (nodes.empty( )) {
+		return wideNodes;
+	}
+
+	auto halfArea = [&](uint32_t node) {
+		XMFLOAT3 e = {nodes[node].boundsMax.x - nodes[node].boundsMin.x, nodes[node].boundsMax.y - nodes[node].boundsMin.y,
+					  nodes[node].boundsMax.z - nodes[node].boundsMin.z};
+		return e.x * e.y + e.y * e.z + e.z * e.x;
+	};
+
+	// Binary nodes waiting to be collapsed into the wide node they are paired with.
+	std::vector<std::pair<uint32_t, uint32_t>> stack = {{0, 0}};
+	wideNodes.emplace_back( );
+	while (!stack.empty( )) {
+		auto [binary, wide] = stack.back( );
+		stack.pop_back( );
+
+		uint32_t children[Width];
+		uint32_t childCount = 0;
+		if (nodes[binary].count > 0) {
+			// Only a root can be a leaf here; it becomes the single child of the wide root.
+			children[childCount++] = binary;
+		} else {
+			children[childCount++] = nodes[binary].leftFirst;
+			children[childCount++] = nodes[binary].leftFirst + 1;
+			while (childCount < Width) {
+				int largest = -1;
+				float largestArea = -1.0f;
+				for (uint32_t i = 0; i < childCount; i++) {
+					if (nodes[children[i]].count == 0 && halfArea(children[i]) > largestArea) {
+						largest = static_cast<int>(i);
+						largestArea = halfArea(children[i]);
+					}
+				}
+				if (largest < 0) {
+					break;
+				}
+				uint32_t opened = children[largest];
+				children[largest] = nodes[opened].leftFirst;
+				children[childCount++] = nodes[opened].leftFirst + 1;
+			}
+		}
+
+		WideBvhNode<Width> node;
+		const float infinity = std::numeric_limits<float>::infinity( );
+		for (uint32_t i = 0; i < Width; i++) {
+			const BvhNode* source = i < childCount ? &nodes[children[i]] : nullptr;
+			for (int axis = 0; axis < 3; axis++) {
+				node.boundsMin[axis][i] = source ? (&source->boundsMin.x)[axis] : infinity;
+				node.boundsMax[axis][i] = source ? (&source->boundsMax.x)[axis] : -infinity;
+			}
+			node.child[i] = 0;
+			node.count[i] = 0;
+			if (!source) {
+				continue;
+			}
+			if (source->count > 0) {
+				node.child[i] = source->leftFirst;
+				node.count[i] = source->count;
+			} else {
+				node.child[i] = static_cast<uint32_t>(wideNodes.size( ));
+				wideNodes.emplace_back( );
+				stack.push_back({children[i], node.child[i]});
+			}
+		}
+		wideNodes[wide] = node;
+	}
+	return wideNodes;
+}
+
+template std::vector<WideBvhNode<4>> CollapseBvh<4>(const std::vector<BvhNode>& nodes);
+template std::vector<WideBvhNode<8>> CollapseBvh<8>(const std::vector<BvhNode>& nodes);
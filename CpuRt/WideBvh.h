@@ -0,0 +1,119 @@
+#pragma once
+#include "BvhBuilder.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <limits>
+#if defined(_M_X64) || defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+// BVH node with up to Width children, whose bounds are stored axis by axis so that one load fetches the same
+// plane of every child. Unused slots have empty bounds, min +infinity and max -infinity, which no ray enters.
+template <uint32_t Width>
+struct alignas(32) WideBvhNode {
+	float boundsMin[3][Width];
+	float boundsMax[3][Width];
+	uint32_t child[Width]; // Wide node for inner children, first primitive of the leaf otherwise.
+	uint32_t count[Width]; // Primitives of a leaf, 0 for inner children and unused slots.
+};
+
+// Collapses a binary BVH, top-down: the children of a wide node are those of its binary node, after replacing
+// the inner child with the largest surface area by its own two children until there are Width of them. Leaves
+// keep their ranges of Bvh::primitiveOrder, and wide nodes come after their parent like binary ones.
+template <uint32_t Width>
+std::vector<WideBvhNode<Width>> CollapseBvh(const std::vector<BvhNode>& nodes);
+
+// A ray as the wide node tests take it; invDirection may have infinities, like the binary slab test. A ray in the
+// plane of a face makes that plane 0 * infinity = NaN; the tests skip it, so the ray counts as inside the box, as
+// an edge of the primitive test counts as inside both triangles that share it.
+struct WideRay {
+	float origin[3];
+	float invDirection[3];
+};
+
+// 1 + 2 gamma(3) of Ize 2013, "Robust BVH Ray Traversal". The slab tests scale their exit distances by it, so
+// rounding never makes a ray miss a box it touches, which would undo the watertight primitive test inside.
+const float RobustExitScale = 1.0000004f;
+
+namespace WideBvh {
+	// The slab test of every child, the same as that of the binary traversal, so both enter exactly the same
+	// boxes: the sign of the direction picks the near and far plane of each axis, and std::max(a, b) and
+	// std::min(a, b) keep a when b is NaN. Stores the entry distances and returns one bit per child entered
+	// before tMax.
+	template <uint32_t Width>
+	inline uint32_t IntersectChildren(const WideBvhNode<Width>& node, const WideRay& ray, float tMax, float* tNear) {
+		const float infinity = std::numeric_limits<float>::infinity( );
+		uint32_t mask = 0;
+		for (uint32_t i = 0; i < Width; i++) {
+			float tEnter = -infinity, tExit = infinity;
+			for (int axis = 0; axis < 3; axis++) {
+				bool negative = std::signbit(ray.invDirection[axis]);
+				float nearPlane = negative ? node.boundsMax[axis][i] : node.boundsMin[axis][i];
+				float farPlane = negative ? node.boundsMin[axis][i] : node.boundsMax[axis][i];
+				tEnter = std::max(tEnter, (nearPlane - ray.origin[axis]) * ray.invDirection[axis]);
+				tExit = std::min(tExit, (farPlane - ray.origin[axis]) * ray.invDirection[axis]);
+			}
+			tExit *= RobustExitScale;
+			tNear[i] = tEnter;
+			if (tEnter <= tExit && tExit >= 0 && tEnter < tMax) {
+				mask |= 1u << i;
+			}
+		}
+		return mask;
+	}
+
+#if defined(_M_X64) || defined(__x86_64__)
+	// Four children whose axis a planes start at boundsMin + a * stride. std::max(a, b) keeps a when b is NaN,
+	// _mm_max_ps(b, a) does, so the operands are swapped throughout.
+	inline uint32_t IntersectFour(const float* boundsMin, const float* boundsMax, size_t stride, const WideRay& ray, float tMax, float* tNear) {
+		__m128 tEnter = _mm_set1_ps(-std::numeric_limits<float>::infinity( ));
+		__m128 tExit = _mm_set1_ps(std::numeric_limits<float>::infinity( ));
+		for (int axis = 0; axis < 3; axis++) {
+			bool negative = std::signbit(ray.invDirection[axis]);
+			__m128 origin = _mm_set1_ps(ray.origin[axis]);
+			__m128 invDirection = _mm_set1_ps(ray.invDirection[axis]);
+			__m128 nearPlanes = _mm_load_ps((negative ? boundsMax : boundsMin) + axis * stride);
+			__m128 farPlanes = _mm_load_ps((negative ? boundsMin : boundsMax) + axis * stride);
+			tEnter = _mm_max_ps(_mm_mul_ps(_mm_sub_ps(nearPlanes, origin), invDirection), tEnter);
+			tExit = _mm_min_ps(_mm_mul_ps(_mm_sub_ps(farPlanes, origin), invDirection), tExit);
+		}
+		tExit = _mm_mul_ps(tExit, _mm_set1_ps(RobustExitScale));
+		__m128 entered = _mm_and_ps(_mm_and_ps(_mm_cmple_ps(tEnter, tExit), _mm_cmpge_ps(tExit, _mm_setzero_ps( ))),
+									_mm_cmplt_ps(tEnter, _mm_set1_ps(tMax)));
+		_mm_storeu_ps(tNear, tEnter);
+		return static_cast<uint32_t>(_mm_movemask_ps(entered));
+	}
+
+	template <>
+	inline uint32_t IntersectChildren<4>(const WideBvhNode<4>& node, const WideRay& ray, float tMax, float* tNear) {
+		return IntersectFour(node.boundsMin[0], node.boundsMax[0], 4, ray, tMax, tNear);
+	}
+
+	template <>
+	inline uint32_t IntersectChildren<8>(const WideBvhNode<8>& node, const WideRay& ray, float tMax, float* tNear) {
+#if defined(__AVX2__)
+		__m256 tEnter = _mm256_set1_ps(-std::numeric_limits<float>::infinity( ));
+		__m256 tExit = _mm256_set1_ps(std::numeric_limits<float>::infinity( ));
+		for (int axis = 0; axis < 3; axis++) {
+			bool negative = std::signbit(ray.invDirection[axis]);
+			__m256 origin = _mm256_set1_ps(ray.origin[axis]);
+			__m256 invDirection = _mm256_set1_ps(ray.invDirection[axis]);
+			__m256 nearPlanes = _mm256_load_ps(negative ? node.boundsMax[axis] : node.boundsMin[axis]);
+			__m256 farPlanes = _mm256_load_ps(negative ? node.boundsMin[axis] : node.boundsMax[axis]);
+			tEnter = _mm256_max_ps(_mm256_mul_ps(_mm256_sub_ps(nearPlanes, origin), invDirection), tEnter);
+			tExit = _mm256_min_ps(_mm256_mul_ps(_mm256_sub_ps(farPlanes, origin), invDirection), tExit);
+		}
+		tExit = _mm256_mul_ps(tExit, _mm256_set1_ps(RobustExitScale));
+		__m256 entered = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(tEnter, tExit, _CMP_LE_OQ), _mm256_cmp_ps(tExit, _mm256_setzero_ps( ), _CMP_GE_OQ)),
+									   _mm256_cmp_ps(tEnter, _mm256_set1_ps(tMax), _CMP_LT_OQ));
+		_mm256_storeu_ps(tNear, tEnter);
+		return static_cast<uint32_t>(_mm256_movemask_ps(entered));
+#else
+		// Without AVX2 the two halves of the node take one SSE test each.
+		return IntersectFour(node.boundsMin[0], node.boundsMax[0], 8, ray, tMax, tNear)
+			| IntersectFour(node.boundsMin[0] + 4, node.boundsMax[0] + 4, 8, ray, tMax, tNear + 4) << 4;
+#endif
+	}
+#endif
+}
@@ -11,13 +11,9 @@
 
 
 #include "D3D12HelloTriangle.h"
+#include <algorithm>
 #include <stdexcept>
 
-#include "DxR/DXRHelper.h"
-#include "DxR/nv_helpers_dx12/BottomLevelASGenerator.h"
-#include "DxR/nv_helpers_dx12/RaytracingPipelineGenerator.h"
-#include "DxR/nv_helpers_dx12/RootSignatureGenerator.h"
-
 #include <windowsx.h>
 
 #include <system_error>
@@ -33,18 +29,22 @@ void D3D12HelloTriangle::OnInit( ) {
 	LoadPipeline( );
 	LoadAssets( );
 
-	CheckRaytracingSupport( );
-	CreateAccelerationStructures( );
-
-	ThrowIfFailed(m_commandList->Close( ));
-
-	CreateRaytracingPipeline( );
-	CreateRaytracingOutputBuffer( );
+	if (m_useCpuBackend) {
+		m_cpuBackend = std::make_unique<CpuBackend>(m_width, m_height);
+		m_backend = m_cpuBackend.get( );
+		CreateCpuOutputUpload( );
+	} else {
+		CheckRaytracingSupport( );
+		m_dxrBackend = std::make_unique<DxrBackend>(m_device.Get( ), m_commandQueue.Get( ), m_commandAllocator.Get( ),
+													m_commandList.Get( ), m_width, m_height);
+		m_backend = m_dxrBackend.get( );
+	}
 
+	// Only the CPU tracer selects levels of detail per ray.
+	m_backend->UploadScene(SceneBuilder::CreateDefaultScene(true, m_useCpuBackend));
+	m_backend->BuildAccelerationStructures( );
 
-	CreateConstBuffers( );
-	CreateShaderResourceHeap( );
-	CreateShaderBindingTable( );
+	ThrowIfFailed(m_commandList->Close( ));
 }
 
 // Load the rendering pipeline dependencies.
@@ -188,13 +188,6 @@ void D3D12HelloTriangle::LoadAssets( ) {
 	// Create the command list.
 	ThrowIfFailed(m_device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT, m_commandAllocator.Get( ), m_compStateObject.Get( ), IID_PPV_ARGS(&m_commandList)));
 
-	{
-		CreateSphere( );
-		CreateSkyBox( );
-		CreateTable( );
-		CreateLight( );
-	}
-
 	// Create synchronization objects and wait until assets have been uploaded to the GPU.
 	{
 		ThrowIfFailed(m_device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&m_fence)));
@@ -215,8 +208,8 @@ void D3D12HelloTriangle::LoadAssets( ) {
 
 // Update frame-based values.
 void D3D12HelloTriangle::OnUpdate( ) {
-	UpdateCameraBuffer( );
-	UpdateFrameCountBuffer(m_framesFromMove.x + 1);
+	m_backend->UpdateCamera(ComputeCameraMatrices(Eye, At, Up, m_aspectRatio));
+	m_backend->UpdateFrameCount(++m_framesFromMove);
 }
 
 // Render the scene.
@@ -264,42 +257,24 @@ void D3D12HelloTriangle::PopulateCommandList( ) {
 	CD3DX12_CPU_DESCRIPTOR_HANDLE rtvHandle(m_rtvHeap->GetCPUDescriptorHandleForHeapStart( ), m_frameIndex, m_rtvDescriptorSize);
 	m_commandList->OMSetRenderTargets(1, &rtvHandle, FALSE, nullptr);
 
-	std::vector<ID3D12DescriptorHeap*> heaps = {m_srvUavHeap.Get( )};
-	m_commandList->SetDescriptorHeaps(static_cast<UINT>(heaps.size( )), heaps.data( ));
-
-	CD3DX12_RESOURCE_BARRIER transition = CD3DX12_RESOURCE_BARRIER::Transition(
-		m_outputResource.Get( ), D3D12_RESOURCE_STATE_COPY_SOURCE,
-		D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
-	m_commandList->ResourceBarrier(1, &transition);
-
-	D3D12_DISPATCH_RAYS_DESC desc = {};
-	CreateRayDesc(desc);
-
-	m_commandList->SetPipelineState1(m_rtStateObject.Get( ));
-	m_commandList->DispatchRays(&desc);
-
-	//m_commandList->ResourceBarrier(1, &transition);
-
-
-	//m_commandList->SetComputeRootSignature(m_compSignature.Get( ));
-	//m_commandList->SetPipelineState(m_compStateObject.Get());
-	//m_commandList->Dispatch(1, 1, 1);
-
-	
-
-
-	transition = CD3DX12_RESOURCE_BARRIER::Transition(
-		m_renderTargets[m_frameIndex].Get( ), D3D12_RESOURCE_STATE_RENDER_TARGET,
-		D3D12_RESOURCE_STATE_COPY_DEST);
+	if (m_useCpuBackend) {
+		m_cpuBackend->Trace( );
+		CopyCpuOutput( );
+	} else {
+		m_dxrBackend->Trace( );
 
-	m_commandList->ResourceBarrier(1, &transition);
-	m_commandList->CopyResource(m_renderTargets[m_frameIndex].Get( ), m_outputResource.Get( ));
+		CD3DX12_RESOURCE_BARRIER transition = CD3DX12_RESOURCE_BARRIER::Transition(
+			m_renderTargets[m_frameIndex].Get( ), D3D12_RESOURCE_STATE_RENDER_TARGET,
+			D3D12_RESOURCE_STATE_COPY_DEST);
 
-	transition = CD3DX12_RESOURCE_BARRIER::Transition(
-		m_renderTargets[m_frameIndex].Get( ), D3D12_RESOURCE_STATE_COPY_DEST,
-		D3D12_RESOURCE_STATE_RENDER_TARGET);
-	m_commandList->ResourceBarrier(1, &transition);
+		m_commandList->ResourceBarrier(1, &transition);
+		m_commandList->CopyResource(m_renderTargets[m_frameIndex].Get( ), m_dxrBackend->GetOutputResource( ));
 
+		transition = CD3DX12_RESOURCE_BARRIER::Transition(
+			m_renderTargets[m_frameIndex].Get( ), D3D12_RESOURCE_STATE_COPY_DEST,
+			D3D12_RESOURCE_STATE_RENDER_TARGET);
+		m_commandList->ResourceBarrier(1, &transition);
+	}
 
 	// Indicate that the back buffer will now be used to present.
 	m_commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(m_renderTargets[m_frameIndex].Get( ), D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PRESENT));
@@ -307,26 +282,6 @@ void D3D12HelloTriangle::PopulateCommandList( ) {
 	ThrowIfFailed(m_commandList->Close( ));
 }
 
-void D3D12HelloTriangle::CreateRayDesc(D3D12_DISPATCH_RAYS_DESC& desc) {
-	UINT32 rayGenerationSectionSizeInBytes = m_sbtHelper.GetRayGenSectionSize( );
-	desc.RayGenerationShaderRecord.StartAddress = m_sbtStorage->GetGPUVirtualAddress( );
-	desc.RayGenerationShaderRecord.SizeInBytes = rayGenerationSectionSizeInBytes;
-
-	UINT32 missSectionSizeInBytes = m_sbtHelper.GetMissSectionSize( );
-	desc.MissShaderTable.StartAddress = m_sbtStorage->GetGPUVirtualAddress( ) + rayGenerationSectionSizeInBytes;
-	desc.MissShaderTable.SizeInBytes = missSectionSizeInBytes;
-	desc.MissShaderTable.StrideInBytes = m_sbtHelper.GetMissEntrySize( );
-
-	UINT32 hitGroupsSectionSize = m_sbtHelper.GetHitGroupSectionSize( );
-	desc.HitGroupTable.StartAddress = m_sbtStorage->GetGPUVirtualAddress( ) +
-		rayGenerationSectionSizeInBytes + missSectionSizeInBytes;
-	desc.HitGroupTable.SizeInBytes = hitGroupsSectionSize;
-	desc.HitGroupTable.StrideInBytes = m_sbtHelper.GetHitGroupEntrySize( );
-
-	desc.Width = GetWidth( );
-	desc.Height = GetHeight( );
-	desc.Depth = 1;
-}
 
 void D3D12HelloTriangle::WaitForPreviousFrame( ) {
 	// WAITING FOR THE FRAME TO COMPLETE BEFORE CONTINUING IS NOT BEST PRACTICE.
@@ -357,425 +312,57 @@ void D3D12HelloTriangle::CheckRaytracingSupport( ) {
 		throw std::runtime_error("Raytracing not supported on device");
 }
 
-
-
-
-
-D3D12HelloTriangle::AccelerationStructureBuffers
-D3D12HelloTriangle::CreateBottomLevelAS(std::vector<std::pair<ComPtr<ID3D12Resource>, uint32_t>> vVertexBuffers,
-										std::vector<std::pair<ComPtr<ID3D12Resource>, uint32_t>> vIndexBuffers) {
-	nv_helpers_dx12::BottomLevelASGenerator bottomLevelAS;
-
-	// Adding all vertex buffers and not transforming their position.
-	for (size_t i = 0; i < vVertexBuffers.size( ); i++) {
-		bottomLevelAS.AddVertexBuffer(vVertexBuffers[i].first.Get( ), 0, vVertexBuffers[i].second, sizeof(Vertex),
-									  vIndexBuffers[i].first.Get( ), 0, vIndexBuffers[i].second,
-									  nullptr, 0, true);
-	}
-
-	UINT64 scratchSizeInBytes = 0;
-	UINT64 resultSizeInBytes = 0;
-
-	bottomLevelAS.ComputeASBufferSizes(m_device.Get( ), false, &scratchSizeInBytes, &resultSizeInBytes);
-
-	AccelerationStructureBuffers buffers;
-	buffers.pScratch = nv_helpers_dx12::CreateBuffer(m_device.Get( ), scratchSizeInBytes, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS,
-													 D3D12_RESOURCE_STATE_COMMON, nv_helpers_dx12::kDefaultHeapProps);
-
-	buffers.pResult = nv_helpers_dx12::CreateBuffer(m_device.Get( ), resultSizeInBytes, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS,
-													D3D12_RESOURCE_STATE_RAYTRACING_ACCELERATION_STRUCTURE, nv_helpers_dx12::kDefaultHeapProps);
-
-	bottomLevelAS.Generate(m_commandList.Get( ), buffers.pScratch.Get( ), buffers.pResult.Get( ), false, nullptr);
-	return buffers;
-}
-
-void D3D12HelloTriangle::CreateTopLevelAS(const std::vector<std::pair<ComPtr<ID3D12Resource>, DirectX::XMMATRIX>>& instances) {
-	for (size_t i = 0; i < instances.size( ); i++) {
-		m_topLevelASGenerator.AddInstance(instances[i].first.Get( ), instances[i].second, static_cast<UINT>(i), static_cast<UINT>(2 * i));
-	}
-
-	UINT64 scratchSize, resultSize, instanceDescsSize;
-
-	m_topLevelASGenerator.ComputeASBufferSizes(m_device.Get( ), true, &scratchSize, &resultSize, &instanceDescsSize);
-
-
-	m_topLevelASBuffers.pScratch = nv_helpers_dx12::CreateBuffer(
-		m_device.Get( ), scratchSize, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS,
-		D3D12_RESOURCE_STATE_UNORDERED_ACCESS, nv_helpers_dx12::kDefaultHeapProps);
-	m_topLevelASBuffers.pResult = nv_helpers_dx12::CreateBuffer(
-		m_device.Get( ), resultSize, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS,
-		D3D12_RESOURCE_STATE_RAYTRACING_ACCELERATION_STRUCTURE, nv_helpers_dx12::kDefaultHeapProps);
-	m_topLevelASBuffers.pInstanceDesc = nv_helpers_dx12::CreateBuffer(
-		m_device.Get( ), instanceDescsSize, D3D12_RESOURCE_FLAG_NONE,
-		D3D12_RESOURCE_STATE_GENERIC_READ, nv_helpers_dx12::kUploadHeapProps);
-
-	m_topLevelASGenerator.Generate(m_commandList.Get( ), m_topLevelASBuffers.pScratch.Get( ), m_topLevelASBuffers.pResult.Get( ), m_topLevelASBuffers.pInstanceDesc.Get( ));
-}
-
-void D3D12HelloTriangle::CreateAccelerationStructures( ) {
-	for (size_t i = 0; i < m_objects.size( ); i++) {
-		AccelerationStructureBuffers BLASBuffer = CreateBottomLevelAS({{m_objects[i].pVertexBuffer.Get( ), m_objects[i].uVertices}}, {{m_objects[i].pIndexBuffer.Get( ), m_objects[i].uIndices}});
-		m_instances.push_back({BLASBuffer.pResult, m_objects[i].modelMatrix});
-	}
-	CreateTopLevelAS(m_instances);
-
-	m_commandList->Close( );
-	ID3D12CommandList* ppCommandLists[] = {m_commandList.Get( )};
-	m_commandQueue->ExecuteCommandLists(1, ppCommandLists);
-	m_fenceValue++;
-	m_commandQueue->Signal(m_fence.Get( ), m_fenceValue);
-
-	m_fence->SetEventOnCompletion(m_fenceValue, m_fenceEvent);
-	WaitForSingleObject(m_fenceEvent, INFINITE);
-
-	ThrowIfFailed(m_commandList->Reset(m_commandAllocator.Get( ), m_pipelineState.Get( )));
-}
-
-ComPtr<ID3D12RootSignature> D3D12HelloTriangle::CreateRayGenSignature( ) {
-	nv_helpers_dx12::RootSignatureGenerator rsc;
-	rsc.AddHeapRangesParameter({{0,1,0,D3D12_DESCRIPTOR_RANGE_TYPE_UAV,0},
-							   {1,1,0,D3D12_DESCRIPTOR_RANGE_TYPE_UAV,1},
-							   {2,1,0,D3D12_DESCRIPTOR_RANGE_TYPE_UAV,2},
-							   {3,1,0,D3D12_DESCRIPTOR_RANGE_TYPE_UAV,3},
-							   {4,1,0,D3D12_DESCRIPTOR_RANGE_TYPE_UAV,4},
-							   {0,1,0,D3D12_DESCRIPTOR_RANGE_TYPE_SRV,5},
-							   {0,1,0,D3D12_DESCRIPTOR_RANGE_TYPE_CBV,6}});
-	rsc.AddRootParameter(D3D12_ROOT_PARAMETER_TYPE_CBV, 1);
-
-	return rsc.Generate(m_device.Get( ), true);
-}
-
-ComPtr<ID3D12RootSignature> D3D12HelloTriangle::CreateMissSignature( ) {
-	nv_helpers_dx12::RootSignatureGenerator rsc;
-	return rsc.Generate(m_device.Get( ), true);
-}
-
-ComPtr<ID3D12RootSignature> D3D12HelloTriangle::CreateHitSignature( ) {
-	nv_helpers_dx12::RootSignatureGenerator rsc;
-
-	rsc.AddRootParameter(D3D12_ROOT_PARAMETER_TYPE_SRV, 0);
-	rsc.AddRootParameter(D3D12_ROOT_PARAMETER_TYPE_SRV, 1);
-	rsc.AddRootParameter(D3D12_ROOT_PARAMETER_TYPE_CBV, 0);
-	rsc.AddRootParameter(D3D12_ROOT_PARAMETER_TYPE_CBV, 1);
-	rsc.AddHeapRangesParameter({{2,1,0, D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 5}});
-
-	return rsc.Generate(m_device.Get( ), true);
-}
-
-void D3D12HelloTriangle::CreateRaytracingPipeline( ) {
-	nv_helpers_dx12::RayTracingPipelineGenerator pipeline(m_device.Get( ));
-
-	m_rayGenLibrary = nv_helpers_dx12::CompileShaderLibrary(L"Shaders/RayGen.hlsl");
-	m_missLibrary = nv_helpers_dx12::CompileShaderLibrary(L"Shaders/Miss.hlsl");
-	m_hitLibrary = nv_helpers_dx12::CompileShaderLibrary(L"Shaders/Hit.hlsl");
-	m_shadowLiblary = nv_helpers_dx12::CompileShaderLibrary(L"Shaders/ShadowRay.hlsl");
-
-	pipeline.AddLibrary(m_rayGenLibrary.Get( ), {L"RayGen"});
-	pipeline.AddLibrary(m_missLibrary.Get( ), {L"Miss"});
-	pipeline.AddLibrary(m_hitLibrary.Get( ), {L"ObjectClosestHit"});
-	pipeline.AddLibrary(m_shadowLiblary.Get( ), {L"ShadowClosestHit", L"ShadowMiss"});
-
-	m_rayGenSignature = CreateRayGenSignature( );
-	m_missSignature = CreateMissSignature( );
-	m_hitSignature = CreateHitSignature( );
-	m_shadowSignature = CreateHitSignature( );
-
-	pipeline.AddHitGroup(L"HitGroup", L"ObjectClosestHit");
-	pipeline.AddHitGroup(L"ShadowHitGroup", L"ShadowClosestHit");
-
-	pipeline.AddRootSignatureAssociation(m_rayGenSignature.Get( ), {L"RayGen"});
-	pipeline.AddRootSignatureAssociation(m_missSignature.Get( ), {L"Miss", L"ShadowMiss"});
-	pipeline.AddRootSignatureAssociation(m_hitSignature.Get( ), {L"HitGroup"});
-	pipeline.AddRootSignatureAssociation(m_shadowSignature.Get( ), {L"ShadowHitGroup"});
-
-	pipeline.SetMaxPayloadSize(7 * sizeof(float));
-	pipeline.SetMaxAttributeSize(2 * sizeof(float));
-	pipeline.SetMaxRecursionDepth(10);
-
-	m_rtStateObject = pipeline.Generate( );
-	ThrowIfFailed(m_rtStateObject->QueryInterface(IID_PPV_ARGS(&m_rtStateObjectProps)));
-}
-
-
-void D3D12HelloTriangle::CreateRaytracingOutputBuffer( ) {
-	D3D12_RESOURCE_DESC resDesc = {};
-	resDesc.DepthOrArraySize = 1;
-	resDesc.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
-	resDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
-	resDesc.Flags = D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS;
-	resDesc.Width = GetWidth( );
-	resDesc.Height = GetHeight( );
-	resDesc.Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN;
-	resDesc.MipLevels = 1;
-	resDesc.SampleDesc.Count = 1;
-
-	ThrowIfFailed(m_device->CreateCommittedResource(
-		&nv_helpers_dx12::kDefaultHeapProps, D3D12_HEAP_FLAG_NONE, &resDesc,
-		D3D12_RESOURCE_STATE_COPY_SOURCE, nullptr, IID_PPV_ARGS(&m_outputResource)
-	));
-
-	ThrowIfFailed(m_device->CreateCommittedResource(
-		&nv_helpers_dx12::kDefaultHeapProps, D3D12_HEAP_FLAG_NONE, &resDesc,
-		D3D12_RESOURCE_STATE_COPY_SOURCE, nullptr, IID_PPV_ARGS(&m_outputImage)
-	));
-	
-	ThrowIfFailed(m_device->CreateCommittedResource(
-		&nv_helpers_dx12::kDefaultHeapProps, D3D12_HEAP_FLAG_NONE, &resDesc,
-		D3D12_RESOURCE_STATE_COPY_SOURCE, nullptr, IID_PPV_ARGS(&m_outputGradX)
-	));
-
-	ThrowIfFailed(m_device->CreateCommittedResource(
-		&nv_helpers_dx12::kDefaultHeapProps, D3D12_HEAP_FLAG_NONE, &resDesc,
-		D3D12_RESOURCE_STATE_COPY_SOURCE, nullptr, IID_PPV_ARGS(&m_outputGradY)
-	));
-	
-	ThrowIfFailed(m_device->CreateCommittedResource(
-		&nv_helpers_dx12::kDefaultHeapProps, D3D12_HEAP_FLAG_NONE, &resDesc,
-		D3D12_RESOURCE_STATE_COPY_SOURCE, nullptr, IID_PPV_ARGS(&m_outputReconstruct)
-	));
-}
-
-void D3D12HelloTriangle::CreateShaderResourceHeap( ) {
-	m_srvUavHeap = nv_helpers_dx12::CreateDescriptorHeap(m_device.Get( ), 7, D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, true);
-
-	D3D12_CPU_DESCRIPTOR_HANDLE srvHandle = m_srvUavHeap->GetCPUDescriptorHandleForHeapStart( );
-
-	D3D12_UNORDERED_ACCESS_VIEW_DESC uavDesc = {};
-	uavDesc.ViewDimension = D3D12_UAV_DIMENSION_TEXTURE2D;
-
-	// Output
-	m_device->CreateUnorderedAccessView(m_outputResource.Get( ), nullptr, &uavDesc, srvHandle);
-	srvHandle.ptr += m_device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
-
-	// Image
-	m_device->CreateUnorderedAccessView(m_outputImage.Get( ), nullptr, &uavDesc, srvHandle);
-	srvHandle.ptr += m_device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
-	
-	// GradX
-	m_device->CreateUnorderedAccessView(m_outputGradX.Get( ), nullptr, &uavDesc, srvHandle);
-	srvHandle.ptr += m_device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
-
-	// Grad Y
-	m_device->CreateUnorderedAccessView(m_outputGradY.Get( ), nullptr, &uavDesc, srvHandle);
-	srvHandle.ptr += m_device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
-
-	// Reconstr
-	m_device->CreateUnorderedAccessView(m_outputReconstruct.Get( ), nullptr, &uavDesc, srvHandle);
-	srvHandle.ptr += m_device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
-
-	D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc;
-	srvDesc.Format = DXGI_FORMAT_UNKNOWN;
-	srvDesc.ViewDimension = D3D12_SRV_DIMENSION_RAYTRACING_ACCELERATION_STRUCTURE;
-	srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
-	srvDesc.RaytracingAccelerationStructure.Location = m_topLevelASBuffers.pResult->GetGPUVirtualAddress( );
-
-	m_device->CreateShaderResourceView(nullptr, &srvDesc, srvHandle);
-
-	srvHandle.ptr += m_device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
-	D3D12_CONSTANT_BUFFER_VIEW_DESC cbvDesc = {};
-	cbvDesc.BufferLocation = m_cameraBuffer->GetGPUVirtualAddress( );
-	cbvDesc.SizeInBytes = m_cameraBufferSize;
-
-	m_device->CreateConstantBufferView(&cbvDesc, srvHandle);
-
-
-}
-
-void D3D12HelloTriangle::CreateShaderBindingTable( ) {
-	m_sbtHelper.Reset( );
-	D3D12_GPU_DESCRIPTOR_HANDLE srvUavHeapHandle = m_srvUavHeap->GetGPUDescriptorHandleForHeapStart( );
-
-	auto heapPointer = reinterpret_cast<UINT64*>(srvUavHeapHandle.ptr);
-
-	m_sbtHelper.AddRayGenerationProgram(L"RayGen", {heapPointer, (void*) m_frameBuffer->GetGPUVirtualAddress()});
-	m_sbtHelper.AddMissProgram(L"Miss", {});
-	m_sbtHelper.AddMissProgram(L"ShadowMiss", {});
-
-	for (auto object : m_objects) {
-		m_sbtHelper.AddHitGroup(L"HitGroup", {(void*) object.pVertexBuffer->GetGPUVirtualAddress( ),
-								(void*) object.pIndexBuffer->GetGPUVirtualAddress( ),(void*) object.constantBuffers[0]->GetGPUVirtualAddress( ),
-								(void*) m_lights->GetGPUVirtualAddress( ), heapPointer});
-		m_sbtHelper.AddHitGroup(L"ShadowHitGroup", {(void*) object.pVertexBuffer->GetGPUVirtualAddress( ),
-								(void*) object.pIndexBuffer->GetGPUVirtualAddress( ),(void*) object.constantBuffers[0]->GetGPUVirtualAddress( ),
-								(void*) m_lights->GetGPUVirtualAddress( ), heapPointer});
-	}
-
-	UINT32 sbtSize = m_sbtHelper.ComputeSBTSize( );
-
-	m_sbtStorage = nv_helpers_dx12::CreateBuffer(m_device.Get( ), sbtSize, D3D12_RESOURCE_FLAG_NONE,
-												 D3D12_RESOURCE_STATE_GENERIC_READ, nv_helpers_dx12::kUploadHeapProps);
-
-	if (!m_sbtStorage) {
-		throw std::logic_error("Could not allocate the shader binding table");
-	}
-
-	m_sbtHelper.Generate(m_sbtStorage.Get( ), m_rtStateObjectProps.Get( ));
-}
-
-
-void D3D12HelloTriangle::CreateConstBuffers( ) {
-	UINT32 nbMatrix = 4; //V, P, Vinv, Pinv
-	m_cameraBufferSize = nbMatrix * sizeof(XMMATRIX);
-	m_frameBufferSize = sizeof(XMUINT4);
-
-	m_frameBuffer = nv_helpers_dx12::CreateBuffer(
-		m_device.Get( ), m_frameBufferSize, D3D12_RESOURCE_FLAG_NONE,
-		D3D12_RESOURCE_STATE_GENERIC_READ, nv_helpers_dx12::kUploadHeapProps
-	);
-
-	m_cameraBuffer = nv_helpers_dx12::CreateBuffer(
-		m_device.Get( ), m_cameraBufferSize, D3D12_RESOURCE_FLAG_NONE,
-		D3D12_RESOURCE_STATE_GENERIC_READ, nv_helpers_dx12::kUploadHeapProps
-	);
-}
-
-void D3D12HelloTriangle::UpdateCameraBuffer( ) {
-	std::vector<XMMATRIX> matrices(4);
-	matrices[0] = XMMatrixLookAtRH(Eye, At, Up);
-
-	float fovAngleY = 75.0f * XM_PI / 180.0f;
-	matrices[1] = XMMatrixPerspectiveFovRH(fovAngleY, m_aspectRatio, 0.1f, 1000.f);
-
-	XMVECTOR det;
-	matrices[2] = XMMatrixInverse(&det, matrices[0]);
-	matrices[3] = XMMatrixInverse(&det, matrices[1]);
-
-	UINT8* pData;
-	ThrowIfFailed(m_cameraBuffer->Map(0, nullptr, (void**) &pData));
-	memcpy(pData, matrices.data( ), m_cameraBufferSize);
-	m_cameraBuffer->Unmap(0, nullptr);
-}
-
-void D3D12HelloTriangle::UpdateFrameCountBuffer(UINT32 value) {
-	m_framesFromMove.x = value;
-
-	UINT8* pData;
-	ThrowIfFailed(m_frameBuffer->Map(0, nullptr, (void**) &pData));
-	memcpy(pData, &m_framesFromMove, m_frameBufferSize);
-	m_frameBuffer->Unmap(0, nullptr);
-}
-
-
-
-
-
-void D3D12HelloTriangle::CreateSphere( ) {
-	auto sphere = m_objectCreator.CreateSphere(1.0f);
-	CreateObject(sphere.Vertices, sphere.Indices, {{1, 1, 1, 1.0f}, {0}, 1});
-}
-
-void D3D12HelloTriangle::CreateSkyBox( ) {
-	auto sky = m_objectCreator.CreateBox({8, 10, 8}, {1,1,1});
-	CreateObject(sky.Vertices, sky.Indices, {{0.8, 0.8, 0.8, 1.0f}, {0}, 0}, XMMatrixTranslation(0, 0, 0));
-}
-
-void D3D12HelloTriangle::CreateTable( ) {
-	auto tlLeg = m_objectCreator.CreateBox({0.5,3,0.5}, {1,1,1});
-	CreateObject(tlLeg.Vertices, tlLeg.Indices, {{0.960, 0.949, 0.6, 1.0f}, {0}, 0}, XMMatrixTranslation(-2, 0, -2));
-
-	auto trLeg = m_objectCreator.CreateBox({0.5,3,0.5}, {1,1,1});
-	CreateObject(trLeg.Vertices, trLeg.Indices, {{0.960, 0.6, 0.933, 1.0f}, {0}, 0}, XMMatrixTranslation(2, 0, -2));
-
-	auto brLeg = m_objectCreator.CreateBox({0.5,3,0.5}, {1,1,1});
-	CreateObject(brLeg.Vertices, brLeg.Indices, {{0.6, 0.725, 0.960, 1.0f}, {0}, 0}, XMMatrixTranslation(-2, 0, 2));
-
-	auto blLeg = m_objectCreator.CreateBox({0.5,3,0.5}, {1,1,1});
-	CreateObject(blLeg.Vertices, blLeg.Indices, {{0.698, 0.960, 0.6, 1.0f}, {0}, 0}, XMMatrixTranslation(2, 0, 2));
-
-	auto face = m_objectCreator.CreateBox({4.5,0.5,4.5}, {1,1,1});
-	CreateObject(face.Vertices, face.Indices, {{0.960, 0.6, 0.717, 1.0f}, {0}, 1}, XMMatrixTranslation(0, -1.75, 0));
-}
-
-void D3D12HelloTriangle::CreateLight( ) {
-	auto light = m_objectCreator.CreateBox({1, 0.1, 1}, {1,1,1});
-	CreateObject(light.Vertices, light.Indices, {{1, 1, 1}, {10, 10, 10}, 3}, XMMatrixTranslation(0, 4.5, 0));
-
-	CreateLightBuffer({{0, 4.5, 0, 1}, {1, 0.1, 1}, {10, 10, 10, 0}});
-}
-
-void D3D12HelloTriangle::CreateObject(std::vector<Vertex>& vertices, std::vector<UINT>& indices, Material material, XMMATRIX position) {
-	VBObject object;
-
-	CreateVB(object, vertices);
-	CreateIB(object, indices);
-	CreateMaterial(object, material);
-
-	object.modelMatrix = position;
-	m_objects.push_back(object);
-}
-
-void D3D12HelloTriangle::CreateVB(VBObject& object, std::vector<Vertex>& vertices) {
-	object.uVertices = vertices.size( );
-	const UINT bufferSize = static_cast<UINT>(vertices.size( )) * sizeof(Vertex);
+void D3D12HelloTriangle::CreateCpuOutputUpload( ) {
+	D3D12_RESOURCE_DESC backBufferDesc = m_renderTargets[0]->GetDesc( );
+	UINT64 uploadSize = 0;
+	m_device->GetCopyableFootprints(&backBufferDesc, 0, 1, 0, &m_cpuOutputFootprint, nullptr, nullptr, &uploadSize);
 
 	CD3DX12_HEAP_PROPERTIES heapProperty = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD);
-	CD3DX12_RESOURCE_DESC bufferResource = CD3DX12_RESOURCE_DESC::Buffer(bufferSize);
+	CD3DX12_RESOURCE_DESC bufferResource = CD3DX12_RESOURCE_DESC::Buffer(uploadSize);
 	ThrowIfFailed(m_device->CreateCommittedResource(
 		&heapProperty, D3D12_HEAP_FLAG_NONE, &bufferResource,
-		D3D12_RESOURCE_STATE_GENERIC_READ, nullptr, IID_PPV_ARGS(&object.pVertexBuffer))
+		D3D12_RESOURCE_STATE_GENERIC_READ, nullptr, IID_PPV_ARGS(&m_cpuOutputUpload))
 	);
-
-	UINT8* pVertexDataBegin;
-	CD3DX12_RANGE readRange(0, 0);
-	ThrowIfFailed(object.pVertexBuffer->Map(0, &readRange, reinterpret_cast<void**>(&pVertexDataBegin)));
-	memcpy(pVertexDataBegin, vertices.data( ), bufferSize);
-	object.pVertexBuffer->Unmap(0, nullptr);
-
-	object.sVertexBufferView.BufferLocation = object.pVertexBuffer->GetGPUVirtualAddress( );
-	object.sVertexBufferView.StrideInBytes = sizeof(Vertex);
-	object.sVertexBufferView.SizeInBytes = bufferSize;
 }
 
-void D3D12HelloTriangle::CreateIB(VBObject& object, std::vector<UINT>& indices) {
-	object.uIndices = indices.size( );
-	const UINT indexBufferSize = static_cast<UINT>(indices.size( )) * sizeof(UINT);
+// Converts the float output of the CPU tracer to the back buffer format, as the UNORM UAV does on the GPU.
+void D3D12HelloTriangle::CopyCpuOutput( ) {
+	const auto& output = m_cpuBackend->GetRaytracer( ).GetOutput( );
 
-	CD3DX12_HEAP_PROPERTIES heapProperty = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD);
-	CD3DX12_RESOURCE_DESC bufferResource = CD3DX12_RESOURCE_DESC::Buffer(indexBufferSize);
-	ThrowIfFailed(m_device->CreateCommittedResource(
-		&heapProperty, D3D12_HEAP_FLAG_NONE, &bufferResource, //
-		D3D12_RESOURCE_STATE_GENERIC_READ, nullptr, IID_PPV_ARGS(&object.pIndexBuffer)));
-
-	// Copy the triangle data to the index buffer.
-	UINT8* pIndexDataBegin;
-	CD3DX12_RANGE readRange(0, 0);
-	ThrowIfFailed(object.pIndexBuffer->Map(0, &readRange, reinterpret_cast<void**>(&pIndexDataBegin)));
-	memcpy(pIndexDataBegin, indices.data( ), indexBufferSize);
-	object.pIndexBuffer->Unmap(0, nullptr);
-
-	// Initialize the index buffer view.
-	object.sIndexBufferView.BufferLocation = object.pIndexBuffer->GetGPUVirtualAddress( );
-	object.sIndexBufferView.Format = DXGI_FORMAT_R32_UINT;
-	object.sIndexBufferView.SizeInBytes = indexBufferSize;
-}
-
-void D3D12HelloTriangle::CreateMaterial(VBObject& object, Material material) {
-	auto m_constantBuffer = nv_helpers_dx12::CreateBuffer(
-		m_device.Get( ), sizeof(Material), D3D12_RESOURCE_FLAG_NONE, D3D12_RESOURCE_STATE_GENERIC_READ, nv_helpers_dx12::kUploadHeapProps);
-
-	uint8_t* pData;
-	ThrowIfFailed(m_constantBuffer->Map(0, nullptr, (void**) &pData));
-	memcpy(pData, &material, sizeof(Material));
-	m_constantBuffer->Unmap(0, nullptr);
+	UINT8* pData;
+	ThrowIfFailed(m_cpuOutputUpload->Map(0, nullptr, (void**) &pData));
+	for (UINT y = 0; y < m_height; y++) {
+		UINT8* row = pData + m_cpuOutputFootprint.Offset + y * m_cpuOutputFootprint.Footprint.RowPitch;
+		for (UINT x = 0; x < m_width; x++) {
+			const XMFLOAT4& pixel = output[y * m_width + x];
+			const float channels[4] = {pixel.x, pixel.y, pixel.z, pixel.w};
+			for (int c = 0; c < 4; c++) {
+				row[4 * x + c] = static_cast<UINT8>(std::min(std::max(channels[c], 0.0f), 1.0f) * 255.0f + 0.5f);
+			}
+		}
+	}
+	m_cpuOutputUpload->Unmap(0, nullptr);
 
-	object.constantBuffers.push_back(m_constantBuffer);
-}
+	CD3DX12_RESOURCE_BARRIER transition = CD3DX12_RESOURCE_BARRIER::Transition(
+		m_renderTargets[m_frameIndex].Get( ), D3D12_RESOURCE_STATE_RENDER_TARGET,
+		D3D12_RESOURCE_STATE_COPY_DEST);
+	m_commandList->ResourceBarrier(1, &transition);
 
-void D3D12HelloTriangle::CreateLightBuffer(Light light) {
-	m_lights = nv_helpers_dx12::CreateBuffer(
-		m_device.Get( ), sizeof(Material), D3D12_RESOURCE_FLAG_NONE, D3D12_RESOURCE_STATE_GENERIC_READ, nv_helpers_dx12::kUploadHeapProps);
+	CD3DX12_TEXTURE_COPY_LOCATION dst(m_renderTargets[m_frameIndex].Get( ), 0);
+	CD3DX12_TEXTURE_COPY_LOCATION src(m_cpuOutputUpload.Get( ), m_cpuOutputFootprint);
+	m_commandList->CopyTextureRegion(&dst, 0, 0, 0, &src, nullptr);
 
-	uint8_t* pData;
-	ThrowIfFailed(m_lights->Map(0, nullptr, (void**) &pData));
-	memcpy(pData, &light, sizeof(Light));
-	m_lights->Unmap(0, nullptr);
+	transition = CD3DX12_RESOURCE_BARRIER::Transition(
+		m_renderTargets[m_frameIndex].Get( ), D3D12_RESOURCE_STATE_COPY_DEST,
+		D3D12_RESOURCE_STATE_RENDER_TARGET);
+	m_commandList->ResourceBarrier(1, &transition);
 }
 
 void D3D12HelloTriangle::OnKeyDown(UINT8 key) {
 	auto forward = XMVector3Normalize(At - Eye);
 	auto side = XMVector3Normalize(XMVector3Cross(forward, Up));
 
-	m_framesFromMove.x = 0;
+	m_framesFromMove = 0;
 
 	switch (key) {
 	case 0x57: //W
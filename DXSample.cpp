@@ -17,7 +17,8 @@ DXSample::DXSample(UINT width, UINT height, std::wstring name) :
 	m_width(width),
 	m_height(height),
 	m_title(name),
-	m_useWarpDevice(false)
+	m_useWarpDevice(false),
+	m_useCpuBackend(false)
 {
 	WCHAR assetsPath[512];
 	GetAssetsPath(assetsPath, _countof(assetsPath));
@@ -86,5 +87,11 @@ void DXSample::ParseCommandLineArgs(WCHAR* argv[], int argc)
 			m_useWarpDevice = true;
 			m_title = m_title + L" (WARP)";
 		}
+		else if (_wcsnicmp(argv[i], L"-cpu", wcslen(argv[i])) == 0 || 
+			_wcsnicmp(argv[i], L"/cpu", wcslen(argv[i])) == 0)
+		{
+			m_useCpuBackend = true;
+			m_title = m_title + L" (CPU)";
+		}
 	}
 }
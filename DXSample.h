@@ -54,6 +54,7 @@ protected:
 
 	// Adapter info.
 	bool m_useWarpDevice;
+	bool m_useCpuBackend;
 
 private:
 	// Root assets path.
@@ -71,7 +71,7 @@ void BottomLevelASGenerator::AddVertexBuffer(
 // API:
 //   - triangles (no custom intersector support)
 //   - 3xfloat32 format
-//   - 32-bit indices
+//   - 16- or 32-bit indices
 void BottomLevelASGenerator::AddVertexBuffer(
     ID3D12Resource *vertexBuffer, // Buffer containing the vertex coordinates,
                                   // possibly interleaved with other vertex data
@@ -89,11 +89,12 @@ void BottomLevelASGenerator::AddVertexBuffer(
                                      // vertices. This buffer cannot be nullptr
     UINT64 transformOffsetInBytes,   // Offset of the transform matrix in the
                                      // transform buffer
-    bool isOpaque /* = true */ // If true, the geometry is considered opaque,
-                               // optimizing the search for a closest hit
+    bool isOpaque /* = true */, // If true, the geometry is considered opaque,
+                                // optimizing the search for a closest hit
+    DXGI_FORMAT indexFormat /* = DXGI_FORMAT_R32_UINT */ // Format of the indices
 ) {
   // Create the DX12 descriptor representing the input data, assumed to be
-  // opaque triangles, with 3xf32 vertex coordinates and 32-bit indices
+  // opaque triangles, with 3xf32 vertex coordinates and 16- or 32-bit indices
   D3D12_RAYTRACING_GEOMETRY_DESC descriptor = {};
   descriptor.Type = D3D12_RAYTRACING_GEOMETRY_TYPE_TRIANGLES;
   descriptor.Triangles.VertexBuffer.StartAddress =
@@ -105,7 +106,7 @@ void BottomLevelASGenerator::AddVertexBuffer(
       indexBuffer ? (indexBuffer->GetGPUVirtualAddress() + indexOffsetInBytes)
                   : 0;
   descriptor.Triangles.IndexFormat =
-      indexBuffer ? DXGI_FORMAT_R32_UINT : DXGI_FORMAT_UNKNOWN;
+      indexBuffer ? indexFormat : DXGI_FORMAT_UNKNOWN;
   descriptor.Triangles.IndexCount = indexCount;
   descriptor.Triangles.Transform3x4 =
       transformBuffer
@@ -117,6 +118,29 @@ void BottomLevelASGenerator::AddVertexBuffer(
   m_vertexBuffers.push_back(descriptor);
 }
 
+//--------------------------------------------------------------------------------------------------
+// Add a buffer of axis-aligned boxes in GPU memory into the acceleration
+// structure. Every box is a procedural primitive: the traversal only reports
+// that a ray enters it, and the intersection shader decides about the hit
+void BottomLevelASGenerator::AddAabbBuffer(
+    ID3D12Resource *aabbBuffer, // Buffer containing the boxes
+    UINT64 aabbOffsetInBytes,   // Offset of the first box in the buffer
+    uint32_t aabbCount,         // Number of boxes to consider in the buffer
+    bool isOpaque /* = true */  // If true, the geometry is considered opaque,
+                                // optimizing the search for a closest hit
+) {
+  D3D12_RAYTRACING_GEOMETRY_DESC descriptor = {};
+  descriptor.Type = D3D12_RAYTRACING_GEOMETRY_TYPE_PROCEDURAL_PRIMITIVE_AABBS;
+  descriptor.AABBs.AABBs.StartAddress =
+      aabbBuffer->GetGPUVirtualAddress() + aabbOffsetInBytes;
+  descriptor.AABBs.AABBs.StrideInBytes = sizeof(D3D12_RAYTRACING_AABB);
+  descriptor.AABBs.AABBCount = aabbCount;
+  descriptor.Flags = isOpaque ? D3D12_RAYTRACING_GEOMETRY_FLAG_OPAQUE
+                              : D3D12_RAYTRACING_GEOMETRY_FLAG_NONE;
+
+  m_vertexBuffers.push_back(descriptor);
+}
+
 //--------------------------------------------------------------------------------------------------
 // Compute the size of the scratch space required to build the acceleration
 // structure, as well as the size of the resulting structure. The allocation of
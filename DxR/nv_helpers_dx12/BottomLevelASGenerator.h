@@ -101,8 +101,8 @@ public:
   );
 
   /// Add a vertex buffer along with its index buffer in GPU memory into the acceleration structure.
-  /// The vertices are supposed to be represented by 3 float32 value, and the indices are 32-bit
-  /// unsigned ints
+  /// The vertices are supposed to be represented by 3 float32 value, and the indices are 16- or
+  /// 32-bit unsigned ints
   void AddVertexBuffer(ID3D12Resource* vertexBuffer, /// Buffer containing the vertex coordinates,
                                                      /// possibly interleaved with other vertex data
                        UINT64 vertexOffsetInBytes,   /// Offset of the first vertex in the vertex
@@ -123,8 +123,19 @@ public:
                                                         /// be nullptr
                        UINT64 transformOffsetInBytes,   /// Offset of the transform matrix in the
                                                         /// transform buffer
-                       bool isOpaque = true /// If true, the geometry is considered opaque,
-                                            /// optimizing the search for a closest hit
+                       bool isOpaque = true, /// If true, the geometry is considered opaque,
+                                             /// optimizing the search for a closest hit
+                       DXGI_FORMAT indexFormat = DXGI_FORMAT_R32_UINT /// DXGI_FORMAT_R16_UINT or
+                                                                      /// DXGI_FORMAT_R32_UINT
+  );
+
+  /// Add a buffer of D3D12_RAYTRACING_AABB boxes in GPU memory into the acceleration structure. Each
+  /// box is one procedural primitive, resolved by the intersection shader of its hit group
+  void AddAabbBuffer(ID3D12Resource* aabbBuffer, /// Buffer containing the boxes
+                     UINT64 aabbOffsetInBytes,   /// Offset of the first box in the buffer
+                     uint32_t aabbCount,         /// Number of boxes to consider in the buffer
+                     bool isOpaque = true /// If true, the geometry is considered opaque,
+                                          /// optimizing the search for a closest hit
   );
 
   /// Compute the size of the scratch space required to build the acceleration structure, as well as
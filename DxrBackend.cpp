@@ -0,0 +1,575 @@
+#include "DxrBackend.h"
+#include <stdexcept>
+
+#include "DxR/DXRHelper.h"
+#include "DxR/nv_helpers_dx12/BottomLevelASGenerator.h"
+#include "DxR/nv_helpers_dx12/RaytracingPipelineGenerator.h"
+#include "DxR/nv_helpers_dx12/RootSignatureGenerator.h"
+
+DxrBackend::DxrBackend(ID3D12Device5* device, ID3D12CommandQueue* commandQueue, ID3D12CommandAllocator* commandAllocator,
+					   ID3D12GraphicsCommandList4* commandList, UINT width, UINT height, VertexFormat vertexFormat) :
+	m_device(device),
+	m_commandQueue(commandQueue),
+	m_commandAllocator(commandAllocator),
+	m_commandList(commandList),
+	m_width(width),
+	m_height(height),
+	m_vertexFormat(vertexFormat) {
+	ThrowIfFailed(m_device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&m_fence)));
+	m_fenceEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+	if (m_fenceEvent == nullptr) {
+		ThrowIfFailed(HRESULT_FROM_WIN32(GetLastError( )));
+	}
+
+	CreateRaytracingPipeline( );
+	CreateRaytracingOutputBuffer( );
+	CreateConstBuffers( );
+}
+
+DxrBackend::~DxrBackend( ) {
+	CloseHandle(m_fenceEvent);
+}
+
+void DxrBackend::UploadScene(const Scene& scene) {
+	for (const auto& mesh : scene.meshes) {
+		CreateMesh(mesh.Vertices, mesh.Indices);
+	}
+	for (const auto& file : scene.meshFiles) {
+		CreateMesh(*file);
+	}
+	// DXR only takes indexed or fully unrolled triangles, so the grids get their index buffer here.
+	for (const auto& grid : scene.grids) {
+		Object object = ObjectCreator::ExpandGrid(grid);
+		CreateMesh(object.Vertices, object.Indices);
+	}
+	for (const auto& shape : scene.shapes) {
+		CreateShape(shape);
+	}
+
+	// The instance transform also scales the unit shapes to their size.
+	size_t shapesBegin = scene.meshes.size( ) + scene.meshFiles.size( ) + scene.grids.size( );
+	for (const auto& object : scene.objects) {
+		XMMATRIX position = object.modelMatrix;
+		if (object.mesh >= shapesBegin) {
+			position = scene.shapes[object.mesh - shapesBegin].GetUnitTransform( ) * position;
+		}
+		CreateObject(object.mesh, object.material, position);
+	}
+	CreateLightBuffer(scene.light);
+}
+
+void DxrBackend::BuildAccelerationStructures( ) {
+	CreateAccelerationStructures( );
+
+	CreateShaderResourceHeap( );
+	CreateShaderBindingTable( );
+}
+
+void DxrBackend::Trace( ) {
+	std::vector<ID3D12DescriptorHeap*> heaps = {m_srvUavHeap.Get( )};
+	m_commandList->SetDescriptorHeaps(static_cast<UINT>(heaps.size( )), heaps.data( ));
+
+	CD3DX12_RESOURCE_BARRIER transition = CD3DX12_RESOURCE_BARRIER::Transition(
+		m_outputResource.Get( ), D3D12_RESOURCE_STATE_COPY_SOURCE,
+		D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+	m_commandList->ResourceBarrier(1, &transition);
+
+	D3D12_DISPATCH_RAYS_DESC desc = {};
+	CreateRayDesc(desc);
+
+	m_commandList->SetPipelineState1(m_rtStateObject.Get( ));
+	m_commandList->DispatchRays(&desc);
+
+	transition = CD3DX12_RESOURCE_BARRIER::Transition(
+		m_outputResource.Get( ), D3D12_RESOURCE_STATE_UNORDERED_ACCESS,
+		D3D12_RESOURCE_STATE_COPY_SOURCE);
+	m_commandList->ResourceBarrier(1, &transition);
+}
+
+void DxrBackend::ExecuteAndWait( ) {
+	m_commandList->Close( );
+	ID3D12CommandList* ppCommandLists[] = {m_commandList.Get( )};
+	m_commandQueue->ExecuteCommandLists(1, ppCommandLists);
+	m_fenceValue++;
+	m_commandQueue->Signal(m_fence.Get( ), m_fenceValue);
+
+	m_fence->SetEventOnCompletion(m_fenceValue, m_fenceEvent);
+	WaitForSingleObject(m_fenceEvent, INFINITE);
+
+	ThrowIfFailed(m_commandList->Reset(m_commandAllocator.Get( ), nullptr));
+}
+
+void DxrBackend::CreateRayDesc(D3D12_DISPATCH_RAYS_DESC& desc) {
+	UINT32 rayGenerationSectionSizeInBytes = m_sbtHelper.GetRayGenSectionSize( );
+	desc.RayGenerationShaderRecord.StartAddress = m_sbtStorage->GetGPUVirtualAddress( );
+	desc.RayGenerationShaderRecord.SizeInBytes = rayGenerationSectionSizeInBytes;
+
+	UINT32 missSectionSizeInBytes = m_sbtHelper.GetMissSectionSize( );
+	desc.MissShaderTable.StartAddress = m_sbtStorage->GetGPUVirtualAddress( ) + rayGenerationSectionSizeInBytes;
+	desc.MissShaderTable.SizeInBytes = missSectionSizeInBytes;
+	desc.MissShaderTable.StrideInBytes = m_sbtHelper.GetMissEntrySize( );
+
+	UINT32 hitGroupsSectionSize = m_sbtHelper.GetHitGroupSectionSize( );
+	desc.HitGroupTable.StartAddress = m_sbtStorage->GetGPUVirtualAddress( ) +
+		rayGenerationSectionSizeInBytes + missSectionSizeInBytes;
+	desc.HitGroupTable.SizeInBytes = hitGroupsSectionSize;
+	desc.HitGroupTable.StrideInBytes = m_sbtHelper.GetHitGroupEntrySize( );
+
+	desc.Width = m_width;
+	desc.Height = m_height;
+	desc.Depth = 1;
+}
+
+DxrBackend::AccelerationStructureBuffers
+DxrBackend::CreateBottomLevelAS(std::vector<std::pair<ComPtr<ID3D12Resource>, uint32_t>> vVertexBuffers,
+										std::vector<std::pair<ComPtr<ID3D12Resource>, uint32_t>> vIndexBuffers, UINT vertexStride, DXGI_FORMAT indexFormat) {
+	nv_helpers_dx12::BottomLevelASGenerator bottomLevelAS;
+
+	// Adding all vertex buffers and not transforming their position.
+	for (size_t i = 0; i < vVertexBuffers.size( ); i++) {
+		bottomLevelAS.AddVertexBuffer(vVertexBuffers[i].first.Get( ), 0, vVertexBuffers[i].second, vertexStride,
+									  vIndexBuffers[i].first.Get( ), 0, vIndexBuffers[i].second,
+									  nullptr, 0, true, indexFormat);
+	}
+
+	UINT64 scratchSizeInBytes = 0;
+	UINT64 resultSizeInBytes = 0;
+
+	bottomLevelAS.ComputeASBufferSizes(m_device.Get( ), false, &scratchSizeInBytes, &resultSizeInBytes);
+
+	AccelerationStructureBuffers buffers;
+	buffers.pScratch = nv_helpers_dx12::CreateBuffer(m_device.Get( ), scratchSizeInBytes, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS,
+													 D3D12_RESOURCE_STATE_COMMON, nv_helpers_dx12::kDefaultHeapProps);
+
+	buffers.pResult = nv_helpers_dx12::CreateBuffer(m_device.Get( ), resultSizeInBytes, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS,
+													D3D12_RESOURCE_STATE_RAYTRACING_ACCELERATION_STRUCTURE, nv_helpers_dx12::kDefaultHeapProps);
+
+	bottomLevelAS.Generate(m_commandList.Get( ), buffers.pScratch.Get( ), buffers.pResult.Get( ), false, nullptr);
+	return buffers;
+}
+
+DxrBackend::AccelerationStructureBuffers DxrBackend::CreateBottomLevelAS(ID3D12Resource* aabbBuffer) {
+	nv_helpers_dx12::BottomLevelASGenerator bottomLevelAS;
+	bottomLevelAS.AddAabbBuffer(aabbBuffer, 0, 1);
+
+	UINT64 scratchSizeInBytes = 0;
+	UINT64 resultSizeInBytes = 0;
+
+	bottomLevelAS.ComputeASBufferSizes(m_device.Get( ), false, &scratchSizeInBytes, &resultSizeInBytes);
+
+	AccelerationStructureBuffers buffers;
+	buffers.pScratch = nv_helpers_dx12::CreateBuffer(m_device.Get( ), scratchSizeInBytes, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS,
+													 D3D12_RESOURCE_STATE_COMMON, nv_helpers_dx12::kDefaultHeapProps);
+
+	buffers.pResult = nv_helpers_dx12::CreateBuffer(m_device.Get( ), resultSizeInBytes, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS,
+													D3D12_RESOURCE_STATE_RAYTRACING_ACCELERATION_STRUCTURE, nv_helpers_dx12::kDefaultHeapProps);
+
+	bottomLevelAS.Generate(m_commandList.Get( ), buffers.pScratch.Get( ), buffers.pResult.Get( ), false, nullptr);
+	return buffers;
+}
+
+void DxrBackend::CreateTopLevelAS(const std::vector<std::pair<ComPtr<ID3D12Resource>, DirectX::XMMATRIX>>& instances) {
+	for (size_t i = 0; i < instances.size( ); i++) {
+		m_topLevelASGenerator.AddInstance(instances[i].first.Get( ), instances[i].second, static_cast<UINT>(i), static_cast<UINT>(2 * i));
+	}
+
+	UINT64 scratchSize, resultSize, instanceDescsSize;
+
+	m_topLevelASGenerator.ComputeASBufferSizes(m_device.Get( ), true, &scratchSize, &resultSize, &instanceDescsSize);
+
+
+	m_topLevelASBuffers.pScratch = nv_helpers_dx12::CreateBuffer(
+		m_device.Get( ), scratchSize, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS,
+		D3D12_RESOURCE_STATE_UNORDERED_ACCESS, nv_helpers_dx12::kDefaultHeapProps);
+	m_topLevelASBuffers.pResult = nv_helpers_dx12::CreateBuffer(
+		m_device.Get( ), resultSize, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS,
+		D3D12_RESOURCE_STATE_RAYTRACING_ACCELERATION_STRUCTURE, nv_helpers_dx12::kDefaultHeapProps);
+	m_topLevelASBuffers.pInstanceDesc = nv_helpers_dx12::CreateBuffer(
+		m_device.Get( ), instanceDescsSize, D3D12_RESOURCE_FLAG_NONE,
+		D3D12_RESOURCE_STATE_GENERIC_READ, nv_helpers_dx12::kUploadHeapProps);
+
+	m_topLevelASGenerator.Generate(m_commandList.Get( ), m_topLevelASBuffers.pScratch.Get( ), m_topLevelASBuffers.pResult.Get( ), m_topLevelASBuffers.pInstanceDesc.Get( ));
+}
+
+void DxrBackend::CreateAccelerationStructures( ) {
+	// One BLAS per unique mesh. The scratch buffers have to outlive the command list execution.
+	std::vector<ComPtr<ID3D12Resource>> scratchBuffers;
+	for (const auto& mesh : m_meshes) {
+		AccelerationStructureBuffers BLASBuffer = mesh.procedural
+			? CreateBottomLevelAS(mesh.pVertexBuffer.Get( ))
+			: CreateBottomLevelAS({{mesh.pVertexBuffer.Get( ), mesh.uVertices}}, {{mesh.pIndexBuffer.Get( ), mesh.uIndices}}, mesh.uVertexStride, mesh.sIndexBufferView.Format);
+		m_bottomLevelAS.push_back(BLASBuffer.pResult);
+		scratchBuffers.push_back(BLASBuffer.pScratch);
+	}
+
+	for (const auto& object : m_objects) {
+		m_instances.push_back({m_bottomLevelAS[object.mesh], object.modelMatrix});
+	}
+	CreateTopLevelAS(m_instances);
+
+	ExecuteAndWait( );
+}
+
+ComPtr<ID3D12RootSignature> DxrBackend::CreateRayGenSignature( ) {
+	nv_helpers_dx12::RootSignatureGenerator rsc;
+	rsc.AddHeapRangesParameter({{0,1,0,D3D12_DESCRIPTOR_RANGE_TYPE_UAV,0},
+							   {1,1,0,D3D12_DESCRIPTOR_RANGE_TYPE_UAV,1},
+							   {2,1,0,D3D12_DESCRIPTOR_RANGE_TYPE_UAV,2},
+							   {3,1,0,D3D12_DESCRIPTOR_RANGE_TYPE_UAV,3},
+							   {4,1,0,D3D12_DESCRIPTOR_RANGE_TYPE_UAV,4},
+							   {0,1,0,D3D12_DESCRIPTOR_RANGE_TYPE_SRV,5},
+							   {0,1,0,D3D12_DESCRIPTOR_RANGE_TYPE_CBV,6}});
+	rsc.AddRootParameter(D3D12_ROOT_PARAMETER_TYPE_CBV, 1);
+
+	return rsc.Generate(m_device.Get( ), true);
+}
+
+ComPtr<ID3D12RootSignature> DxrBackend::CreateMissSignature( ) {
+	nv_helpers_dx12::RootSignatureGenerator rsc;
+	return rsc.Generate(m_device.Get( ), true);
+}
+
+ComPtr<ID3D12RootSignature> DxrBackend::CreateHitSignature( ) {
+	nv_helpers_dx12::RootSignatureGenerator rsc;
+
+	rsc.AddRootParameter(D3D12_ROOT_PARAMETER_TYPE_SRV, 0);
+	rsc.AddRootParameter(D3D12_ROOT_PARAMETER_TYPE_SRV, 1);
+	rsc.AddRootParameter(D3D12_ROOT_PARAMETER_TYPE_CBV, 0);
+	rsc.AddRootParameter(D3D12_ROOT_PARAMETER_TYPE_CBV, 1);
+	rsc.AddHeapRangesParameter({{2,1,0, D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 5}});
+	rsc.AddRootParameter(D3D12_ROOT_PARAMETER_TYPE_32BIT_CONSTANTS, 2, 0, 1);
+
+	return rsc.Generate(m_device.Get( ), true);
+}
+
+void DxrBackend::CreateRaytracingPipeline( ) {
+	nv_helpers_dx12::RayTracingPipelineGenerator pipeline(m_device.Get( ));
+
+	m_rayGenLibrary = nv_helpers_dx12::CompileShaderLibrary(L"Shaders/RayGen.hlsl");
+	m_missLibrary = nv_helpers_dx12::CompileShaderLibrary(L"Shaders/Miss.hlsl");
+	std::vector<DxcDefine> hitDefines;
+	if (m_vertexFormat == VertexFormat::Compact) {
+		hitDefines.push_back({L"COMPACT_VERTICES", L"1"});
+	}
+	m_hitLibrary = nv_helpers_dx12::CompileShaderLibrary(L"Shaders/Hit.hlsl", hitDefines);
+	m_shadowLiblary = nv_helpers_dx12::CompileShaderLibrary(L"Shaders/ShadowRay.hlsl");
+
+	pipeline.AddLibrary(m_rayGenLibrary.Get( ), {L"RayGen"});
+	pipeline.AddLibrary(m_missLibrary.Get( ), {L"Miss"});
+	pipeline.AddLibrary(m_hitLibrary.Get( ), {L"ObjectClosestHit", L"ShapeClosestHit", L"SphereIntersection", L"BoxIntersection"});
+	pipeline.AddLibrary(m_shadowLiblary.Get( ), {L"ShadowClosestHit", L"ShadowShapeClosestHit", L"ShadowMiss"});
+
+	m_rayGenSignature = CreateRayGenSignature( );
+	m_missSignature = CreateMissSignature( );
+	m_hitSignature = CreateHitSignature( );
+	m_shadowSignature = CreateHitSignature( );
+
+	pipeline.AddHitGroup(L"HitGroup", L"ObjectClosestHit");
+	pipeline.AddHitGroup(L"ShadowHitGroup", L"ShadowClosestHit");
+	// Procedural shapes, one hit group per intersection shader and ray type.
+	pipeline.AddHitGroup(L"SphereHitGroup", L"ShapeClosestHit", L"", L"SphereIntersection");
+	pipeline.AddHitGroup(L"BoxHitGroup", L"ShapeClosestHit", L"", L"BoxIntersection");
+	pipeline.AddHitGroup(L"ShadowSphereHitGroup", L"ShadowShapeClosestHit", L"", L"SphereIntersection");
+	pipeline.AddHitGroup(L"ShadowBoxHitGroup", L"ShadowShapeClosestHit", L"", L"BoxIntersection");
+
+	pipeline.AddRootSignatureAssociation(m_rayGenSignature.Get( ), {L"RayGen"});
+	pipeline.AddRootSignatureAssociation(m_missSignature.Get( ), {L"Miss", L"ShadowMiss"});
+	pipeline.AddRootSignatureAssociation(m_hitSignature.Get( ), {L"HitGroup", L"SphereHitGroup", L"BoxHitGroup"});
+	pipeline.AddRootSignatureAssociation(m_shadowSignature.Get( ), {L"ShadowHitGroup", L"ShadowSphereHitGroup", L"ShadowBoxHitGroup"});
+
+	pipeline.SetMaxPayloadSize(7 * sizeof(float));
+	pipeline.SetMaxAttributeSize(3 * sizeof(float)); // ShapeAttributes
+	pipeline.SetMaxRecursionDepth(10);
+
+	m_rtStateObject = pipeline.Generate( );
+	ThrowIfFailed(m_rtStateObject->QueryInterface(IID_PPV_ARGS(&m_rtStateObjectProps)));
+}
+
+
+void DxrBackend::CreateRaytracingOutputBuffer( ) {
+	D3D12_RESOURCE_DESC resDesc = {};
+	resDesc.DepthOrArraySize = 1;
+	resDesc.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
+	resDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+	resDesc.Flags = D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS;
+	resDesc.Width = m_width;
+	resDesc.Height = m_height;
+	resDesc.Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN;
+	resDesc.MipLevels = 1;
+	resDesc.SampleDesc.Count = 1;
+
+	ThrowIfFailed(m_device->CreateCommittedResource(
+		&nv_helpers_dx12::kDefaultHeapProps, D3D12_HEAP_FLAG_NONE, &resDesc,
+		D3D12_RESOURCE_STATE_COPY_SOURCE, nullptr, IID_PPV_ARGS(&m_outputResource)
+	));
+
+	ThrowIfFailed(m_device->CreateCommittedResource(
+		&nv_helpers_dx12::kDefaultHeapProps, D3D12_HEAP_FLAG_NONE, &resDesc,
+		D3D12_RESOURCE_STATE_COPY_SOURCE, nullptr, IID_PPV_ARGS(&m_outputImage)
+	));
+	
+	ThrowIfFailed(m_device->CreateCommittedResource(
+		&nv_helpers_dx12::kDefaultHeapProps, D3D12_HEAP_FLAG_NONE, &resDesc,
+		D3D12_RESOURCE_STATE_COPY_SOURCE, nullptr, IID_PPV_ARGS(&m_outputGradX)
+	));
+
+	ThrowIfFailed(m_device->CreateCommittedResource(
+		&nv_helpers_dx12::kDefaultHeapProps, D3D12_HEAP_FLAG_NONE, &resDesc,
+		D3D12_RESOURCE_STATE_COPY_SOURCE, nullptr, IID_PPV_ARGS(&m_outputGradY)
+	));
+	
+	ThrowIfFailed(m_device->CreateCommittedResource(
+		&nv_helpers_dx12::kDefaultHeapProps, D3D12_HEAP_FLAG_NONE, &resDesc,
+		D3D12_RESOURCE_STATE_COPY_SOURCE, nullptr, IID_PPV_ARGS(&m_outputReconstruct)
+	));
+}
+
+void DxrBackend::CreateShaderResourceHeap( ) {
+	m_srvUavHeap = nv_helpers_dx12::CreateDescriptorHeap(m_device.Get( ), 7, D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, true);
+
+	D3D12_CPU_DESCRIPTOR_HANDLE srvHandle = m_srvUavHeap->GetCPUDescriptorHandleForHeapStart( );
+
+	D3D12_UNORDERED_ACCESS_VIEW_DESC uavDesc = {};
+	uavDesc.ViewDimension = D3D12_UAV_DIMENSION_TEXTURE2D;
+
+	// Output
+	m_device->CreateUnorderedAccessView(m_outputResource.Get( ), nullptr, &uavDesc, srvHandle);
+	srvHandle.ptr += m_device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+
+	// Image
+	m_device->CreateUnorderedAccessView(m_outputImage.Get( ), nullptr, &uavDesc, srvHandle);
+	srvHandle.ptr += m_device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+	
+	// GradX
+	m_device->CreateUnorderedAccessView(m_outputGradX.Get( ), nullptr, &uavDesc, srvHandle);
+	srvHandle.ptr += m_device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+
+	// Grad Y
+	m_device->CreateUnorderedAccessView(m_outputGradY.Get( ), nullptr, &uavDesc, srvHandle);
+	srvHandle.ptr += m_device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+
+	// Reconstr
+	m_device->CreateUnorderedAccessView(m_outputReconstruct.Get( ), nullptr, &uavDesc, srvHandle);
+	srvHandle.ptr += m_device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+
+	D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc;
+	srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+	srvDesc.ViewDimension = D3D12_SRV_DIMENSION_RAYTRACING_ACCELERATION_STRUCTURE;
+	srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+	srvDesc.RaytracingAccelerationStructure.Location = m_topLevelASBuffers.pResult->GetGPUVirtualAddress( );
+
+	m_device->CreateShaderResourceView(nullptr, &srvDesc, srvHandle);
+
+	srvHandle.ptr += m_device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+	D3D12_CONSTANT_BUFFER_VIEW_DESC cbvDesc = {};
+	cbvDesc.BufferLocation = m_cameraBuffer->GetGPUVirtualAddress( );
+	cbvDesc.SizeInBytes = m_cameraBufferSize;
+
+	m_device->CreateConstantBufferView(&cbvDesc, srvHandle);
+
+
+}
+
+void DxrBackend::CreateShaderBindingTable( ) {
+	m_sbtHelper.Reset( );
+	D3D12_GPU_DESCRIPTOR_HANDLE srvUavHeapHandle = m_srvUavHeap->GetGPUDescriptorHandleForHeapStart( );
+
+	auto heapPointer = reinterpret_cast<UINT64*>(srvUavHeapHandle.ptr);
+
+	m_sbtHelper.AddRayGenerationProgram(L"RayGen", {heapPointer, (void*) m_frameBuffer->GetGPUVirtualAddress()});
+	m_sbtHelper.AddMissProgram(L"Miss", {});
+	m_sbtHelper.AddMissProgram(L"ShadowMiss", {});
+
+	for (const auto& object : m_objects) {
+		const VBObject& mesh = m_meshes[object.mesh];
+
+		// Root constant b2: bytes per index, read by the index fetch of Hit.hlsl.
+		void* indexSize = (void*) static_cast<UINT64>(mesh.sIndexBufferView.Format == DXGI_FORMAT_R16_UINT ? 2 : 4);
+		// Shapes read neither buffer, but the root signature still needs a valid address for t1.
+		ID3D12Resource* indexBuffer = mesh.procedural ? mesh.pVertexBuffer.Get( ) : mesh.pIndexBuffer.Get( );
+
+		const wchar_t* hitGroup = L"HitGroup";
+		const wchar_t* shadowHitGroup = L"ShadowHitGroup";
+		if (mesh.procedural) {
+			hitGroup = mesh.shapeType == ShapeType::Sphere ? L"SphereHitGroup" : L"BoxHitGroup";
+			shadowHitGroup = mesh.shapeType == ShapeType::Sphere ? L"ShadowSphereHitGroup" : L"ShadowBoxHitGroup";
+		}
+
+		m_sbtHelper.AddHitGroup(hitGroup, {(void*) mesh.pVertexBuffer->GetGPUVirtualAddress( ),
+								(void*) indexBuffer->GetGPUVirtualAddress( ),(void*) object.material->GetGPUVirtualAddress( ),
+								(void*) m_lights->GetGPUVirtualAddress( ), heapPointer, indexSize});
+		m_sbtHelper.AddHitGroup(shadowHitGroup, {(void*) mesh.pVertexBuffer->GetGPUVirtualAddress( ),
+								(void*) indexBuffer->GetGPUVirtualAddress( ),(void*) object.material->GetGPUVirtualAddress( ),
+								(void*) m_lights->GetGPUVirtualAddress( ), heapPointer, indexSize});
+	}
+
+	UINT32 sbtSize = m_sbtHelper.ComputeSBTSize( );
+
+	m_sbtStorage = nv_helpers_dx12::CreateBuffer(m_device.Get( ), sbtSize, D3D12_RESOURCE_FLAG_NONE,
+												 D3D12_RESOURCE_STATE_GENERIC_READ, nv_helpers_dx12::kUploadHeapProps);
+
+	if (!m_sbtStorage) {
+		throw std::logic_error("Could not allocate the shader binding table");
+	}
+
+	m_sbtHelper.Generate(m_sbtStorage.Get( ), m_rtStateObjectProps.Get( ));
+}
+
+
+void DxrBackend::CreateConstBuffers( ) {
+	m_cameraBufferSize = sizeof(CameraMatrices); //V, P, Vinv, Pinv
+	m_frameBufferSize = sizeof(XMUINT4);
+
+	m_frameBuffer = nv_helpers_dx12::CreateBuffer(
+		m_device.Get( ), m_frameBufferSize, D3D12_RESOURCE_FLAG_NONE,
+		D3D12_RESOURCE_STATE_GENERIC_READ, nv_helpers_dx12::kUploadHeapProps
+	);
+
+	m_cameraBuffer = nv_helpers_dx12::CreateBuffer(
+		m_device.Get( ), m_cameraBufferSize, D3D12_RESOURCE_FLAG_NONE,
+		D3D12_RESOURCE_STATE_GENERIC_READ, nv_helpers_dx12::kUploadHeapProps
+	);
+}
+
+void DxrBackend::UpdateCamera(const CameraMatrices& camera) {
+	UINT8* pData;
+	ThrowIfFailed(m_cameraBuffer->Map(0, nullptr, (void**) &pData));
+	memcpy(pData, &camera, m_cameraBufferSize);
+	m_cameraBuffer->Unmap(0, nullptr);
+}
+
+void DxrBackend::UpdateFrameCount(UINT32 framesCount) {
+	m_framesFromMove.x = framesCount;
+
+	UINT8* pData;
+	ThrowIfFailed(m_frameBuffer->Map(0, nullptr, (void**) &pData));
+	memcpy(pData, &m_framesFromMove, m_frameBufferSize);
+	m_frameBuffer->Unmap(0, nullptr);
+}
+
+void DxrBackend::CreateMesh(const std::vector<Vertex>& vertices, const std::vector<UINT>& indices) {
+	VBObject mesh;
+
+	if (m_vertexFormat == VertexFormat::Compact) {
+		std::vector<CompactVertex> compactVertices = ObjectCreator::EncodeCompactVertices(vertices);
+		CreateVB(mesh, compactVertices.data( ), static_cast<UINT>(vertices.size( )), sizeof(CompactVertex));
+	} else {
+		CreateVB(mesh, vertices.data( ), static_cast<UINT>(vertices.size( )), sizeof(Vertex));
+	}
+
+	if (ObjectCreator::FitsShortIndices(vertices.size( ))) {
+		std::vector<uint16_t> shortIndices = ObjectCreator::EncodeShortIndices(indices);
+		CreateIB(mesh, shortIndices.data( ), static_cast<UINT>(indices.size( )), DXGI_FORMAT_R16_UINT);
+	} else {
+		CreateIB(mesh, indices.data( ), static_cast<UINT>(indices.size( )), DXGI_FORMAT_R32_UINT);
+	}
+
+	m_meshes.push_back(mesh);
+}
+
+void DxrBackend::CreateMesh(const MeshFile& file) {
+	// The file blocks already have the compact upload layout, so they are copied straight out of the mapping.
+	if (m_vertexFormat != VertexFormat::Compact) {
+		Object object = file.ToObject( );
+		CreateMesh(object.Vertices, object.Indices);
+		return;
+	}
+
+	// An index past the vertices would make the GPU read outside the vertex buffer.
+	file.ValidateContents( );
+	VBObject mesh;
+	CreateVB(mesh, file.GetVertices( ), static_cast<UINT>(file.GetVertexCount( )), sizeof(CompactVertex));
+	CreateIB(mesh, file.GetIndexData( ), static_cast<UINT>(file.GetIndexCount( )),
+			 file.GetIndexSize( ) == sizeof(uint16_t) ? DXGI_FORMAT_R16_UINT : DXGI_FORMAT_R32_UINT);
+
+	m_meshes.push_back(mesh);
+}
+
+void DxrBackend::CreateShape(const Shape& shape) {
+	// The instance transform scales the unit shape, so every shape has the same box.
+	const D3D12_RAYTRACING_AABB bounds = {-1, -1, -1, 1, 1, 1};
+
+	VBObject mesh = {};
+	CreateVB(mesh, &bounds, 1, sizeof(bounds));
+	mesh.procedural = true;
+	mesh.shapeType = shape.type;
+
+	m_meshes.push_back(mesh);
+}
+
+void DxrBackend::CreateObject(UINT mesh, Material material, XMMATRIX position) {
+	m_objects.push_back({mesh, CreateMaterial(material), position});
+}
+
+void DxrBackend::CreateVB(VBObject& object, const void* vertexData, UINT vertexCount, UINT vertexStride) {
+	object.uVertexStride = vertexStride;
+	object.uVertices = vertexCount;
+	const UINT bufferSize = vertexCount * vertexStride;
+
+	CD3DX12_HEAP_PROPERTIES heapProperty = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD);
+	CD3DX12_RESOURCE_DESC bufferResource = CD3DX12_RESOURCE_DESC::Buffer(bufferSize);
+	ThrowIfFailed(m_device->CreateCommittedResource(
+		&heapProperty, D3D12_HEAP_FLAG_NONE, &bufferResource,
+		D3D12_RESOURCE_STATE_GENERIC_READ, nullptr, IID_PPV_ARGS(&object.pVertexBuffer))
+	);
+
+	UINT8* pVertexDataBegin;
+	CD3DX12_RANGE readRange(0, 0);
+	ThrowIfFailed(object.pVertexBuffer->Map(0, &readRange, reinterpret_cast<void**>(&pVertexDataBegin)));
+	memcpy(pVertexDataBegin, vertexData, bufferSize);
+	object.pVertexBuffer->Unmap(0, nullptr);
+
+	object.sVertexBufferView.BufferLocation = object.pVertexBuffer->GetGPUVirtualAddress( );
+	object.sVertexBufferView.StrideInBytes = object.uVertexStride;
+	object.sVertexBufferView.SizeInBytes = bufferSize;
+}
+
+void DxrBackend::CreateIB(VBObject& object, const void* indexData, UINT indexCount, DXGI_FORMAT indexFormat) {
+	const UINT indexSize = indexFormat == DXGI_FORMAT_R16_UINT ? sizeof(uint16_t) : sizeof(UINT);
+	object.sIndexBufferView.Format = indexFormat;
+
+	object.uIndices = indexCount;
+	const UINT indexDataSize = indexCount * indexSize;
+	// Hit.hlsl fetches 16-bit indices two dwords at a time, so the buffer is padded to whole dwords.
+	const UINT indexBufferSize = (indexDataSize + 3) & ~3u;
+
+	CD3DX12_HEAP_PROPERTIES heapProperty = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD);
+	CD3DX12_RESOURCE_DESC bufferResource = CD3DX12_RESOURCE_DESC::Buffer(indexBufferSize);
+	ThrowIfFailed(m_device->CreateCommittedResource(
+		&heapProperty, D3D12_HEAP_FLAG_NONE, &bufferResource, //
+		D3D12_RESOURCE_STATE_GENERIC_READ, nullptr, IID_PPV_ARGS(&object.pIndexBuffer)));
+
+	// Copy the triangle data to the index buffer.
+	UINT8* pIndexDataBegin;
+	CD3DX12_RANGE readRange(0, 0);
+	ThrowIfFailed(object.pIndexBuffer->Map(0, &readRange, reinterpret_cast<void**>(&pIndexDataBegin)));
+	memcpy(pIndexDataBegin, indexData, indexDataSize);
+	memset(pIndexDataBegin + indexDataSize, 0, indexBufferSize - indexDataSize);
+	object.pIndexBuffer->Unmap(0, nullptr);
+
+	// Initialize the index buffer view.
+	object.sIndexBufferView.BufferLocation = object.pIndexBuffer->GetGPUVirtualAddress( );
+	object.sIndexBufferView.SizeInBytes = indexBufferSize;
+}
+
+ComPtr<ID3D12Resource> DxrBackend::CreateMaterial(Material material) {
+	auto m_constantBuffer = nv_helpers_dx12::CreateBuffer(
+		m_device.Get( ), sizeof(Material), D3D12_RESOURCE_FLAG_NONE, D3D12_RESOURCE_STATE_GENERIC_READ, nv_helpers_dx12::kUploadHeapProps);
+
+	uint8_t* pData;
+	ThrowIfFailed(m_constantBuffer->Map(0, nullptr, (void**) &pData));
+	memcpy(pData, &material, sizeof(Material));
+	m_constantBuffer->Unmap(0, nullptr);
+
+	return m_constantBuffer;
+}
+
+void DxrBackend::CreateLightBuffer(Light light) {
+	m_lights = nv_helpers_dx12::CreateBuffer(
+		m_device.Get( ), sizeof(Material), D3D12_RESOURCE_FLAG_NONE, D3D12_RESOURCE_STATE_GENERIC_READ, nv_helpers_dx12::kUploadHeapProps);
+
+	uint8_t* pData;
+	ThrowIfFailed(m_lights->Map(0, nullptr, (void**) &pData));
+	memcpy(pData, &light, sizeof(Light));
+	m_lights->Unmap(0, nullptr);
+}
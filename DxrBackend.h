@@ -0,0 +1,152 @@
+#pragma once
+
+#include "stdafx.h"
+#include "RenderBackend.h"
+
+#include "DxR/nv_helpers_dx12/TopLevelASGenerator.h"
+#include "DxR/nv_helpers_dx12/ShaderBindingTableGenerator.h"
+
+#include <vector>
+
+using namespace DirectX;
+using Microsoft::WRL::ComPtr;
+
+// The DXR path: scene buffers, BLAS/TLAS, the raytracing pipeline and its SBT, and the UAV outputs
+// written by Shaders/RayGen.hlsl. The device, queue and command list belong to the front-end.
+class DxrBackend : public RenderBackend {
+public:
+	// Geometry of one Scene::meshes, Scene::meshFiles, Scene::grids or Scene::shapes entry, shared by every object that references it.
+	struct VBObject {
+		ComPtr<ID3D12Resource> pVertexBuffer;
+		D3D12_VERTEX_BUFFER_VIEW sVertexBufferView;
+		UINT uVertices;
+		UINT uVertexStride;
+
+		ComPtr<ID3D12Resource> pIndexBuffer;
+		D3D12_INDEX_BUFFER_VIEW sIndexBufferView;
+		UINT uIndices;
+
+		// Scene::shapes are procedural: pVertexBuffer holds the one D3D12_RAYTRACING_AABB of the unit shape
+		// and there is no index buffer.
+		bool procedural = false;
+		ShapeType shapeType = ShapeType::Sphere;
+	};
+
+	// commandList must be open; BuildAccelerationStructures executes it once and resets it with commandAllocator.
+	// vertexFormat selects the vertex buffer layout and the matching STriVertex of Shaders/Hit.hlsl.
+	DxrBackend(ID3D12Device5* device, ID3D12CommandQueue* commandQueue, ID3D12CommandAllocator* commandAllocator,
+			   ID3D12GraphicsCommandList4* commandList, UINT width, UINT height, VertexFormat vertexFormat = VertexFormat::Compact);
+	~DxrBackend( );
+
+	void UploadScene(const Scene& scene) override;
+	void BuildAccelerationStructures( ) override;
+
+	void UpdateCamera(const CameraMatrices& camera) override;
+	void UpdateFrameCount(UINT32 framesCount) override;
+
+	// Records DispatchRays into the front-end's command list. The output is left in COPY_SOURCE state.
+	void Trace( ) override;
+
+	ID3D12Resource* GetOutputResource( ) const { return m_outputResource.Get( ); }
+
+private:
+	struct AccelerationStructureBuffers {
+		ComPtr<ID3D12Resource> pScratch; // Scratch memory for AS builder
+		ComPtr<ID3D12Resource> pResult;  // Where the AS is
+		ComPtr<ID3D12Resource> pInstanceDesc; // Holt the matrices of the instance
+	};
+
+	// One TLAS instance and hit group pair.
+	struct SceneInstance {
+		UINT mesh;
+		ComPtr<ID3D12Resource> material;
+		XMMATRIX modelMatrix;
+	};
+
+	ComPtr<ID3D12Device5> m_device;
+	ComPtr<ID3D12CommandQueue> m_commandQueue;
+	ComPtr<ID3D12CommandAllocator> m_commandAllocator;
+	ComPtr<ID3D12GraphicsCommandList4> m_commandList;
+	UINT m_width;
+	UINT m_height;
+	VertexFormat m_vertexFormat;
+
+	ComPtr<ID3D12Fence> m_fence;
+	UINT64 m_fenceValue = 0;
+	HANDLE m_fenceEvent;
+
+	nv_helpers_dx12::TopLevelASGenerator m_topLevelASGenerator;
+	nv_helpers_dx12::ShaderBindingTableGenerator m_sbtHelper;
+
+	AccelerationStructureBuffers m_topLevelASBuffers;
+	std::vector<std::pair<ComPtr<ID3D12Resource>, DirectX::XMMATRIX>> m_instances;
+
+	std::vector<VBObject> m_meshes;
+	std::vector<ComPtr<ID3D12Resource>> m_bottomLevelAS; // Per mesh
+	std::vector<SceneInstance> m_objects;
+	ComPtr<ID3D12Resource> m_lights = {};
+
+	// Raygen and trace
+	ComPtr<IDxcBlob> m_rayGenLibrary;
+	ComPtr<IDxcBlob> m_hitLibrary;
+	ComPtr<IDxcBlob> m_missLibrary;
+	ComPtr<IDxcBlob> m_shadowLiblary;
+
+	ComPtr<ID3D12RootSignature> m_rayGenSignature;
+	ComPtr<ID3D12RootSignature> m_hitSignature;
+	ComPtr<ID3D12RootSignature> m_missSignature;
+	ComPtr<ID3D12RootSignature> m_shadowSignature;
+
+	ComPtr<ID3D12StateObject> m_rtStateObject;
+	ComPtr<ID3D12StateObjectProperties> m_rtStateObjectProps;
+
+	ComPtr<ID3D12Resource> m_outputResource;
+	ComPtr<ID3D12Resource> m_outputImage;
+	ComPtr<ID3D12Resource> m_outputGradX;
+	ComPtr<ID3D12Resource> m_outputGradY;
+	ComPtr<ID3D12Resource> m_outputReconstruct;
+
+	ComPtr<ID3D12DescriptorHeap> m_srvUavHeap;
+
+	ComPtr<ID3D12Resource> m_sbtStorage;
+
+	// DxR extra
+	ComPtr<ID3D12Resource> m_cameraBuffer;
+	ComPtr<ID3D12Resource> m_frameBuffer;
+
+	UINT32 m_cameraBufferSize = 0;
+	UINT32 m_frameBufferSize = 0;
+	XMUINT4 m_framesFromMove = {0,0,0,0};
+
+	void CreateRayDesc(D3D12_DISPATCH_RAYS_DESC& desc);
+	void ExecuteAndWait( );
+
+	// DxR
+	AccelerationStructureBuffers CreateBottomLevelAS(std::vector<std::pair<ComPtr<ID3D12Resource>, uint32_t>> vVertexBuffers, std::vector<std::pair<ComPtr<ID3D12Resource>, uint32_t>> vIndexBuffers, UINT vertexStride, DXGI_FORMAT indexFormat);
+	AccelerationStructureBuffers CreateBottomLevelAS(ID3D12Resource* aabbBuffer);
+	void CreateTopLevelAS(const std::vector<std::pair<ComPtr<ID3D12Resource>, DirectX::XMMATRIX>>& instances);
+	void CreateAccelerationStructures( );
+
+	ComPtr<ID3D12RootSignature> CreateRayGenSignature( );
+	ComPtr<ID3D12RootSignature> CreateMissSignature( );
+	ComPtr<ID3D12RootSignature> CreateHitSignature( );
+	void CreateRaytracingPipeline( );
+
+	void CreateRaytracingOutputBuffer( );
+	void CreateShaderResourceHeap( );
+	void CreateShaderBindingTable( );
+
+	// DxR extra
+	void CreateConstBuffers( );
+
+	void CreateMesh(const std::vector<Vertex>& vertices, const std::vector<UINT>& indices);
+	void CreateMesh(const MeshFile& file);
+	void CreateShape(const Shape& shape);
+	void CreateObject(UINT mesh, Material material, XMMATRIX position = XMMatrixIdentity( ));
+
+	// Upload vertexCount vertices of vertexStride bytes and indexCount indices of indexFormat as they are.
+	void CreateVB(VBObject& object, const void* vertexData, UINT vertexCount, UINT vertexStride);
+	void CreateIB(VBObject& object, const void* indexData, UINT indexCount, DXGI_FORMAT indexFormat);
+	ComPtr<ID3D12Resource> CreateMaterial(Material material);
+	void CreateLightBuffer(Light light);
+};
@@ -0,0 +1,87 @@
+#include "MappedFile.h"
+#include <stdexcept>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(const std::string& path) {
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path.c_str( ), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		throw std::runtime_error("Cannot open " + path);
+	}
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size)) {
+		CloseHandle(file);
+		throw std::runtime_error("Cannot read the size of " + path);
+	}
+	m_size = static_cast<size_t>(size.QuadPart);
+	if (m_size == 0) {
+		// Empty files cannot be mapped; there is nothing to read anyway.
+		CloseHandle(file);
+		return;
+	}
+
+	HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	m_data = mapping ? static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+	if (!m_data) {
+		if (mapping) {
+			CloseHandle(mapping);
+		}
+		CloseHandle(file);
+		throw std::runtime_error("Cannot map " + path);
+	}
+	m_file = file;
+	m_mapping = mapping;
+#else
+	int file = open(path.c_str( ), O_RDONLY);
+	if (file < 0) {
+		throw std::runtime_error("Cannot open " + path);
+	}
+
+	struct stat status;
+	if (fstat(file, &status) != 0) {
+		close(file);
+		throw std::runtime_error("Cannot read the size of " + path);
+	}
+	m_size = static_cast<size_t>(status.st_size);
+	if (m_size == 0) {
+		close(file);
+		return;
+	}
+
+	void* data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, file, 0);
+	close(file); // The mapping keeps the file alive.
+	if (data == MAP_FAILED) {
+		throw std::runtime_error("Cannot map " + path);
+	}
+	madvise(data, m_size, MADV_SEQUENTIAL);
+	m_data = static_cast<const uint8_t*>(data);
+#endif
+}
+
+MappedFile::~MappedFile( ) {
+	if (!m_data) {
+		return;
+	}
+#ifdef _WIN32
+	UnmapViewOfFile(m_data);
+	CloseHandle(m_mapping);
+	CloseHandle(m_file);
+#else
+	munmap(const_cast<uint8_t*>(m_data), m_size);
+#endif
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// A whole file mapped read-only into memory. Pages are read on first touch, so opening is cheap for
+// any file size and threads can parse disjoint ranges without copying. Throws std::runtime_error if
+// the file cannot be opened or mapped.
+class MappedFile {
+public:
+	explicit MappedFile(const std::string& path);
+	~MappedFile( );
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	const uint8_t* GetData( ) const { return m_data; }
+	size_t GetSize( ) const { return m_size; }
+
+private:
+	const uint8_t* m_data = nullptr;
+	size_t m_size = 0;
+
+#ifdef _WIN32
+	void* m_file = nullptr;
+	void* m_mapping = nullptr;
+#endif
+};
@@ -0,0 +1,220 @@
+#include "MeshClusterizer.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace {
+	// Spreads the low 10 bits of v so that two zero bits follow each of them.
+	uint32_t ExpandBits(uint32_t v) {
+		v = (v * 0x00010001u) & 0xFF0000FFu;
+		v = (v * 0x00000101u) & 0x0F00F00Fu;
+		v = (v * 0x00000011u) & 0xC30C30C3u;
+		v = (v * 0x00000005u) & 0x49249249u;
+		return v;
+	}
+
+	// 30-bit Morton code of a point in [0, 1]^3.
+	uint32_t MortonCode(FXMVECTOR point) {
+		XMFLOAT3 p;
+		XMStoreFloat3(&p, point);
+		auto quantize = [](float value) { return static_cast<uint32_t>(std::clamp(value * 1024.0f, 0.0f, 1023.0f)); };
+		return (ExpandBits(quantize(p.x)) << 2) | (ExpandBits(quantize(p.y)) << 1) | ExpandBits(quantize(p.z));
+	}
+}
+
+std::vector<MeshCluster> MeshClusterizer::Build(Object& object, const ClusterSettings& settings) {
+	const uint32_t vertexCount = static_cast<uint32_t>(object.Vertices.size( ));
+	const uint32_t triangleCount = static_cast<uint32_t>(object.Indices.size( ) / 3);
+	std::vector<MeshCluster> clusters;
+	if (triangleCount == 0) {
+		return clusters;
+	}
+
+	const uint32_t maxTriangles = std::max(settings.maxTriangles, 1u);
+	const uint32_t maxVertices = std::max(settings.maxVertices, 3u);
+
+	std::vector<XMFLOAT3> centroids(triangleCount);
+	XMVECTOR boundsMin = XMVectorReplicate(FLT_MAX);
+	XMVECTOR boundsMax = XMVectorReplicate(-FLT_MAX);
+	for (uint32_t t = 0; t < triangleCount; t++) {
+		const uint32_t* triangle = &object.Indices[3 * t];
+		XMVECTOR centroid = (object.Vertices[triangle[0]].Position + object.Vertices[triangle[1]].Position + object.Vertices[triangle[2]].Position) / 3.0f;
+		XMStoreFloat3(&centroids[t], centroid);
+		boundsMin = XMVectorMin(boundsMin, centroid);
+		boundsMax = XMVectorMax(boundsMax, centroid);
+	}
+
+	// Seeds are taken in Morton order, so every new cluster starts next to the previous ones.
+	XMVECTOR scale = XMVectorReciprocal(XMVectorMax(boundsMax - boundsMin, XMVectorReplicate(1e-20f)));
+	std::vector<std::pair<uint32_t, uint32_t>> seedOrder(triangleCount);
+	for (uint32_t t = 0; t < triangleCount; t++) {
+		seedOrder[t] = {MortonCode((XMLoadFloat3(&centroids[t]) - boundsMin) * scale), t};
+	}
+	std::sort(seedOrder.begin( ), seedOrder.end( ));
+
+	// Triangles using each vertex.
+	std::vector<uint32_t> adjacencyOffset(vertexCount + 1, 0);
+	for (uint32_t index : object.Indices) {
+		adjacencyOffset[index + 1]++;
+	}
+	for (uint32_t v = 0; v < vertexCount; v++) {
+		adjacencyOffset[v + 1] += adjacencyOffset[v];
+	}
+	std::vector<uint32_t> adjacency(adjacencyOffset[vertexCount]);
+	std::vector<uint32_t> fill(adjacencyOffset.begin( ), adjacencyOffset.end( ) - 1);
+	for (uint32_t t = 0; t < triangleCount; t++) {
+		for (uint32_t k = 0; k < 3; k++) {
+			adjacency[fill[object.Indices[3 * t + k]]++] = t;
+		}
+	}
+
+	std::vector<uint32_t> clusterOf(triangleCount, UINT32_MAX);
+	std::vector<uint32_t> vertexCluster(vertexCount, UINT32_MAX);
+	std::vector<uint32_t> candidateCluster(triangleCount, UINT32_MAX);
+	std::vector<uint32_t> candidates;
+	std::vector<uint32_t> members;
+	std::vector<uint32_t> indices;
+	indices.reserve(object.Indices.size( ));
+
+	size_t seedCursor = 0;
+	for (uint32_t cluster = 0; ; cluster++) {
+		while (seedCursor < seedOrder.size( ) && clusterOf[seedOrder[seedCursor].second] != UINT32_MAX) {
+			seedCursor++;
+		}
+		if (seedCursor == seedOrder.size( )) {
+			break;
+		}
+
+		members.clear( );
+		candidates.clear( );
+		uint32_t clusterVertices = 0;
+		XMVECTOR centroidSum = XMVectorZero( );
+
+		auto add = [&](uint32_t t) {
+			clusterOf[t] = cluster;
+			members.push_back(t);
+			centroidSum += XMLoadFloat3(&centroids[t]);
+
+			for (uint32_t k = 0; k < 3; k++) {
+				uint32_t v = object.Indices[3 * t + k];
+				if (vertexCluster[v] == cluster) {
+					continue;
+				}
+				vertexCluster[v] = cluster;
+				clusterVertices++;
+
+				for (uint32_t a = adjacencyOffset[v]; a < adjacencyOffset[v + 1]; a++) {
+					uint32_t neighbour = adjacency[a];
+					if (clusterOf[neighbour] == UINT32_MAX && candidateCluster[neighbour] != cluster) {
+						candidateCluster[neighbour] = cluster;
+						candidates.push_back(neighbour);
+					}
+				}
+			}
+		};
+
+		add(seedOrder[seedCursor].second);
+
+		// Grow through shared vertices: prefer triangles that add the fewest new vertices, then the ones
+		// closest to the cluster centre, which keeps the clusters round.
+		while (members.size( ) < maxTriangles) {
+			XMVECTOR center = centroidSum / static_cast<float>(members.size( ));
+			uint32_t best = UINT32_MAX;
+			uint32_t bestNewVertices = 4;
+			float bestDistance = FLT_MAX;
+
+			for (size_t i = 0; i < candidates.size( ); ) {
+				uint32_t t = candidates[i];
+				if (clusterOf[t] != UINT32_MAX) {
+					candidates[i] = candidates.back( );
+					candidates.pop_back( );
+					continue;
+				}
+				i++;
+
+				const uint32_t* triangle = &object.Indices[3 * t];
+				uint32_t newVertices = (vertexCluster[triangle[0]] != cluster) + (vertexCluster[triangle[1]] != cluster) + (vertexCluster[triangle[2]] != cluster);
+				if (clusterVertices + newVertices > maxVertices || newVertices > bestNewVertices) {
+					continue;
+				}
+
+				float distance = XMVectorGetX(XMVector3LengthSq(XMLoadFloat3(&centroids[t]) - center));
+				if (newVertices < bestNewVertices || distance < bestDistance) {
+					best = t;
+					bestNewVertices = newVertices;
+					bestDistance = distance;
+				}
+			}
+
+			if (best == UINT32_MAX) {
+				break;
+			}
+			add(best);
+		}
+
+		std::sort(members.begin( ), members.end( ));
+		uint32_t firstTriangle = static_cast<uint32_t>(indices.size( ) / 3);
+		for (uint32_t t : members) {
+			indices.insert(indices.end( ), &object.Indices[3 * t], &object.Indices[3 * t] + 3);
+		}
+		clusters.push_back({firstTriangle, static_cast<uint32_t>(members.size( )), 0, { }, { }, { }, 0.0f});
+	}
+
+	object.Indices = std::move(indices);
+	for (auto& cluster : clusters) {
+		cluster = ComputeCluster(object, cluster.FirstTriangle, cluster.TriangleCount);
+	}
+	return clusters;
+}
+
+MeshCluster MeshClusterizer::ComputeCluster(const Object& object, uint32_t firstTriangle, uint32_t triangleCount) {
+	MeshCluster cluster = { };
+	cluster.FirstTriangle = firstTriangle;
+	cluster.TriangleCount = triangleCount;
+
+	const uint32_t* begin = &object.Indices[3 * static_cast<size_t>(firstTriangle)];
+	std::vector<uint32_t> vertices(begin, begin + 3 * static_cast<size_t>(triangleCount));
+	std::sort(vertices.begin( ), vertices.end( ));
+	vertices.erase(std::unique(vertices.begin( ), vertices.end( )), vertices.end( ));
+	cluster.VertexCount = static_cast<uint32_t>(vertices.size( ));
+
+	XMVECTOR boundsMin = XMVectorReplicate(FLT_MAX);
+	XMVECTOR boundsMax = XMVectorReplicate(-FLT_MAX);
+	for (uint32_t v : vertices) {
+		boundsMin = XMVectorMin(boundsMin, object.Vertices[v].Position);
+		boundsMax = XMVectorMax(boundsMax, object.Vertices[v].Position);
+	}
+	XMStoreFloat3(&cluster.BoundsMin, boundsMin);
+	XMStoreFloat3(&cluster.BoundsMax, boundsMax);
+
+	// Geometric normals, not the vertex normals: the cone has to hold for the faces rays actually hit.
+	std::vector<XMVECTOR> normals;
+	normals.reserve(triangleCount);
+	XMVECTOR axis = XMVectorZero( );
+	for (uint32_t t = 0; t < triangleCount; t++) {
+		XMVECTOR v0 = object.Vertices[begin[3 * t + 0]].Position;
+		XMVECTOR v1 = object.Vertices[begin[3 * t + 1]].Position;
+		XMVECTOR v2 = object.Vertices[begin[3 * t + 2]].Position;
+		XMVECTOR normal = XMVector3Cross(v1 - v0, v2 - v0);
+		if (XMVectorGetX(XMVector3LengthSq(normal)) > 0.0f) {
+			normal = XMVector3Normalize(normal);
+			normals.push_back(normal);
+			axis += normal;
+		}
+	}
+
+	cluster.ConeAxis = {0, 0, 1};
+	cluster.ConeCutoff = -1.0f;
+	if (normals.empty( ) || XMVectorGetX(XMVector3LengthSq(axis)) < 1e-12f) {
+		return cluster;
+	}
+
+	axis = XMVector3Normalize(axis);
+	float cutoff = 1.0f;
+	for (const auto& normal : normals) {
+		cutoff = std::min(cutoff, XMVectorGetX(XMVector3Dot(axis, normal)));
+	}
+	XMStoreFloat3(&cluster.ConeAxis, axis);
+	cluster.ConeCutoff = std::max(cutoff, -1.0f);
+	return cluster;
+}
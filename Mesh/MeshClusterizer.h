@@ -0,0 +1,21 @@
+#pragma once
+#include "../ObjectCreator.h"
+#include <vector>
+
+struct ClusterSettings {
+	uint32_t maxTriangles = 128;
+	uint32_t maxVertices = 96;
+};
+
+// Partitions meshes into MeshClusters: small, connected groups of neighbouring triangles, each a contiguous
+// range of the index buffer with its bounds and normal cone. MeshFile stores them next to the mesh.
+class MeshClusterizer {
+public:
+	// Reorders the triangles of object so that every cluster is one contiguous range and returns the clusters
+	// in index buffer order. Within a cluster the triangles keep their relative order, so a vertex cache
+	// optimized mesh stays mostly optimized. Vertices are not touched.
+	static std::vector<MeshCluster> Build(Object& object, const ClusterSettings& settings = {});
+
+	// Bounds and normal cone of triangles [firstTriangle, firstTriangle + triangleCount) of object.
+	static MeshCluster ComputeCluster(const Object& object, uint32_t firstTriangle, uint32_t triangleCount);
+};
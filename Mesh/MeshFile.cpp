@@ -0,0 +1,174 @@
+#include "MeshFile.h"
+#include <cfloat>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+static_assert(sizeof(MeshFileHeader) == 96, "MeshFileHeader is part of the file format");
+static_assert(sizeof(CompactVertex) == 16, "CompactVertex is part of the file format");
+static_assert(sizeof(MeshCluster) == 52, "MeshCluster is part of the file format");
+
+namespace {
+	uint64_t Align(uint64_t offset) {
+		return (offset + MeshFileAlignment - 1) & ~(MeshFileAlignment - 1);
+	}
+
+	// long is 32-bit on Windows, so the offsets go through the 64-bit seek functions of each platform.
+	int Seek(FILE* file, uint64_t offset) {
+#ifdef _WIN32
+		return _fseeki64(file, static_cast<__int64>(offset), SEEK_SET);
+#else
+		return fseeko(file, static_cast<off_t>(offset), SEEK_SET);
+#endif
+	}
+
+	uint64_t Tell(FILE* file) {
+#ifdef _WIN32
+		return static_cast<uint64_t>(_ftelli64(file));
+#else
+		return static_cast<uint64_t>(ftello(file));
+#endif
+	}
+
+	void WriteBlock(FILE* file, uint64_t offset, const void* data, size_t size) {
+		if (Seek(file, offset) != 0 || std::fwrite(data, 1, size, file) != size) {
+			std::fclose(file);
+			throw std::runtime_error("Cannot write mesh file");
+		}
+	}
+}
+
+MeshFile::MeshFile(const std::string& path) :
+	m_file(path) {
+	if (m_file.GetSize( ) < sizeof(MeshFileHeader)) {
+		throw std::runtime_error("Mesh file " + path + " is too small");
+	}
+	m_data = m_file.GetData( );
+	m_size = m_file.GetSize( );
+	m_header = reinterpret_cast<const MeshFileHeader*>(m_data);
+	ValidateHeader( );
+}
+
+void MeshFile::ValidateHeader( ) const {
+	const MeshFileHeader& header = *m_header;
+	if (std::memcmp(header.magic, MeshFileMagic, sizeof(MeshFileMagic)) != 0) {
+		throw std::runtime_error("Not a mesh file");
+	}
+	if (header.version != MeshFileVersion) {
+		throw std::runtime_error("Unsupported mesh file version");
+	}
+	if (header.vertexStride != sizeof(CompactVertex) || (header.indexSize != 2 && header.indexSize != 4)) {
+		throw std::runtime_error("Unsupported mesh file layout");
+	}
+
+	// Every block has to be aligned and inside the file; the counts are bounded first so the sizes cannot overflow.
+	auto checkBlock = [&](uint64_t offset, uint64_t count, uint64_t elementSize) {
+		if (offset % MeshFileAlignment != 0 || offset > m_size || count > (m_size - offset) / elementSize) {
+			throw std::runtime_error("Mesh file block out of range");
+		}
+	};
+	checkBlock(header.vertexOffset, header.vertexCount, header.vertexStride);
+	checkBlock(header.indexOffset, header.indexCount, header.indexSize);
+	checkBlock(header.clusterOffset, header.clusterCount, sizeof(MeshCluster));
+	if (header.indexOffset + GetIndexDataSize( ) > m_size) {
+		throw std::runtime_error("Mesh file block out of range");
+	}
+	if (header.indexCount % 3 != 0) {
+		throw std::runtime_error("Mesh file index count is not a whole number of triangles");
+	}
+}
+
+void MeshFile::ValidateContents( ) const {
+	for (size_t i = 0; i < GetIndexCount( ); i++) {
+		if (GetIndex(i) >= GetVertexCount( )) {
+			throw std::runtime_error("Mesh file index out of range");
+		}
+	}
+	uint64_t triangleCount = m_header->indexCount / 3;
+	for (size_t i = 0; i < GetClusterCount( ); i++) {
+		const MeshCluster& cluster = GetClusters( )[i];
+		if (cluster.FirstTriangle > triangleCount || cluster.TriangleCount > triangleCount - cluster.FirstTriangle) {
+			throw std::runtime_error("Mesh file cluster out of range");
+		}
+	}
+}
+
+uint32_t MeshFile::GetIndex(size_t i) const {
+	if (m_header->indexSize == 2) {
+		return static_cast<const uint16_t*>(GetIndexData( ))[i];
+	}
+	return static_cast<const uint32_t*>(GetIndexData( ))[i];
+}
+
+Object MeshFile::ToObject( ) const {
+	Object object;
+	object.Vertices.resize(GetVertexCount( ));
+	const CompactVertex* vertices = GetVertices( );
+	for (size_t i = 0; i < object.Vertices.size( ); i++) {
+		object.Vertices[i].Position = XMVectorSetW(XMLoadFloat3(&vertices[i].Position), 1);
+		object.Vertices[i].Normal = XMVectorSetW(DecodeOctahedralNormal(vertices[i].Normal), 1);
+	}
+
+	object.Indices.resize(GetIndexCount( ));
+	for (size_t i = 0; i < object.Indices.size( ); i++) {
+		object.Indices[i] = GetIndex(i);
+		if (object.Indices[i] >= object.Vertices.size( )) {
+			throw std::runtime_error("Mesh file index out of range");
+		}
+	}
+	return object;
+}
+
+void MeshFile::Write(const std::string& path, const Object& object, const std::vector<MeshCluster>& clusters) {
+	std::vector<CompactVertex> vertices = ObjectCreator::EncodeCompactVertices(object.Vertices);
+	bool shortIndices = ObjectCreator::FitsShortIndices(object.Vertices.size( ));
+
+	MeshFileHeader header = { };
+	std::memcpy(header.magic, MeshFileMagic, sizeof(MeshFileMagic));
+	header.version = MeshFileVersion;
+	header.vertexStride = sizeof(CompactVertex);
+	header.indexSize = shortIndices ? sizeof(uint16_t) : sizeof(uint32_t);
+	header.vertexCount = vertices.size( );
+	header.indexCount = object.Indices.size( );
+	header.clusterCount = clusters.size( );
+
+	header.vertexOffset = Align(sizeof(MeshFileHeader));
+	header.indexOffset = Align(header.vertexOffset + header.vertexCount * header.vertexStride);
+	uint64_t indexDataSize = (header.indexCount * header.indexSize + 3) & ~3ull;
+	header.clusterOffset = Align(header.indexOffset + indexDataSize);
+	uint64_t fileSize = header.clusterOffset + header.clusterCount * sizeof(MeshCluster);
+
+	XMVECTOR boundsMin = XMVectorReplicate(object.Vertices.empty( ) ? 0.0f : FLT_MAX);
+	XMVECTOR boundsMax = XMVectorReplicate(object.Vertices.empty( ) ? 0.0f : -FLT_MAX);
+	for (const auto& vertex : object.Vertices) {
+		boundsMin = XMVectorMin(boundsMin, vertex.Position);
+		boundsMax = XMVectorMax(boundsMax, vertex.Position);
+	}
+	XMStoreFloat3(&header.boundsMin, boundsMin);
+	XMStoreFloat3(&header.boundsMax, boundsMax);
+
+	FILE* file = std::fopen(path.c_str( ), "wb");
+	if (!file) {
+		throw std::runtime_error("Cannot create mesh file " + path);
+	}
+
+	WriteBlock(file, 0, &header, sizeof(header));
+	WriteBlock(file, header.vertexOffset, vertices.data( ), vertices.size( ) * sizeof(CompactVertex));
+	if (shortIndices) {
+		std::vector<uint16_t> indices = ObjectCreator::EncodeShortIndices(object.Indices);
+		indices.resize(indexDataSize / sizeof(uint16_t), 0);
+		WriteBlock(file, header.indexOffset, indices.data( ), indices.size( ) * sizeof(uint16_t));
+	} else {
+		WriteBlock(file, header.indexOffset, object.Indices.data( ), object.Indices.size( ) * sizeof(uint32_t));
+	}
+	WriteBlock(file, header.clusterOffset, clusters.data( ), clusters.size( ) * sizeof(MeshCluster));
+
+	// Pads the file up to the end of the last block, which is empty when there are no clusters.
+	if (Tell(file) < fileSize) {
+		WriteBlock(file, fileSize - 1, "", 1);
+	}
+
+	if (std::fclose(file) != 0) {
+		throw std::runtime_error("Cannot write mesh file " + path);
+	}
+}
@@ -0,0 +1,73 @@
+#pragma once
+#include "../ObjectCreator.h"
+#include "MappedFile.h"
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Header of the binary mesh container. The blocks hold exactly what DxrBackend uploads: CompactVertex
+// vertices, 16-bit indices when the mesh fits them (padded to whole dwords) or 32-bit ones, and an
+// optional MeshCluster table. Every block starts on a MeshFileAlignment boundary. Little-endian.
+struct MeshFileHeader {
+	char magic[4];
+	uint32_t version;
+	uint32_t vertexStride;
+	uint32_t indexSize;
+	uint64_t vertexCount;
+	uint64_t vertexOffset;
+	uint64_t indexCount;
+	uint64_t indexOffset;
+	uint64_t clusterCount;
+	uint64_t clusterOffset;
+	XMFLOAT3 boundsMin;
+	XMFLOAT3 boundsMax;
+	uint32_t reserved[2];
+};
+
+const char MeshFileMagic[4] = {'P', 'L', 'M', 'F'};
+const uint32_t MeshFileVersion = 1;
+const uint64_t MeshFileAlignment = 64;
+
+// A mesh file mapped read-only into memory. The accessors point into the mapping, so opening a file
+// costs the same for any mesh size and the blocks can be copied straight into GPU buffers or BVH inputs.
+// Throws std::runtime_error if the file cannot be mapped or its header does not describe valid blocks.
+// The block contents are not read on open: ToObject and the consumers that copy the blocks range check the
+// indices as they go, and ValidateContents checks everything at once.
+class MeshFile {
+public:
+	explicit MeshFile(const std::string& path);
+
+	// Writes object, encoded like DxrBackend uploads it, and clusters if there are any.
+	static void Write(const std::string& path, const Object& object, const std::vector<MeshCluster>& clusters = { });
+
+	const MeshFileHeader& GetHeader( ) const { return *m_header; }
+
+	const CompactVertex* GetVertices( ) const { return reinterpret_cast<const CompactVertex*>(m_data + m_header->vertexOffset); }
+	size_t GetVertexCount( ) const { return static_cast<size_t>(m_header->vertexCount); }
+
+	// Raw index block of GetIndexSize( )-byte indices, GetIndexDataSize( ) bytes including the padding.
+	const void* GetIndexData( ) const { return m_data + m_header->indexOffset; }
+	uint32_t GetIndexSize( ) const { return m_header->indexSize; }
+	size_t GetIndexCount( ) const { return static_cast<size_t>(m_header->indexCount); }
+	size_t GetIndexDataSize( ) const { return (GetIndexCount( ) * GetIndexSize( ) + 3) & ~static_cast<size_t>(3); }
+	uint32_t GetIndex(size_t i) const;
+
+	const MeshCluster* GetClusters( ) const { return reinterpret_cast<const MeshCluster*>(m_data + m_header->clusterOffset); }
+	size_t GetClusterCount( ) const { return static_cast<size_t>(m_header->clusterCount); }
+
+	// Throws std::runtime_error if an index refers past the vertices or a cluster past the triangles.
+	// Reads every index, so it takes as long as copying them.
+	void ValidateContents( ) const;
+
+	// Decodes the file into an Object for the code paths that need the generator layout. Throws
+	// std::runtime_error if an index refers past the vertices.
+	Object ToObject( ) const;
+
+private:
+	void ValidateHeader( ) const;
+
+	MappedFile m_file;
+	const uint8_t* m_data = nullptr;
+	size_t m_size = 0;
+	const MeshFileHeader* m_header = nullptr;
+};
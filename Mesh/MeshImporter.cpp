@@ -0,0 +1,894 @@
+#include "MeshImporter.h"
+#include "MappedFile.h"
+#include "../CpuRt/ThreadPool.h"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <charconv>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+	const size_t ChunkSize = 1 << 20;
+	const uint32_t CornerGrain = 1 << 16;
+	const uint32_t BucketCount = 256;
+	const uint32_t NoNormal = UINT32_MAX;
+
+	// An index into the positions or normals of the whole file, with the normal in the low half.
+	uint64_t CornerKey(uint32_t position, uint32_t normal) {
+		return (static_cast<uint64_t>(position) << 32) | normal;
+	}
+
+	void Run(ThreadPool* threadPool, uint32_t count, const ThreadPool::RangeTask& task, uint32_t grainSize = 1) {
+		if (threadPool) {
+			threadPool->ParallelFor(count, task, grainSize);
+		} else if (count > 0) {
+			task(0, count);
+		}
+	}
+
+	// Boundaries of pieces of [begin, end) of about ChunkSize bytes that each end after a newline.
+	std::vector<const char*> SplitLines(const char* begin, const char* end) {
+		std::vector<const char*> bounds = {begin};
+		const char* cursor = begin;
+		while (static_cast<size_t>(end - cursor) > ChunkSize) {
+			const char* newline = static_cast<const char*>(std::memchr(cursor + ChunkSize, '\n', end - cursor - ChunkSize));
+			if (!newline) {
+				break;
+			}
+			cursor = newline + 1;
+			bounds.push_back(cursor);
+		}
+		if (bounds.back( ) != end) {
+			bounds.push_back(end);
+		}
+		return bounds;
+	}
+
+	const char* NextLine(const char* p, const char* end) {
+		const char* newline = static_cast<const char*>(std::memchr(p, '\n', end - p));
+		return newline ? newline + 1 : end;
+	}
+
+	const char* SkipSpaces(const char* p, const char* end) {
+		while (p < end && (*p == ' ' || *p == '\t')) {
+			p++;
+		}
+		return p;
+	}
+
+	bool AtLineEnd(const char* p, const char* end) {
+		return p == end || *p == '\r' || *p == '\n' || *p == '#';
+	}
+
+	template <typename T>
+	bool ParseNumber(const char*& p, const char* end, T& value) {
+		p = SkipSpaces(p, end);
+		if (p < end && *p == '+') {
+			p++;
+		}
+		auto result = std::from_chars(p, end, value);
+		if (result.ec != std::errc( )) {
+			return false;
+		}
+		p = result.ptr;
+		return true;
+	}
+
+	// Merges the corners with equal keys into one vertex each, numbered in the order the corners first use
+	// them. The corners are bucketed by key hash so that every bucket is deduplicated on its own thread.
+	Object BuildObject(const std::vector<XMFLOAT3>& positions, const std::vector<XMFLOAT3>& normals,
+					   const std::vector<uint64_t>& keys, ThreadPool* threadPool) {
+		if (keys.size( ) > UINT32_MAX) {
+			throw std::runtime_error("Mesh has too many triangles");
+		}
+		const uint32_t cornerCount = static_cast<uint32_t>(keys.size( ));
+		const uint32_t segmentCount = (cornerCount + CornerGrain - 1) / CornerGrain;
+		auto segmentEnd = [&](uint32_t segment) { return static_cast<uint32_t>(std::min<uint64_t>(cornerCount, (segment + 1ull) * CornerGrain)); };
+		auto bucketOf = [](uint64_t key) { return static_cast<uint32_t>((key * 0x9E3779B97F4A7C15ull) >> 56); };
+
+		// Segment-major counts, turned into bucket-major offsets: every bucket lists its corners in ascending order.
+		std::vector<uint32_t> bucketCursor(static_cast<size_t>(segmentCount) * BucketCount, 0);
+		Run(threadPool, segmentCount, [&](uint32_t begin, uint32_t end) {
+			for (uint32_t segment = begin; segment < end; segment++) {
+				uint32_t* counts = &bucketCursor[static_cast<size_t>(segment) * BucketCount];
+				for (uint32_t corner = segment * CornerGrain; corner < segmentEnd(segment); corner++) {
+					counts[bucketOf(keys[corner])]++;
+				}
+			}
+		});
+
+		std::vector<uint32_t> bucketBegin(BucketCount + 1);
+		uint32_t offset = 0;
+		for (uint32_t bucket = 0; bucket < BucketCount; bucket++) {
+			bucketBegin[bucket] = offset;
+			for (uint32_t segment = 0; segment < segmentCount; segment++) {
+				uint32_t& cursor = bucketCursor[static_cast<size_t>(segment) * BucketCount + bucket];
+				uint32_t count = cursor;
+				cursor = offset;
+				offset += count;
+			}
+		}
+		bucketBegin[BucketCount] = offset;
+
+		std::vector<uint32_t> bucketed(cornerCount);
+		Run(threadPool, segmentCount, [&](uint32_t begin, uint32_t end) {
+			for (uint32_t segment = begin; segment < end; segment++) {
+				uint32_t* cursors = &bucketCursor[static_cast<size_t>(segment) * BucketCount];
+				for (uint32_t corner = segment * CornerGrain; corner < segmentEnd(segment); corner++) {
+					bucketed[cursors[bucketOf(keys[corner])]++] = corner;
+				}
+			}
+		});
+
+		// The first corner with a key represents all of them.
+		std::vector<uint32_t> first(cornerCount);
+		Run(threadPool, BucketCount, [&](uint32_t begin, uint32_t end) {
+			std::unordered_map<uint64_t, uint32_t> seen;
+			for (uint32_t bucket = begin; bucket < end; bucket++) {
+				seen.clear( );
+				seen.reserve(bucketBegin[bucket + 1] - bucketBegin[bucket]);
+				for (uint32_t i = bucketBegin[bucket]; i < bucketBegin[bucket + 1]; i++) {
+					uint32_t corner = bucketed[i];
+					first[corner] = seen.emplace(keys[corner], corner).first->second;
+				}
+			}
+		});
+		bucketed = { };
+
+		std::vector<uint32_t> segmentVertices(segmentCount + 1, 0);
+		Run(threadPool, segmentCount, [&](uint32_t begin, uint32_t end) {
+			for (uint32_t segment = begin; segment < end; segment++) {
+				for (uint32_t corner = segment * CornerGrain; corner < segmentEnd(segment); corner++) {
+					segmentVertices[segment + 1] += first[corner] == corner;
+				}
+			}
+		});
+		for (uint32_t segment = 0; segment < segmentCount; segment++) {
+			segmentVertices[segment + 1] += segmentVertices[segment];
+		}
+
+		Object object;
+		object.Vertices.resize(segmentVertices[segmentCount]);
+		object.Indices.resize(cornerCount);
+		std::atomic<bool> missingNormals {false};
+		Run(threadPool, segmentCount, [&](uint32_t begin, uint32_t end) {
+			for (uint32_t segment = begin; segment < end; segment++) {
+				uint32_t vertex = segmentVertices[segment];
+				for (uint32_t corner = segment * CornerGrain; corner < segmentEnd(segment); corner++) {
+					if (first[corner] != corner) {
+						continue;
+					}
+					uint32_t position = static_cast<uint32_t>(keys[corner] >> 32);
+					uint32_t normal = static_cast<uint32_t>(keys[corner]);
+					object.Vertices[vertex].Position = XMVectorSetW(XMLoadFloat3(&positions[position]), 1);
+					if (normal == NoNormal) {
+						object.Vertices[vertex].Normal = XMVectorZero( );
+						missingNormals = true;
+					} else {
+						object.Vertices[vertex].Normal = XMVectorSetW(XMVector3Normalize(XMLoadFloat3(&normals[normal])), 1);
+					}
+					object.Indices[corner] = vertex++;
+				}
+			}
+		});
+		Run(threadPool, segmentCount, [&](uint32_t begin, uint32_t end) {
+			// Head corners already hold their vertex and are read by other segments, so only the others are written.
+			for (uint32_t corner = begin * CornerGrain; corner < segmentEnd(end - 1); corner++) {
+				if (first[corner] != corner) {
+					object.Indices[corner] = object.Indices[first[corner]];
+				}
+			}
+		});
+
+		if (missingNormals) {
+			// Serial, as triangles scatter into shared vertices; the zero W marks the vertices to fill.
+			std::vector<XMFLOAT3> sums(object.Vertices.size( ), {0, 0, 0});
+			for (size_t i = 0; i + 2 < object.Indices.size( ); i += 3) {
+				const uint32_t* triangle = &object.Indices[i];
+				XMVECTOR v0 = object.Vertices[triangle[0]].Position;
+				XMVECTOR normal = XMVector3Cross(object.Vertices[triangle[1]].Position - v0, object.Vertices[triangle[2]].Position - v0);
+				for (uint32_t k = 0; k < 3; k++) {
+					XMStoreFloat3(&sums[triangle[k]], XMLoadFloat3(&sums[triangle[k]]) + normal);
+				}
+			}
+			for (size_t v = 0; v < object.Vertices.size( ); v++) {
+				if (XMVectorGetW(object.Vertices[v].Normal) != 0.0f) {
+					continue;
+				}
+				XMVECTOR sum = XMLoadFloat3(&sums[v]);
+				bool degenerate = XMVectorGetX(XMVector3LengthSq(sum)) <= 0.0f;
+				object.Vertices[v].Normal = degenerate ? XMVectorSet(0, 1, 0, 1) : XMVectorSetW(XMVector3Normalize(sum), 1);
+			}
+		}
+
+		return object;
+	}
+
+	// OBJ chunks are parsed before the vertex counts of the previous chunks are known, so negative indices
+	// are stored relative to the start of their chunk, offset by RelativeBias.
+	const int64_t RelativeBias = int64_t(1) << 62;
+	const int64_t MissingIndex = -1;
+
+	struct ObjCorner {
+		int64_t position;
+		int64_t normal;
+	};
+
+	struct ObjChunk {
+		std::vector<XMFLOAT3> positions;
+		std::vector<XMFLOAT3> normals;
+		std::vector<ObjCorner> corners; // Three per triangle.
+		bool valid = true;
+	};
+
+	bool ParseObjIndex(const char*& p, const char* end, size_t definedInChunk, int64_t& index) {
+		int64_t reference;
+		if (!ParseNumber(p, end, reference) || reference == 0 || reference > UINT32_MAX || reference < -static_cast<int64_t>(UINT32_MAX)) {
+			return false;
+		}
+		index = reference > 0 ? reference - 1 : RelativeBias + static_cast<int64_t>(definedInChunk) + reference;
+		return true;
+	}
+
+	void ParseObjChunk(const char* begin, const char* end, ObjChunk& chunk) {
+		std::vector<ObjCorner> polygon;
+		for (const char* line = begin; line < end; ) {
+			const char* lineEnd = NextLine(line, end);
+			const char* p = SkipSpaces(line, lineEnd);
+			line = lineEnd;
+
+			auto isKeyword = [&](const char* keyword, size_t length) {
+				return static_cast<size_t>(lineEnd - p) > length && std::memcmp(p, keyword, length) == 0 && (p[length] == ' ' || p[length] == '\t');
+			};
+
+			if (isKeyword("v", 1) || isKeyword("vn", 2)) {
+				bool normal = p[1] == 'n';
+				p += normal ? 2 : 1;
+				XMFLOAT3 value;
+				if (!ParseNumber(p, lineEnd, value.x) || !ParseNumber(p, lineEnd, value.y) || !ParseNumber(p, lineEnd, value.z)) {
+					chunk.valid = false;
+					return;
+				}
+				(normal ? chunk.normals : chunk.positions).push_back(value);
+			} else if (isKeyword("f", 1)) {
+				p++;
+				polygon.clear( );
+				while (!AtLineEnd(p = SkipSpaces(p, lineEnd), lineEnd)) {
+					ObjCorner corner = {0, MissingIndex};
+					if (!ParseObjIndex(p, lineEnd, chunk.positions.size( ), corner.position)) {
+						chunk.valid = false;
+						return;
+					}
+					if (p < lineEnd && *p == '/') {
+						p++;
+						int64_t texcoord;
+						if (p < lineEnd && *p != '/' && !ParseNumber(p, lineEnd, texcoord)) {
+							chunk.valid = false;
+							return;
+						}
+						if (p < lineEnd && *p == '/') {
+							p++;
+							if (!ParseObjIndex(p, lineEnd, chunk.normals.size( ), corner.normal)) {
+								chunk.valid = false;
+								return;
+							}
+						}
+					}
+					polygon.push_back(corner);
+				}
+				for (size_t k = 2; k < polygon.size( ); k++) {
+					chunk.corners.push_back(polygon[0]);
+					chunk.corners.push_back(polygon[k - 1]);
+					chunk.corners.push_back(polygon[k]);
+				}
+			}
+		}
+	}
+
+	enum class PlyType {
+		Int8, UInt8, Int16, UInt16, Int32, UInt32, Float32, Float64
+	};
+
+	struct PlyProperty {
+		std::string name;
+		PlyType type;
+		bool list;
+		PlyType countType;
+	};
+
+	struct PlyElement {
+		std::string name;
+		uint64_t count;
+		std::vector<PlyProperty> properties;
+	};
+
+	enum class PlyFormat {
+		Ascii, BinaryLittleEndian, BinaryBigEndian
+	};
+
+	struct PlyHeader {
+		PlyFormat format;
+		std::vector<PlyElement> elements;
+		size_t bodyOffset;
+	};
+
+	size_t PlyTypeSize(PlyType type) {
+		const size_t sizes[] = {1, 1, 2, 2, 4, 4, 4, 8};
+		return sizes[static_cast<int>(type)];
+	}
+
+	PlyType ParsePlyType(const std::string& name) {
+		const char* names[][2] = {
+			{"char", "int8"}, {"uchar", "uint8"}, {"short", "int16"}, {"ushort", "uint16"},
+			{"int", "int32"}, {"uint", "uint32"}, {"float", "float32"}, {"double", "float64"}
+		};
+		for (int type = 0; type < 8; type++) {
+			if (name == names[type][0] || name == names[type][1]) {
+				return static_cast<PlyType>(type);
+			}
+		}
+		throw std::runtime_error("Unknown PLY property type " + name);
+	}
+
+	PlyHeader ParsePlyHeader(const char* data, size_t size) {
+		const char* end = data + size;
+		const char* line = data;
+		auto nextWords = [&]( ) {
+			const char* lineEnd = NextLine(line, end);
+			std::vector<std::string> words;
+			for (const char* p = line; p < lineEnd; ) {
+				p = SkipSpaces(p, lineEnd);
+				const char* word = p;
+				while (p < lineEnd && !std::isspace(static_cast<unsigned char>(*p))) {
+					p++;
+				}
+				if (p > word) {
+					words.emplace_back(word, p);
+				}
+				while (p < lineEnd && std::isspace(static_cast<unsigned char>(*p))) {
+					p++;
+				}
+			}
+			line = lineEnd;
+			return words;
+		};
+
+		std::vector<std::string> words = nextWords( );
+		if (words.size( ) != 1 || words[0] != "ply") {
+			throw std::runtime_error("Not a PLY file");
+		}
+
+		PlyHeader header = { };
+		bool hasFormat = false;
+		while (line < end) {
+			words = nextWords( );
+			if (words.empty( ) || words[0] == "comment" || words[0] == "obj_info") {
+				continue;
+			}
+			if (words[0] == "end_header") {
+				if (!hasFormat) {
+					throw std::runtime_error("PLY header has no format");
+				}
+				header.bodyOffset = line - data;
+				return header;
+			}
+			if (words[0] == "format" && words.size( ) >= 2) {
+				hasFormat = true;
+				if (words[1] == "ascii") {
+					header.format = PlyFormat::Ascii;
+				} else if (words[1] == "binary_little_endian") {
+					header.format = PlyFormat::BinaryLittleEndian;
+				} else if (words[1] == "binary_big_endian") {
+					header.format = PlyFormat::BinaryBigEndian;
+				} else {
+					throw std::runtime_error("Unknown PLY format " + words[1]);
+				}
+			} else if (words[0] == "element" && words.size( ) == 3) {
+				header.elements.push_back({words[1], std::stoull(words[2]), { }});
+			} else if (words[0] == "property" && !header.elements.empty( )) {
+				if (words.size( ) == 5 && words[1] == "list") {
+					header.elements.back( ).properties.push_back({words[4], ParsePlyType(words[3]), true, ParsePlyType(words[2])});
+				} else if (words.size( ) == 3) {
+					header.elements.back( ).properties.push_back({words[2], ParsePlyType(words[1]), false, PlyType::UInt8});
+				} else {
+					throw std::runtime_error("Malformed PLY property");
+				}
+			} else {
+				throw std::runtime_error("Malformed PLY header");
+			}
+		}
+		throw std::runtime_error("PLY header has no end_header");
+	}
+
+	double ReadPlyValue(PlyType type, const uint8_t* p, bool swap) {
+		uint8_t bytes[8];
+		size_t size = PlyTypeSize(type);
+		if (swap) {
+			std::reverse_copy(p, p + size, bytes);
+		} else {
+			std::memcpy(bytes, p, size);
+		}
+
+		switch (type) {
+			case PlyType::Int8: { int8_t v; std::memcpy(&v, bytes, 1); return v; }
+			case PlyType::UInt8: return bytes[0];
+			case PlyType::Int16: { int16_t v; std::memcpy(&v, bytes, 2); return v; }
+			case PlyType::UInt16: { uint16_t v; std::memcpy(&v, bytes, 2); return v; }
+			case PlyType::Int32: { int32_t v; std::memcpy(&v, bytes, 4); return v; }
+			case PlyType::UInt32: { uint32_t v; std::memcpy(&v, bytes, 4); return v; }
+			case PlyType::Float32: { float v; std::memcpy(&v, bytes, 4); return v; }
+			case PlyType::Float64: { double v; std::memcpy(&v, bytes, 8); return v; }
+		}
+		return 0.0;
+	}
+
+	// Which properties of the vertex element are imported: x, y, z, nx, ny, nz, or -1.
+	std::vector<int> MapVertexProperties(const PlyElement& element, bool& hasNormals) {
+		const char* names[] = {"x", "y", "z", "nx", "ny", "nz"};
+		std::vector<int> components(element.properties.size( ), -1);
+		uint32_t found = 0;
+		for (size_t i = 0; i < element.properties.size( ); i++) {
+			for (int component = 0; component < 6; component++) {
+				if (element.properties[i].name == names[component] && !element.properties[i].list) {
+					components[i] = component;
+					found |= 1u << component;
+				}
+			}
+		}
+		if ((found & 7u) != 7u) {
+			throw std::runtime_error("PLY vertices have no x, y and z");
+		}
+		hasNormals = (found & 0x38u) == 0x38u;
+		return components;
+	}
+
+	size_t FindFaceList(const PlyElement& element) {
+		for (size_t i = 0; i < element.properties.size( ); i++) {
+			if (element.properties[i].list && (element.properties[i].name == "vertex_indices" || element.properties[i].name == "vertex_index")) {
+				return i;
+			}
+		}
+		throw std::runtime_error("PLY faces have no vertex_indices");
+	}
+
+	struct PlyMesh {
+		std::vector<XMFLOAT3> positions;
+		std::vector<XMFLOAT3> normals;
+		std::vector<uint64_t> keys;
+		bool hasNormals = false;
+	};
+
+	// Appends the fan of polygon to keys; false if it references a missing vertex.
+	bool AddPlyPolygon(const uint32_t* polygon, size_t count, const PlyMesh& mesh, std::vector<uint64_t>& keys) {
+		for (size_t k = 0; k < count; k++) {
+			if (polygon[k] >= mesh.positions.size( )) {
+				return false;
+			}
+		}
+		for (size_t k = 2; k < count; k++) {
+			for (uint32_t vertex : {polygon[0], polygon[k - 1], polygon[k]}) {
+				keys.push_back(CornerKey(vertex, mesh.hasNormals ? vertex : NoNormal));
+			}
+		}
+		return true;
+	}
+
+	void SetPlyComponent(PlyMesh& mesh, size_t vertex, int component, float value) {
+		XMFLOAT3& target = component < 3 ? mesh.positions[vertex] : mesh.normals[vertex];
+		(&target.x)[component % 3] = value;
+	}
+
+	void ReadPlyAscii(const PlyHeader& header, const char* data, size_t size, ThreadPool* threadPool, PlyMesh& mesh) {
+		const char* body = data + header.bodyOffset;
+		const char* end = data + size;
+		std::vector<const char*> bounds = SplitLines(body, end);
+		const uint32_t chunkCount = static_cast<uint32_t>(bounds.size( ) - 1);
+
+		// Every line is one record, so the line number tells which element and record a line holds.
+		std::vector<uint64_t> firstLine(chunkCount + 1, 0);
+		Run(threadPool, chunkCount, [&](uint32_t begin, uint32_t finish) {
+			for (uint32_t chunk = begin; chunk < finish; chunk++) {
+				for (const char* line = bounds[chunk]; line < bounds[chunk + 1]; line = NextLine(line, bounds[chunk + 1])) {
+					firstLine[chunk + 1]++;
+				}
+			}
+		});
+		for (uint32_t chunk = 0; chunk < chunkCount; chunk++) {
+			firstLine[chunk + 1] += firstLine[chunk];
+		}
+
+		std::vector<uint64_t> elementLine(header.elements.size( ) + 1, 0);
+		for (size_t e = 0; e < header.elements.size( ); e++) {
+			elementLine[e + 1] = elementLine[e] + header.elements[e].count;
+		}
+		if (firstLine[chunkCount] < elementLine.back( )) {
+			throw std::runtime_error("PLY file is truncated");
+		}
+
+		std::vector<int> vertexComponents;
+		for (const auto& element : header.elements) {
+			if (element.name == "vertex") {
+				bool hasNormals;
+				vertexComponents = MapVertexProperties(element, hasNormals);
+			}
+		}
+
+		std::vector<std::vector<uint64_t>> chunkKeys(chunkCount);
+		std::atomic<bool> invalid {false};
+		Run(threadPool, chunkCount, [&](uint32_t begin, uint32_t finish) {
+			std::vector<uint32_t> polygon;
+			for (uint32_t chunk = begin; chunk < finish && !invalid; chunk++) {
+				uint64_t lineNumber = firstLine[chunk];
+				size_t element = std::upper_bound(elementLine.begin( ), elementLine.end( ), lineNumber) - elementLine.begin( ) - 1;
+				for (const char* line = bounds[chunk]; line < bounds[chunk + 1] && element < header.elements.size( ); lineNumber++) {
+					const char* lineEnd = NextLine(line, bounds[chunk + 1]);
+					const char* p = line;
+					line = lineEnd;
+					while (element < header.elements.size( ) && lineNumber >= elementLine[element + 1]) {
+						element++;
+					}
+					if (element == header.elements.size( )) {
+						break;
+					}
+
+					const PlyElement& record = header.elements[element];
+					bool isVertex = record.name == "vertex";
+					bool isFace = record.name == "face";
+					if (!isVertex && !isFace) {
+						continue;
+					}
+					size_t index = lineNumber - elementLine[element];
+					for (size_t i = 0; i < record.properties.size( ); i++) {
+						const PlyProperty& property = record.properties[i];
+						if (!property.list) {
+							double value;
+							if (!ParseNumber(p, lineEnd, value)) {
+								invalid = true;
+								return;
+							}
+							int component = isVertex ? vertexComponents[i] : -1;
+							if (component >= 0 && (component < 3 || mesh.hasNormals)) {
+								SetPlyComponent(mesh, index, component, static_cast<float>(value));
+							}
+							continue;
+						}
+
+						uint64_t count;
+						if (!ParseNumber(p, lineEnd, count) || count > static_cast<uint64_t>(lineEnd - p)) {
+							invalid = true;
+							return;
+						}
+						polygon.resize(count);
+						for (uint64_t k = 0; k < count; k++) {
+							if (!ParseNumber(p, lineEnd, polygon[k])) {
+								invalid = true;
+								return;
+							}
+						}
+						if (isFace && (property.name == "vertex_indices" || property.name == "vertex_index") &&
+							!AddPlyPolygon(polygon.data( ), polygon.size( ), mesh, chunkKeys[chunk])) {
+							invalid = true;
+							return;
+						}
+					}
+				}
+			}
+		});
+		if (invalid) {
+			throw std::runtime_error("Malformed PLY record");
+		}
+
+		std::vector<size_t> keyOffset(chunkCount + 1, 0);
+		for (uint32_t chunk = 0; chunk < chunkCount; chunk++) {
+			keyOffset[chunk + 1] = keyOffset[chunk] + chunkKeys[chunk].size( );
+		}
+		mesh.keys.resize(keyOffset[chunkCount]);
+		Run(threadPool, chunkCount, [&](uint32_t begin, uint32_t finish) {
+			for (uint32_t chunk = begin; chunk < finish; chunk++) {
+				std::copy(chunkKeys[chunk].begin( ), chunkKeys[chunk].end( ), mesh.keys.begin( ) + keyOffset[chunk]);
+			}
+		});
+	}
+
+	void ReadPlyBinary(const PlyHeader& header, const uint8_t* data, size_t size, ThreadPool* threadPool, PlyMesh& mesh) {
+		const bool swap = header.format == PlyFormat::BinaryBigEndian;
+		const uint8_t* end = data + size;
+		const uint8_t* cursor = data + header.bodyOffset;
+
+		// Sizes of a property or record at p, or 0 if it runs past the end of the file.
+		auto propertySize = [&](const PlyProperty& property, const uint8_t* p) -> size_t {
+			size_t countSize = property.list ? PlyTypeSize(property.countType) : 0;
+			if (static_cast<size_t>(end - p) < countSize) {
+				return 0;
+			}
+			uint64_t count = property.list ? static_cast<uint64_t>(ReadPlyValue(property.countType, p, swap)) : 1;
+			if (count > static_cast<uint64_t>(end - p - countSize) / PlyTypeSize(property.type)) {
+				return 0;
+			}
+			return countSize + static_cast<size_t>(count) * PlyTypeSize(property.type);
+		};
+		auto recordSize = [&](const PlyElement& element, const uint8_t* p) -> size_t {
+			const uint8_t* start = p;
+			for (const auto& property : element.properties) {
+				size_t size = propertySize(property, p);
+				if (size == 0) {
+					return 0;
+				}
+				p += size;
+			}
+			return p - start;
+		};
+
+		for (const auto& element : header.elements) {
+			bool fixedSize = std::none_of(element.properties.begin( ), element.properties.end( ), [](const PlyProperty& property) { return property.list; });
+			size_t stride = 0;
+			for (const auto& property : element.properties) {
+				stride += property.list ? 0 : PlyTypeSize(property.type);
+			}
+
+			if (element.name == "vertex") {
+				if (!fixedSize) {
+					throw std::runtime_error("PLY vertices with list properties are not supported");
+				}
+				if (element.count > static_cast<uint64_t>(end - cursor) / std::max<size_t>(stride, 1)) {
+					throw std::runtime_error("PLY file is truncated");
+				}
+				bool hasNormals;
+				std::vector<int> components = MapVertexProperties(element, hasNormals);
+				std::vector<size_t> offsets(element.properties.size( ), 0);
+				for (size_t i = 1; i < offsets.size( ); i++) {
+					offsets[i] = offsets[i - 1] + PlyTypeSize(element.properties[i - 1].type);
+				}
+
+				const uint8_t* vertices = cursor;
+				Run(threadPool, static_cast<uint32_t>(element.count), [&](uint32_t begin, uint32_t finish) {
+					for (uint32_t vertex = begin; vertex < finish; vertex++) {
+						const uint8_t* record = vertices + static_cast<size_t>(vertex) * stride;
+						for (size_t i = 0; i < components.size( ); i++) {
+							if (components[i] >= 0 && (components[i] < 3 || mesh.hasNormals)) {
+								SetPlyComponent(mesh, vertex, components[i], static_cast<float>(ReadPlyValue(element.properties[i].type, record + offsets[i], swap)));
+							}
+						}
+					}
+				}, 4096);
+				cursor += element.count * stride;
+				continue;
+			}
+
+			if (element.name != "face") {
+				if (fixedSize) {
+					if (element.count > static_cast<uint64_t>(end - cursor) / std::max<size_t>(stride, 1)) {
+						throw std::runtime_error("PLY file is truncated");
+					}
+					cursor += element.count * stride;
+				} else {
+					for (uint64_t i = 0; i < element.count; i++) {
+						size_t recordBytes = recordSize(element, cursor);
+						if (recordBytes == 0) {
+							throw std::runtime_error("PLY file is truncated");
+						}
+						cursor += recordBytes;
+					}
+				}
+				continue;
+			}
+
+			const size_t list = FindFaceList(element);
+			const PlyProperty& indices = element.properties[list];
+			size_t listOffset = 0;
+			for (size_t i = 0; i < list; i++) {
+				listOffset += PlyTypeSize(element.properties[i].type);
+			}
+			const uint32_t faceCount = static_cast<uint32_t>(element.count);
+
+			// Almost every exported mesh is all triangles. Then every record has the same size and the faces
+			// are decoded in place; a count other than 3 anywhere means the records have to be walked instead.
+			bool otherLists = std::count_if(element.properties.begin( ), element.properties.end( ), [](const PlyProperty& property) { return property.list; }) > 1;
+			size_t triangleStride = stride + PlyTypeSize(indices.countType) + 3 * PlyTypeSize(indices.type);
+			if (!otherLists && element.count <= static_cast<uint64_t>(end - cursor) / triangleStride) {
+				mesh.keys.resize(static_cast<size_t>(faceCount) * 3);
+				// Once a polygon shows up, records decoded past it by other threads are at wrong offsets, so what
+				// they find only counts if every face turns out to be a triangle.
+				std::atomic<bool> polygons {false};
+				std::atomic<bool> missingVertex {false};
+				const uint8_t* faces = cursor;
+				Run(threadPool, faceCount, [&](uint32_t begin, uint32_t finish) {
+					for (uint32_t face = begin; face < finish && !polygons; face++) {
+						const uint8_t* record = faces + static_cast<size_t>(face) * triangleStride + listOffset;
+						if (ReadPlyValue(indices.countType, record, swap) != 3.0) {
+							polygons = true;
+							return;
+						}
+						record += PlyTypeSize(indices.countType);
+						for (uint32_t k = 0; k < 3; k++) {
+							uint32_t vertex = static_cast<uint32_t>(ReadPlyValue(indices.type, record + k * PlyTypeSize(indices.type), swap));
+							if (vertex >= mesh.positions.size( )) {
+								missingVertex = true;
+								vertex = 0;
+							}
+							mesh.keys[3 * static_cast<size_t>(face) + k] = CornerKey(vertex, mesh.hasNormals ? vertex : NoNormal);
+						}
+					}
+				}, 4096);
+				if (!polygons) {
+					if (missingVertex) {
+						throw std::runtime_error("PLY face references a missing vertex");
+					}
+					cursor += element.count * triangleStride;
+					continue;
+				}
+			}
+
+			std::vector<const uint8_t*> records(static_cast<size_t>(faceCount) + 1);
+			records[0] = cursor;
+			for (uint32_t face = 0; face < faceCount; face++) {
+				size_t recordBytes = recordSize(element, records[face]);
+				if (recordBytes == 0) {
+					throw std::runtime_error("PLY file is truncated");
+				}
+				records[face + 1] = records[face] + recordBytes;
+			}
+
+			const uint32_t groupCount = (faceCount + CornerGrain - 1) / CornerGrain;
+			std::vector<std::vector<uint64_t>> groupKeys(groupCount);
+			std::atomic<bool> invalid {false};
+			Run(threadPool, groupCount, [&](uint32_t begin, uint32_t finish) {
+				std::vector<uint32_t> polygon;
+				for (uint32_t group = begin; group < finish; group++) {
+					for (uint32_t face = group * CornerGrain; face < static_cast<uint32_t>(std::min<uint64_t>(faceCount, (group + 1ull) * CornerGrain)); face++) {
+						const uint8_t* record = records[face];
+						for (size_t i = 0; i < list; i++) {
+							record += propertySize(element.properties[i], record);
+						}
+						size_t count = static_cast<size_t>(ReadPlyValue(indices.countType, record, swap));
+						record += PlyTypeSize(indices.countType);
+						polygon.resize(count);
+						for (size_t k = 0; k < count; k++) {
+							polygon[k] = static_cast<uint32_t>(ReadPlyValue(indices.type, record + k * PlyTypeSize(indices.type), swap));
+						}
+						if (!AddPlyPolygon(polygon.data( ), count, mesh, groupKeys[group])) {
+							invalid = true;
+						}
+					}
+				}
+			});
+			if (invalid) {
+				throw std::runtime_error("PLY face references a missing vertex");
+			}
+
+			mesh.keys.clear( );
+			for (const auto& keys : groupKeys) {
+				mesh.keys.insert(mesh.keys.end( ), keys.begin( ), keys.end( ));
+			}
+			cursor = records[faceCount];
+		}
+	}
+}
+
+Object MeshImporter::Import(const std::string& path, ThreadPool* threadPool, MeshImportStats* stats) {
+	auto start = std::chrono::steady_clock::now( );
+
+	std::string extension = path.substr(std::min(path.size( ), path.find_last_of('.')));
+	std::transform(extension.begin( ), extension.end( ), extension.begin( ), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+
+	MappedFile file(path);
+	const char* data = reinterpret_cast<const char*>(file.GetData( ));
+	Object object;
+	if (extension == ".obj") {
+		object = ImportObj(data, file.GetSize( ), threadPool);
+	} else if (extension == ".ply") {
+		object = ImportPly(data, file.GetSize( ), threadPool);
+	} else {
+		throw std::runtime_error("Unsupported mesh format " + path);
+	}
+
+	if (stats) {
+		stats->bytes = file.GetSize( );
+		stats->vertices = object.Vertices.size( );
+		stats->triangles = object.Indices.size( ) / 3;
+		stats->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now( ) - start).count( );
+		stats->megabytesPerSecond = stats->seconds > 0.0 ? stats->bytes / 1e6 / stats->seconds : 0.0;
+		stats->trianglesPerSecond = stats->seconds > 0.0 ? stats->triangles / stats->seconds : 0.0;
+	}
+	return object;
+}
+
+Object MeshImporter::ImportObj(const char* data, size_t size, ThreadPool* threadPool) {
+	std::vector<const char*> bounds = SplitLines(data, data + size);
+	const uint32_t chunkCount = static_cast<uint32_t>(bounds.size( ) - 1);
+	std::vector<ObjChunk> chunks(chunkCount);
+	Run(threadPool, chunkCount, [&](uint32_t begin, uint32_t end) {
+		for (uint32_t chunk = begin; chunk < end; chunk++) {
+			ParseObjChunk(bounds[chunk], bounds[chunk + 1], chunks[chunk]);
+		}
+	});
+
+	std::vector<size_t> positionBase(chunkCount + 1, 0);
+	std::vector<size_t> normalBase(chunkCount + 1, 0);
+	std::vector<size_t> cornerBase(chunkCount + 1, 0);
+	for (uint32_t chunk = 0; chunk < chunkCount; chunk++) {
+		if (!chunks[chunk].valid) {
+			throw std::runtime_error("Malformed OBJ statement");
+		}
+		positionBase[chunk + 1] = positionBase[chunk] + chunks[chunk].positions.size( );
+		normalBase[chunk + 1] = normalBase[chunk] + chunks[chunk].normals.size( );
+		cornerBase[chunk + 1] = cornerBase[chunk] + chunks[chunk].corners.size( );
+	}
+	if (positionBase[chunkCount] >= UINT32_MAX || normalBase[chunkCount] >= UINT32_MAX) {
+		throw std::runtime_error("OBJ file has too many vertices");
+	}
+
+	std::vector<XMFLOAT3> positions(positionBase[chunkCount]);
+	std::vector<XMFLOAT3> normals(normalBase[chunkCount]);
+	std::vector<uint64_t> keys(cornerBase[chunkCount]);
+	std::atomic<bool> invalid {false};
+	Run(threadPool, chunkCount, [&](uint32_t begin, uint32_t end) {
+		auto resolve = [](int64_t index, size_t base, size_t count, uint32_t& resolved) {
+			if (index >= RelativeBias / 2) {
+				index = index - RelativeBias + static_cast<int64_t>(base);
+			}
+			resolved = static_cast<uint32_t>(index);
+			return index >= 0 && static_cast<uint64_t>(index) < count;
+		};
+
+		for (uint32_t chunk = begin; chunk < end; chunk++) {
+			ObjChunk& source = chunks[chunk];
+			std::copy(source.positions.begin( ), source.positions.end( ), positions.begin( ) + positionBase[chunk]);
+			std::copy(source.normals.begin( ), source.normals.end( ), normals.begin( ) + normalBase[chunk]);
+
+			for (size_t i = 0; i < source.corners.size( ); i++) {
+				uint32_t position;
+				uint32_t normal = NoNormal;
+				if (!resolve(source.corners[i].position, positionBase[chunk], positions.size( ), position) ||
+					(source.corners[i].normal != MissingIndex && !resolve(source.corners[i].normal, normalBase[chunk], normals.size( ), normal))) {
+					invalid = true;
+				}
+				keys[cornerBase[chunk] + i] = CornerKey(position, normal);
+			}
+			source = { };
+		}
+	});
+	if (invalid) {
+		throw std::runtime_error("OBJ face references a missing vertex");
+	}
+
+	return BuildObject(positions, normals, keys, threadPool);
+}
+
+Object MeshImporter::ImportPly(const char* data, size_t size, ThreadPool* threadPool) {
+	PlyHeader header = ParsePlyHeader(data, size);
+
+	PlyMesh mesh;
+	bool hasVertices = false;
+	for (const auto& element : header.elements) {
+		if (element.name == "vertex") {
+			if (element.count >= UINT32_MAX) {
+				throw std::runtime_error("PLY file has too many vertices");
+			}
+			MapVertexProperties(element, mesh.hasNormals);
+			mesh.positions.resize(static_cast<size_t>(element.count));
+			mesh.normals.resize(mesh.hasNormals ? static_cast<size_t>(element.count) : 0);
+			hasVertices = true;
+		} else if (element.name == "face") {
+			if (element.count >= UINT32_MAX) {
+				throw std::runtime_error("PLY file has too many faces");
+			}
+			FindFaceList(element);
+		}
+	}
+	if (!hasVertices) {
+		throw std::runtime_error("PLY file has no vertex element");
+	}
+
+	if (header.format == PlyFormat::Ascii) {
+		ReadPlyAscii(header, data, size, threadPool, mesh);
+	} else {
+		ReadPlyBinary(header, reinterpret_cast<const uint8_t*>(data), size, threadPool, mesh);
+	}
+
+	return BuildObject(mesh.positions, mesh.normals, mesh.keys, threadPool);
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include "../ObjectCreator.h"
+#include <cstddef>
+#include <string>
+
+class ThreadPool;
+
+struct MeshImportStats {
+	size_t bytes = 0;
+	size_t vertices = 0;
+	size_t triangles = 0;
+	double seconds = 0.0;
+	double megabytesPerSecond = 0.0;
+	double trianglesPerSecond = 0.0;
+};
+
+// Loads triangle meshes exported by DCC tools. The file is mapped, split into chunks of whole lines
+// (or records) that are parsed on every thread of the pool, and the chunks are merged into one Object.
+// OBJ corners that share a position and normal become one vertex, numbered in first-use order;
+// polygons are fanned into triangles. Vertices without a normal get the area-weighted one of their faces.
+// Texture coordinates, materials, groups and every other attribute are skipped.
+class MeshImporter {
+public:
+	// Picks the parser by extension (.obj or .ply). Throws std::runtime_error if the file cannot be read
+	// or is malformed.
+	static Object Import(const std::string& path, ThreadPool* threadPool = nullptr, MeshImportStats* stats = nullptr);
+
+	// Wavefront OBJ: v, vn and f statements, with 1-based or negative (relative) indices.
+	static Object ImportObj(const char* data, size_t size, ThreadPool* threadPool = nullptr);
+
+	// Stanford PLY in ASCII or binary of either endianness: the x, y, z and optional nx, ny, nz properties
+	// of the vertex element and the vertex_indices list of the face element.
+	static Object ImportPly(const char* data, size_t size, ThreadPool* threadPool = nullptr);
+};
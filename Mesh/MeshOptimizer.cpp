@@ -0,0 +1,288 @@
+#include "MeshOptimizer.h"
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
+
+namespace {
+	// Tuning of the vertex cache optimizer, from Forsyth's "Linear-Speed Vertex Cache Optimisation".
+	const uint32_t OptimizerCacheSize = 32;
+	const float CacheDecayPower = 1.5f;
+	const float LastTriangleScore = 0.75f;
+	const float ValenceBoostScale = 2.0f;
+	const float ValenceBoostPower = 0.5f;
+
+	float ComputeVertexScore(int cachePosition, uint32_t activeTriangles) {
+		if (activeTriangles == 0) {
+			return -1.0f;
+		}
+
+		float score = 0.0f;
+		if (cachePosition >= 0) {
+			if (cachePosition < 3) {
+				score = LastTriangleScore;
+			} else {
+				float scaler = 1.0f / (OptimizerCacheSize - 3);
+				score = std::pow(1.0f - (cachePosition - 3) * scaler, CacheDecayPower);
+			}
+		}
+
+		score += ValenceBoostScale * std::pow(static_cast<float>(activeTriangles), -ValenceBoostPower);
+		return score;
+	}
+
+	// The score only depends on small integers, so the common cases come from a table.
+	const uint32_t ScoreTableValence = 16;
+
+	struct VertexScoreTable {
+		float scores[OptimizerCacheSize + 1][ScoreTableValence];
+
+		VertexScoreTable( ) {
+			for (int position = -1; position < static_cast<int>(OptimizerCacheSize); position++) {
+				for (uint32_t valence = 0; valence < ScoreTableValence; valence++) {
+					scores[position + 1][valence] = ComputeVertexScore(position, valence);
+				}
+			}
+		}
+	};
+
+	float VertexScore(int cachePosition, uint32_t activeTriangles) {
+		static const VertexScoreTable table;
+		if (activeTriangles < ScoreTableValence) {
+			return table.scores[cachePosition + 1][activeTriangles];
+		}
+		return ComputeVertexScore(cachePosition, activeTriangles);
+	}
+
+	uint64_t CellKey(int64_t x, int64_t y, int64_t z) {
+		const uint64_t mask = (1ull << 21) - 1;
+		return ((static_cast<uint64_t>(x) & mask) << 42) | ((static_cast<uint64_t>(y) & mask) << 21) | (static_cast<uint64_t>(z) & mask);
+	}
+}
+
+MeshOptimizationReport MeshOptimizer::Optimize(Object& object) {
+	MeshOptimizationReport report;
+	report.before = ComputeStats(object);
+
+	Weld(object);
+	OptimizeVertexCache(object);
+	OptimizeVertexFetch(object);
+
+	report.after = ComputeStats(object);
+	return report;
+}
+
+void MeshOptimizer::Weld(Object& object, float epsilon) {
+	// With cells of twice the tolerance a match can only be in the cell of the vertex or in the
+	// neighbour on the side of the nearer cell face, so 8 cells cover it.
+	const float cellSize = 2.0f * std::max(epsilon, 1e-7f);
+
+	// Hash grid over the welded vertices. Each cell holds a chain through next.
+	std::unordered_map<uint64_t, uint32_t> cells;
+	cells.reserve(object.Vertices.size( ));
+	std::vector<uint32_t> next;
+	next.reserve(object.Vertices.size( ));
+
+	std::vector<Vertex> vertices;
+	vertices.reserve(object.Vertices.size( ));
+	std::vector<uint32_t> remap(object.Vertices.size( ));
+
+	for (size_t i = 0; i < object.Vertices.size( ); i++) {
+		const Vertex& vertex = object.Vertices[i];
+		XMFLOAT3 position;
+		XMStoreFloat3(&position, vertex.Position / cellSize);
+
+		int64_t cell[3] = {};
+		int64_t neighbour[3] = {};
+		const float coordinates[3] = {position.x, position.y, position.z};
+		for (int axis = 0; axis < 3; axis++) {
+			float base = std::floor(coordinates[axis]);
+			cell[axis] = static_cast<int64_t>(base);
+			neighbour[axis] = coordinates[axis] - base < 0.5f ? -1 : 1;
+		}
+
+		uint32_t match = UINT32_MAX;
+		for (uint32_t corner = 0; corner < 8 && match == UINT32_MAX; corner++) {
+			auto found = cells.find(CellKey(cell[0] + ((corner & 1) ? neighbour[0] : 0),
+											cell[1] + ((corner & 2) ? neighbour[1] : 0),
+											cell[2] + ((corner & 4) ? neighbour[2] : 0)));
+			for (uint32_t candidate = found == cells.end( ) ? UINT32_MAX : found->second; candidate != UINT32_MAX; candidate = next[candidate]) {
+				const Vertex& other = vertices[candidate];
+				if (XMVector3NearEqual(vertex.Position, other.Position, XMVectorReplicate(epsilon)) &&
+					XMVector3NearEqual(vertex.Normal, other.Normal, XMVectorReplicate(epsilon))) {
+					match = candidate;
+					break;
+				}
+			}
+		}
+
+		if (match == UINT32_MAX) {
+			match = static_cast<uint32_t>(vertices.size( ));
+			vertices.push_back(vertex);
+
+			auto inserted = cells.insert({CellKey(cell[0], cell[1], cell[2]), match});
+			next.push_back(inserted.second ? UINT32_MAX : inserted.first->second);
+			inserted.first->second = match;
+		}
+		remap[i] = match;
+	}
+
+	std::vector<uint32_t> indices;
+	indices.reserve(object.Indices.size( ));
+	for (size_t i = 0; i + 2 < object.Indices.size( ); i += 3) {
+		uint32_t a = remap[object.Indices[i]];
+		uint32_t b = remap[object.Indices[i + 1]];
+		uint32_t c = remap[object.Indices[i + 2]];
+		if (a != b && b != c && a != c) {
+			indices.insert(indices.end( ), {a, b, c});
+		}
+	}
+
+	object.Vertices = std::move(vertices);
+	object.Indices = std::move(indices);
+}
+
+void MeshOptimizer::OptimizeVertexCache(Object& object) {
+	const uint32_t vertexCount = static_cast<uint32_t>(object.Vertices.size( ));
+	const uint32_t triangleCount = static_cast<uint32_t>(object.Indices.size( ) / 3);
+	if (triangleCount == 0) {
+		return;
+	}
+
+	// Triangles using each vertex. The first activeTriangles entries are the ones not emitted yet.
+	std::vector<uint32_t> activeTriangles(vertexCount, 0);
+	for (uint32_t index : object.Indices) {
+		activeTriangles[index]++;
+	}
+
+	std::vector<uint32_t> adjacencyOffset(vertexCount + 1, 0);
+	for (uint32_t v = 0; v < vertexCount; v++) {
+		adjacencyOffset[v + 1] = adjacencyOffset[v] + activeTriangles[v];
+	}
+
+	std::vector<uint32_t> adjacency(adjacencyOffset[vertexCount]);
+	std::vector<uint32_t> fill(adjacencyOffset.begin( ), adjacencyOffset.end( ) - 1);
+	for (uint32_t t = 0; t < triangleCount; t++) {
+		for (uint32_t k = 0; k < 3; k++) {
+			adjacency[fill[object.Indices[3 * t + k]]++] = t;
+		}
+	}
+
+	std::vector<int> cachePosition(vertexCount, -1);
+	std::vector<float> vertexScore(vertexCount);
+	for (uint32_t v = 0; v < vertexCount; v++) {
+		vertexScore[v] = VertexScore(-1, activeTriangles[v]);
+	}
+
+	std::vector<float> triangleScore(triangleCount);
+	std::vector<bool> emitted(triangleCount, false);
+	for (uint32_t t = 0; t < triangleCount; t++) {
+		const uint32_t* triangle = &object.Indices[3 * t];
+		triangleScore[t] = vertexScore[triangle[0]] + vertexScore[triangle[1]] + vertexScore[triangle[2]];
+	}
+
+	std::vector<uint32_t> indices;
+	indices.reserve(object.Indices.size( ));
+
+	std::vector<uint32_t> cache;
+	std::vector<uint32_t> newCache;
+	cache.reserve(OptimizerCacheSize + 3);
+	newCache.reserve(OptimizerCacheSize + 3);
+
+	uint32_t bestTriangle = static_cast<uint32_t>(std::max_element(triangleScore.begin( ), triangleScore.end( )) - triangleScore.begin( ));
+	uint32_t cursor = 0;
+
+	for (uint32_t step = 0; step < triangleCount; step++) {
+		if (bestTriangle == UINT32_MAX) {
+			// Nothing adjacent to the cache is left, continue with the next triangle in input order.
+			while (emitted[cursor]) {
+				cursor++;
+			}
+			bestTriangle = cursor;
+		}
+
+		const uint32_t* triangle = &object.Indices[3 * bestTriangle];
+		emitted[bestTriangle] = true;
+		indices.insert(indices.end( ), triangle, triangle + 3);
+
+		newCache.clear( );
+		for (uint32_t k = 0; k < 3; k++) {
+			uint32_t v = triangle[k];
+			newCache.push_back(v);
+
+			uint32_t* begin = &adjacency[adjacencyOffset[v]];
+			uint32_t* end = begin + activeTriangles[v];
+			std::iter_swap(std::find(begin, end, bestTriangle), end - 1);
+			activeTriangles[v]--;
+		}
+		for (uint32_t v : cache) {
+			if (v != triangle[0] && v != triangle[1] && v != triangle[2]) {
+				newCache.push_back(v);
+			}
+		}
+
+		for (size_t i = 0; i < newCache.size( ); i++) {
+			uint32_t v = newCache[i];
+			cachePosition[v] = i < OptimizerCacheSize ? static_cast<int>(i) : -1;
+			vertexScore[v] = VertexScore(cachePosition[v], activeTriangles[v]);
+		}
+
+		bestTriangle = UINT32_MAX;
+		float bestScore = -1.0f;
+		for (uint32_t v : newCache) {
+			for (uint32_t a = 0; a < activeTriangles[v]; a++) {
+				uint32_t t = adjacency[adjacencyOffset[v] + a];
+				const uint32_t* other = &object.Indices[3 * t];
+				triangleScore[t] = vertexScore[other[0]] + vertexScore[other[1]] + vertexScore[other[2]];
+				if (triangleScore[t] > bestScore) {
+					bestScore = triangleScore[t];
+					bestTriangle = t;
+				}
+			}
+		}
+
+		if (newCache.size( ) > OptimizerCacheSize) {
+			newCache.resize(OptimizerCacheSize);
+		}
+		std::swap(cache, newCache);
+	}
+
+	object.Indices = std::move(indices);
+}
+
+void MeshOptimizer::OptimizeVertexFetch(Object& object) {
+	std::vector<uint32_t> remap(object.Vertices.size( ), UINT32_MAX);
+	std::vector<Vertex> vertices;
+	vertices.reserve(object.Vertices.size( ));
+
+	for (uint32_t& index : object.Indices) {
+		if (remap[index] == UINT32_MAX) {
+			remap[index] = static_cast<uint32_t>(vertices.size( ));
+			vertices.push_back(object.Vertices[index]);
+		}
+		index = remap[index];
+	}
+
+	object.Vertices = std::move(vertices);
+}
+
+MeshStats MeshOptimizer::ComputeStats(const Object& object) {
+	MeshStats stats;
+	stats.vertices = object.Vertices.size( );
+	stats.triangles = object.Indices.size( ) / 3;
+	if (stats.triangles == 0) {
+		return stats;
+	}
+
+	// FIFO cache: a vertex is resident while fewer than CacheSize misses happened since it was loaded.
+	std::vector<uint32_t> loadedAt(object.Vertices.size( ), 0);
+	uint32_t misses = 0;
+	for (uint32_t index : object.Indices) {
+		if (loadedAt[index] == 0 || misses + 1 - loadedAt[index] > CacheSize) {
+			misses++;
+			loadedAt[index] = misses;
+		}
+	}
+
+	stats.acmr = static_cast<float>(misses) / stats.triangles;
+	return stats;
+}
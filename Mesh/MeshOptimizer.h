@@ -0,0 +1,36 @@
+#pragma once
+#include "../ObjectCreator.h"
+#include <cstddef>
+
+struct MeshStats {
+	size_t vertices = 0;
+	size_t triangles = 0;
+	float acmr = 0; // Average cache miss ratio: transformed vertices per triangle with a FIFO cache.
+};
+
+struct MeshOptimizationReport {
+	MeshStats before;
+	MeshStats after;
+};
+
+// Post-processing for ObjectCreator output. The passes keep every triangle's winding and only
+// change how the triangles and vertices are stored, so the meshes render the same on both backends.
+class MeshOptimizer {
+public:
+	static const uint32_t CacheSize = 16;
+
+	// Weld, then OptimizeVertexCache, then OptimizeVertexFetch.
+	static MeshOptimizationReport Optimize(Object& object);
+
+	// Merges vertices whose positions and normals are within epsilon of each other, then drops the
+	// triangles that collapsed. CreateBox and CreateSphere emit every plane seam twice.
+	static void Weld(Object& object, float epsilon = 1e-5f);
+
+	// Reorders the triangles for the post-transform vertex cache (Forsyth's linear-speed algorithm).
+	static void OptimizeVertexCache(Object& object);
+
+	// Renumbers the vertices in the order the index buffer first references them.
+	static void OptimizeVertexFetch(Object& object);
+
+	static MeshStats ComputeStats(const Object& object);
+};
@@ -0,0 +1,51 @@
+#include "MeshRegistry.h"
+#include <cstring>
+#include <utility>
+
+namespace {
+	// FNV-1a over raw bytes.
+	uint64_t HashBytes(uint64_t hash, const void* data, size_t size) {
+		const uint8_t* bytes = static_cast<const uint8_t*>(data);
+		for (size_t i = 0; i < size; i++) {
+			hash = (hash ^ bytes[i]) * 1099511628211ull;
+		}
+		return hash;
+	}
+
+	bool Equal(const Object& a, const Object& b) {
+		return a.Vertices.size( ) == b.Vertices.size( ) && a.Indices.size( ) == b.Indices.size( ) &&
+			std::memcmp(a.Vertices.data( ), b.Vertices.data( ), a.Vertices.size( ) * sizeof(Vertex)) == 0 &&
+			std::memcmp(a.Indices.data( ), b.Indices.data( ), a.Indices.size( ) * sizeof(uint32_t)) == 0;
+	}
+}
+
+uint32_t MeshRegistry::Add(Object&& object) {
+	uint64_t hash = ComputeHash(object);
+
+	auto range = m_lookup.equal_range(hash);
+	for (auto it = range.first; it != range.second; ++it) {
+		if (Equal(m_meshes[it->second], object)) {
+			return it->second;
+		}
+	}
+
+	uint32_t mesh = static_cast<uint32_t>(m_meshes.size( ));
+	m_meshes.push_back(std::move(object));
+	m_lookup.insert({hash, mesh});
+	return mesh;
+}
+
+std::vector<Object> MeshRegistry::Release( ) {
+	std::vector<Object> meshes = std::move(m_meshes);
+	m_meshes.clear( );
+	m_lookup.clear( );
+	return meshes;
+}
+
+uint64_t MeshRegistry::ComputeHash(const Object& object) {
+	uint64_t hash = 14695981039346656037ull;
+	size_t counts[2] = {object.Vertices.size( ), object.Indices.size( )};
+	hash = HashBytes(hash, counts, sizeof(counts));
+	hash = HashBytes(hash, object.Vertices.data( ), object.Vertices.size( ) * sizeof(Vertex));
+	return HashBytes(hash, object.Indices.data( ), object.Indices.size( ) * sizeof(uint32_t));
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include "../ObjectCreator.h"
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// Deduplicates meshes by content. Objects that share geometry get the same index, so the backends
+// upload it and build its BLAS once and place it with several instances.
+class MeshRegistry {
+public:
+	// Returns the index of a mesh equal to object, adding object if there is none yet.
+	uint32_t Add(Object&& object);
+
+	const Object& Get(uint32_t mesh) const { return m_meshes[mesh]; }
+	size_t GetCount( ) const { return m_meshes.size( ); }
+
+	// Hands the meshes over in index order and empties the registry.
+	std::vector<Object> Release( );
+
+	static uint64_t ComputeHash(const Object& object);
+
+private:
+	std::vector<Object> m_meshes;
+	std::unordered_multimap<uint64_t, uint32_t> m_lookup;
+};
@@ -0,0 +1,412 @@
+#include "MeshSimplifier.h"
+#include <algorithm>
+#include <cmath>
+#include <queue>
+#include <unordered_map>
+
+namespace {
+	// Collapses that turn a triangle by more than this (cosine between the old and new normal) are rejected.
+	const double MinNormalCosine = 0.2;
+	// Levels that keep more than this share of the previous level's triangles end the chain.
+	const float MinLevelReduction = 0.9f;
+
+	struct Point {
+		double x, y, z;
+	};
+
+	Point operator+(Point a, Point b) { return {a.x + b.x, a.y + b.y, a.z + b.z}; }
+	Point operator-(Point a, Point b) { return {a.x - b.x, a.y - b.y, a.z - b.z}; }
+	Point operator*(Point a, double s) { return {a.x * s, a.y * s, a.z * s}; }
+	double Dot(Point a, Point b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+	Point Cross(Point a, Point b) { return {a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x}; }
+
+	// Sum of squared distances to a set of planes, as the symmetric 4x4 matrix of the plane equations.
+	struct Quadric {
+		double xx = 0, xy = 0, xz = 0, xw = 0, yy = 0, yz = 0, yw = 0, zz = 0, zw = 0, ww = 0;
+
+		static Quadric FromPlane(Point normal, double d) {
+			Quadric q;
+			q.xx = normal.x * normal.x; q.xy = normal.x * normal.y; q.xz = normal.x * normal.z; q.xw = normal.x * d;
+			q.yy = normal.y * normal.y; q.yz = normal.y * normal.z; q.yw = normal.y * d;
+			q.zz = normal.z * normal.z; q.zw = normal.z * d;
+			q.ww = d * d;
+			return q;
+		}
+
+		Quadric& operator+=(const Quadric& o) {
+			xx += o.xx; xy += o.xy; xz += o.xz; xw += o.xw; yy += o.yy;
+			yz += o.yz; yw += o.yw; zz += o.zz; zw += o.zw; ww += o.ww;
+			return *this;
+		}
+
+		double Evaluate(Point p) const {
+			return xx * p.x * p.x + 2 * xy * p.x * p.y + 2 * xz * p.x * p.z + 2 * xw * p.x
+				+ yy * p.y * p.y + 2 * yz * p.y * p.z + 2 * yw * p.y
+				+ zz * p.z * p.z + 2 * zw * p.z + ww;
+		}
+
+		// The point of least error, if the planes pin one down.
+		bool Minimum(Point& p) const {
+			double det = xx * (yy * zz - yz * yz) - xy * (xy * zz - yz * xz) + xz * (xy * yz - yy * xz);
+			if (std::fabs(det) < 1e-12) {
+				return false;
+			}
+			double bx = -xw, by = -yw, bz = -zw;
+			p.x = (bx * (yy * zz - yz * yz) - xy * (by * zz - yz * bz) + xz * (by * yz - yy * bz)) / det;
+			p.y = (xx * (by * zz - yz * bz) - bx * (xy * zz - yz * xz) + xz * (xy * bz - by * xz)) / det;
+			p.z = (xx * (yy * bz - by * yz) - xy * (xy * bz - by * xz) + bx * (xy * yz - yy * xz)) / det;
+			return true;
+		}
+	};
+
+	struct Candidate {
+		double cost;
+		uint32_t keep;
+		uint32_t remove;
+		uint32_t keepVersion;
+		uint32_t removeVersion;
+		Point target;
+
+		bool operator>(const Candidate& o) const { return cost > o.cost; }
+	};
+
+	uint64_t EdgeKey(uint32_t a, uint32_t b) {
+		return (static_cast<uint64_t>(std::min(a, b)) << 32) | std::max(a, b);
+	}
+
+	Point LoadPoint(FXMVECTOR v) {
+		XMFLOAT3 f;
+		XMStoreFloat3(&f, v);
+		return {f.x, f.y, f.z};
+	}
+
+	// Collapse state over a copy of the mesh. Run can be called with decreasing targets to take
+	// snapshots of one simplification, so every level is measured against the original quadrics.
+	class QuadricSimplifier {
+	public:
+		explicit QuadricSimplifier(const Object& object);
+
+		// Collapses until at most targetTriangles remain or the next collapse costs more than maxError.
+		void Run(size_t targetTriangles, float maxError);
+
+		size_t GetTriangleCount( ) const { return m_triangleCount; }
+		// Error reached so far: the quadric sums squared distances to the original planes, so its root
+		// bounds the distance to each of them.
+		float GetError( ) const { return static_cast<float>(std::sqrt(m_reachedCost)); }
+
+		Object Extract( ) const;
+
+	private:
+		void PushEdge(uint32_t a, uint32_t b);
+		void CollectNeighbours(uint32_t v, std::vector<uint32_t>& out) const;
+		bool KeepsOrientation(uint32_t v, uint32_t other, Point target) const;
+		bool Collapse(const Candidate& collapse);
+
+		std::vector<Vertex> m_vertices;
+		std::vector<Point> m_positions;
+		std::vector<uint32_t> m_indices;
+		std::vector<bool> m_triangleRemoved;
+		std::vector<std::vector<uint32_t>> m_vertexTriangles;
+		std::vector<Quadric> m_quadrics;
+		std::vector<bool> m_locked;
+		std::vector<bool> m_vertexRemoved;
+		std::vector<uint32_t> m_version;
+		std::priority_queue<Candidate, std::vector<Candidate>, std::greater<Candidate>> m_heap;
+
+		std::vector<uint32_t> m_neighbours;
+		std::vector<uint32_t> m_removeNeighbours;
+
+		size_t m_triangleCount;
+		double m_reachedCost = 0;
+	};
+
+	QuadricSimplifier::QuadricSimplifier(const Object& object) :
+		m_vertices(object.Vertices),
+		m_positions(object.Vertices.size( )),
+		m_indices(object.Indices),
+		m_triangleRemoved(object.Indices.size( ) / 3, false),
+		m_vertexTriangles(object.Vertices.size( )),
+		m_quadrics(object.Vertices.size( )),
+		m_locked(object.Vertices.size( ), false),
+		m_vertexRemoved(object.Vertices.size( ), false),
+		m_version(object.Vertices.size( ), 0),
+		m_triangleCount(object.Indices.size( ) / 3) {
+		for (size_t v = 0; v < m_vertices.size( ); v++) {
+			m_positions[v] = LoadPoint(m_vertices[v].Position);
+		}
+
+		for (uint32_t t = 0; t < m_triangleCount; t++) {
+			const uint32_t* triangle = &m_indices[3 * t];
+			Point normal = Cross(m_positions[triangle[1]] - m_positions[triangle[0]], m_positions[triangle[2]] - m_positions[triangle[0]]);
+			double length = std::sqrt(Dot(normal, normal));
+			if (length > 0) {
+				normal = normal * (1.0 / length);
+				Quadric plane = Quadric::FromPlane(normal, -Dot(normal, m_positions[triangle[0]]));
+				for (uint32_t k = 0; k < 3; k++) {
+					m_quadrics[triangle[k]] += plane;
+				}
+			}
+			for (uint32_t k = 0; k < 3; k++) {
+				m_vertexTriangles[triangle[k]].push_back(t);
+			}
+		}
+
+		// An edge used by a single triangle is on a boundary or a seam; its vertices never move.
+		std::unordered_map<uint64_t, uint32_t> edgeUse;
+		edgeUse.reserve(m_indices.size( ));
+		for (size_t i = 0; i < m_indices.size( ); i += 3) {
+			for (uint32_t k = 0; k < 3; k++) {
+				edgeUse[EdgeKey(m_indices[i + k], m_indices[i + (k + 1) % 3])]++;
+			}
+		}
+		for (const auto& edge : edgeUse) {
+			if (edge.second != 2) {
+				m_locked[edge.first >> 32] = true;
+				m_locked[edge.first & 0xFFFFFFFF] = true;
+			}
+		}
+
+		for (const auto& edge : edgeUse) {
+			PushEdge(static_cast<uint32_t>(edge.first >> 32), static_cast<uint32_t>(edge.first & 0xFFFFFFFF));
+		}
+	}
+
+	void QuadricSimplifier::PushEdge(uint32_t a, uint32_t b) {
+		if (m_locked[a] && m_locked[b]) {
+			return;
+		}
+
+		Quadric q = m_quadrics[a];
+		q += m_quadrics[b];
+
+		// A locked vertex stays where it is; otherwise try the optimum, the ends and the midpoint.
+		Point candidates[4];
+		uint32_t candidateCount = 0;
+		if (m_locked[a] || m_locked[b]) {
+			candidates[candidateCount++] = m_locked[a] ? m_positions[a] : m_positions[b];
+		} else {
+			Point midpoint = (m_positions[a] + m_positions[b]) * 0.5;
+			Point edge = m_positions[b] - m_positions[a];
+			Point optimum;
+			if (q.Minimum(optimum) && Dot(optimum - midpoint, optimum - midpoint) <= Dot(edge, edge)) {
+				candidates[candidateCount++] = optimum;
+			}
+			candidates[candidateCount++] = m_positions[a];
+			candidates[candidateCount++] = m_positions[b];
+			candidates[candidateCount++] = midpoint;
+		}
+
+		Candidate collapse;
+		collapse.cost = HUGE_VAL;
+		for (uint32_t i = 0; i < candidateCount; i++) {
+			double cost = std::max(q.Evaluate(candidates[i]), 0.0);
+			if (cost < collapse.cost) {
+				collapse.cost = cost;
+				collapse.target = candidates[i];
+			}
+		}
+
+		collapse.keep = m_locked[b] ? b : a;
+		collapse.remove = m_locked[b] ? a : b;
+		collapse.keepVersion = m_version[collapse.keep];
+		collapse.removeVersion = m_version[collapse.remove];
+		m_heap.push(collapse);
+	}
+
+	void QuadricSimplifier::CollectNeighbours(uint32_t v, std::vector<uint32_t>& out) const {
+		out.clear( );
+		for (uint32_t t : m_vertexTriangles[v]) {
+			for (uint32_t k = 0; k < 3; k++) {
+				uint32_t other = m_indices[3 * t + k];
+				if (other != v) {
+					out.push_back(other);
+				}
+			}
+		}
+		std::sort(out.begin( ), out.end( ));
+		out.erase(std::unique(out.begin( ), out.end( )), out.end( ));
+	}
+
+	// Moving v to target must not flip or degenerate any of its triangles that survive the collapse.
+	bool QuadricSimplifier::KeepsOrientation(uint32_t v, uint32_t other, Point target) const {
+		for (uint32_t t : m_vertexTriangles[v]) {
+			const uint32_t* triangle = &m_indices[3 * t];
+			if (triangle[0] == other || triangle[1] == other || triangle[2] == other) {
+				continue;
+			}
+
+			Point p[3] = {m_positions[triangle[0]], m_positions[triangle[1]], m_positions[triangle[2]]};
+			Point before = Cross(p[1] - p[0], p[2] - p[0]);
+			for (uint32_t k = 0; k < 3; k++) {
+				if (triangle[k] == v) {
+					p[k] = target;
+				}
+			}
+			Point after = Cross(p[1] - p[0], p[2] - p[0]);
+
+			double lengths = std::sqrt(Dot(before, before) * Dot(after, after));
+			if (lengths == 0 || Dot(before, after) < MinNormalCosine * lengths) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	bool QuadricSimplifier::Collapse(const Candidate& collapse) {
+		uint32_t keep = collapse.keep, remove = collapse.remove;
+
+		// Link condition: the two ends may only share the neighbours of their common triangles,
+		// otherwise the collapse pinches the surface.
+		uint32_t sharedTriangles = 0;
+		for (uint32_t t : m_vertexTriangles[remove]) {
+			const uint32_t* triangle = &m_indices[3 * t];
+			sharedTriangles += triangle[0] == keep || triangle[1] == keep || triangle[2] == keep;
+		}
+		CollectNeighbours(keep, m_neighbours);
+		CollectNeighbours(remove, m_removeNeighbours);
+		uint32_t sharedNeighbours = 0;
+		for (uint32_t v : m_removeNeighbours) {
+			sharedNeighbours += std::binary_search(m_neighbours.begin( ), m_neighbours.end( ), v);
+		}
+		if (sharedNeighbours != sharedTriangles) {
+			return false;
+		}
+
+		if (!KeepsOrientation(keep, remove, collapse.target) || !KeepsOrientation(remove, keep, collapse.target)) {
+			return false;
+		}
+
+		// The kept vertex takes the normal of the end the target is closer to, blended for inner targets.
+		Point toKeep = collapse.target - m_positions[keep];
+		Point toRemove = collapse.target - m_positions[remove];
+		double keepDistance = std::sqrt(Dot(toKeep, toKeep)), removeDistance = std::sqrt(Dot(toRemove, toRemove));
+		if (keepDistance + removeDistance > 0) {
+			float weight = static_cast<float>(keepDistance / (keepDistance + removeDistance));
+			XMVECTOR normal = m_vertices[keep].Normal * (1.0f - weight) + m_vertices[remove].Normal * weight;
+			m_vertices[keep].Normal = XMVectorSetW(XMVector3Normalize(normal), XMVectorGetW(m_vertices[keep].Normal));
+		}
+
+		m_positions[keep] = collapse.target;
+		m_quadrics[keep] += m_quadrics[remove];
+		m_vertexRemoved[remove] = true;
+		m_version[keep]++;
+		m_reachedCost = std::max(m_reachedCost, collapse.cost);
+
+		for (uint32_t t : m_vertexTriangles[remove]) {
+			uint32_t* triangle = &m_indices[3 * t];
+			if (triangle[0] == keep || triangle[1] == keep || triangle[2] == keep) {
+				m_triangleRemoved[t] = true;
+				m_triangleCount--;
+				continue;
+			}
+			for (uint32_t k = 0; k < 3; k++) {
+				if (triangle[k] == remove) {
+					triangle[k] = keep;
+				}
+			}
+			m_vertexTriangles[keep].push_back(t);
+		}
+		m_vertexTriangles[remove].clear( );
+
+		// The collapsed triangles are still listed by keep, so its neighbours include their third corners.
+		CollectNeighbours(keep, m_neighbours);
+		m_neighbours.push_back(keep);
+		for (uint32_t v : m_neighbours) {
+			auto& list = m_vertexTriangles[v];
+			list.erase(std::remove_if(list.begin( ), list.end( ), [&](uint32_t t) { return m_triangleRemoved[t]; }), list.end( ));
+		}
+
+		CollectNeighbours(keep, m_neighbours);
+		for (uint32_t v : m_neighbours) {
+			PushEdge(keep, v);
+		}
+		return true;
+	}
+
+	void QuadricSimplifier::Run(size_t targetTriangles, float maxError) {
+		const double maxCost = static_cast<double>(maxError) * maxError;
+
+		while (m_triangleCount > targetTriangles && !m_heap.empty( )) {
+			const Candidate& top = m_heap.top( );
+			if (m_vertexRemoved[top.keep] || m_vertexRemoved[top.remove] ||
+				m_version[top.keep] != top.keepVersion || m_version[top.remove] != top.removeVersion) {
+				m_heap.pop( );
+				continue;
+			}
+			// Left on the heap, a later Run with a larger error bound picks it up again.
+			if (top.cost > maxCost) {
+				break;
+			}
+
+			Candidate collapse = top;
+			m_heap.pop( );
+			Collapse(collapse);
+		}
+	}
+
+	Object QuadricSimplifier::Extract( ) const {
+		Object object;
+		std::vector<uint32_t> remap(m_vertices.size( ), UINT32_MAX);
+		object.Indices.reserve(m_triangleCount * 3);
+
+		for (size_t t = 0; t < m_triangleRemoved.size( ); t++) {
+			if (m_triangleRemoved[t]) {
+				continue;
+			}
+			for (uint32_t k = 0; k < 3; k++) {
+				uint32_t v = m_indices[3 * t + k];
+				if (remap[v] == UINT32_MAX) {
+					remap[v] = static_cast<uint32_t>(object.Vertices.size( ));
+					Vertex vertex = m_vertices[v];
+					vertex.Position = XMVectorSet(static_cast<float>(m_positions[v].x), static_cast<float>(m_positions[v].y),
+												  static_cast<float>(m_positions[v].z), XMVectorGetW(vertex.Position));
+					object.Vertices.push_back(vertex);
+				}
+				object.Indices.push_back(remap[v]);
+			}
+		}
+		return object;
+	}
+}
+
+float MeshSimplifier::Simplify(Object& object, size_t targetTriangles, float maxError) {
+	if (object.Indices.size( ) / 3 <= targetTriangles) {
+		return 0.0f;
+	}
+
+	QuadricSimplifier simplifier(object);
+	simplifier.Run(targetTriangles, maxError);
+	object = simplifier.Extract( );
+	return simplifier.GetError( );
+}
+
+std::vector<MeshLod> MeshSimplifier::BuildLodChain(const Object& object, const LodChainSettings& settings) {
+	std::vector<MeshLod> lods;
+	if (object.Vertices.empty( )) {
+		return lods;
+	}
+
+	XMVECTOR boundsMin = object.Vertices[0].Position;
+	XMVECTOR boundsMax = boundsMin;
+	for (const auto& vertex : object.Vertices) {
+		boundsMin = XMVectorMin(boundsMin, vertex.Position);
+		boundsMax = XMVectorMax(boundsMax, vertex.Position);
+	}
+	float radius = 0.5f * XMVectorGetX(XMVector3Length(boundsMax - boundsMin));
+	float maxError = settings.maxRelativeError * radius;
+
+	QuadricSimplifier simplifier(object);
+	size_t previousTriangles = simplifier.GetTriangleCount( );
+	for (uint32_t level = 0; level < settings.maxLevels; level++) {
+		simplifier.Run(static_cast<size_t>(previousTriangles * settings.triangleRatio), maxError);
+
+		size_t triangles = simplifier.GetTriangleCount( );
+		if (triangles == 0 || triangles > previousTriangles * MinLevelReduction) {
+			break;
+		}
+
+		previousTriangles = triangles;
+		lods.push_back({simplifier.Extract( ), simplifier.GetError( )});
+	}
+	return lods;
+}
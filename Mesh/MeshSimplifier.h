@@ -0,0 +1,24 @@
+#pragma once
+#include "../SceneTypes.h"
+#include <cstddef>
+#include <vector>
+
+struct LodChainSettings {
+	uint32_t maxLevels = 4;         // Levels generated below the source mesh.
+	float triangleRatio = 0.5f;     // Triangle budget of a level relative to the previous one.
+	float maxRelativeError = 0.02f; // Error bound of every level, relative to the bounding sphere radius.
+};
+
+// Edge-collapse simplification with the quadric error metric of Garland and Heckbert.
+// Open boundaries and seams (vertices split because their normals differ) are kept in place,
+// so the simplified meshes do not crack where ObjectCreator emits hard edges.
+class MeshSimplifier {
+public:
+	// Collapses edges, cheapest first, until object has at most targetTriangles triangles or the next
+	// collapse would move the surface by more than maxError. Returns the error of the result in object units.
+	static float Simplify(Object& object, size_t targetTriangles, float maxError);
+
+	// Successively coarser versions of object, taken from one simplification run so that every error is
+	// measured against the original surface. Stops once a level would remove too few triangles.
+	static std::vector<MeshLod> BuildLodChain(const Object& object, const LodChainSettings& settings = {});
+};
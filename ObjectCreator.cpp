@@ -1,79 +1,719 @@
 #include "ObjectCreator.h"
+#include "ParametricSurface.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+
+#include "CpuRt/BvhBuildInput.h"
+#include "CpuRt/ThreadPool.h"
+
+namespace {
+	const float GoldenRatio = 1.6180339887f;
+
+	const XMFLOAT3 IcosahedronVertices[12] = {
+		{-1,  GoldenRatio, 0}, {1,  GoldenRatio, 0}, {-1, -GoldenRatio, 0}, {1, -GoldenRatio, 0},
+		{0, -1,  GoldenRatio}, {0, 1,  GoldenRatio}, {0, -1, -GoldenRatio}, {0, 1, -GoldenRatio},
+		{ GoldenRatio, 0, -1}, { GoldenRatio, 0, 1}, {-GoldenRatio, 0, -1}, {-GoldenRatio, 0, 1}
+	};
+
+	const uint32_t IcosahedronFaces[20][3] = {
+		{0, 11, 5}, {0, 5, 1}, {0, 1, 7}, {0, 7, 10}, {0, 10, 11},
+		{1, 5, 9}, {5, 11, 4}, {11, 10, 2}, {10, 7, 6}, {7, 1, 8},
+		{3, 9, 4}, {3, 4, 2}, {3, 2, 6}, {3, 6, 8}, {3, 8, 9},
+		{4, 9, 5}, {2, 4, 11}, {6, 2, 10}, {8, 6, 7}, {9, 8, 1}
+	};
+
+	// Point (i, j) of the frequency grid on face corners a, b, c, on the unit sphere.
+	XMVECTOR IcosphereGridPoint(uint32_t a, uint32_t b, uint32_t c, uint32_t i, uint32_t j, uint32_t frequency) {
+		XMVECTOR va = XMLoadFloat3(&IcosahedronVertices[a]);
+		XMVECTOR vb = XMLoadFloat3(&IcosahedronVertices[b]);
+		XMVECTOR vc = XMLoadFloat3(&IcosahedronVertices[c]);
+		float u = static_cast<float>(i) / frequency;
+		float v = static_cast<float>(j) / frequency;
+		return XMVector3Normalize(va + (vb - va) * u + (vc - va) * v);
+	}
+
+	// Lowest count in [1, maxCount] whose tessellation fits, or maxCount. The error only shrinks as the cells do,
+	// so the count is doubled until it fits and the last step is bisected; counting up one by one would
+	// evaluate O(maxCount) tessellations of up to maxCount^2 cells each.
+	template <typename Fits>
+	uint32_t LowestFittingCount(uint32_t maxCount, Fits fits) {
+		uint32_t low = 1, high = 1;
+		while (high < maxCount && !fits(high)) {
+			low = high + 1;
+			high = std::min(2 * high, maxCount);
+		}
+		while (low < high) {
+			uint32_t count = (low + high) / 2;
+			if (fits(count)) {
+				high = count;
+			} else {
+				low = count + 1;
+			}
+		}
+		return low;
+	}
+
+	// The chord errors are computed as radius * (1 - distance) in float, which cannot resolve tolerances much
+	// below the rounding of radius; those take the finest tessellation straight away.
+	bool ResolvableChordError(float radius, float maxChordError) {
+		return maxChordError >= radius * FLT_EPSILON;
+	}
+
+	// Unit offsets of the six cube faces: -x, +x, -y, +y, -z, +z.
+	const int FaceDirections[6][3] = {{-1, 0, 0}, {1, 0, 0}, {0, -1, 0}, {0, 1, 0}, {0, 0, -1}, {0, 0, 1}};
+
+	// Subtrees of this depth are the units of parallel work: up to 400 of them.
+	const uint32_t SpongeTaskDepth = 2;
+
+	uint64_t MixBits(uint64_t value) {
+		value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ull;
+		value = (value ^ (value >> 27)) * 0x94D049BB133111EBull;
+		return value ^ (value >> 31);
+	}
+
+	// A cube of the sponge: its coordinates on the 3^depth grid of its level and which of its six
+	// neighbours on that grid are solid.
+	struct SpongeCell {
+		uint32_t depth;
+		int32_t x, y, z;
+		uint32_t solidNeighbours;
+	};
+
+	class MengerSponge {
+	public:
+		MengerSponge(uint32_t level, float probability, uint32_t seed) :
+			m_level(level),
+			m_probability(probability),
+			m_seed(MixBits(seed)) {
+		}
+
+		// Child (x, y, z) of a solid cube on level depth - 1 is solid if it is one of the 20 Menger children
+		// and, below probability 1, wins its draw.
+		bool IsKept(uint32_t depth, int32_t x, int32_t y, int32_t z) const {
+			if ((x % 3 == 1) + (y % 3 == 1) + (z % 3 == 1) >= 2) {
+				return false;
+			}
+			if (m_probability >= 1.0f) {
+				return true;
+			}
+			uint64_t key = static_cast<uint64_t>(x) | static_cast<uint64_t>(y) << 20 | static_cast<uint64_t>(z) << 40 | static_cast<uint64_t>(depth) << 60;
+			return static_cast<float>(MixBits(key ^ m_seed) >> 40) * (1.0f / 16777216.0f) < m_probability;
+		}
+
+		// Calls visit for every solid cube on level stopDepth below cell, depth first. The neighbour flags are
+		// carried down: a child's neighbour is a sibling, or a child of the parent's neighbour if that is solid.
+		template <typename Visit>
+		void Traverse(const SpongeCell& cell, uint32_t stopDepth, Visit& visit) const {
+			if (cell.depth == stopDepth) {
+				visit(cell);
+				return;
+			}
+
+			bool kept[27];
+			for (int i = 0; i < 27; i++) {
+				kept[i] = IsKept(cell.depth + 1, 3 * cell.x + i / 9, 3 * cell.y + i / 3 % 3, 3 * cell.z + i % 3);
+			}
+
+			for (int i = 0; i < 27; i++) {
+				if (!kept[i]) {
+					continue;
+				}
+				int cx = i / 9, cy = i / 3 % 3, cz = i % 3;
+				SpongeCell child = {cell.depth + 1, 3 * cell.x + cx, 3 * cell.y + cy, 3 * cell.z + cz, 0};
+				for (uint32_t d = 0; d < 6; d++) {
+					int nx = cx + FaceDirections[d][0], ny = cy + FaceDirections[d][1], nz = cz + FaceDirections[d][2];
+					bool solid;
+					if (nx >= 0 && nx < 3 && ny >= 0 && ny < 3 && nz >= 0 && nz < 3) {
+						solid = kept[nx * 9 + ny * 3 + nz];
+					} else {
+						solid = (cell.solidNeighbours >> d & 1) &&
+							IsKept(child.depth, child.x + FaceDirections[d][0], child.y + FaceDirections[d][1], child.z + FaceDirections[d][2]);
+					}
+					child.solidNeighbours |= static_cast<uint32_t>(solid) << d;
+				}
+				Traverse(child, stopDepth, visit);
+			}
+		}
+
+		// Roots of the parallel subtrees, in output order.
+		std::vector<SpongeCell> Split( ) const {
+			std::vector<SpongeCell> cells;
+			auto collect = [&](const SpongeCell& cell) { cells.push_back(cell); };
+			Traverse({0, 0, 0, 0, 0}, std::min(m_level, SpongeTaskDepth), collect);
+			return cells;
+		}
+
+		uint64_t CountFaces(const SpongeCell& root) const {
+			uint64_t faces = 0;
+			auto count = [&](const SpongeCell& cell) { faces += 6 - Popcount(cell.solidNeighbours); };
+			Traverse(root, m_level, count);
+			return faces;
+		}
+
+		// Every exposed face is a quad of its own with four vertices, like the faces of CreateBox.
+		// With a BVH writer the two triangles of every face are added to it as they are written.
+		void WriteFaces(const SpongeCell& root, float size, Vertex* vertices, uint32_t* indices, uint32_t firstVertex, BvhInputWriter* bvh) const {
+			float cellSize = size / std::pow(3.0f, static_cast<float>(m_level));
+			auto write = [&](const SpongeCell& cell) {
+				float low[3] = {cell.x * cellSize - size / 2, cell.y * cellSize - size / 2, cell.z * cellSize - size / 2};
+				for (uint32_t d = 0; d < 6; d++) {
+					if (cell.solidNeighbours >> d & 1) {
+						continue;
+					}
+					// Faces in a positive direction lie on the far side of the cube. u and v are ordered so that
+					// cross(u, v) is the outward normal, which gives CreateBox's winding.
+					uint32_t axis = d / 2;
+					bool positive = d & 1;
+					float corner[3] = {low[0], low[1], low[2]};
+					float u[3] = {0, 0, 0};
+					float v[3] = {0, 0, 0};
+					corner[axis] += positive ? cellSize : 0.0f;
+					u[(axis + (positive ? 1 : 2)) % 3] = cellSize;
+					v[(axis + (positive ? 2 : 1)) % 3] = cellSize;
+
+					XMVECTOR origin = XMVectorSet(corner[0], corner[1], corner[2], 1);
+					XMVECTOR uVector = XMVectorSet(u[0], u[1], u[2], 0);
+					XMVECTOR vVector = XMVectorSet(v[0], v[1], v[2], 0);
+					XMVECTOR normal = XMVectorSet(static_cast<float>(FaceDirections[d][0]), static_cast<float>(FaceDirections[d][1]), static_cast<float>(FaceDirections[d][2]), 1);
+					*vertices++ = {origin, normal};
+					*vertices++ = {origin + uVector, normal};
+					*vertices++ = {origin + vVector, normal};
+					*vertices++ = {origin + uVector + vVector, normal};
+					for (uint32_t k : {0u, 1u, 2u, 2u, 1u, 3u}) {
+						*indices++ = firstVertex + k;
+					}
+					firstVertex += 4;
+					if (bvh) {
+						bvh->AddTriangle(origin, origin + uVector, origin + vVector);
+						bvh->AddTriangle(origin + vVector, origin + uVector, origin + uVector + vVector);
+					}
+				}
+			};
+			Traverse(root, m_level, write);
+		}
+
+	private:
+		static uint32_t Popcount(uint32_t bits) {
+			uint32_t count = 0;
+			for (; bits; bits &= bits - 1) {
+				count++;
+			}
+			return count;
+		}
+
+		uint32_t m_level;
+		float m_probability;
+		uint64_t m_seed;
+	};
+
+	// Faces of every subtree of sponge, followed by their total.
+	std::vector<uint64_t> CountSpongeFaces(const MengerSponge& sponge, const std::vector<SpongeCell>& tasks, ThreadPool* threadPool) {
+		std::vector<uint64_t> faces(tasks.size( ) + 1, 0);
+		auto count = [&](uint32_t begin, uint32_t end) {
+			for (uint32_t task = begin; task < end; task++) {
+				faces[task] = sponge.CountFaces(tasks[task]);
+			}
+		};
+		if (threadPool) {
+			threadPool->ParallelFor(static_cast<uint32_t>(tasks.size( )), count);
+		} else {
+			count(0, static_cast<uint32_t>(tasks.size( )));
+		}
+
+		for (size_t task = 0; task < tasks.size( ); task++) {
+			faces.back( ) += faces[task];
+		}
+		if (faces.back( ) * 4 > UINT32_MAX) {
+			throw std::length_error("Menger sponge has too many vertices for 32-bit indices");
+		}
+		return faces;
+	}
+}
 
 Object ObjectCreator::CreateBox(XMFLOAT3 dimensions, XMUINT3 parts) {
 	ClearObject( );
 
-	XMFLOAT3 half = {dimensions.x / 2, dimensions.y / 2, dimensions.z / 2};
+	ObjectSize size = GetBoxSize(parts);
+	m_object.Vertices.resize(size.VertexCount);
+	m_object.Indices.resize(size.IndexCount);
+	WriteBox(dimensions, parts, {m_object.Vertices.data( ), size.VertexCount, m_object.Indices.data( ), size.IndexCount});
 
-	CreatePlane({0, 0,  half.z}, {0,   0, 0}, {dimensions.x, dimensions.y}, {parts.x, parts.y}); // Szembe
-	CreatePlane({0, 0, -half.z}, {0, 180, 0}, {dimensions.x, dimensions.y}, {parts.x, parts.y}); // Htra
+	return std::move(m_object);
+}
+
+Object ObjectCreator::CreateBox(XMFLOAT3 dimensions, float) {
+	return CreateBox(dimensions, XMUINT3{1, 1, 1});
+}
 
-	CreatePlane({half.x, 0, 0}, {90,  0,  90}, {dimensions.y, dimensions.z}, {parts.y, parts.z}); // Jobb
-	CreatePlane({-half.x, 0, 0}, {-90, 0,  90}, {dimensions.y, dimensions.z}, {parts.y, parts.z}); // Bal
+Object ObjectCreator::CreateSphere(float radius, uint32_t parts) {
+	ClearObject( );
+
+	ObjectSize size = GetSphereSize(parts);
+	m_object.Vertices.resize(size.VertexCount);
+	m_object.Indices.resize(size.IndexCount);
+	WriteSphere(radius, {m_object.Vertices.data( ), size.VertexCount, m_object.Indices.data( ), size.IndexCount}, nullptr, parts);
 
-	CreatePlane({0, -half.y, 0}, {90, 0, 0}, {dimensions.z, dimensions.x}, {parts.z, parts.x}); // Le
-	CreatePlane({0,  half.y, 0}, {270, 0, 0}, {dimensions.z, dimensions.x}, {parts.z, parts.x}); // Fel
+	return std::move(m_object);
+}
 
-	return m_object;
+Object ObjectCreator::CreateSphere(float radius, float maxChordError) {
+	return CreateSphere(radius, SpherePartsForError(radius, maxChordError));
 }
 
-Object ObjectCreator::CreateSphere(float radius) {
+Object ObjectCreator::CreatePlane(XMFLOAT3 center, XMFLOAT2 size, XMUINT2 parts) {
 	ClearObject( );
-	CreateBox({1,1,1}, {40,40,40});
 
-	for (size_t i = 0; i < m_object.Vertices.size( ); i++) {
-		auto vec = XMVector3Normalize(m_object.Vertices[i].Position);
-		auto pos = vec * radius;
+	ObjectSize objectSize = GetPlaneSize(parts);
+	m_object.Vertices.resize(objectSize.VertexCount);
+	m_object.Indices.resize(objectSize.IndexCount);
+	WritePlane(center, size, parts, {m_object.Vertices.data( ), objectSize.VertexCount, m_object.Indices.data( ), objectSize.IndexCount});
 
-		m_object.Vertices[i].Position = pos;
-		m_object.Vertices[i].Normal = vec;
-	}
+	return std::move(m_object);
+}
 
-	return m_object;
+Object ObjectCreator::CreatePlane(XMFLOAT3 center, XMFLOAT2 size, float) {
+	return CreatePlane(center, size, XMUINT2{1, 1});
 }
 
-Object ObjectCreator::CreatePlane(XMFLOAT3 center, XMFLOAT2 size, XMUINT2 parts) {
+GridObject ObjectCreator::CreateBoxGrid(XMFLOAT3 dimensions, XMUINT3 parts) {
+	GridObject grid;
+	grid.Vertices.resize(GetBoxSize(parts).VertexCount);
+	grid.Patches.resize(6);
+	WriteBoxFaces(dimensions, parts, grid.Vertices.data( ), nullptr, grid.Patches.data( ), nullptr);
+
+	return grid;
+}
+
+GridObject ObjectCreator::CreateBoxGrid(XMFLOAT3 dimensions, float) {
+	return CreateBoxGrid(dimensions, XMUINT3{1, 1, 1});
+}
+
+GridObject ObjectCreator::CreatePlaneGrid(XMFLOAT3 center, XMFLOAT2 size, XMUINT2 parts) {
+	GridObject grid;
+	grid.Vertices.resize(GetPlaneSize(parts).VertexCount);
+	grid.Patches = {{0, 0, parts}};
+
+	XMFLOAT3 topLeft = {center.x - size.x, center.y - size.y, center.z};
+	WritePlane(topLeft, {0, 0, 0}, size, parts, grid.Vertices.data( ), nullptr, 0);
+
+	return grid;
+}
+
+GridObject ObjectCreator::CreatePlaneGrid(XMFLOAT3 center, XMFLOAT2 size, float) {
+	return CreatePlaneGrid(center, size, XMUINT2{1, 1});
+}
+
+Object ObjectCreator::ExpandGrid(const GridObject& grid) {
+	Object object;
+	object.Vertices = grid.Vertices;
+	for (const auto& patch : grid.Patches) {
+		for (uint32_t triangle = 0; triangle < 2 * patch.Parts.x * patch.Parts.y; triangle++) {
+			for (uint32_t corner = 0; corner < 3; corner++) {
+				object.Indices.push_back(patch.GetIndex(triangle, corner));
+			}
+		}
+	}
+	return object;
+}
+
+Object ObjectCreator::CreateMengerSponge(float size, uint32_t level, float probability, uint32_t seed, ThreadPool* threadPool) {
 	ClearObject( );
+
+	ObjectSize objectSize = GetMengerSpongeSize(level, probability, seed, threadPool);
+	m_object.Vertices.resize(objectSize.VertexCount);
+	m_object.Indices.resize(objectSize.IndexCount);
+	WriteMengerSponge(size, level, probability, seed, {m_object.Vertices.data( ), objectSize.VertexCount, m_object.Indices.data( ), objectSize.IndexCount}, threadPool);
+
+	return std::move(m_object);
+}
+
+ObjectSize ObjectCreator::GetMengerSpongeSize(uint32_t level, float probability, uint32_t seed, ThreadPool* threadPool) {
+	MengerSponge sponge(level, probability, seed);
+	uint64_t faces = CountSpongeFaces(sponge, sponge.Split( ), threadPool).back( );
+	return {static_cast<size_t>(4 * faces), static_cast<size_t>(6 * faces)};
+}
+
+void ObjectCreator::WriteMengerSponge(float size, uint32_t level, float probability, uint32_t seed, const ObjectSpan& destination, ThreadPool* threadPool) {
+	WriteMengerSponge(size, level, probability, seed, destination, nullptr, threadPool);
+}
+
+void ObjectCreator::WriteMengerSponge(float size, uint32_t level, float probability, uint32_t seed, const ObjectSpan& destination,
+									  BvhBuildInput& bvhInput, ThreadPool* threadPool) {
+	WriteMengerSponge(size, level, probability, seed, destination, &bvhInput, threadPool);
+}
+
+void ObjectCreator::WriteMengerSponge(float size, uint32_t level, float probability, uint32_t seed, const ObjectSpan& destination,
+									  BvhBuildInput* bvhInput, ThreadPool* threadPool) {
+	MengerSponge sponge(level, probability, seed);
+	std::vector<SpongeCell> tasks = sponge.Split( );
+
+	// Counting first gives every subtree its own range of the destination.
+	std::vector<uint64_t> faces = CountSpongeFaces(sponge, tasks, threadPool);
+	CheckDestination({static_cast<size_t>(4 * faces.back( )), static_cast<size_t>(6 * faces.back( ))}, destination);
+	uint64_t firstFace = 0;
+	for (size_t task = 0; task < tasks.size( ); task++) {
+		uint64_t count = faces[task];
+		faces[task] = firstFace;
+		firstFace += count;
+	}
+
+	// The subtrees are visited depth first, so the triangles already come in a spatially coherent order.
+	Aabb frame = {{-size / 2, -size / 2, -size / 2}, {size / 2, size / 2, size / 2}};
+	MortonEncoder encoder(frame);
+	std::mutex mergeMutex;
+	if (bvhInput) {
+		bvhInput->Reset(static_cast<size_t>(2 * firstFace), frame);
+	}
+
+	auto write = [&](uint32_t begin, uint32_t end) {
+		for (uint32_t task = begin; task < end; task++) {
+			if (!bvhInput) {
+				sponge.WriteFaces(tasks[task], size, destination.Vertices + 4 * faces[task], destination.Indices + 6 * faces[task],
+								  static_cast<uint32_t>(4 * faces[task]), nullptr);
+				continue;
+			}
+			BvhInputWriter writer(*bvhInput, encoder, static_cast<size_t>(2 * faces[task]));
+			sponge.WriteFaces(tasks[task], size, destination.Vertices + 4 * faces[task], destination.Indices + 6 * faces[task],
+							  static_cast<uint32_t>(4 * faces[task]), &writer);
+			std::lock_guard<std::mutex> lock(mergeMutex);
+			writer.Merge( );
+		}
+	};
+	if (threadPool) {
+		threadPool->ParallelFor(static_cast<uint32_t>(tasks.size( )), write);
+	} else {
+		write(0, static_cast<uint32_t>(tasks.size( )));
+	}
+}
+
+ObjectSize ObjectCreator::GetPlaneSize(XMUINT2 parts) {
+	return {static_cast<size_t>(parts.x + 1) * (parts.y + 1), static_cast<size_t>(6) * parts.x * parts.y};
+}
+
+ObjectSize ObjectCreator::GetBoxSize(XMUINT3 parts) {
+	ObjectSize front = GetPlaneSize({parts.x, parts.y});
+	ObjectSize side = GetPlaneSize({parts.y, parts.z});
+	ObjectSize bottom = GetPlaneSize({parts.z, parts.x});
+	return {2 * (front.VertexCount + side.VertexCount + bottom.VertexCount), 2 * (front.IndexCount + side.IndexCount + bottom.IndexCount)};
+}
+
+ObjectSize ObjectCreator::GetSphereSize(uint32_t parts) {
+	parts = std::max(parts, 1u);
+	return GetBoxSize({parts, parts, parts});
+}
+
+void ObjectCreator::WritePlane(XMFLOAT3 center, XMFLOAT2 size, XMUINT2 parts, const ObjectSpan& destination) {
+	CheckDestination(GetPlaneSize(parts), destination);
+
 	XMFLOAT3 topLeft = {center.x - size.x, center.y - size.y, center.z};
-	CreatePlane(topLeft, {0, 0, 0}, size, parts);
-	return m_object;
+	WritePlane(topLeft, {0, 0, 0}, size, parts, destination.Vertices, destination.Indices, 0);
+}
+
+void ObjectCreator::WriteBox(XMFLOAT3 dimensions, XMUINT3 parts, const ObjectSpan& destination, ThreadPool* threadPool) {
+	CheckDestination(GetBoxSize(parts), destination);
+	WriteBoxFaces(dimensions, parts, destination.Vertices, destination.Indices, nullptr, threadPool);
 }
 
-void ObjectCreator::CreatePlane(XMFLOAT3 topLeft, XMFLOAT3 rotation, XMFLOAT2 size, XMUINT2 parts) {
+void ObjectCreator::WriteBoxFaces(XMFLOAT3 dimensions, XMUINT3 parts, Vertex* vertices, uint32_t* indices, GridPatch* patches, ThreadPool* threadPool) {
+	XMFLOAT3 half = {dimensions.x / 2, dimensions.y / 2, dimensions.z / 2};
+
+	struct Face {
+		XMFLOAT3 topLeft;
+		XMFLOAT3 rotation;
+		XMFLOAT2 size;
+		XMUINT2 parts;
+	};
+
+	const Face faces[6] = {
+		{{0, 0,  half.z}, {0,   0, 0}, {dimensions.x, dimensions.y}, {parts.x, parts.y}}, // Szembe
+		{{0, 0, -half.z}, {0, 180, 0}, {dimensions.x, dimensions.y}, {parts.x, parts.y}}, // Htra
+
+		{{half.x, 0, 0}, {90,  0,  90}, {dimensions.y, dimensions.z}, {parts.y, parts.z}}, // Jobb
+		{{-half.x, 0, 0}, {-90, 0,  90}, {dimensions.y, dimensions.z}, {parts.y, parts.z}}, // Bal
+
+		{{0, -half.y, 0}, {90, 0, 0}, {dimensions.z, dimensions.x}, {parts.z, parts.x}}, // Le
+		{{0,  half.y, 0}, {270, 0, 0}, {dimensions.z, dimensions.x}, {parts.z, parts.x}}  // Fel
+	};
+
+	// The faces are laid out one after the other, so every face knows its ranges up front.
+	size_t vertexOffset[6];
+	size_t indexOffset[6];
+	size_t vertexCount = 0, indexCount = 0;
+	for (int face = 0; face < 6; face++) {
+		vertexOffset[face] = vertexCount;
+		indexOffset[face] = indexCount;
+
+		ObjectSize size = GetPlaneSize(faces[face].parts);
+		vertexCount += size.VertexCount;
+		indexCount += size.IndexCount;
+		if (patches) {
+			patches[face] = {static_cast<uint32_t>(vertexOffset[face]), static_cast<uint32_t>(indexOffset[face] / 3), faces[face].parts};
+		}
+	}
+
+	auto writeFaces = [&](uint32_t begin, uint32_t end) {
+		for (uint32_t face = begin; face < end; face++) {
+			WritePlane(faces[face].topLeft, faces[face].rotation, faces[face].size, faces[face].parts,
+					   vertices + vertexOffset[face], indices ? indices + indexOffset[face] : nullptr,
+					   static_cast<uint32_t>(vertexOffset[face]));
+		}
+	};
+
+	if (threadPool) {
+		threadPool->ParallelFor(6, writeFaces);
+	} else {
+		writeFaces(0, 6);
+	}
+}
+
+void ObjectCreator::WriteSphere(float radius, const ObjectSpan& destination, ThreadPool* threadPool, uint32_t parts) {
+	parts = std::max(parts, 1u);
+	WriteBox({1, 1, 1}, {parts, parts, parts}, destination, threadPool);
+
+	auto project = [&](uint32_t begin, uint32_t end) {
+		for (uint32_t i = begin; i < end; i++) {
+			auto vec = XMVector3Normalize(destination.Vertices[i].Position);
+			auto pos = vec * radius;
+
+			destination.Vertices[i].Position = pos;
+			destination.Vertices[i].Normal = vec;
+		}
+	};
+
+	uint32_t vertexCount = static_cast<uint32_t>(GetSphereSize(parts).VertexCount);
+	if (threadPool) {
+		threadPool->ParallelFor(vertexCount, project, 1024);
+	} else {
+		project(0, vertexCount);
+	}
+}
+
+void ObjectCreator::WritePlane(XMFLOAT3 topLeft, XMFLOAT3 rotation, XMFLOAT2 size, XMUINT2 parts, Vertex* vertices, uint32_t* indices, uint32_t startPos) {
 	XMMATRIX rotationMatrix = XMMatrixRotationX(XMConvertToRadians(rotation.x)) * XMMatrixRotationY(XMConvertToRadians(rotation.y)) * XMMatrixRotationZ(XMConvertToRadians(rotation.z));
 	XMMATRIX translateMatrix = XMMatrixTranslation(topLeft.x, topLeft.y, topLeft.z);
 	XMMATRIX scaleMatrix = XMMatrixScaling(size.x, size.y, 1);
 	XMMATRIX M = scaleMatrix * rotationMatrix * translateMatrix;
 
-	float colStep = 1.0f / parts.x;
-	float rowStep = 1.0f / parts.y;
+	// Unsubdivided faces are by far the most common, so they get the unrolled grid.
+	if (parts.x == 1 && parts.y == 1) {
+		WriteParametricGrid<1, 1>(PlaneSurface( ), M, rotationMatrix, vertices, indices, startPos);
+	} else {
+		WriteParametricGrid(PlaneSurface( ), parts, M, rotationMatrix, vertices, indices, startPos);
+	}
+}
+
+void ObjectCreator::CheckDestination(const ObjectSize& required, const ObjectSpan& destination) {
+	if (destination.VertexCount < required.VertexCount || destination.IndexCount < required.IndexCount) {
+		throw std::length_error("Destination is too small for the generated object");
+	}
+}
+
+void ObjectCreator::ClearObject( ) {
+	m_object.Vertices.clear( );
+	m_object.Indices.clear( );
+}
+
+Object ObjectCreator::CreateIcosphere(float radius, uint32_t frequency) {
+	ClearObject( );
+	frequency = std::max(frequency, 1u);
+	m_object.Vertices.reserve(10 * frequency * frequency + 2);
+	m_object.Indices.reserve(60 * frequency * frequency);
+
+	auto addVertex = [&](FXMVECTOR direction) {
+		m_object.Vertices.push_back({XMVectorSetW(direction * radius, 1), XMVectorSetW(direction, 1)});
+		return static_cast<uint32_t>(m_object.Vertices.size( ) - 1);
+	};
 
-	int startPos = m_object.Vertices.size( );
-	for (int col = 0; col <= parts.x; col++) {
-		for (int row = 0; row <= parts.y; row++) {
-			XMVECTOR vector = {-.5f + colStep * col, -.5f + rowStep * row, 0, 1};
-			XMVECTOR normalVector = {0,0,1,1};
+	for (const auto& corner : IcosahedronVertices) {
+		addVertex(XMVector3Normalize(XMLoadFloat3(&corner)));
+	}
+
+	// Every edge is shared by two faces, so its inner vertices are created once, walking from the lower corner.
+	std::map<std::pair<uint32_t, uint32_t>, uint32_t> edges;
+	auto edgeVertex = [&](uint32_t from, uint32_t to, uint32_t step) {
+		uint32_t low = std::min(from, to), high = std::max(from, to);
+		auto edge = edges.find({low, high});
+		if (edge == edges.end( )) {
+			uint32_t first = static_cast<uint32_t>(m_object.Vertices.size( ));
+			for (uint32_t k = 1; k < frequency; k++) {
+				addVertex(IcosphereGridPoint(low, high, low, k, 0, frequency));
+			}
+			edge = edges.insert({{low, high}, first}).first;
+		}
+		return edge->second + (from == low ? step : frequency - step) - 1;
+	};
 
-			vector = XMVector3Transform(vector, M);
-			normalVector = XMVector3Transform(normalVector, rotationMatrix);
+	std::vector<uint32_t> grid;
+	for (const auto& face : IcosahedronFaces) {
+		uint32_t a = face[0], b = face[1], c = face[2];
 
-			m_object.Vertices.push_back({vector, normalVector});
+		// Row-major triangle of (i, j) with i + j <= frequency: i walks towards b, j towards c.
+		grid.clear( );
+		for (uint32_t j = 0; j <= frequency; j++) {
+			for (uint32_t i = 0; i + j <= frequency; i++) {
+				uint32_t index;
+				if (i == 0 && j == 0) {
+					index = a;
+				} else if (i == frequency) {
+					index = b;
+				} else if (j == frequency) {
+					index = c;
+				} else if (j == 0) {
+					index = edgeVertex(a, b, i);
+				} else if (i == 0) {
+					index = edgeVertex(a, c, j);
+				} else if (i + j == frequency) {
+					index = edgeVertex(b, c, j);
+				} else {
+					index = addVertex(IcosphereGridPoint(a, b, c, i, j, frequency));
+				}
+				grid.push_back(index);
+			}
+		}
+
+		uint32_t rowStart = 0;
+		for (uint32_t j = 0; j < frequency; j++) {
+			uint32_t rowLength = frequency + 1 - j;
+			uint32_t nextRowStart = rowStart + rowLength;
+			for (uint32_t i = 0; i + j < frequency; i++) {
+				m_object.Indices.insert(m_object.Indices.end( ), {grid[rowStart + i], grid[rowStart + i + 1], grid[nextRowStart + i]});
+				if (i + j + 1 < frequency) {
+					m_object.Indices.insert(m_object.Indices.end( ), {grid[rowStart + i + 1], grid[nextRowStart + i + 1], grid[nextRowStart + i]});
+				}
+			}
+			rowStart = nextRowStart;
 		}
 	}
 
-	for (int col = 0; col < parts.x; col++) {
-		for (int row = 0; row < parts.y; row++) {
-			m_object.Indices.push_back(startPos + col * (parts.y + 1) + row);
-			m_object.Indices.push_back(startPos + (col + 1) * (parts.y + 1) + row);
-			m_object.Indices.push_back(startPos + col * (parts.y + 1) + row + 1);
-			m_object.Indices.push_back(startPos + col * (parts.y + 1) + row + 1);
-			m_object.Indices.push_back(startPos + (col + 1) * (parts.y + 1) + row);
-			m_object.Indices.push_back(startPos + (col + 1) * (parts.y + 1) + row + 1);
+	return std::move(m_object);
+}
+
+Object ObjectCreator::CreateIcosphere(float radius, float maxChordError) {
+	return CreateIcosphere(radius, IcosphereFrequencyForError(radius, maxChordError));
+}
+
+uint32_t ObjectCreator::SpherePartsForError(float radius, float maxChordError) {
+	const uint32_t maxParts = 1024;
+
+	// The six faces of the projected box are congruent, so the worst triangle of one face is the worst of
+	// the sphere.
+	if (!ResolvableChordError(radius, maxChordError)) {
+		return maxParts;
+	}
+	auto chordError = [&](uint32_t parts) {
+		auto point = [&](uint32_t i, uint32_t j) {
+			return XMVector3Normalize(XMVectorSet(-1 + 2.0f * i / parts, -1 + 2.0f * j / parts, 1, 0));
+		};
+		float worstDistance = 1.0f;
+		auto addTriangle = [&](FXMVECTOR p0, FXMVECTOR p1, FXMVECTOR p2) {
+			XMVECTOR normal = XMVector3Normalize(XMVector3Cross(p1 - p0, p2 - p0));
+			worstDistance = std::min(worstDistance, std::fabs(XMVectorGetX(XMVector3Dot(normal, p0))));
+		};
+		for (uint32_t i = 0; i < parts; i++) {
+			for (uint32_t j = 0; j < parts; j++) {
+				addTriangle(point(i, j), point(i + 1, j), point(i, j + 1));
+				addTriangle(point(i, j + 1), point(i + 1, j), point(i + 1, j + 1));
+			}
 		}
+		return radius * (1.0f - worstDistance);
+	};
+
+	return LowestFittingCount(maxParts, [&](uint32_t parts) { return chordError(parts) <= maxChordError; });
+}
+
+uint32_t ObjectCreator::IcosphereFrequencyForBudget(uint32_t maxTriangles) {
+	uint32_t frequency = static_cast<uint32_t>(std::sqrt(maxTriangles / 20.0));
+	while (20ull * (frequency + 1) * (frequency + 1) <= maxTriangles) {
+		frequency++;
 	}
+	while (frequency > 1 && 20ull * frequency * frequency > maxTriangles) {
+		frequency--;
+	}
+	return std::max(frequency, 1u);
 }
 
-void ObjectCreator::ClearObject( ) {
-	m_object.Vertices.clear( );
-	m_object.Indices.clear( );
+uint32_t ObjectCreator::IcosphereFrequencyForError(float radius, float maxChordError) {
+	const uint32_t maxFrequency = 1024;
+	const uint32_t a = IcosahedronFaces[0][0], b = IcosahedronFaces[0][1], c = IcosahedronFaces[0][2];
+
+	// All faces are congruent, so the worst triangle of one face is the worst of the sphere. The largest
+	// deviation of a flat triangle is where its plane is closest to the centre.
+	if (!ResolvableChordError(radius, maxChordError)) {
+		return maxFrequency;
+	}
+	auto chordError = [&](uint32_t frequency) {
+		float worstDistance = 1.0f;
+		for (uint32_t j = 0; j < frequency; j++) {
+			for (uint32_t i = 0; i + j < frequency; i++) {
+				XMVECTOR p0 = IcosphereGridPoint(a, b, c, i, j, frequency);
+				XMVECTOR p1 = IcosphereGridPoint(a, b, c, i + 1, j, frequency);
+				XMVECTOR p2 = IcosphereGridPoint(a, b, c, i, j + 1, frequency);
+				XMVECTOR normal = XMVector3Normalize(XMVector3Cross(p1 - p0, p2 - p0));
+				worstDistance = std::min(worstDistance, std::fabs(XMVectorGetX(XMVector3Dot(normal, p0))));
+
+				if (i + j + 1 < frequency) {
+					XMVECTOR p3 = IcosphereGridPoint(a, b, c, i + 1, j + 1, frequency);
+					normal = XMVector3Normalize(XMVector3Cross(p3 - p1, p2 - p1));
+					worstDistance = std::min(worstDistance, std::fabs(XMVectorGetX(XMVector3Dot(normal, p1))));
+				}
+			}
+		}
+
+		return radius * (1.0f - worstDistance);
+	};
+
+	return LowestFittingCount(maxFrequency, [&](uint32_t frequency) { return chordError(frequency) <= maxChordError; });
+}
+
+std::vector<CompactVertex> ObjectCreator::EncodeCompactVertices(const std::vector<Vertex>& vertices) {
+	std::vector<CompactVertex> compact(vertices.size( ));
+	for (size_t i = 0; i < vertices.size( ); i++) {
+		XMStoreFloat3(&compact[i].Position, vertices[i].Position);
+		compact[i].Normal = EncodeOctahedralNormal(vertices[i].Normal);
+	}
+	return compact;
+}
+
+std::vector<uint16_t> ObjectCreator::EncodeShortIndices(const std::vector<uint32_t>& indices) {
+	return std::vector<uint16_t>(indices.begin( ), indices.end( ));
+}
+
+uint32_t EncodeOctahedralNormal(FXMVECTOR normal) {
+	XMFLOAT3 n;
+	XMStoreFloat3(&n, normal);
+
+	float length = std::fabs(n.x) + std::fabs(n.y) + std::fabs(n.z);
+	if (length == 0.0f) {
+		return 0;
+	}
+
+	float u = n.x / length;
+	float v = n.y / length;
+	if (n.z < 0.0f) {
+		float foldedU = (1.0f - std::fabs(v)) * (u >= 0.0f ? 1.0f : -1.0f);
+		float foldedV = (1.0f - std::fabs(u)) * (v >= 0.0f ? 1.0f : -1.0f);
+		u = foldedU;
+		v = foldedV;
+	}
+
+	auto quantize = [](float value) {
+		return static_cast<uint16_t>(static_cast<int16_t>(std::round(std::clamp(value, -1.0f, 1.0f) * 32767.0f)));
+	};
+	return quantize(u) | (static_cast<uint32_t>(quantize(v)) << 16);
+}
+
+XMVECTOR DecodeOctahedralNormal(uint32_t normal) {
+	float u = std::max(static_cast<int16_t>(normal & 0xFFFF) / 32767.0f, -1.0f);
+	float v = std::max(static_cast<int16_t>(normal >> 16) / 32767.0f, -1.0f);
+
+	float z = 1.0f - std::fabs(u) - std::fabs(v);
+	float t = std::max(-z, 0.0f);
+	u += u >= 0.0f ? -t : t;
+	v += v >= 0.0f ? -t : t;
+
+	return XMVector3Normalize(XMVectorSet(u, v, z, 0));
 }
@@ -1,5 +1,6 @@
 #pragma once
-#include "stdafx.h"
+#include <DirectXMath.h>
+#include <cstdint>
 #include <vector>
 
 using namespace DirectX;
@@ -9,22 +10,161 @@ struct Vertex {
 	XMVECTOR Normal;
 };
 
+// 16-byte layout of the compact vertex buffers: float3 position and an octahedral normal
+// as two 16-bit snorms (x in the low half). Matches STriVertex of Shaders/Hit.hlsl with COMPACT_VERTICES.
+struct CompactVertex {
+	XMFLOAT3 Position;
+	uint32_t Normal;
+};
+
+enum class VertexFormat {
+	Full,    // Vertex, 32 bytes
+	Compact  // CompactVertex, 16 bytes
+};
+
+uint32_t EncodeOctahedralNormal(FXMVECTOR normal);
+XMVECTOR DecodeOctahedralNormal(uint32_t normal);
+
 struct Object {
 	std::vector<Vertex> Vertices;
-	std::vector<UINT> Indices;
+	std::vector<uint32_t> Indices;
+};
+
+// A spatially coherent run of an Object's triangles, Indices[3 * FirstTriangle, 3 * (FirstTriangle + TriangleCount)).
+// Every triangle normal n satisfies dot(n, ConeAxis) >= ConeCutoff; a cutoff of -1 means the cone is open.
+struct MeshCluster {
+	uint32_t FirstTriangle;
+	uint32_t TriangleCount;
+	uint32_t VertexCount; // Distinct vertices referenced by the cluster.
+	XMFLOAT3 BoundsMin;
+	XMFLOAT3 BoundsMax;
+	XMFLOAT3 ConeAxis;
+	float ConeCutoff;
+};
+
+struct ObjectSize {
+	size_t VertexCount;
+	size_t IndexCount;
+};
+
+// Caller-owned destination of the Write* generators, e.g. a mapped upload buffer or an arena.
+struct ObjectSpan {
+	Vertex* Vertices;
+	size_t VertexCount;
+	uint32_t* Indices;
+	size_t IndexCount;
+};
+
+// A run of triangles laid out like the cells of CreatePlane, so that its indices never have to be stored:
+// (Parts.x + 1) * (Parts.y + 1) vertices from FirstVertex, column by column, and the two triangles of cell
+// (col, row) from FirstTriangle + 2 * (col * Parts.y + row).
+struct GridPatch {
+	uint32_t FirstVertex;
+	uint32_t FirstTriangle;
+	XMUINT2 Parts;
+
+	// The index CreatePlane stores for corner (0-2) of triangle, counted from FirstTriangle.
+	uint32_t GetIndex(uint32_t triangle, uint32_t corner) const {
+		uint32_t cell = triangle / 2;
+		uint32_t a = FirstVertex + (cell / Parts.y) * (Parts.y + 1) + cell % Parts.y;
+		uint32_t b = a + Parts.y + 1;
+		const uint32_t corners[2][3] = {{a, b, a + 1}, {a + 1, b, b + 1}};
+		return corners[triangle % 2][corner];
+	}
 };
 
+// An Object without its index buffer. Patches are in triangle order.
+struct GridObject {
+	std::vector<Vertex> Vertices;
+	std::vector<GridPatch> Patches;
+};
+
+class ThreadPool;
+struct BvhBuildInput;
+
 class ObjectCreator {
 	Object m_object;
 
 public:
-	Object CreateBox(XMFLOAT3 dimensions, XMUINT3 parts = {20,20,20});
-	Object CreateSphere(float radius);
+	// About 6e-4 chord error on the unit sphere.
+	static constexpr uint32_t DefaultSphereParts = 40;
+
+	// The overloads that take maxChordError pick the tessellation themselves: the lowest one whose flat
+	// triangles all stay within that distance of the exact surface. Box and plane faces are flat, so those
+	// always get a single part per face, whatever the tolerance.
+
+	// More parts only matter to callers that bend the box afterwards, like CreateSphere.
+	Object CreateBox(XMFLOAT3 dimensions, XMUINT3 parts = {1,1,1});
+	Object CreateBox(XMFLOAT3 dimensions, float maxChordError);
+	// A box with parts x parts cells per face, projected onto the sphere.
+	Object CreateSphere(float radius, uint32_t parts = DefaultSphereParts);
+	Object CreateSphere(float radius, float maxChordError);
+	// Lowest parts whose flat cells stay within maxChordError of the sphere surface, at most 1024.
+	static uint32_t SpherePartsForError(float radius, float maxChordError);
+
+	// Geodesic sphere: an icosahedron with every face split into frequency * frequency triangles,
+	// 20 * frequency^2 in total, with the vertices projected onto the sphere.
+	Object CreateIcosphere(float radius, uint32_t frequency);
+	Object CreateIcosphere(float radius, float maxChordError);
+	// Highest frequency that fits into maxTriangles (at least 1).
+	static uint32_t IcosphereFrequencyForBudget(uint32_t maxTriangles);
+	// Lowest frequency whose flat triangles stay within maxChordError of the sphere surface, at most 1024.
+	// Tolerances below the float rounding of radius cannot be measured and get 1024.
+	static uint32_t IcosphereFrequencyForError(float radius, float maxChordError);
+
+	static std::vector<CompactVertex> EncodeCompactVertices(const std::vector<Vertex>& vertices);
+
+	// Meshes with up to 65536 vertices can be indexed with 16 bits.
+	static bool FitsShortIndices(size_t vertexCount) { return vertexCount <= 0x10000; }
+	static std::vector<uint16_t> EncodeShortIndices(const std::vector<uint32_t>& indices);
+
+	// Every cell is the triangle pair (a, b, c), (c, b, d) around the b-c diagonal, as are the box and sponge
+	// faces; the CPU tracer merges such pairs back into one quad.
+	Object CreatePlane(XMFLOAT3 center, XMFLOAT2 size, XMUINT2 parts = {1,1});
+	Object CreatePlane(XMFLOAT3 center, XMFLOAT2 size, float maxChordError);
+
+	// The vertices of CreateBox and CreatePlane, one patch per face; the same triangles as ExpandGrid.
+	GridObject CreateBoxGrid(XMFLOAT3 dimensions, XMUINT3 parts = {1,1,1});
+	GridObject CreateBoxGrid(XMFLOAT3 dimensions, float maxChordError);
+	GridObject CreatePlaneGrid(XMFLOAT3 center, XMFLOAT2 size, XMUINT2 parts = {1,1});
+	GridObject CreatePlaneGrid(XMFLOAT3 center, XMFLOAT2 size, float maxChordError);
+	// Writes out the index buffer of grid, for consumers that only take indexed triangles.
+	static Object ExpandGrid(const GridObject& grid);
+
+	// Menger sponge with edge length size, centred on the origin. Every level splits each cube into 27 and
+	// keeps the 20 that touch no face centre, each with the given probability. Only faces between a cube and
+	// empty space are emitted. The random choices hash seed with the cube, so a seed always gives the same
+	// sponge, whatever the number of threads.
+	Object CreateMengerSponge(float size, uint32_t level, float probability = 1.0f, uint32_t seed = 0, ThreadPool* threadPool = nullptr);
+
+	// Exact sizes of the Create* results, so that callers can provide the storage.
+	static ObjectSize GetBoxSize(XMUINT3 parts = {1,1,1});
+	static ObjectSize GetSphereSize(uint32_t parts = DefaultSphereParts);
+	static ObjectSize GetPlaneSize(XMUINT2 parts = {1,1});
+	// Walks the whole sponge to count its faces. Throws std::length_error past 2^32 vertices.
+	static ObjectSize GetMengerSpongeSize(uint32_t level, float probability = 1.0f, uint32_t seed = 0, ThreadPool* threadPool = nullptr);
 
-	Object CreatePlane(XMFLOAT3 center, XMFLOAT2 size, XMUINT2 parts);
+	// Write the same vertices and indices as the Create* functions straight into destination, without
+	// allocating. Throws std::length_error if destination is smaller than the Get*Size result.
+	// With a thread pool the six box faces are filled in parallel.
+	static void WriteBox(XMFLOAT3 dimensions, XMUINT3 parts, const ObjectSpan& destination, ThreadPool* threadPool = nullptr);
+	static void WriteSphere(float radius, const ObjectSpan& destination, ThreadPool* threadPool = nullptr, uint32_t parts = DefaultSphereParts);
+	static void WritePlane(XMFLOAT3 center, XMFLOAT2 size, XMUINT2 parts, const ObjectSpan& destination);
+	// The sponge is streamed depth first with one stack frame per level; the pool splits it into subtrees.
+	static void WriteMengerSponge(float size, uint32_t level, float probability, uint32_t seed, const ObjectSpan& destination, ThreadPool* threadPool = nullptr);
+	// Also fills bvhInput with the bounds, centroid and Morton code of every triangle while its face is written,
+	// so that a BVH can be built without reading the sponge back. The Morton frame is the sponge's bounding cube.
+	static void WriteMengerSponge(float size, uint32_t level, float probability, uint32_t seed, const ObjectSpan& destination,
+								  BvhBuildInput& bvhInput, ThreadPool* threadPool = nullptr);
 
 private:
-	void CreatePlane(XMFLOAT3 topLeft, XMFLOAT3 rotation, XMFLOAT2 size, XMUINT2 parts = {20,20});
+	// indices may be null.
+	static void WritePlane(XMFLOAT3 topLeft, XMFLOAT3 rotation, XMFLOAT2 size, XMUINT2 parts, Vertex* vertices, uint32_t* indices, uint32_t startPos);
+	static void WriteMengerSponge(float size, uint32_t level, float probability, uint32_t seed, const ObjectSpan& destination,
+								  BvhBuildInput* bvhInput, ThreadPool* threadPool);
+	// indices and patches may be null.
+	static void WriteBoxFaces(XMFLOAT3 dimensions, XMUINT3 parts, Vertex* vertices, uint32_t* indices, GridPatch* patches, ThreadPool* threadPool);
+	static void CheckDestination(const ObjectSize& required, const ObjectSpan& destination);
 	void ClearObject( );
 };
 
@@ -0,0 +1,81 @@
+#pragma once
+#include "ObjectCreator.h"
+
+// Grids of vertices on a parametric surface, laid out like the cells of ObjectCreator::CreatePlane. A surface
+// is any type with Position(u, v) and Normal(u, v) for u, v in [0, 1], in object space, and a ConstantNormal
+// flag for surfaces whose normal is evaluated and transformed only once.
+
+// CreatePlane's unit square in the z = 0 plane, centred on the origin and facing +z.
+struct PlaneSurface {
+	static constexpr bool ConstantNormal = true;
+
+	XMVECTOR Position(float u, float v) const { return XMVectorSet(-.5f + u, -.5f + v, 0, 1); }
+	XMVECTOR Normal(float, float) const { return XMVectorSet(0, 0, 1, 0); }
+};
+
+namespace ParametricGrid {
+	// (partsX + 1) * (partsY + 1) vertices, column by column, each written once, transformed. Inlined into the
+	// fixed-size version, where the constant trip counts and steps let the compiler unroll the loops.
+	template <typename Surface>
+	inline void WriteVertices(const Surface& surface, uint32_t partsX, uint32_t partsY, FXMMATRIX transform, CXMMATRIX normalTransform,
+							  Vertex* vertices) {
+		const float colStep = 1.0f / partsX;
+		const float rowStep = 1.0f / partsY;
+
+		XMVECTOR constantNormal = XMVectorZero( );
+		if constexpr (Surface::ConstantNormal) {
+			constantNormal = XMVector3TransformNormal(surface.Normal(0, 0), normalTransform);
+		}
+		for (uint32_t col = 0; col <= partsX; col++) {
+			for (uint32_t row = 0; row <= partsY; row++) {
+				float u = colStep * col;
+				float v = rowStep * row;
+				vertices->Position = XMVector3Transform(surface.Position(u, v), transform);
+				if constexpr (Surface::ConstantNormal) {
+					vertices->Normal = constantNormal;
+				} else {
+					vertices->Normal = XMVector3TransformNormal(surface.Normal(u, v), normalTransform);
+				}
+				vertices++;
+			}
+		}
+	}
+
+	// The (a, b, c), (c, b, d) triangle pairs of CreatePlane, for vertices numbered from firstVertex.
+	inline void WriteIndices(uint32_t partsX, uint32_t partsY, uint32_t* indices, uint32_t firstVertex) {
+		for (uint32_t col = 0; col < partsX; col++) {
+			for (uint32_t row = 0; row < partsY; row++) {
+				uint32_t a = firstVertex + col * (partsY + 1) + row;
+				uint32_t b = a + partsY + 1;
+				*indices++ = a;
+				*indices++ = b;
+				*indices++ = a + 1;
+				*indices++ = a + 1;
+				*indices++ = b;
+				*indices++ = b + 1;
+			}
+		}
+	}
+}
+
+// Runtime grid size. normalTransform is the inverse transpose of transform, or its rotation if it has no
+// shear or non-uniform scale out of the surface. indices may be null, as for GridObject.
+template <typename Surface>
+void WriteParametricGrid(const Surface& surface, XMUINT2 parts, FXMMATRIX transform, CXMMATRIX normalTransform,
+						 Vertex* vertices, uint32_t* indices, uint32_t firstVertex) {
+	ParametricGrid::WriteVertices(surface, parts.x, parts.y, transform, normalTransform, vertices);
+	if (indices) {
+		ParametricGrid::WriteIndices(parts.x, parts.y, indices, firstVertex);
+	}
+}
+
+// Grid size fixed at compile time, for the small grids that are generated over and over, like 1x1 box faces.
+template <uint32_t PartsX, uint32_t PartsY, typename Surface>
+void WriteParametricGrid(const Surface& surface, FXMMATRIX transform, CXMMATRIX normalTransform,
+						 Vertex* vertices, uint32_t* indices, uint32_t firstVertex) {
+	static_assert(PartsX > 0 && PartsY > 0, "A grid needs at least one cell");
+	ParametricGrid::WriteVertices(surface, PartsX, PartsY, transform, normalTransform, vertices);
+	if (indices) {
+		ParametricGrid::WriteIndices(PartsX, PartsY, indices, firstVertex);
+	}
+}
@@ -0,0 +1,23 @@
+#pragma once
+#include "Camera.h"
+#include "SceneTypes.h"
+#include <cstdint>
+
+// What the front-end needs from a renderer. D3D12HelloTriangle drives either DxrBackend on the GPU
+// or CpuBackend, which needs neither a device nor a swap chain and also runs headless.
+class RenderBackend {
+public:
+	virtual ~RenderBackend( ) = default;
+
+	// Copies the geometry, materials and light of the scene into backend-owned storage.
+	virtual void UploadScene(const Scene& scene) = 0;
+	// Builds the bottom- and top-level acceleration structures over the uploaded scene.
+	virtual void BuildAccelerationStructures( ) = 0;
+
+	virtual void UpdateCamera(const CameraMatrices& camera) = 0;
+	// Same meaning as the FrameParams cbuffer: 1 restarts the accumulation.
+	virtual void UpdateFrameCount(uint32_t framesCount) = 0;
+
+	// Traces one frame and accumulates it into the image and gradient buffers.
+	virtual void Trace( ) = 0;
+};
@@ -0,0 +1,158 @@
+#include "SceneBuilder.h"
+#include "CpuRt/ThreadPool.h"
+#include "Mesh/MeshImporter.h"
+#include "Mesh/MeshOptimizer.h"
+#include "Mesh/MeshSimplifier.h"
+#include <algorithm>
+#include <cfloat>
+#include <cstring>
+#include <utility>
+
+Scene SceneBuilder::CreateDefaultScene(bool optimizeMeshes, bool generateLods, const std::string& sphereMeshFile, bool analyticShapes) {
+	SceneBuilder builder;
+	builder.m_optimizeMeshes = optimizeMeshes;
+	builder.m_analyticShapes = analyticShapes;
+	if (sphereMeshFile.empty( )) {
+		builder.CreateSphere( );
+	} else {
+		builder.CreateSphere(sphereMeshFile);
+	}
+	builder.CreateSkyBox( );
+	builder.CreateTable( );
+	builder.CreateLight( );
+	builder.m_scene.meshes = builder.m_meshes.Release( );
+	for (size_t object : builder.m_fileObjects) {
+		builder.m_scene.objects[object].mesh += static_cast<uint32_t>(builder.m_scene.meshes.size( ));
+	}
+	for (size_t object : builder.m_gridObjects) {
+		builder.m_scene.objects[object].mesh += static_cast<uint32_t>(builder.m_scene.meshes.size( ) + builder.m_scene.meshFiles.size( ));
+	}
+	for (size_t object : builder.m_shapeObjects) {
+		builder.m_scene.objects[object].mesh += static_cast<uint32_t>(builder.m_scene.meshes.size( ) + builder.m_scene.meshFiles.size( ) + builder.m_scene.grids.size( ));
+	}
+	if (generateLods) {
+		builder.GenerateLods( );
+	}
+	return builder.m_scene;
+}
+
+void SceneBuilder::CreateSphere( ) {
+	if (m_analyticShapes) {
+		CreateObject(Shape {ShapeType::Sphere, {1, 1, 1}}, {{1, 1, 1, 1.0f}, {0}, 1});
+		return;
+	}
+
+	// An icosphere meets the tolerance with half the triangles of CreateSphere's projected cube.
+	auto sphere = m_objectCreator.CreateIcosphere(1.0f, MaxChordError);
+	CreateObject(std::move(sphere), {{1, 1, 1, 1.0f}, {0}, 1});
+}
+
+void SceneBuilder::CreateSphere(const std::string& meshFile) {
+	// Scales and moves bounds onto the unit sphere the generated sphere would occupy.
+	auto fit = [](XMVECTOR boundsMin, XMVECTOR boundsMax) {
+		XMVECTOR halfExtent = (boundsMax - boundsMin) * 0.5f;
+		float radius = std::max(XMVectorGetX(XMVector3Length(halfExtent)), 1e-6f);
+		return XMMatrixTranslationFromVector(-(boundsMin + halfExtent)) * XMMatrixScaling(1 / radius, 1 / radius, 1 / radius);
+	};
+	const Material material = {{1, 1, 1, 1.0f}, {0}, 1};
+
+	std::string extension = meshFile.substr(std::min(meshFile.size( ), meshFile.find_last_of('.')));
+	if (extension == ".obj" || extension == ".ply" || extension == ".OBJ" || extension == ".PLY") {
+		ThreadPool threadPool;
+		Object object = MeshImporter::Import(meshFile, &threadPool);
+		XMVECTOR boundsMin = XMVectorReplicate(FLT_MAX);
+		XMVECTOR boundsMax = XMVectorReplicate(-FLT_MAX);
+		for (const auto& vertex : object.Vertices) {
+			boundsMin = XMVectorMin(boundsMin, vertex.Position);
+			boundsMax = XMVectorMax(boundsMax, vertex.Position);
+		}
+		CreateObject(std::move(object), material, fit(boundsMin, boundsMax));
+		return;
+	}
+
+	// A MeshFile is used as stored, so it is only placed through its transform.
+	auto file = std::make_shared<const MeshFile>(meshFile);
+	XMMATRIX position = fit(XMLoadFloat3(&file->GetHeader( ).boundsMin), XMLoadFloat3(&file->GetHeader( ).boundsMax));
+	CreateObject(std::move(file), material, position);
+}
+
+void SceneBuilder::CreateSkyBox( ) {
+	CreateBox({8, 10, 8}, {{0.8, 0.8, 0.8, 1.0f}, {0}, 0}, XMMatrixTranslation(0, 0, 0));
+}
+
+void SceneBuilder::CreateTable( ) {
+	CreateBox({0.5,3,0.5}, {{0.960, 0.949, 0.6, 1.0f}, {0}, 0}, XMMatrixTranslation(-2, 0, -2));
+	CreateBox({0.5,3,0.5}, {{0.960, 0.6, 0.933, 1.0f}, {0}, 0}, XMMatrixTranslation(2, 0, -2));
+	CreateBox({0.5,3,0.5}, {{0.6, 0.725, 0.960, 1.0f}, {0}, 0}, XMMatrixTranslation(-2, 0, 2));
+	CreateBox({0.5,3,0.5}, {{0.698, 0.960, 0.6, 1.0f}, {0}, 0}, XMMatrixTranslation(2, 0, 2));
+	CreateBox({4.5,0.5,4.5}, {{0.960, 0.6, 0.717, 1.0f}, {0}, 1}, XMMatrixTranslation(0, -1.75, 0));
+}
+
+void SceneBuilder::CreateLight( ) {
+	CreateBox({1, 0.1, 1}, {{1, 1, 1}, {10, 10, 10}, 3}, XMMatrixTranslation(0, 4.5, 0));
+
+	m_scene.light = {{0, 4.5, 0, 1}, {1, 0.1, 1}, {10, 10, 10, 0}};
+}
+
+void SceneBuilder::GenerateLods( ) {
+	// The boxes are grids, so only the sphere is left to simplify.
+	m_scene.lods.clear( );
+	for (const auto& mesh : m_scene.meshes) {
+		std::vector<MeshLod> lods = MeshSimplifier::BuildLodChain(mesh);
+		if (m_optimizeMeshes) {
+			for (auto& lod : lods) {
+				MeshOptimizer::OptimizeVertexCache(lod.mesh);
+				MeshOptimizer::OptimizeVertexFetch(lod.mesh);
+			}
+		}
+		m_scene.lods.push_back(std::move(lods));
+	}
+}
+
+void SceneBuilder::CreateObject(Object&& object, Material material, XMMATRIX position) {
+	// The optimizer is deterministic, so copies of a mesh still compare equal afterwards.
+	if (m_optimizeMeshes) {
+		MeshOptimizer::Optimize(object);
+	}
+	m_scene.objects.push_back({m_meshes.Add(std::move(object)), material, position});
+}
+
+void SceneBuilder::CreateObject(std::shared_ptr<const MeshFile> file, Material material, XMMATRIX position) {
+	m_fileObjects.push_back(m_scene.objects.size( ));
+	m_scene.objects.push_back({static_cast<uint32_t>(m_scene.meshFiles.size( )), material, position});
+	m_scene.meshFiles.push_back(std::move(file));
+}
+
+void SceneBuilder::CreateBox(XMFLOAT3 dimensions, Material material, XMMATRIX position) {
+	if (m_analyticShapes) {
+		CreateObject(Shape {ShapeType::Box, {dimensions.x / 2, dimensions.y / 2, dimensions.z / 2}}, material, position);
+	} else {
+		CreateObject(m_objectCreator.CreateBoxGrid(dimensions, MaxChordError), material, position);
+	}
+}
+
+void SceneBuilder::CreateObject(GridObject&& grid, Material material, XMMATRIX position) {
+	auto same = [&](const GridObject& other) {
+		return other.Patches.size( ) == grid.Patches.size( ) && other.Vertices.size( ) == grid.Vertices.size( )
+			&& memcmp(other.Patches.data( ), grid.Patches.data( ), grid.Patches.size( ) * sizeof(GridPatch)) == 0
+			&& memcmp(other.Vertices.data( ), grid.Vertices.data( ), grid.Vertices.size( ) * sizeof(Vertex)) == 0;
+	};
+	size_t mesh = std::find_if(m_scene.grids.begin( ), m_scene.grids.end( ), same) - m_scene.grids.begin( );
+	if (mesh == m_scene.grids.size( )) {
+		m_scene.grids.push_back(std::move(grid));
+	}
+	m_gridObjects.push_back(m_scene.objects.size( ));
+	m_scene.objects.push_back({static_cast<uint32_t>(mesh), material, position});
+}
+
+void SceneBuilder::CreateObject(Shape shape, Material material, XMMATRIX position) {
+	auto same = [&](const Shape& other) {
+		return other.type == shape.type && memcmp(&other.size, &shape.size, sizeof(shape.size)) == 0;
+	};
+	size_t mesh = std::find_if(m_scene.shapes.begin( ), m_scene.shapes.end( ), same) - m_scene.shapes.begin( );
+	if (mesh == m_scene.shapes.size( )) {
+		m_scene.shapes.push_back(shape);
+	}
+	m_shapeObjects.push_back(m_scene.objects.size( ));
+	m_scene.objects.push_back({static_cast<uint32_t>(mesh), material, position});
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include "ObjectCreator.h"
+#include "SceneTypes.h"
+#include "Mesh/MeshRegistry.h"
+#include <memory>
+#include <string>
+
+// Builds the scene shown by the sample: a mirror sphere and a table in a closed room lit by one area light.
+// Backend independent, so the GPU front-end, the headless renderer and the benchmarks share it.
+class SceneBuilder {
+public:
+	// optimizeMeshes runs every mesh through MeshOptimizer::Optimize before it is added.
+	// Identical meshes end up in Scene::meshes once.
+	// generateLods fills Scene::lods with MeshSimplifier.
+	// sphereMeshFile, if not empty, replaces the generated sphere with that MeshFile, OBJ or PLY file, fitted into its place.
+	// analyticShapes makes the sphere and the boxes Scene::shapes instead of triangles.
+	static Scene CreateDefaultScene(bool optimizeMeshes = true, bool generateLods = true, const std::string& sphereMeshFile = { },
+									bool analyticShapes = false);
+
+	void CreateSphere( );
+	void CreateSphere(const std::string& meshFile);
+	void CreateSkyBox( );
+
+	void CreateTable( );
+	void CreateLight( );
+
+
+private:
+	// Largest distance between a generated surface and the exact one, the chord error of the 40-part sphere the
+	// sample used to build. Only the sphere is curved, the boxes keep one cell per face.
+	static constexpr float MaxChordError = 6.25e-4f;
+
+	void GenerateLods( );
+	void CreateObject(Object&& object, Material material, XMMATRIX position = XMMatrixIdentity( ));
+	void CreateObject(std::shared_ptr<const MeshFile> file, Material material, XMMATRIX position = XMMatrixIdentity( ));
+	// Identical grids are stored once, like the registry does for meshes.
+	void CreateObject(GridObject&& grid, Material material, XMMATRIX position = XMMatrixIdentity( ));
+	void CreateObject(Shape shape, Material material, XMMATRIX position = XMMatrixIdentity( ));
+	// A grid, or a shape with analytic shapes.
+	void CreateBox(XMFLOAT3 dimensions, Material material, XMMATRIX position);
+
+	ObjectCreator m_objectCreator;
+	MeshRegistry m_meshes;
+	Scene m_scene;
+	// Objects whose mesh indexes Scene::meshFiles, Scene::grids or Scene::shapes until the registry is released.
+	std::vector<size_t> m_fileObjects;
+	std::vector<size_t> m_gridObjects;
+	std::vector<size_t> m_shapeObjects;
+	bool m_optimizeMeshes = false;
+	bool m_analyticShapes = false;
+};
@@ -0,0 +1,73 @@
+#pragma once
+#include "ObjectCreator.h"
+#include "Mesh/MeshFile.h"
+#include <memory>
+#include <vector>
+
+// Layouts match the Material and Light cbuffers in Shaders/Hit.hlsl.
+enum class MaterialType {
+	Diffuse,
+	Specular,
+	Refractive,
+	Light
+};
+
+struct Material {
+	XMVECTOR color;
+	XMVECTOR emission;
+	float type;
+};
+
+struct Light {
+	XMVECTOR position;
+	XMVECTOR size;
+	XMVECTOR light;
+};
+
+// A simplified version of a mesh. error bounds how far its surface is from the original, in object units.
+struct MeshLod {
+	Object mesh;
+	float error;
+};
+
+// Geometry with an exact intersection instead of triangles. In object space a sphere is centred on the origin
+// and a box spans -size to size; SceneObject::modelMatrix places and orients both.
+enum class ShapeType {
+	Sphere,
+	Box
+};
+
+struct Shape {
+	ShapeType type;
+	XMFLOAT3 size; // Half extents of a box; a sphere has radius size.x.
+
+	// Maps the unit sphere or the -1 to 1 cube onto the shape.
+	XMMATRIX GetUnitTransform( ) const {
+		return type == ShapeType::Sphere ? XMMatrixScaling(size.x, size.x, size.x) : XMMatrixScaling(size.x, size.y, size.z);
+	}
+};
+
+struct SceneObject {
+	uint32_t mesh; // Index into Scene::meshes, continued by Scene::meshFiles, Scene::grids and Scene::shapes.
+	Material material;
+	XMMATRIX modelMatrix = XMMatrixIdentity( );
+};
+
+// CPU-side copy of everything LoadAssets uploads, so that backends other than DXR can consume it.
+// Geometry is stored once per unique mesh; objects reference it with their own material and transform.
+struct Scene {
+	std::vector<Object> meshes;
+	std::vector<SceneObject> objects;
+	// Coarser levels of meshes[i], finest first. Meshes without levels, or every mesh if no LOD chains
+	// were generated, have an empty entry.
+	std::vector<std::vector<MeshLod>> lods;
+	// Meshes used straight from their mapped files; SceneObject::mesh == meshes.size( ) + i refers to meshFiles[i].
+	// They have no levels of detail.
+	std::vector<std::shared_ptr<const MeshFile>> meshFiles;
+	// Meshes whose indices follow from their grid layout, after meshFiles in the SceneObject::mesh numbering.
+	// No levels of detail either; these are the flat boxes of the room and the table.
+	std::vector<GridObject> grids;
+	// Analytic spheres and boxes, after grids in the SceneObject::mesh numbering.
+	std::vector<Shape> shapes;
+	Light light;
+};
@@ -23,4 +23,10 @@ struct Attributes
     float2 bary;
 };
 
+// Attributes reported by the intersection shaders of the procedural shapes: the world space normal
+struct ShapeAttributes
+{
+    float3 normal;
+};
+
 
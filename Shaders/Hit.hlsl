@@ -1,13 +1,22 @@
 #include "Common.hlsl"
 
+#ifdef COMPACT_VERTICES
+// CompactVertex in ObjectCreator.h: the normal is octahedral encoded in two 16-bit snorms.
+struct STriVertex
+{
+    float3 vertex;
+    uint normal;
+};
+#else
 struct STriVertex
 {
     float4 vertex;
     float4 normal;
 };
+#endif
 
 StructuredBuffer<STriVertex> BTriVertex : register(t0);
-StructuredBuffer<int> indices : register(t1);
+ByteAddressBuffer indices : register(t1);
 RaytracingAccelerationStructure SceneBVH : register(t2);
 
 cbuffer Material : register(b0)
@@ -24,6 +33,12 @@ cbuffer Light : register(b1)
     float4 power;
 }
 
+// Bytes per index: 2 for the R16_UINT index buffers of meshes with up to 65536 vertices, 4 otherwise.
+cbuffer GeometryParams : register(b2)
+{
+    uint indexSize;
+}
+
 static const float PI = 3.1415926535f;
 
 
@@ -52,6 +67,37 @@ float3 CastRays(float3 origin, float3 dir, float depth, float2 seed)
     return payload.color.rgb;
 }
 
+float3 DecodeOctahedral(uint packed)
+{
+    float2 e = max(float2(asint(uint2(packed << 16, packed)) >> 16) / 32767.0f, -1.0f);
+    float3 n = float3(e, 1.0f - abs(e.x) - abs(e.y));
+    float t = saturate(-n.z);
+    n.xy -= t * (step(0.0f, n.xy) * 2.0f - 1.0f);
+    return normalize(n);
+}
+
+uint3 LoadTriangleIndices(uint primitive)
+{
+    if (indexSize == 4)
+        return indices.Load3(primitive * 12);
+
+    uint offset = primitive * 6;
+    uint alignedOffset = offset & ~3;
+    uint2 packed = indices.Load2(alignedOffset);
+    if (offset == alignedOffset)
+        return uint3(packed.x & 0xFFFF, packed.x >> 16, packed.y & 0xFFFF);
+    return uint3(packed.x >> 16, packed.y & 0xFFFF, packed.y >> 16);
+}
+
+float3 VertexNormal(uint index)
+{
+#ifdef COMPACT_VERTICES
+    return DecodeOctahedral(BTriVertex[index].normal);
+#else
+    return BTriVertex[index].normal.xyz;
+#endif
+}
+
 float Max(float3 vect)
 {
     return max(max(vect.x, vect.y), vect.z);
@@ -96,8 +142,8 @@ float3 DirectLight(float3 hit, float3 normal, float2 seed)
     }
 }
 
-[shader("closesthit")]
-void ObjectClosestHit(inout HitInfo payload, Attributes attrib)
+// Shading of a hit with the given world space normal, shared by the triangle and the shape hit groups
+void Shade(inout HitInfo payload, float3 normal)
 {
     float depth = payload.depth;
     if (depth >= 10)
@@ -109,11 +155,6 @@ void ObjectClosestHit(inout HitInfo payload, Attributes attrib)
     float3 rayDir = normalize(WorldRayDirection());
     float3 rayOrigin = WorldRayOrigin();
     float3 hitLocation = WorldRayOrigin() + WorldRayDirection() * RayTCurrent();
-        
-    float3 barycentrics = float3(1.0f - attrib.bary.x - attrib.bary.y, attrib.bary.x, attrib.bary.y);
-    uint vertID = PrimitiveIndex() * 3;
-    float3 vertex = (BTriVertex[indices[vertID + 0]].vertex.xyz * barycentrics.x + BTriVertex[indices[vertID + 1]].vertex.xyz * barycentrics.y + BTriVertex[indices[vertID + 2]].vertex.xyz * barycentrics.z).xyz;
-    float3 normal = (BTriVertex[indices[vertID + 0]].normal.xyz * barycentrics.x + BTriVertex[indices[vertID + 1]].normal.xyz * barycentrics.y + BTriVertex[indices[vertID + 2]].normal.xyz * barycentrics.z).xyz;
       
     normal = normalize(normal);
     float3 normalCorrected = dot(rayDir, normal) < 0 ? normal : normal * -1;
@@ -200,3 +241,92 @@ void ObjectClosestHit(inout HitInfo payload, Attributes attrib)
     
     payload.color = float4(calculatedColor, 1);
 }
+
+// Normals go to world space by the transpose of the inverse of the instance transform, like normalToWorld
+// in CpuRaytracer, so that non-uniform scales keep them perpendicular to the surface.
+float3 ObjectWorldNormal(float3 objectNormal)
+{
+    return normalize(mul(objectNormal, (float3x3) WorldToObject3x4()));
+}
+
+[shader("closesthit")]
+void ObjectClosestHit(inout HitInfo payload, Attributes attrib)
+{
+    float3 barycentrics = float3(1.0f - attrib.bary.x - attrib.bary.y, attrib.bary.x, attrib.bary.y);
+    uint3 triangleIndices = LoadTriangleIndices(PrimitiveIndex());
+    float3 normal = VertexNormal(triangleIndices.x) * barycentrics.x + VertexNormal(triangleIndices.y) * barycentrics.y + VertexNormal(triangleIndices.z) * barycentrics.z;
+    
+    Shade(payload, ObjectWorldNormal(normal));
+}
+
+[shader("closesthit")]
+void ShapeClosestHit(inout HitInfo payload, ShapeAttributes attrib)
+{
+    Shade(payload, attrib.normal);
+}
+
+// Procedural shapes: the unit sphere and the -1 to 1 cube in object space, scaled and placed by the
+// instance transform. The ray is intersected in object space, where t is the same as in world space.
+[shader("intersection")]
+void SphereIntersection()
+{
+    float3 origin = ObjectRayOrigin();
+    float3 direction = ObjectRayDirection();
+    
+    float a = dot(direction, direction);
+    float b = dot(origin, direction);
+    float c = dot(origin, origin) - 1;
+    float discriminant = b * b - a * c;
+    if (discriminant < 0)
+        return;
+    
+    // Rays that start inside the sphere hit it from within.
+    float root = sqrt(discriminant);
+    float t = (-b - root) / a;
+    if (t <= RayTMin())
+        t = (-b + root) / a;
+    
+    ShapeAttributes attrib;
+    attrib.normal = ObjectWorldNormal(origin + direction * t);
+    ReportHit(t, 0, attrib);
+}
+
+[shader("intersection")]
+void BoxIntersection()
+{
+    float3 origin = ObjectRayOrigin();
+    float3 direction = ObjectRayDirection();
+    
+    // Slab test on the inverse direction, like the CPU tracer. A ray parallel to the faces of an axis only has to
+    // start between them; in the plane of a face, 0 * infinity would make its distances NaN.
+    float tNear = -1e30f;
+    float tFar = 1e30f;
+    [unroll]
+    for (uint axis = 0; axis < 3; axis++)
+    {
+        if (direction[axis] == 0)
+        {
+            if (abs(origin[axis]) > 1)
+                return;
+            continue;
+        }
+        float invDirection = 1 / direction[axis];
+        float t1 = (-1 - origin[axis]) * invDirection;
+        float t2 = (1 - origin[axis]) * invDirection;
+        tNear = max(tNear, min(t1, t2));
+        tFar = min(tFar, max(t1, t2));
+    }
+    if (tNear > tFar)
+        return;
+    
+    float t = tNear > RayTMin() ? tNear : tFar;
+    
+    // The face is the axis on which the hit point is farthest out.
+    float3 p = origin + direction * t;
+    float3 a = abs(p);
+    float3 normal = a.x >= a.y && a.x >= a.z ? float3(sign(p.x), 0, 0) : (a.y >= a.z ? float3(0, sign(p.y), 0) : float3(0, 0, sign(p.z)));
+    
+    ShapeAttributes attrib;
+    attrib.normal = ObjectWorldNormal(normal);
+    ReportHit(t, 0, attrib);
+}
@@ -9,6 +9,11 @@ struct Attributes
     float2 uv;
 };
 
+struct ShapeAttributes
+{
+    float3 normal;
+};
+
 cbuffer Material : register(b0)
 {
     float4 color;
@@ -16,8 +21,7 @@ cbuffer Material : register(b0)
     float type;
 }
 
-[shader("closesthit")]
-void ShadowClosestHit(inout ShadowHitInfo hit, Attributes bary)
+void ShadowHit(inout ShadowHitInfo hit)
 {
     hit.isHit = true;
     hit.isLightHit = false;
@@ -27,6 +31,19 @@ void ShadowClosestHit(inout ShadowHitInfo hit, Attributes bary)
     }
 }
 
+[shader("closesthit")]
+void ShadowClosestHit(inout ShadowHitInfo hit, Attributes bary)
+{
+    ShadowHit(hit);
+}
+
+// Closest hit of the procedural shapes, whose intersection shaders report ShapeAttributes
+[shader("closesthit")]
+void ShadowShapeClosestHit(inout ShadowHitInfo hit, ShapeAttributes attrib)
+{
+    ShadowHit(hit);
+}
+
 [shader("miss")]
 void ShadowMiss(inout ShadowHitInfo hit : SV_RayPayload)
 {
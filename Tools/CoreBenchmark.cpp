@@ -0,0 +1,451 @@
+// Times the CPU-side hot paths of the core library: mesh generation, scene setup and camera updates.
+#include "../Camera.h"
+#include "../CpuRt/BvhBuildInput.h"
+#include "../CpuRt/CpuBlasGenerator.h"
+#include "../CpuRt/CpuRaytracer.h"
+#include "../CpuRt/ThreadPool.h"
+#include "../Mesh/MeshClusterizer.h"
+#include "../Mesh/MeshFile.h"
+#include "../Mesh/MeshImporter.h"
+#include "../Mesh/MeshOptimizer.h"
+#include "../Mesh/MeshSimplifier.h"
+#include "../ObjectCreator.h"
+#include "../ParametricSurface.h"
+#include "../SceneBuilder.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+
+namespace {
+	void Measure(const char* name, int iterations, const std::function<void( )>& body) {
+		body( ); // warm-up
+
+		auto start = std::chrono::steady_clock::now( );
+		for (int i = 0; i < iterations; i++) {
+			body( );
+		}
+		auto end = std::chrono::steady_clock::now( );
+
+		double totalMs = std::chrono::duration<double, std::milli>(end - start).count( );
+		std::printf("%-62s %10.4f ms/iter (%d iterations)\n", name, totalMs / iterations, iterations);
+	}
+
+	// Exports object the way DCC tools do: OBJ with v//vn faces, binary little-endian PLY with normals.
+	void WriteObj(const char* path, const Object& object) {
+		FILE* file = std::fopen(path, "w");
+		for (const auto& vertex : object.Vertices) {
+			std::fprintf(file, "v %f %f %f\n", XMVectorGetX(vertex.Position), XMVectorGetY(vertex.Position), XMVectorGetZ(vertex.Position));
+		}
+		for (const auto& vertex : object.Vertices) {
+			std::fprintf(file, "vn %f %f %f\n", XMVectorGetX(vertex.Normal), XMVectorGetY(vertex.Normal), XMVectorGetZ(vertex.Normal));
+		}
+		for (size_t i = 0; i < object.Indices.size( ); i += 3) {
+			uint32_t a = object.Indices[i] + 1, b = object.Indices[i + 1] + 1, c = object.Indices[i + 2] + 1;
+			std::fprintf(file, "f %u//%u %u//%u %u//%u\n", a, a, b, b, c, c);
+		}
+		std::fclose(file);
+	}
+
+	void WritePly(const char* path, const Object& object) {
+		FILE* file = std::fopen(path, "wb");
+		std::fprintf(file, "ply\nformat binary_little_endian 1.0\nelement vertex %zu\n", object.Vertices.size( ));
+		std::fprintf(file, "property float x\nproperty float y\nproperty float z\nproperty float nx\nproperty float ny\nproperty float nz\n");
+		std::fprintf(file, "element face %zu\nproperty list uchar int vertex_indices\nend_header\n", object.Indices.size( ) / 3);
+		for (const auto& vertex : object.Vertices) {
+			XMFLOAT3 values[2];
+			XMStoreFloat3(&values[0], vertex.Position);
+			XMStoreFloat3(&values[1], vertex.Normal);
+			std::fwrite(values, sizeof(values), 1, file);
+		}
+		for (size_t i = 0; i < object.Indices.size( ); i += 3) {
+			uint8_t count = 3;
+			std::fwrite(&count, 1, 1, file);
+			std::fwrite(&object.Indices[i], sizeof(uint32_t), 3, file);
+		}
+		std::fclose(file);
+	}
+
+	// The per-vertex loop ObjectCreator::WritePlane used before it went through WriteParametricGrid.
+	void WritePlanePerVertex(FXMMATRIX M, FXMMATRIX rotationMatrix, XMUINT2 parts, Vertex* vertices, uint32_t* indices, uint32_t startPos) {
+		float colStep = 1.0f / parts.x;
+		float rowStep = 1.0f / parts.y;
+
+		XMVECTOR normalVector = XMVector3Transform({0,0,1,1}, rotationMatrix);
+		for (uint32_t col = 0; col <= parts.x; col++) {
+			for (uint32_t row = 0; row <= parts.y; row++) {
+				XMVECTOR vector = {-.5f + colStep * col, -.5f + rowStep * row, 0, 1};
+				*vertices++ = {XMVector3Transform(vector, M), normalVector};
+			}
+		}
+		for (uint32_t col = 0; col < parts.x; col++) {
+			for (uint32_t row = 0; row < parts.y; row++) {
+				*indices++ = startPos + col * (parts.y + 1) + row;
+				*indices++ = startPos + (col + 1) * (parts.y + 1) + row;
+				*indices++ = startPos + col * (parts.y + 1) + row + 1;
+				*indices++ = startPos + col * (parts.y + 1) + row + 1;
+				*indices++ = startPos + (col + 1) * (parts.y + 1) + row;
+				*indices++ = startPos + (col + 1) * (parts.y + 1) + row + 1;
+			}
+		}
+	}
+
+	// Writes count planes of parts cells with the per-vertex loop, the runtime-sized grid and the fixed-size grid.
+	template <uint32_t PartsX, uint32_t PartsY>
+	void MeasurePlaneGrids(int count, int iterations) {
+		XMMATRIX rotation = XMMatrixRotationX(XMConvertToRadians(90.0f));
+		XMMATRIX transform = XMMatrixScaling(2, 3, 1) * rotation * XMMatrixTranslation(1, 2, 3);
+		ObjectSize size = ObjectCreator::GetPlaneSize({PartsX, PartsY});
+		std::vector<Vertex> vertices(size.VertexCount * count);
+		std::vector<uint32_t> indices(size.IndexCount * count);
+		auto run = [&](auto write) {
+			for (int plane = 0; plane < count; plane++) {
+				write(&vertices[plane * size.VertexCount], &indices[plane * size.IndexCount], static_cast<uint32_t>(plane * size.VertexCount));
+			}
+		};
+
+		char name[96];
+		std::snprintf(name, sizeof(name), "Plane %ux%u x%d: per-vertex transform", PartsX, PartsY, count);
+		Measure(name, iterations, [&] { run([&](Vertex* v, uint32_t* i, uint32_t first) { WritePlanePerVertex(transform, rotation, {PartsX, PartsY}, v, i, first); }); });
+		std::vector<Vertex> reference = vertices;
+		std::snprintf(name, sizeof(name), "Plane %ux%u x%d: WriteParametricGrid (runtime size)", PartsX, PartsY, count);
+		Measure(name, iterations, [&] { run([&](Vertex* v, uint32_t* i, uint32_t first) { WriteParametricGrid(PlaneSurface( ), {PartsX, PartsY}, transform, rotation, v, i, first); }); });
+		std::snprintf(name, sizeof(name), "Plane %ux%u x%d: WriteParametricGrid<%u, %u>", PartsX, PartsY, count, PartsX, PartsY);
+		Measure(name, iterations, [&] { run([&](Vertex* v, uint32_t* i, uint32_t first) { WriteParametricGrid<PartsX, PartsY>(PlaneSurface( ), transform, rotation, v, i, first); }); });
+		bool same = std::equal(reference.begin( ), reference.end( ), vertices.begin( ), [](const Vertex& a, const Vertex& b) {
+			const XMVECTOR epsilon = XMVectorReplicate(1e-5f);
+			return XMVector3NearEqual(a.Position, b.Position, epsilon) && XMVector3NearEqual(a.Normal, b.Normal, epsilon);
+		});
+		std::printf("  same positions and normals as the per-vertex loop: %s\n", same ? "yes" : "no");
+	}
+
+	void MeasureImport(const char* name, const char* path, ThreadPool& threadPool) {
+		Object object;
+		MeshImportStats stats;
+		Measure(name, 5, [&] { object = MeshImporter::Import(path, &threadPool, &stats); });
+		std::printf("  %zu vertices, %zu triangles: %.1f MB/s, %.2f M triangles/s\n", stats.vertices, stats.triangles,
+					stats.megabytesPerSecond, stats.trianglesPerSecond / 1e6);
+	}
+}
+
+int main( ) {
+	ObjectCreator objectCreator;
+
+	Object sphere;
+	Measure("ObjectCreator::CreateSphere", 20, [&] { sphere = objectCreator.CreateSphere(1.0f); });
+	std::printf("  sphere: %zu vertices, %zu indices\n", sphere.Vertices.size( ), sphere.Indices.size( ));
+
+	ObjectSize sphereSize = ObjectCreator::GetSphereSize( );
+	std::vector<Vertex> sphereVertices(sphereSize.VertexCount);
+	std::vector<uint32_t> sphereIndices(sphereSize.IndexCount);
+	ObjectSpan sphereSpan = {sphereVertices.data( ), sphereVertices.size( ), sphereIndices.data( ), sphereIndices.size( )};
+	Measure("ObjectCreator::WriteSphere", 20, [&] { ObjectCreator::WriteSphere(1.0f, sphereSpan); });
+	ThreadPool threadPool;
+	Measure("ObjectCreator::WriteSphere (thread pool)", 20, [&] { ObjectCreator::WriteSphere(1.0f, sphereSpan, &threadPool); });
+
+	Object icosphere;
+	uint32_t frequency = ObjectCreator::IcosphereFrequencyForError(1.0f, 6.25e-4f);
+	Measure("ObjectCreator::CreateIcosphere", 20, [&] { icosphere = objectCreator.CreateIcosphere(1.0f, frequency); });
+	std::printf("  icosphere (frequency %u): %zu vertices, %zu indices\n", frequency, icosphere.Vertices.size( ), icosphere.Indices.size( ));
+
+	std::vector<CompactVertex> compact;
+	Measure("ObjectCreator::EncodeCompactVertices", 20, [&] { compact = ObjectCreator::EncodeCompactVertices(sphere.Vertices); });
+	std::printf("  sphere vertex buffer: %zu bytes full, %zu bytes compact\n",
+				sphere.Vertices.size( ) * sizeof(Vertex), compact.size( ) * sizeof(CompactVertex));
+
+	Object box;
+	Measure("ObjectCreator::CreateBox", 200, [&] { box = objectCreator.CreateBox({1, 1, 1}); });
+	std::printf("  box: %zu vertices, %zu indices (%zu with 20 parts per axis)\n", box.Vertices.size( ), box.Indices.size( ),
+				ObjectCreator::GetBoxSize({20, 20, 20}).IndexCount);
+
+	Object plane;
+	GridObject planeGrid;
+	Measure("ObjectCreator::CreatePlane (256x256)", 20, [&] { plane = objectCreator.CreatePlane({0, 0, 0}, {4, 4}, {256, 256}); });
+	Measure("ObjectCreator::CreatePlaneGrid (256x256)", 20, [&] { planeGrid = objectCreator.CreatePlaneGrid({0, 0, 0}, {4, 4}, {256, 256}); });
+	std::printf("  grid: %zu vertices, no index buffer instead of %zu bytes of indices\n", planeGrid.Vertices.size( ), plane.Indices.size( ) * sizeof(uint32_t));
+
+	MeasurePlaneGrids<1, 1>(100000, 5);
+	MeasurePlaneGrids<16, 16>(1000, 5);
+	MeasurePlaneGrids<256, 256>(4, 5);
+
+	uint32_t sphereParts = 0;
+	Measure("ObjectCreator::SpherePartsForError", 20, [&] { sphereParts = ObjectCreator::SpherePartsForError(1.0f, 6.25e-4f); });
+	std::printf("  sphere within 6.25e-4: %u parts, %zu triangles\n", sphereParts, ObjectCreator::GetSphereSize(sphereParts).IndexCount / 3);
+
+	// Every cube of the sponge contributes 12 triangles when no faces are culled.
+	Object sponge;
+	Measure("ObjectCreator::CreateMengerSponge (level 4)", 3, [&] { sponge = objectCreator.CreateMengerSponge(1.0f, 4); });
+	Measure("ObjectCreator::CreateMengerSponge (level 4, thread pool)", 3, [&] { sponge = objectCreator.CreateMengerSponge(1.0f, 4, 1.0f, 0, &threadPool); });
+	std::printf("  sponge: %zu vertices, %zu triangles (%u without culling)\n", sponge.Vertices.size( ), sponge.Indices.size( ) / 3, 12 * 20 * 20 * 20 * 20);
+	// Bottom-level BVHs of the level 4 sponge and the icosphere over their vertex and index arrays.
+	for (const auto& [name, mesh] : {std::pair<const char*, const Object*>("sponge", &sponge), std::pair<const char*, const Object*>("icosphere", &icosphere)}) {
+		const BvhBuildSettings variants[] = {{4, 16}, {1, 16}, {8, 16}, {4, 8}, {4, 32},
+											 {4, 16, 1.0f, BvhBuildMode::Linear, 30}, {4, 16, 1.0f, BvhBuildMode::Linear, 63},
+											 {4, 16, 1.0f, BvhBuildMode::SpatialSplits}};
+		for (const auto& settings : variants) {
+			CpuBlasGenerator generator;
+			generator.AddVertexBuffer(mesh->Vertices.data( ), static_cast<uint32_t>(mesh->Vertices.size( )), sizeof(Vertex),
+									  mesh->Indices.data( ), static_cast<uint32_t>(mesh->Indices.size( )));
+			generator.SetBuildSettings(settings);
+			uint64_t scratchSize, resultSize;
+			generator.ComputeASBufferSizes(false, &scratchSize, &resultSize);
+			BvhBuildInput scratch;
+			CpuBlas blas;
+			char label[128];
+			if (settings.mode == BvhBuildMode::Linear) {
+				std::snprintf(label, sizeof(label), "CpuBlasGenerator::Generate (%s, linear, %u-bit codes)", name, settings.mortonCodeBits);
+			} else if (settings.mode == BvhBuildMode::SpatialSplits) {
+				std::snprintf(label, sizeof(label), "CpuBlasGenerator::Generate (%s, spatial splits)", name);
+			} else {
+				std::snprintf(label, sizeof(label), "CpuBlasGenerator::Generate (%s, leaves of %u, %u bins)", name, settings.maxLeafPrimitives, settings.binCount);
+			}
+			Measure(label, 3, [&] { generator.Generate(scratch, blas, &threadPool); });
+			// The hierarchy alone, without filling the input from the vertices.
+			BvhBuildStats stats;
+			Measure("  BvhBuilder::Build", 3, [&] { BvhBuilder::Build(scratch, settings, &threadPool, &stats); });
+			std::printf("  %.2f ms, SAH cost %.2f, %zu nodes, %zu leaves, %zu references, depth %u\n", stats.buildMilliseconds, stats.sahCost,
+						stats.nodeCount, stats.leafCount, stats.referenceCount, stats.depth);
+		}
+	}
+
+	ObjectSize spongeSize;
+	Measure("ObjectCreator::GetMengerSpongeSize (level 5)", 1, [&] { spongeSize = ObjectCreator::GetMengerSpongeSize(5, 1.0f, 0, &threadPool); });
+	std::printf("  level 5: %zu triangles\n", spongeSize.IndexCount / 3);
+	sponge = { };
+
+	// BVH input of the level 5 sponge: a second pass over the written mesh against filling it while writing.
+	{
+		Object spongeMesh;
+		spongeMesh.Vertices.resize(spongeSize.VertexCount);
+		spongeMesh.Indices.resize(spongeSize.IndexCount);
+		ObjectSpan span = {spongeMesh.Vertices.data( ), spongeSize.VertexCount, spongeMesh.Indices.data( ), spongeSize.IndexCount};
+		Aabb frame = {{-0.5f, -0.5f, -0.5f}, {0.5f, 0.5f, 0.5f}};
+		BvhBuildInput bvhInput;
+		Measure("WriteMengerSponge + BuildBvhInput (level 5, thread pool)", 3, [&] {
+			ObjectCreator::WriteMengerSponge(1.0f, 5, 1.0f, 0, span, &threadPool);
+			BuildBvhInput(spongeMesh.Vertices.data( ), sizeof(Vertex), spongeMesh.Indices.data( ), spongeSize.IndexCount / 3, frame, bvhInput, &threadPool);
+		});
+		Measure("WriteMengerSponge with BVH input (level 5, thread pool)", 3, [&] {
+			ObjectCreator::WriteMengerSponge(1.0f, 5, 1.0f, 0, span, bvhInput, &threadPool);
+		});
+		std::printf("  %zu primitives, %.1f MB of BVH input\n", bvhInput.GetPrimitiveCount( ),
+					bvhInput.GetPrimitiveCount( ) * (sizeof(Aabb) + sizeof(XMFLOAT3) + sizeof(uint64_t)) / 1048576.0);
+	}
+
+	MeshOptimizationReport report;
+	Measure("MeshOptimizer::Optimize (sphere)", 10, [&] { Object copy = sphere; report = MeshOptimizer::Optimize(copy); });
+	std::printf("  vertices %zu -> %zu, triangles %zu -> %zu, ACMR %.3f -> %.3f\n",
+				report.before.vertices, report.after.vertices, report.before.triangles, report.after.triangles,
+				report.before.acmr, report.after.acmr);
+
+	std::vector<MeshCluster> clusters;
+	Measure("MeshClusterizer::Build (sphere)", 10, [&] { Object copy = sphere; clusters = MeshClusterizer::Build(copy); });
+	size_t clusteredVertices = 0;
+	for (const auto& cluster : clusters) {
+		clusteredVertices += cluster.VertexCount;
+	}
+	std::printf("  %zu clusters, %.1f triangles and %.1f vertices on average\n", clusters.size( ),
+				sphere.Indices.size( ) / 3.0 / clusters.size( ), static_cast<double>(clusteredVertices) / clusters.size( ));
+	// Clustering moves the triangles of a vertex cache optimized mesh around and only keeps their order within
+	// each cluster.
+	Object optimizedSphere = sphere;
+	MeshOptimizer::Optimize(optimizedSphere);
+	float optimizedAcmr = MeshOptimizer::ComputeStats(optimizedSphere).acmr;
+	MeshClusterizer::Build(optimizedSphere);
+	std::printf("  ACMR of the optimized sphere %.3f -> %.3f after clustering\n", optimizedAcmr, MeshOptimizer::ComputeStats(optimizedSphere).acmr);
+
+	// The file holds the clustered sphere in upload layout; opening it should not depend on the mesh size.
+	const char* meshPath = "core_benchmark_sphere.mesh";
+	Object clusteredSphere = sphere;
+	clusters = MeshClusterizer::Build(clusteredSphere);
+	Measure("MeshFile::Write (sphere)", 10, [&] { MeshFile::Write(meshPath, clusteredSphere, clusters); });
+	Measure("MeshFile open (sphere)", 100, [&] { MeshFile file(meshPath); });
+	Measure("MeshFile::ValidateContents (sphere)", 20, [&] { MeshFile(meshPath).ValidateContents( ); });
+	Object loadedSphere;
+	Measure("MeshFile::ToObject (sphere)", 20, [&] { loadedSphere = MeshFile(meshPath).ToObject( ); });
+	{
+		MeshFile file(meshPath);
+		std::printf("  %zu vertices, %zu indices in %zu bytes (%u-byte), %zu clusters\n", file.GetVertexCount( ), file.GetIndexCount( ),
+					file.GetIndexDataSize( ), file.GetIndexSize( ), file.GetClusterCount( ));
+	}
+	std::remove(meshPath);
+
+	WriteObj("core_benchmark_sphere.obj", sphere);
+	WritePly("core_benchmark_sphere.ply", sphere);
+	MeasureImport("MeshImporter::Import (sphere OBJ)", "core_benchmark_sphere.obj", threadPool);
+	MeasureImport("MeshImporter::Import (sphere PLY)", "core_benchmark_sphere.ply", threadPool);
+	std::remove("core_benchmark_sphere.obj");
+	std::remove("core_benchmark_sphere.ply");
+
+	std::vector<MeshLod> lods;
+	Measure("MeshSimplifier::BuildLodChain (icosphere)", 5, [&] { lods = MeshSimplifier::BuildLodChain(icosphere); });
+	for (size_t level = 0; level < lods.size( ); level++) {
+		std::printf("  level %zu: %zu triangles, error %.5f\n", level + 1, lods[level].mesh.Indices.size( ) / 3, lods[level].error);
+	}
+
+	XMVECTOR eye = XMVectorSet(-2.0f, 0.0f, 0.0f, 0.0f);
+	XMVECTOR at = XMVectorSet(0.0f, 0.0f, 0.0f, 0.0f);
+	XMVECTOR up = XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
+	CameraMatrices camera;
+	Measure("ComputeCameraMatrices", 100000, [&] { camera = ComputeCameraMatrices(eye, at, up, 16.0f / 9.0f); });
+
+	Scene scene;
+	Measure("SceneBuilder::CreateDefaultScene (raw)", 10, [&] { scene = SceneBuilder::CreateDefaultScene(false); });
+	Measure("SceneBuilder::CreateDefaultScene", 10, [&] { scene = SceneBuilder::CreateDefaultScene( ); });
+	std::printf("  %zu objects share %zu meshes and %zu grids\n", scene.objects.size( ), scene.meshes.size( ), scene.grids.size( ));
+
+	CpuRaytracer raytracer(320, 180);
+	Measure("CpuRaytracer::SetScene", 10, [&] { raytracer.SetScene(scene); });
+	Measure("CpuRaytracer::BuildAccelerationStructure", 10, [&] { raytracer.BuildAccelerationStructure( ); });
+	std::printf("  %u levels of detail\n", raytracer.GetLodLevelCount( ));
+
+	// Small frames: a render traces about 5 camera paths per pixel.
+	CpuRaytracer renderer(80, 45);
+	renderer.SetScene(scene);
+	renderer.BuildAccelerationStructure( );
+	renderer.SetCamera(camera);
+	Measure("CpuRaytracer::Render (LOD selection)", 3, [&] { renderer.Render(1); });
+	renderer.SetLodSelection({false, 1.0f});
+	Measure("CpuRaytracer::Render (full resolution)", 3, [&] { renderer.Render(1); });
+
+	// A sponge is nothing but axis-aligned cells, so every triangle pair becomes a quad.
+	Scene spongeScene;
+	spongeScene.meshes = {objectCreator.CreateMengerSponge(2.0f, 3), objectCreator.CreateBox({1, 0.1f, 1})};
+	spongeScene.objects = {{0, {{0.8f, 0.8f, 0.8f, 1.0f}, {0}, 0}}, {1, {{1, 1, 1}, {10, 10, 10}, 3}, XMMatrixTranslation(0, 4.5f, 0)}};
+	spongeScene.light = scene.light;
+	std::vector<XMFLOAT4> images[2];
+	for (bool quads : {false, true}) {
+		CpuRaytracer spongeRenderer(80, 45);
+		spongeRenderer.SetQuadPrimitives(quads);
+		spongeRenderer.SetScene(spongeScene);
+		Measure(quads ? "CpuRaytracer::BuildAccelerationStructure (sponge, quads)" : "CpuRaytracer::BuildAccelerationStructure (sponge, triangles)",
+				5, [&] { spongeRenderer.BuildAccelerationStructure( ); });
+		std::printf("  %zu primitives, %zu BVH nodes, SAH cost %.2f\n", spongeRenderer.GetPrimitiveCount( ), spongeRenderer.GetBvhNodeCount( ),
+					spongeRenderer.GetBvhStats( ).sahCost);
+		spongeRenderer.SetCamera(ComputeCameraMatrices(XMVectorSet(-3.0f, 1.5f, -2.5f, 0.0f), at, up, 16.0f / 9.0f));
+		Measure(quads ? "CpuRaytracer::Render (sponge, quads)" : "CpuRaytracer::Render (sponge, triangles)", 3, [&] { spongeRenderer.Render(1); });
+		images[quads] = spongeRenderer.GetOutput( );
+	}
+	float largestDifference = 0.0f;
+	for (size_t i = 0; i < images[0].size( ); i++) {
+		XMVECTOR difference = XMVectorAbs(XMLoadFloat4(&images[0][i]) - XMLoadFloat4(&images[1][i]));
+		largestDifference = std::max(largestDifference, XMVectorGetX(XMVector3Length(difference)));
+	}
+	std::printf("  largest pixel difference between the two: %g\n", largestDifference);
+
+	// Build and trace time of the build modes, on the default scene, whose sky box, table top and light are a
+	// few large triangles across many small ones, and on the sphere and the sponge under the light.
+	Scene sphereScene = spongeScene;
+	sphereScene.meshes[0] = sphere;
+	CameraMatrices sideCamera = ComputeCameraMatrices(XMVectorSet(-3.0f, 1.5f, -2.5f, 0.0f), at, up, 16.0f / 9.0f);
+	struct ModeScene {
+		const char* name;
+		const Scene* scene;
+		const CameraMatrices* camera;
+	};
+	for (const ModeScene& modeScene : {ModeScene{"default", &scene, &camera}, ModeScene{"sphere", &sphereScene, &sideCamera},
+									   ModeScene{"sponge", &spongeScene, &sideCamera}}) {
+		for (BvhBuildMode mode : {BvhBuildMode::BinnedSah, BvhBuildMode::Linear, BvhBuildMode::SpatialSplits}) {
+			CpuRaytracer modeRenderer(80, 45);
+			BvhBuildSettings settings;
+			settings.mode = mode;
+			modeRenderer.SetBvhBuildSettings(settings);
+			modeRenderer.SetScene(*modeScene.scene);
+			const char* modeName = mode == BvhBuildMode::Linear ? "linear" : mode == BvhBuildMode::SpatialSplits ? "spatial splits" : "SAH";
+			char label[128];
+			std::snprintf(label, sizeof(label), "CpuRaytracer::BuildAccelerationStructure (%s, %s)", modeScene.name, modeName);
+			Measure(label, 5, [&] { modeRenderer.BuildAccelerationStructure( ); });
+			const BvhBuildStats& stats = modeRenderer.GetBvhStats( );
+			std::printf("  %zu primitive references, %zu BVH nodes, SAH cost %.2f: %.2f node visits, %.2f primitive tests\n",
+						stats.referenceCount, stats.nodeCount, stats.sahCost, stats.nodeVisits, stats.primitiveTests);
+			modeRenderer.SetCamera(*modeScene.camera);
+			std::snprintf(label, sizeof(label), "CpuRaytracer::Render (%s, %s)", modeScene.name, modeName);
+			Measure(label, 3, [&] { modeRenderer.Render(1); });
+		}
+	}
+
+	// Binary against 4 and 8-wide nodes, in rays per second over the closest hit and shadow rays of a frame.
+	std::printf("  8-wide nodes test their children with %s\n",
+#if defined(__AVX2__)
+				"AVX2");
+#else
+				"two SSE operations");
+#endif
+	for (const ModeScene& widthScene : {ModeScene{"default", &scene, &camera}, ModeScene{"sponge", &spongeScene, &sideCamera}}) {
+		for (uint32_t width : {2u, 4u, 8u}) {
+			CpuRaytracer widthRenderer(80, 45);
+			widthRenderer.SetBvhWidth(width);
+			widthRenderer.SetScene(*widthScene.scene);
+			widthRenderer.BuildAccelerationStructure( );
+			widthRenderer.SetCamera(*widthScene.camera);
+			char label[128];
+			std::snprintf(label, sizeof(label), "CpuRaytracer::Render (%s, %u-wide nodes)", widthScene.name, width);
+			const int iterations = 3;
+			auto start = std::chrono::steady_clock::now( );
+			Measure(label, iterations, [&] { widthRenderer.Render(1); });
+			double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now( ) - start).count( );
+			// Measure renders once more to warm up.
+			std::printf("  %.2f Mrays/s\n", (iterations + 1) * widthRenderer.GetRayCount( ) / seconds * 1e-6);
+		}
+	}
+
+	// A field of 16 spheres: one mesh shared by every object, then a copy per object, which is what a scene
+	// flattened into world space would store. Both are traced through the same 17 instances.
+	for (bool shared : {true, false}) {
+		Scene fieldScene;
+		fieldScene.meshes = {objectCreator.CreateBox({1, 0.1f, 1})};
+		fieldScene.objects = {{0, {{1, 1, 1}, {10, 10, 10}, 3}, XMMatrixTranslation(0, 4.5f, 0)}};
+		fieldScene.light = scene.light;
+		for (int x = 0; x < 4; x++) {
+			for (int z = 0; z < 4; z++) {
+				if (!shared || fieldScene.meshes.size( ) == 1) {
+					fieldScene.meshes.push_back(icosphere);
+				}
+				fieldScene.objects.push_back({static_cast<uint32_t>(fieldScene.meshes.size( ) - 1), {{0.8f, 0.8f, 0.8f, 1.0f}, {0}, 0},
+											  XMMatrixScaling(0.4f, 0.4f, 0.4f) * XMMatrixTranslation(x - 1.5f, 0, z - 1.5f)});
+			}
+		}
+		CpuRaytracer fieldRenderer(80, 45);
+		fieldRenderer.SetScene(fieldScene);
+		Measure(shared ? "CpuRaytracer::BuildAccelerationStructure (field, shared mesh)" : "CpuRaytracer::BuildAccelerationStructure (field, mesh copies)",
+				5, [&] { fieldRenderer.BuildAccelerationStructure( ); });
+		std::printf("  %zu instances, %zu primitives stored, %zu BVH nodes, SAH cost %.2f\n", fieldRenderer.GetInstanceCount( ),
+					fieldRenderer.GetPrimitiveCount( ), fieldRenderer.GetBvhNodeCount( ), fieldRenderer.GetBvhStats( ).sahCost);
+		fieldRenderer.SetCamera(sideCamera);
+		Measure(shared ? "CpuRaytracer::Render (field, shared mesh)" : "CpuRaytracer::Render (field, mesh copies)", 3, [&] { fieldRenderer.Render(1); });
+		images[shared] = fieldRenderer.GetOutput( );
+	}
+	largestDifference = 0.0f;
+	for (size_t i = 0; i < images[0].size( ); i++) {
+		XMVECTOR difference = XMVectorAbs(XMLoadFloat4(&images[0][i]) - XMLoadFloat4(&images[1][i]));
+		largestDifference = std::max(largestDifference, XMVectorGetX(XMVector3Length(difference)));
+	}
+	std::printf("  largest pixel difference between the two: %g\n", largestDifference);
+
+	// A finely divided floor: one primitive as a grid, 65536 quads or 131072 triangles otherwise.
+	Scene gridScene;
+	gridScene.grids = {objectCreator.CreatePlaneGrid({0, 0, 0}, {4, 4}, {256, 256}), objectCreator.CreateBoxGrid({1, 0.1f, 1})};
+	gridScene.objects = {{0, {{0.8f, 0.8f, 0.8f, 1.0f}, {0}, 0}, XMMatrixRotationX(XMConvertToRadians(90.0f)) * XMMatrixTranslation(4, -1, 4)},
+						 {1, {{1, 1, 1}, {10, 10, 10}, 3}, XMMatrixTranslation(0, 4.5f, 0)}};
+	gridScene.light = scene.light;
+	for (bool grids : {false, true}) {
+		CpuRaytracer gridRenderer(80, 45);
+		gridRenderer.SetQuadPrimitives(grids);
+		gridRenderer.SetScene(gridScene);
+		Measure(grids ? "CpuRaytracer::BuildAccelerationStructure (grid, grids)" : "CpuRaytracer::BuildAccelerationStructure (grid, triangles)",
+				5, [&] { gridRenderer.BuildAccelerationStructure( ); });
+		std::printf("  %zu primitives, %zu BVH nodes\n", gridRenderer.GetPrimitiveCount( ), gridRenderer.GetBvhNodeCount( ));
+		gridRenderer.SetCamera(ComputeCameraMatrices(XMVectorSet(-3.0f, 1.5f, -2.5f, 0.0f), at, up, 16.0f / 9.0f));
+		Measure(grids ? "CpuRaytracer::Render (grid, grids)" : "CpuRaytracer::Render (grid, triangles)", 3, [&] { gridRenderer.Render(1); });
+		images[grids] = gridRenderer.GetOutput( );
+	}
+	largestDifference = 0.0f;
+	for (size_t i = 0; i < images[0].size( ); i++) {
+		XMVECTOR difference = XMVectorAbs(XMLoadFloat4(&images[0][i]) - XMLoadFloat4(&images[1][i]));
+		largestDifference = std::max(largestDifference, XMVectorGetX(XMVector3Length(difference)));
+	}
+	std::printf("  largest pixel difference between the two: %g\n", largestDifference);
+
+	return 0;
+}
@@ -0,0 +1,103 @@
+// Renders the sample scene with the CPU backend, without a window, device or swap chain.
+// Usage: HeadlessRender [width] [height] [frames] [threads] [output.ppm] [sphere.mesh] [analytic shapes: 0 or 1]
+#include "../Camera.h"
+#include "../CpuBackend.h"
+#include "../SceneBuilder.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+	const char* Usage = "Usage: HeadlessRender [width] [height] [frames] [threads] [output.ppm] [sphere.mesh] [analytic shapes: 0 or 1]\n";
+
+	// D3D12_REQ_TEXTURE2D_U_OR_V_DIMENSION, the largest output the DXR backend could render as well.
+	const uint32_t MaxImageSize = 16384;
+
+	// Reads argument index of argv into value, if there is one. Only plain decimal numbers of up to nine digits,
+	// which strtoul cannot overflow, within [minimum, maximum] are taken; atoi would turn "-1" into 4e9 and
+	// "--help" into 0.
+	bool ParseArgument(int argc, char* argv[], int index, uint32_t minimum, uint32_t maximum, uint32_t& value) {
+		if (argc <= index) {
+			return true;
+		}
+		const char* text = argv[index];
+		if (text[0] == 0 || std::strspn(text, "0123456789") != std::strlen(text) || std::strlen(text) > 9) {
+			return false;
+		}
+		unsigned long parsed = std::strtoul(text, nullptr, 10);
+		if (parsed < minimum || parsed > maximum) {
+			return false;
+		}
+		value = static_cast<uint32_t>(parsed);
+		return true;
+	}
+
+	bool WritePpm(const char* path, const std::vector<XMFLOAT4>& pixels, uint32_t width, uint32_t height) {
+		FILE* file = std::fopen(path, "wb");
+		if (!file) {
+			return false;
+		}
+
+		std::fprintf(file, "P6\n%u %u\n255\n", width, height);
+		for (const auto& pixel : pixels) {
+			unsigned char rgb[3] = {
+				static_cast<unsigned char>(std::clamp(pixel.x, 0.0f, 1.0f) * 255.0f + 0.5f),
+				static_cast<unsigned char>(std::clamp(pixel.y, 0.0f, 1.0f) * 255.0f + 0.5f),
+				static_cast<unsigned char>(std::clamp(pixel.z, 0.0f, 1.0f) * 255.0f + 0.5f)
+			};
+			std::fwrite(rgb, 1, 3, file);
+		}
+
+		std::fclose(file);
+		return true;
+	}
+}
+
+int main(int argc, char* argv[]) {
+	uint32_t width = 320, height = 180, frames = 4, threads = 0, analyticShapes = 0;
+	if (argc > 8 || !ParseArgument(argc, argv, 1, 1, MaxImageSize, width) || !ParseArgument(argc, argv, 2, 1, MaxImageSize, height)
+		|| !ParseArgument(argc, argv, 3, 1, UINT32_MAX, frames) || !ParseArgument(argc, argv, 4, 0, UINT32_MAX, threads)
+		|| !ParseArgument(argc, argv, 7, 0, 1, analyticShapes)) {
+		std::fputs(Usage, stderr);
+		return 1;
+	}
+	const char* output = argc > 5 && argv[5][0] ? argv[5] : nullptr;
+	const char* sphereMeshFile = argc > 6 ? argv[6] : "";
+
+	auto start = std::chrono::steady_clock::now( );
+
+	CpuBackend backend(width, height, threads);
+	backend.UploadScene(SceneBuilder::CreateDefaultScene(true, true, sphereMeshFile, analyticShapes != 0));
+	backend.BuildAccelerationStructures( );
+
+	XMVECTOR eye = XMVectorSet(-2.0f, 0.0f, 0.0f, 0.0f);
+	XMVECTOR at = XMVectorSet(0.0f, 0.0f, 0.0f, 0.0f);
+	XMVECTOR up = XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
+	backend.UpdateCamera(ComputeCameraMatrices(eye, at, up, static_cast<float>(width) / static_cast<float>(height)));
+
+	auto setup = std::chrono::steady_clock::now( );
+
+	for (uint32_t frame = 1; frame <= frames; frame++) {
+		backend.UpdateFrameCount(frame);
+		backend.Trace( );
+	}
+
+	auto end = std::chrono::steady_clock::now( );
+
+	double setupMs = std::chrono::duration<double, std::milli>(setup - start).count( );
+	double renderMs = std::chrono::duration<double, std::milli>(end - setup).count( );
+	std::printf("%ux%u, %u frames on %u threads\n", width, height, frames, backend.GetRaytracer( ).GetThreadCount( ));
+	std::printf("scene setup %.1f ms, render %.1f ms (%.1f ms/frame)\n", setupMs, renderMs, frames ? renderMs / frames : 0.0);
+	const BvhBuildStats& bvh = backend.GetRaytracer( ).GetBvhStats( );
+	std::printf("BVH build %.1f ms, %zu nodes, SAH cost %.2f\n", bvh.buildMilliseconds, bvh.nodeCount, bvh.sahCost);
+
+	if (output && !WritePpm(output, backend.GetRaytracer( ).GetOutput( ), width, height)) {
+		std::fprintf(stderr, "Cannot write %s\n", output);
+		return 1;
+	}
+
+	return 0;
+}